@@ -0,0 +1,257 @@
+#include "peachos.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+
+// Low 32 bits of the time stamp counter, in bench.asm
+unsigned int bench_read_tsc();
+
+#define BENCH_SAMPLES 1000
+// Every spawned process costs a process slot until it is reaped, keep these runs short
+#define BENCH_SPAWN_SAMPLES 16
+
+// The spawned copy of bench finds the parent's start time under this name
+#define BENCH_SHM_NAME "bench"
+#define BENCH_SPAWN_COMMAND "bench.elf spawned"
+#define BENCH_MISSING_COMMAND "nosuch.elf"
+// Written and left open by the children of bench_exit_dirty
+#define BENCH_DIRTY_FILE "0:/bench.tmp"
+
+struct bench_spawn
+{
+    // Set by the parent right before the system call, read by the child once main runs
+    unsigned int start;
+    unsigned int latency;
+};
+
+static unsigned int bench_samples[BENCH_SAMPLES];
+static unsigned int bench_other_samples[BENCH_SAMPLES];
+
+/**
+ * Sorts the samples and prints the fastest, the median and the slowest of them
+ */
+static void bench_summary(const char* name, unsigned int* samples, int total)
+{
+    for (int i = 1; i < total; i++)
+    {
+        unsigned int sample = samples[i];
+        int j = i - 1;
+        for (; j >= 0 && samples[j] > sample; j--)
+        {
+            samples[j + 1] = samples[j];
+        }
+        samples[j + 1] = sample;
+    }
+
+    printf("  %s: min %i median %i max %i cycles\n", name, samples[0], samples[total / 2], samples[total - 1]);
+}
+
+/**
+ * A round trip through int 0x80 with a call that only reads the tick count
+ */
+static void bench_syscall()
+{
+    print("bench: system call\n");
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        unsigned int start = bench_read_tsc();
+        peachos_get_time();
+        bench_samples[i] = bench_read_tsc() - start;
+    }
+    bench_summary("get_time", bench_samples, BENCH_SAMPLES);
+}
+
+static void bench_malloc()
+{
+    print("bench: malloc\n");
+    unsigned int sizes[] = {16, 64, 4096};
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int total = 0;
+        for (; total < BENCH_SAMPLES; total++)
+        {
+            unsigned int start = bench_read_tsc();
+            void* ptr = malloc(sizes[s]);
+            bench_samples[total] = bench_read_tsc() - start;
+            if (!ptr)
+            {
+                break;
+            }
+
+            start = bench_read_tsc();
+            free(ptr);
+            bench_other_samples[total] = bench_read_tsc() - start;
+        }
+
+        if (!total)
+        {
+            print("bench: out of memory\n");
+            return;
+        }
+
+        printf("  %i bytes\n", sizes[s]);
+        bench_summary("  malloc", bench_samples, total);
+        bench_summary("  free", bench_other_samples, total);
+    }
+}
+
+/**
+ * Fork round trip in the parent, the child exits straight away
+ */
+static void bench_fork()
+{
+    print("bench: fork\n");
+    int total = 0;
+    for (; total < BENCH_SPAWN_SAMPLES; total++)
+    {
+        unsigned int start = bench_read_tsc();
+        int pid = peachos_fork();
+        if (pid == 0)
+        {
+            peachos_exit();
+        }
+        bench_samples[total] = bench_read_tsc() - start;
+        if (pid < 0)
+        {
+            break;
+        }
+    }
+
+    if (!total)
+    {
+        print("bench: fork failed\n");
+        return;
+    }
+
+    bench_summary("fork", bench_samples, total);
+}
+
+/**
+ * A child that exits with a written file still open, its exit flushes the volume and may have to
+ * wait on the disk. The parent sees the end of the pipe once the child's files are all closed
+ */
+static void bench_exit_dirty()
+{
+    print("bench: exit with a dirty file\n");
+    int total = 0;
+    for (; total < BENCH_SPAWN_SAMPLES; total++)
+    {
+        int fds[2];
+        if (peachos_pipe(fds) < 0)
+        {
+            break;
+        }
+
+        unsigned int start = bench_read_tsc();
+        int pid = peachos_fork();
+        if (pid == 0)
+        {
+            int fd = peachos_open(BENCH_DIRTY_FILE, "w");
+            if (fd >= 0)
+            {
+                peachos_write(fd, bench_samples, sizeof(bench_samples));
+            }
+            peachos_exit();
+        }
+
+        peachos_close(fds[1]);
+        char c;
+        int res = pid < 0 ? -1 : peachos_read(fds[0], &c, 1);
+        bench_samples[total] = bench_read_tsc() - start;
+        peachos_close(fds[0]);
+        if (res != 0)
+        {
+            break;
+        }
+    }
+
+    if (!total)
+    {
+        print("bench: exit with a dirty file failed\n");
+        return;
+    }
+
+    bench_summary("exit", bench_samples, total);
+}
+
+/**
+ * From the system call that starts a program to the first line of its main, the program
+ * is another copy of bench that reports back through shared memory
+ */
+static void bench_spawn()
+{
+    print("bench: spawn\n");
+    struct bench_spawn* spawn = peachos_shm_create(BENCH_SHM_NAME, sizeof(struct bench_spawn));
+    if (!spawn)
+    {
+        print("bench: can not create the shared memory\n");
+        return;
+    }
+
+    int total = 0;
+    for (; total < BENCH_SPAWN_SAMPLES; total++)
+    {
+        spawn->latency = 0;
+        spawn->start = bench_read_tsc();
+        if (peachos_system_run(BENCH_SPAWN_COMMAND) < 0 || !spawn->latency)
+        {
+            break;
+        }
+        bench_samples[total] = spawn->latency;
+    }
+
+    peachos_shm_unmap(spawn);
+    if (!total)
+    {
+        print("bench: can not start " BENCH_SPAWN_COMMAND "\n");
+        return;
+    }
+
+    bench_summary("spawn", bench_samples, total);
+}
+
+/**
+ * Starting a program that does not exist, the kernel should turn it down without a disk read.
+ * The kernel reports every failed load on the screen, keep this run short too
+ */
+static void bench_spawn_missing()
+{
+    print("bench: spawn missing\n");
+    for (int i = 0; i < BENCH_SPAWN_SAMPLES; i++)
+    {
+        unsigned int start = bench_read_tsc();
+        peachos_system_run(BENCH_MISSING_COMMAND);
+        bench_samples[i] = bench_read_tsc() - start;
+    }
+    bench_summary("missing", bench_samples, BENCH_SPAWN_SAMPLES);
+}
+
+static int bench_spawned()
+{
+    unsigned int now = bench_read_tsc();
+    struct bench_spawn* spawn = peachos_shm_map(BENCH_SHM_NAME);
+    if (!spawn)
+    {
+        return -1;
+    }
+
+    spawn->latency = now - spawn->start;
+    peachos_shm_unmap(spawn);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strncmp(argv[1], "spawned", 8) == 0)
+    {
+        return bench_spawned();
+    }
+
+    bench_syscall();
+    bench_malloc();
+    bench_fork();
+    bench_exit_dirty();
+    bench_spawn();
+    bench_spawn_missing();
+    return 0;
+}
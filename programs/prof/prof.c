@@ -0,0 +1,289 @@
+#include "peachos.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+
+// Where the build puts the kernel linked as an ELF, kernel.bin itself has no symbols
+#define PROF_KERNEL_IMAGE "0:/kernel.elf"
+#define PROF_DEFAULT_INTERVAL_MS 10
+
+#define PROF_MAX_IMAGES 8
+#define PROF_MAX_ENTRIES 128
+#define PROF_SHOWN_ENTRIES 20
+#define PROF_READ_SAMPLES 256
+
+#define PROF_ELF_SHT_SYMTAB 2
+#define PROF_ELF_STT_FUNC 2
+
+// Just the parts of the ELF structures symbolization needs
+struct prof_elf_header
+{
+    unsigned char ident[16];
+    unsigned short type;
+    unsigned short machine;
+    unsigned int version;
+    unsigned int entry;
+    unsigned int phoff;
+    unsigned int shoff;
+    unsigned int flags;
+    unsigned short ehsize;
+    unsigned short phentsize;
+    unsigned short phnum;
+    unsigned short shentsize;
+    unsigned short shnum;
+    unsigned short shstrndx;
+} __attribute__((packed));
+
+struct prof_elf_section
+{
+    unsigned int name;
+    unsigned int type;
+    unsigned int flags;
+    unsigned int addr;
+    unsigned int offset;
+    unsigned int size;
+    unsigned int link;
+    unsigned int info;
+    unsigned int addralign;
+    unsigned int entsize;
+} __attribute__((packed));
+
+struct prof_elf_symbol
+{
+    unsigned int name;
+    unsigned int value;
+    unsigned int size;
+    unsigned char info;
+    unsigned char other;
+    unsigned short shndx;
+} __attribute__((packed));
+
+// A binary whose symbol table is mapped in, symbols is NULL when it had none
+struct prof_image
+{
+    char name[32];
+    struct prof_elf_symbol* symbols;
+    unsigned int total_symbols;
+    const char* strings;
+};
+
+struct prof_entry
+{
+    struct prof_image* image;
+    // The function the samples hit, the raw address when there was no symbol for it
+    const char* symbol;
+    unsigned int address;
+    unsigned int count;
+};
+
+static struct prof_image prof_images[PROF_MAX_IMAGES];
+static int prof_total_images;
+static struct prof_entry prof_entries[PROF_MAX_ENTRIES];
+static int prof_total_entries;
+
+static struct prof_image* prof_load_image(const char* name)
+{
+    for (int i = 0; i < prof_total_images; i++)
+    {
+        if (strncmp(prof_images[i].name, name, sizeof(prof_images[i].name)) == 0)
+        {
+            return &prof_images[i];
+        }
+    }
+
+    if (prof_total_images == PROF_MAX_IMAGES)
+    {
+        return 0;
+    }
+
+    struct prof_image* image = &prof_images[prof_total_images++];
+    strncpy(image->name, name, sizeof(image->name));
+
+    // Mapped pages are only read once touched, the debug sections of a big ELF cost nothing
+    char* data = peachos_mmap(name, 0, 0);
+    if (!data)
+    {
+        return image;
+    }
+
+    struct prof_elf_header* header = (struct prof_elf_header*) data;
+    struct prof_elf_section* sections = (struct prof_elf_section*)(data + header->shoff);
+    for (int i = 0; i < header->shnum; i++)
+    {
+        if (sections[i].type == PROF_ELF_SHT_SYMTAB)
+        {
+            image->symbols = (struct prof_elf_symbol*)(data + sections[i].offset);
+            image->total_symbols = sections[i].size / sizeof(struct prof_elf_symbol);
+            image->strings = data + sections[sections[i].link].offset;
+            break;
+        }
+    }
+
+    return image;
+}
+
+/**
+ * The function containing address, the closest one below it when sizes are missing
+ */
+static struct prof_elf_symbol* prof_find_symbol(struct prof_image* image, unsigned int address)
+{
+    struct prof_elf_symbol* best = 0;
+    for (unsigned int i = 0; i < image->total_symbols; i++)
+    {
+        struct prof_elf_symbol* symbol = &image->symbols[i];
+        if ((symbol->info & 0x0f) != PROF_ELF_STT_FUNC || symbol->value > address)
+        {
+            continue;
+        }
+
+        if (symbol->size && address < symbol->value + symbol->size)
+        {
+            return symbol;
+        }
+
+        if (!best || symbol->value > best->value)
+        {
+            best = symbol;
+        }
+    }
+
+    return best;
+}
+
+static struct prof_image* prof_image_for_sample(struct peachos_profile_sample* sample,
+                                                struct peachos_process_stat* processes, int total_processes)
+{
+    if (sample->flags & PEACHOS_PROFILE_SAMPLE_KERNEL)
+    {
+        return prof_load_image(PROF_KERNEL_IMAGE);
+    }
+
+    for (int i = 0; i < total_processes; i++)
+    {
+        if (processes[i].id == sample->pid)
+        {
+            return prof_load_image(processes[i].name);
+        }
+    }
+
+    // The process exited before we got to look at it
+    return 0;
+}
+
+static void prof_count(struct prof_image* image, const char* symbol, unsigned int address)
+{
+    for (int i = 0; i < prof_total_entries; i++)
+    {
+        struct prof_entry* entry = &prof_entries[i];
+        if (entry->image == image && entry->symbol == symbol && (symbol || entry->address == address))
+        {
+            entry->count++;
+            return;
+        }
+    }
+
+    if (prof_total_entries == PROF_MAX_ENTRIES)
+    {
+        return;
+    }
+
+    struct prof_entry* entry = &prof_entries[prof_total_entries++];
+    entry->image = image;
+    entry->symbol = symbol;
+    entry->address = address;
+    entry->count = 1;
+}
+
+static int prof_dump()
+{
+    struct peachos_process_stat processes[16];
+    int total_processes = peachos_process_stats(processes, sizeof(processes));
+    if (total_processes < 0)
+    {
+        total_processes = 0;
+    }
+
+    struct peachos_profile_sample* samples = malloc(PROF_READ_SAMPLES * sizeof(struct peachos_profile_sample));
+    if (!samples)
+    {
+        return -1;
+    }
+
+    int total_samples = 0;
+    int read = 0;
+    while ((read = peachos_profile(PEACHOS_PROFILE_READ, samples, PROF_READ_SAMPLES * sizeof(struct peachos_profile_sample))) > 0)
+    {
+        for (int i = 0; i < read; i++)
+        {
+            struct prof_image* image = prof_image_for_sample(&samples[i], processes, total_processes);
+            struct prof_elf_symbol* symbol = image && image->symbols ? prof_find_symbol(image, samples[i].eip) : 0;
+            prof_count(image, symbol ? image->strings + symbol->name : 0, samples[i].eip);
+        }
+        total_samples += read;
+    }
+    free(samples);
+
+    printf("%i samples\n", total_samples);
+    for (int shown = 0; shown < PROF_SHOWN_ENTRIES; shown++)
+    {
+        struct prof_entry* busiest = 0;
+        for (int i = 0; i < prof_total_entries; i++)
+        {
+            if (prof_entries[i].count && (!busiest || prof_entries[i].count > busiest->count))
+            {
+                busiest = &prof_entries[i];
+            }
+        }
+
+        if (!busiest)
+        {
+            break;
+        }
+
+        printf("%i  %s  ", busiest->count, busiest->image ? busiest->image->name : "?");
+        if (busiest->symbol)
+        {
+            printf("%s\n", busiest->symbol);
+        }
+        else
+        {
+            printf("@%i\n", busiest->address);
+        }
+        busiest->count = 0;
+    }
+
+    return 0;
+}
+
+static unsigned int prof_parse_number(const char* str)
+{
+    unsigned int value = 0;
+    for (; isdigit(*str); str++)
+    {
+        value = value * 10 + tonumericdigit(*str);
+    }
+    return value;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strncmp(argv[1], "start", 6) == 0)
+    {
+        unsigned int interval = argc > 2 ? prof_parse_number(argv[2]) : PROF_DEFAULT_INTERVAL_MS;
+        if (peachos_profile(PEACHOS_PROFILE_START, 0, interval) < 0)
+        {
+            printf("prof: can not start the profiler\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (argc > 1 && strncmp(argv[1], "stop", 5) == 0)
+    {
+        peachos_profile(PEACHOS_PROFILE_STOP, 0, 0);
+        return 0;
+    }
+
+    // Without arguments the samples taken so far are shown
+    return prof_dump();
+}
@@ -0,0 +1,140 @@
+[BITS 32]
+
+section .asm
+
+global memory_copy_dwords:function
+global memory_set_dwords:function
+global memory_cpu_features:function
+global memory_copy_sse2:function
+global memory_set_sse2:function
+global memory_strlen_sse2:function
+
+; void memory_copy_dwords(void* dest, void* src, size_t count)
+memory_copy_dwords:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov ecx, [ebp+16]
+    cld
+    rep movsd
+
+    pop edi
+    pop esi
+    pop ebp
+    ret
+
+; void memory_set_dwords(void* dest, uint32_t value, size_t count)
+memory_set_dwords:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edi, [ebp+8]
+    mov eax, [ebp+12]
+    mov ecx, [ebp+16]
+    cld
+    rep stosd
+
+    pop edi
+    pop ebp
+    ret
+
+; unsigned int memory_cpu_features()
+; The feature flags CPUID leaf 1 returns in edx
+memory_cpu_features:
+    push ebx
+    mov eax, 1
+    cpuid
+    mov eax, edx
+    pop ebx
+    ret
+
+; void memory_copy_sse2(void* dest, void* src, size_t blocks)
+; Copies blocks of 64 bytes, dest must be aligned to 16 and blocks must not be zero
+memory_copy_sse2:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov ecx, [ebp+16]
+.loop:
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi+16]
+    movdqu xmm2, [esi+32]
+    movdqu xmm3, [esi+48]
+    movdqa [edi], xmm0
+    movdqa [edi+16], xmm1
+    movdqa [edi+32], xmm2
+    movdqa [edi+48], xmm3
+    add esi, 64
+    add edi, 64
+    dec ecx
+    jnz .loop
+
+    pop edi
+    pop esi
+    pop ebp
+    ret
+
+; void memory_set_sse2(void* dest, uint32_t value, size_t blocks)
+; Fills blocks of 64 bytes, dest must be aligned to 16 and blocks must not be zero
+memory_set_sse2:
+    push ebp
+    mov ebp, esp
+
+    mov edx, [ebp+8]
+    movd xmm0, [ebp+12]
+    pshufd xmm0, xmm0, 0
+    mov ecx, [ebp+16]
+.loop:
+    movdqa [edx], xmm0
+    movdqa [edx+16], xmm0
+    movdqa [edx+32], xmm0
+    movdqa [edx+48], xmm0
+    add edx, 64
+    dec ecx
+    jnz .loop
+
+    pop ebp
+    ret
+
+; int memory_strlen_sse2(const char* ptr)
+; Looks for the terminator 16 bytes at a time. The loads are aligned so they never cross
+; into a page past the end of the string
+memory_strlen_sse2:
+    push ebx
+    mov ebx, [esp+8]
+    mov eax, ebx
+    and eax, ~15
+    mov ecx, ebx
+    and ecx, 15
+    pxor xmm0, xmm0
+
+    ; The first block may start before ptr, ignore the bytes in front of it
+    movdqa xmm1, [eax]
+    pcmpeqb xmm1, xmm0
+    pmovmskb edx, xmm1
+    shr edx, cl
+    shl edx, cl
+    test edx, edx
+    jnz .found
+.loop:
+    add eax, 16
+    movdqa xmm1, [eax]
+    pcmpeqb xmm1, xmm0
+    pmovmskb edx, xmm1
+    test edx, edx
+    jz .loop
+.found:
+    bsf edx, edx
+    add eax, edx
+    sub eax, ebx
+    pop ebx
+    ret
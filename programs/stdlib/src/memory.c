@@ -1,11 +1,80 @@
 #include "memory.h"
+#include <stdint.h>
+
+#define MEMORY_PAGE_SIZE 4096
+#define MEMORY_CPU_FEATURE_SSE2 (1 << 26)
+// The SSE2 routines work on 64 byte blocks stored aligned to 16. Shorter runs stay on the
+// integer registers, a task that never uses the FPU is cheaper to switch
+#define MEMORY_SSE2_BLOCK 64
+#define MEMORY_SSE2_ALIGN 16
+#define MEMORY_SSE2_MIN 256
+
+void memory_copy_dwords(void* dest, void* src, size_t count);
+void memory_set_dwords(void* dest, uint32_t value, size_t count);
+unsigned int memory_cpu_features();
+void memory_copy_sse2(void* dest, void* src, size_t blocks);
+void memory_set_sse2(void* dest, uint32_t value, size_t blocks);
+
+// Unknown until the first call of memory_sse2
+static int memory_has_sse2 = -1;
+
+int memory_sse2()
+{
+    if (memory_has_sse2 < 0)
+    {
+        memory_has_sse2 = (memory_cpu_features() & MEMORY_CPU_FEATURE_SSE2) != 0;
+    }
+
+    return memory_has_sse2;
+}
+
+static int memory_is_whole_pages(void* ptr, size_t size)
+{
+    return size && ((uint32_t)ptr % MEMORY_PAGE_SIZE) == 0 && (size % MEMORY_PAGE_SIZE) == 0;
+}
 
 void* memset(void* ptr, int c, size_t size)
 {
+    uint32_t pattern = (uint32_t)(uint8_t) c * 0x01010101u;
+    if (memory_is_whole_pages(ptr, size))
+    {
+        memory_set_dwords(ptr, pattern, size / sizeof(uint32_t));
+        return ptr;
+    }
+
     char* c_ptr = (char*) ptr;
-    for (int i = 0; i < size; i++)
+    if (size >= MEMORY_SSE2_MIN && memory_sse2())
+    {
+        while ((uint32_t)c_ptr % MEMORY_SSE2_ALIGN)
+        {
+            *c_ptr++ = (char) c;
+            size--;
+        }
+
+        size_t blocks = size / MEMORY_SSE2_BLOCK;
+        memory_set_sse2(c_ptr, pattern, blocks);
+        c_ptr += blocks * MEMORY_SSE2_BLOCK;
+        size -= blocks * MEMORY_SSE2_BLOCK;
+    }
+
+    // Byte writes until we are aligned, then whole words
+    while (size && ((uint32_t)c_ptr % sizeof(uint32_t)))
+    {
+        *c_ptr++ = (char) c;
+        size--;
+    }
+
+    if (size >= sizeof(uint32_t))
+    {
+        size_t words = size / sizeof(uint32_t);
+        memory_set_dwords(c_ptr, pattern, words);
+        c_ptr += words * sizeof(uint32_t);
+        size -= words * sizeof(uint32_t);
+    }
+
+    while (size--)
     {
-        c_ptr[i] = (char) c;
+        *c_ptr++ = (char) c;
     }
     return ptr;
 }
@@ -14,6 +83,15 @@ int memcmp(void* s1, void* s2, int count)
 {
     char* c1 = s1;
     char* c2 = s2;
+
+    // Skip over equal words, the byte loop below finds the difference
+    while (count >= (int) sizeof(uint32_t) && *(uint32_t*)c1 == *(uint32_t*)c2)
+    {
+        c1 += sizeof(uint32_t);
+        c2 += sizeof(uint32_t);
+        count -= sizeof(uint32_t);
+    }
+
     while(count-- > 0)
     {
         if (*c1++ != *c2++)
@@ -27,11 +105,54 @@ int memcmp(void* s1, void* s2, int count)
 
 void* memcpy(void* dest, void* src, int len)
 {
+    if (len <= 0)
+    {
+        return dest;
+    }
+
+    if (memory_is_whole_pages(dest, len) && ((uint32_t)src % MEMORY_PAGE_SIZE) == 0)
+    {
+        memory_copy_dwords(dest, src, len / sizeof(uint32_t));
+        return dest;
+    }
+
     char *d = dest;
     char *s = src;
+
+    if (len >= MEMORY_SSE2_MIN && memory_sse2())
+    {
+        while ((uint32_t)d % MEMORY_SSE2_ALIGN)
+        {
+            *d++ = *s++;
+            len--;
+        }
+
+        int blocks = len / MEMORY_SSE2_BLOCK;
+        memory_copy_sse2(d, s, blocks);
+        d += blocks * MEMORY_SSE2_BLOCK;
+        s += blocks * MEMORY_SSE2_BLOCK;
+        len -= blocks * MEMORY_SSE2_BLOCK;
+    }
+
+    // Align the destination, unaligned source reads are cheap on x86
+    while (len && ((uint32_t)d % sizeof(uint32_t)))
+    {
+        *d++ = *s++;
+        len--;
+    }
+
+    if (len >= (int) sizeof(uint32_t))
+    {
+        int words = len / sizeof(uint32_t);
+        memory_copy_dwords(d, s, words);
+        d += words * sizeof(uint32_t);
+        s += words * sizeof(uint32_t);
+        len -= words * sizeof(uint32_t);
+    }
+
     while(len--)
     {
         *d++ = *s++;
     }
     return dest;
-}
\ No newline at end of file
+}
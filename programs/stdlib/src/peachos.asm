@@ -1,9 +1,23 @@
 [BITS 32]
 
+; Makes the system call in eax with its arguments in ebx, esi and edi. Uses sysenter
+; when the processor has it, the kernel returns to edx with the stack in ecx
+%macro peachos_syscall 0
+    cmp dword [peachos_sysenter], 0
+    je %%interrupt
+    mov ecx, esp
+    mov edx, %%done
+    sysenter
+%%interrupt:
+    int 0x80
+%%done:
+%endmacro
+
 section .asm
 
 global print:function
 global peachos_getkey:function
+global peachos_getkeyblock:function
 global peachos_malloc:function
 global peachos_free:function
 global peachos_putchar:function
@@ -11,15 +25,43 @@ global peachos_process_load_start:function
 global peachos_process_get_arguments:function 
 global peachos_system:function
 global peachos_exit:function
+global peachos_mmap:function
+global peachos_munmap:function
+global peachos_fork:function
+global peachos_sleep:function
+global peachos_get_time:function
+global peachos_syscall_init:function
+global peachos_ring_enter:function
+global peachos_write:function
+global peachos_sbrk:function
+global peachos_thread_new:function
+global peachos_thread_exit:function
+global peachos_thread_join:function
+global peachos_futex_wait:function
+global peachos_futex_wake:function
+global peachos_read:function
+global peachos_pipe:function
+global peachos_close:function
+global peachos_open:function
+global peachos_readdir:function
+global peachos_trace_read:function
+global peachos_stats:function
+global peachos_process_stats:function
+global peachos_profile:function
+global peachos_shm_create:function
+global peachos_shm_map:function
+global peachos_shm_unmap:function
+global peachos_getkeys:function
 
 ; void print(const char* filename)
 print:
     push ebp
     mov ebp, esp
-    push dword[ebp+8]
+    push ebx
+    mov ebx, [ebp+8]
     mov eax, 1 ; Command print
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
@@ -28,7 +70,16 @@ peachos_getkey:
     push ebp
     mov ebp, esp
     mov eax, 2 ; Command getkey
-    int 0x80
+    peachos_syscall
+    pop ebp
+    ret
+
+; int peachos_getkeyblock()
+peachos_getkeyblock:
+    push ebp
+    mov ebp, esp
+    mov eax, 13 ; Command 13 getkey block (Sleeps until a key is pressed)
+    peachos_syscall
     pop ebp
     ret
 
@@ -36,10 +87,11 @@ peachos_getkey:
 peachos_putchar:
     push ebp
     mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "c"
     mov eax, 3 ; Command putchar
-    push dword [ebp+8] ; Variable "c"
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
@@ -47,10 +99,11 @@ peachos_putchar:
 peachos_malloc:
     push ebp
     mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "size"
     mov eax, 4 ; Command malloc (Allocates memory for the process)
-    push dword[ebp+8] ; Variable "size"
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
@@ -58,10 +111,23 @@ peachos_malloc:
 peachos_free:
     push ebp
     mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "ptr"
     mov eax, 5 ; Command 5 free (Frees the allocated memory for this process)
-    push dword[ebp+8] ; Variable "ptr"
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; void* peachos_sbrk(int increment)
+peachos_sbrk:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "increment"
+    mov eax, 18 ; Command 18 sbrk (Grows or shrinks the process heap region)
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
@@ -69,21 +135,26 @@ peachos_free:
 peachos_process_load_start:
     push ebp
     mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "filename"
     mov eax, 6 ; Command 6 process load start ( stars a process )
-    push dword[ebp+8] ; Variable "filename"
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
-; int peachos_system(struct command_argument* arguments)
+; int peachos_system(const char* strings, int size)
 peachos_system:
     push ebp
     mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "strings"
+    mov esi, [ebp+12] ; Variable "size"
     mov eax, 7 ; Command 7 process_system ( runs a system command based on the arguments)
-    push dword[ebp+8] ; Variable "arguments"
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop esi
+    pop ebx
     pop ebp
     ret
 
@@ -92,10 +163,11 @@ peachos_system:
 peachos_process_get_arguments:
     push ebp
     mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable arguments
     mov eax, 8 ; Command 8 Gets the process arguments
-    push dword[ebp+8] ; Variable arguments
-    int 0x80
-    add esp, 4
+    peachos_syscall
+    pop ebx
     pop ebp
     ret
 
@@ -104,6 +176,384 @@ peachos_exit:
     push ebp
     mov ebp, esp
     mov eax, 9 ; Command 9 process exit
-    int 0x80
+    peachos_syscall
+    pop ebp
+    ret
+
+; void* peachos_mmap(const char* filename, unsigned int offset, unsigned int size)
+peachos_mmap:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "filename"
+    mov esi, [ebp+12] ; Variable "offset"
+    mov edi, [ebp+16] ; Variable "size"
+    mov eax, 10 ; Command 10 mmap (Maps part of a file into the process)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_munmap(void* ptr)
+peachos_munmap:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "ptr"
+    mov eax, 11 ; Command 11 munmap (Removes a mapping made by peachos_mmap)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_fork()
+peachos_fork:
+    push ebp
+    mov ebp, esp
+    mov eax, 12 ; Command 12 fork (Copies the process, the child sees zero returned)
+    peachos_syscall
+    pop ebp
+    ret
+
+; void peachos_sleep(unsigned int ms)
+peachos_sleep:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "ms"
+    mov eax, 14 ; Command 14 sleep (Blocks for at least ms milliseconds)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; unsigned int peachos_get_time()
+peachos_get_time:
+    push ebp
+    mov ebp, esp
+    mov eax, 15 ; Command 15 get time (Milliseconds since boot)
+    peachos_syscall
+    pop ebp
+    ret
+
+; int peachos_ring_enter(struct peachos_ring* ring)
+peachos_ring_enter:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "ring"
+    mov eax, 16 ; Command 16 ring enter (Runs every call queued on the ring)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_write(int fd, const void* buf, unsigned int len)
+peachos_write:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "fd"
+    mov esi, [ebp+12] ; Variable "buf"
+    mov edi, [ebp+16] ; Variable "len"
+    mov eax, 17 ; Command 17 write (Writes the whole buffer to the console)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; void peachos_syscall_init()
+; Checks once at startup whether system calls can use sysenter
+peachos_syscall_init:
+    push ebx
+    mov eax, 1
+    cpuid
+    shr edx, 11 ; The SEP bit
+    and edx, 1
+    mov [peachos_sysenter], edx
+    pop ebx
+    ret
+
+section .data
+peachos_sysenter: dd 0
+
+; int peachos_thread_new(void* entry, void* arg0, void* arg1)
+peachos_thread_new:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "entry"
+    mov esi, [ebp+12] ; Variable "arg0"
+    mov edi, [ebp+16] ; Variable "arg1"
+    mov eax, 19 ; Command 19 thread create (Starts entry(arg0, arg1) in a new thread)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; void peachos_thread_exit(int code)
+peachos_thread_exit:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "code"
+    mov eax, 20 ; Command 20 thread exit (Ends the calling thread)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_thread_join(int id, int* code)
+peachos_thread_join:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "id"
+    mov esi, [ebp+12] ; Variable "code"
+    mov eax, 21 ; Command 21 thread join (Waits for a thread to exit)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_futex_wait(int* address, int expected)
+peachos_futex_wait:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "address"
+    mov esi, [ebp+12] ; Variable "expected"
+    mov eax, 22 ; Command 22 futex wait (Sleeps while *address is expected)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_futex_wake(int* address, int count)
+peachos_futex_wake:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "address"
+    mov esi, [ebp+12] ; Variable "count"
+    mov eax, 23 ; Command 23 futex wake (Wakes threads sleeping on address)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_read(int fd, void* buf, unsigned int len)
+peachos_read:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "fd"
+    mov esi, [ebp+12] ; Variable "buf"
+    mov edi, [ebp+16] ; Variable "len"
+    mov eax, 24 ; Command 24 read (Reads from a file or pipe)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_pipe(int fds[2])
+peachos_pipe:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "fds"
+    mov eax, 25 ; Command 25 pipe (Creates a pipe, fds[0] reads what fds[1] writes)
+    peachos_syscall
+    pop ebx
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+; int peachos_close(int fd)
+peachos_close:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "fd"
+    mov eax, 26 ; Command 26 close (Closes a file or pipe end)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_open(const char* filename, const char* mode)
+peachos_open:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "filename"
+    mov esi, [ebp+12] ; Variable "mode"
+    mov eax, 30 ; Command 30 open (Opens a file, returns its descriptor)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_readdir(int fd, struct peachos_dirent* entries, unsigned int size)
+peachos_readdir:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "fd"
+    mov esi, [ebp+12] ; Variable "entries"
+    mov edi, [ebp+16] ; Variable "size"
+    mov eax, 31 ; Command 31 readdir (Lists the next entries of a directory)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_trace_read(int cpu, struct peachos_trace_event* events, unsigned int size)
+peachos_trace_read:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "cpu"
+    mov esi, [ebp+12] ; Variable "events"
+    mov edi, [ebp+16] ; Variable "size"
+    mov eax, 32 ; Command 32 trace read (Reads the kernel trace ring of a processor)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_stats(int cpu, struct peachos_stats* stats)
+peachos_stats:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "cpu"
+    mov esi, [ebp+12] ; Variable "stats"
+    mov eax, 33 ; Command 33 stats (Reads the kernel statistics counters)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_process_stats(struct peachos_process_stat* processes, unsigned int size)
+peachos_process_stats:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "processes"
+    mov esi, [ebp+12] ; Variable "size"
+    mov eax, 34 ; Command 34 process stats (Lists the running processes)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_profile(int command, struct peachos_profile_sample* samples, unsigned int arg)
+peachos_profile:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "command"
+    mov esi, [ebp+12] ; Variable "samples"
+    mov edi, [ebp+16] ; Variable "arg"
+    mov eax, 35 ; Command 35 profile (Starts, stops or reads the sampling profiler)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; void* peachos_shm_create(const char* name, unsigned int size)
+peachos_shm_create:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    mov ebx, [ebp+8] ; Variable "name"
+    mov esi, [ebp+12] ; Variable "size"
+    mov eax, 27 ; Command 27 shm create (Creates a shared memory object and maps it)
+    peachos_syscall
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; void* peachos_shm_map(const char* name)
+peachos_shm_map:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "name"
+    mov eax, 28 ; Command 28 shm map (Maps an existing shared memory object)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_shm_unmap(void* ptr)
+peachos_shm_unmap:
+    push ebp
+    mov ebp, esp
+    push ebx
+    mov ebx, [ebp+8] ; Variable "ptr"
+    mov eax, 29 ; Command 29 shm unmap (Unmaps a shared memory object)
+    peachos_syscall
+    pop ebx
+    pop ebp
+    ret
+
+; int peachos_getkeys(char* keys, unsigned int size, int wait)
+peachos_getkeys:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+    mov ebx, [ebp+8] ; Variable "keys"
+    mov esi, [ebp+12] ; Variable "size"
+    mov edi, [ebp+16] ; Variable "wait"
+    mov eax, 36 ; Command 36 getkeys (Reads every key waiting up to size in one go)
+    peachos_syscall
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
@@ -1,69 +1,80 @@
 #include "peachos.h"
 #include "string.h"
+#include "memory.h"
+#include "stdio.h"
 
-struct command_argument* peachos_parse_command(const char* command, int max)
+/**
+ * Splits command at its spaces, runs of spaces do not make empty arguments
+ */
+int peachos_parse_command(const char* command, struct peachos_command* out)
 {
-    struct command_argument* root_command = 0;
-    char scommand[1025];
-    if (max >= (int) sizeof(scommand))
+    out->argc = 0;
+    out->size = 0;
+    for (; *command; command++)
     {
-        return 0;
-    }
+        bool in_argument = out->size && out->strings[out->size - 1] != 0x00;
+        if (*command == ' ')
+        {
+            if (in_argument)
+            {
+                out->strings[out->size++] = 0x00;
+            }
+            continue;
+        }
 
+        // Leave room for the terminator of this argument
+        if (out->size >= (int) sizeof(out->strings) - 1)
+        {
+            return -1;
+        }
 
-    strncpy(scommand, command, sizeof(scommand));
-    char* token = strtok(scommand, " ");
-    if (!token)
-    {
-        goto out;
+        if (!in_argument)
+        {
+            out->argc++;
+        }
+        out->strings[out->size++] = *command;
     }
 
-    root_command = peachos_malloc(sizeof(struct command_argument));
-    if (!root_command)
+    if (out->size && out->strings[out->size - 1] != 0x00)
     {
-        goto out;
+        out->strings[out->size++] = 0x00;
     }
 
-    strncpy(root_command->argument, token, sizeof(root_command->argument));
-    root_command->next = 0;
+    return out->argc ? 0 : -1;
+}
 
+// Keys peachos_terminal_readline fetched past the end of the line it returned, the next line
+// starts with them
+static char peachos_readline_keys[64];
+static int peachos_readline_head;
+static int peachos_readline_total;
 
-    struct command_argument* current = root_command;
-    token = strtok(NULL, " ");
-    while(token != 0)
+static char peachos_readline_key()
+{
+    if (peachos_readline_head == peachos_readline_total)
     {
-        struct command_argument* new_command = peachos_malloc(sizeof(struct command_argument));
-        if (!new_command)
+        int total = peachos_getkeys(peachos_readline_keys, sizeof(peachos_readline_keys), 1);
+        if (total <= 0)
         {
-            break;
+            return 0;
         }
 
-        strncpy(new_command->argument, token, sizeof(new_command->argument));
-        new_command->next = 0x00;
-        current->next = new_command;
-        current = new_command;
-        token = strtok(NULL, " ");
-    }
-out:
-    return root_command;
-}
-int peachos_getkeyblock()
-{
-    int val = 0;
-    do
-    {
-        val = peachos_getkey();
+        peachos_readline_head = 0;
+        peachos_readline_total = total;
     }
-    while(val == 0);
-    return val;
+
+    return peachos_readline_keys[peachos_readline_head++];
 }
 
 void peachos_terminal_readline(char* out, int max, bool output_while_typing)
 {
+    // A prompt printed without a newline is still sitting in the buffer
+    fflush(stdout);
+
     int i = 0;
     for (i = 0; i < max -1; i++)
     {
-        char key = peachos_getkeyblock();
+        char key = peachos_readline_key();
 
         // Carriage return means we have read the line
         if (key == 13)
@@ -94,13 +105,58 @@ void peachos_terminal_readline(char* out, int max, bool output_while_typing)
 
 int peachos_system_run(const char* command)
 {
-    char buf[1024];
-    strncpy(buf, command, sizeof(buf));
-    struct command_argument* root_command_argument = peachos_parse_command(buf, sizeof(buf));
-    if (!root_command_argument)
+    struct peachos_command parsed;
+    if (peachos_parse_command(command, &parsed) < 0)
     {
         return -1;
     }
 
-    return peachos_system(root_command_argument);
-}
\ No newline at end of file
+    return peachos_system(parsed.strings, parsed.size);
+}
+
+struct peachos_ring* peachos_ring_new()
+{
+    struct peachos_ring* ring = peachos_malloc(sizeof(struct peachos_ring));
+    if (ring)
+    {
+        memset(ring, 0, sizeof(struct peachos_ring));
+    }
+    return ring;
+}
+
+struct peachos_ring_entry* peachos_ring_queue(struct peachos_ring* ring, unsigned int command, unsigned int arg0, unsigned int arg1, unsigned int arg2)
+{
+    if (ring->tail - ring->head == PEACHOS_RING_ENTRIES)
+    {
+        peachos_ring_submit(ring);
+    }
+
+    struct peachos_ring_entry* entry = &ring->entries[ring->tail % PEACHOS_RING_ENTRIES];
+    entry->command = command;
+    entry->arguments[0] = arg0;
+    entry->arguments[1] = arg1;
+    entry->arguments[2] = arg2;
+    ring->tail++;
+    return entry;
+}
+
+int peachos_ring_submit(struct peachos_ring* ring)
+{
+    if (ring->head == ring->tail)
+    {
+        return 0;
+    }
+
+    return peachos_ring_enter(ring);
+}
+
+// Threads start here, returning from the start function ends the thread
+static void peachos_thread_start(int (*start)(void* arg), void* arg)
+{
+    peachos_thread_exit(start(arg));
+}
+
+int peachos_thread_create(int (*start)(void* arg), void* arg)
+{
+    return peachos_thread_new(peachos_thread_start, start, arg);
+}
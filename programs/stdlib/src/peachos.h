@@ -4,10 +4,15 @@
 #include <stdbool.h>
 
 
-struct command_argument
+// Most bytes a command line hands to a program, every argument counted with its terminator
+#define PEACHOS_MAX_ARGUMENTS_SIZE 1024
+
+// A command line split into its arguments, packed back to back with their terminators
+struct peachos_command
 {
-    char argument[512];
-    struct command_argument* next;
+    int argc;
+    int size;
+    char strings[PEACHOS_MAX_ARGUMENTS_SIZE];
 };
 
 struct process_arguments
@@ -16,19 +21,177 @@ struct process_arguments
     char** argv;
 };
 
+// System calls that can be queued on a ring, anything else completes with an error
+#define PEACHOS_RING_COMMAND_SUM 0
+#define PEACHOS_RING_COMMAND_PRINT 1
+#define PEACHOS_RING_COMMAND_GETKEY 2
+#define PEACHOS_RING_COMMAND_PUTCHAR 3
+#define PEACHOS_RING_COMMAND_MALLOC 4
+#define PEACHOS_RING_COMMAND_FREE 5
+#define PEACHOS_RING_COMMAND_GET_TIME 15
+
+// Must match the kernel
+#define PEACHOS_RING_ENTRIES 32
+
+struct peachos_ring_entry
+{
+    unsigned int command;
+    unsigned int arguments[3];
+    int result;
+};
+
+// Calls are queued at tail and run by the kernel in one go, it moves head up to tail
+struct peachos_ring
+{
+    unsigned int head;
+    unsigned int tail;
+    struct peachos_ring_entry entries[PEACHOS_RING_ENTRIES];
+};
+
+#define PEACHOS_DIRENT_DIRECTORY 0b00000001
+#define PEACHOS_DIRENT_READ_ONLY 0b00000010
+#define PEACHOS_DIRENT_HIDDEN 0b00000100
+#define PEACHOS_DIRENT_SYSTEM 0b00001000
+
+// An entry of a directory listing, must match the kernel
+struct peachos_dirent
+{
+    unsigned int size;
+    unsigned int first_cluster;
+    unsigned char attributes;
+    char name[13];
+};
+
+// An event of the kernel trace ring, must match the kernel
+struct peachos_trace_event
+{
+    unsigned long long timestamp;
+    unsigned int type;
+    unsigned int arg0;
+    unsigned int arg1;
+    unsigned int arg2;
+};
+
+// System calls below this command id are counted separately, must match the kernel
+#define PEACHOS_STATS_COMMANDS 64
+
+// Kernel statistics as peachos_stats fills them in, must match the kernel
+struct peachos_stats
+{
+    unsigned int uptime_ticks;
+    unsigned int heap_total_blocks;
+    unsigned int heap_used_blocks;
+    unsigned int heap_peak_blocks;
+    unsigned int cache_hits;
+    unsigned int cache_misses;
+
+    // Counters of the processor asked for
+    unsigned int context_switches;
+    unsigned int idle_ticks;
+    unsigned int sectors_read;
+    unsigned int sectors_written;
+    unsigned int fat_chain_hops;
+    unsigned int syscalls_total;
+    unsigned int syscalls[PEACHOS_STATS_COMMANDS];
+};
+
+struct peachos_process_stat
+{
+    unsigned int id;
+    unsigned int ticks;
+    char name[32];
+};
+
+// Operations of peachos_profile, must match the kernel
+#define PEACHOS_PROFILE_START 0
+#define PEACHOS_PROFILE_STOP 1
+#define PEACHOS_PROFILE_READ 2
+
+#define PEACHOS_PROFILE_SAMPLE_KERNEL 0x01
+
+struct peachos_profile_sample
+{
+    // Zero when no process was running
+    unsigned int pid;
+    unsigned int eip;
+    unsigned int flags;
+};
+
 
 void print(const char* filename);
 int peachos_getkey();
+// Reads up to size waiting keys with one system call, with wait set it blocks until there is at
+// least one. Returns how many. Keys peachos_terminal_readline read past its line are not seen here
+int peachos_getkeys(char* keys, unsigned int size, int wait);
 
 void* peachos_malloc(size_t size);
 void peachos_free(void* ptr);
+// Moves the end of the process heap region by increment bytes, returns the old end or a negative error
+void* peachos_sbrk(int increment);
 void peachos_putchar(char c);
 int peachos_getkeyblock();
 void peachos_terminal_readline(char* out, int max, bool output_while_typing);
 void peachos_process_load_start(const char* filename);
-struct command_argument* peachos_parse_command(const char* command, int max);
+int peachos_parse_command(const char* command, struct peachos_command* out);
 void peachos_process_get_arguments(struct process_arguments* arguments);
-int peachos_system(struct command_argument* arguments);
+int peachos_system(const char* strings, int size);
 int peachos_system_run(const char* command);
 void peachos_exit();
+// Maps size bytes of the file from offset, zero maps the rest of it. Returns NULL on failure
+void* peachos_mmap(const char* filename, unsigned int offset, unsigned int size);
+int peachos_munmap(void* ptr);
+int peachos_fork();
+void peachos_sleep(unsigned int ms);
+unsigned int peachos_get_time();
+// Opens a file with mode "r", "w" or "a" and returns the lowest free descriptor
+int peachos_open(const char* filename, const char* mode);
+// Writes len bytes of buf to fd, 1 (stdout) and 2 (stderr) go to the screen. Returns the bytes written
+int peachos_write(int fd, const void* buf, unsigned int len);
+// Reads up to len bytes, zero at the end of a file. From a pipe it waits for a writer when it is
+// empty and zero means the pipe has no writers left. Page aligned whole pages of sbrk or stack
+// memory move through a pipe without a copy
+int peachos_read(int fd, void* buf, unsigned int len);
+// Creates a pipe, fds[0] reads what is written to fds[1]
+int peachos_pipe(int fds[2]);
+// Descriptors are closed when the process exits, a forked child gets its own copy of each
+int peachos_close(int fd);
+// Fills entries with as many entries of a directory opened with "r" as size bytes hold. Returns
+// how many, zero once the whole directory has been listed
+int peachos_readdir(int fd, struct peachos_dirent* entries, unsigned int size);
+// Fills events with the trace events of a processor that have not been read yet, oldest first.
+// Returns how many, zero once the ring is drained
+int peachos_trace_read(int cpu, struct peachos_trace_event* events, unsigned int size);
+// Fills stats with the counters of a processor, or of every processor added up when cpu is -1
+int peachos_stats(int cpu, struct peachos_stats* stats);
+// Fills processes with as many running processes as size bytes hold, returns how many
+int peachos_process_stats(struct peachos_process_stat* processes, unsigned int size);
+// PEACHOS_PROFILE_START samples every arg milliseconds, PEACHOS_PROFILE_STOP stops and
+// PEACHOS_PROFILE_READ fills samples with as many unread samples as arg bytes hold
+int peachos_profile(int command, struct peachos_profile_sample* samples, unsigned int arg);
+// Creates a named shared memory object of size bytes and maps it, NULL if the name is taken
+void* peachos_shm_create(const char* name, unsigned int size);
+// Maps the object another process created, every mapping sees the same memory
+void* peachos_shm_map(const char* name);
+// The object goes away once nobody maps it anymore
+int peachos_shm_unmap(void* ptr);
+
+// Runs start(arg) in a new thread of the process, returns the thread id or a negative error
+int peachos_thread_create(int (*start)(void* arg), void* arg);
+int peachos_thread_new(void* entry, void* arg0, void* arg1);
+// Ends the calling thread, from the main thread it ends the process
+void peachos_thread_exit(int code);
+// Waits for the thread to exit and stores what it returned in code unless code is NULL
+int peachos_thread_join(int id, int* code);
+// Sleeps as long as *address holds expected, returns at once if it does not
+int peachos_futex_wait(int* address, int expected);
+// Wakes up to count threads sleeping on address, returns how many were woken
+int peachos_futex_wake(int* address, int count);
+
+struct peachos_ring* peachos_ring_new();
+// Queues a call, the returned entry holds its result after the next submit until the slot is reused.
+// A full ring is submitted first
+struct peachos_ring_entry* peachos_ring_queue(struct peachos_ring* ring, unsigned int command, unsigned int arg0, unsigned int arg1, unsigned int arg2);
+// Runs every queued call with a single system call, returns how many completed
+int peachos_ring_submit(struct peachos_ring* ring);
+int peachos_ring_enter(struct peachos_ring* ring);
 #endif
\ No newline at end of file
@@ -3,10 +3,12 @@
 global _start
 extern c_start
 extern peachos_exit
+extern peachos_syscall_init
 
 section .asm
 
 _start:
+    call peachos_syscall_init
     call c_start
     call peachos_exit
     ret
\ No newline at end of file
@@ -1,13 +1,109 @@
 #include "stdio.h"
 #include "peachos.h"
 #include "stdlib.h"
+#include "string.h"
 #include <stdarg.h>
-int putchar(int c)
+
+static FILE stdout_file = { .fd = 1, .mode = _IOLBF };
+static FILE stderr_file = { .fd = 2, .mode = _IONBF };
+FILE* stdout = &stdout_file;
+FILE* stderr = &stderr_file;
+
+// The stdio_ helpers expect the stream to be locked
+static int stdio_flush(FILE* stream)
 {
-    peachos_putchar((char)c);
+    if (stream->len == 0)
+    {
+        return 0;
+    }
+
+    int res = peachos_write(stream->fd, stream->buffer, stream->len);
+    stream->len = 0;
+    return res < 0 ? EOF : 0;
+}
+
+static int stdio_putc(int c, FILE* stream)
+{
+    if (stream->mode == _IONBF)
+    {
+        char ch = c;
+        return peachos_write(stream->fd, &ch, 1) < 0 ? EOF : c;
+    }
+
+    stream->buffer[stream->len++] = c;
+    if (stream->len == BUFSIZ || (stream->mode == _IOLBF && c == '\n'))
+    {
+        if (stdio_flush(stream) < 0)
+        {
+            return EOF;
+        }
+    }
+
+    return c;
+}
+
+static int stdio_puts(const char* s, FILE* stream)
+{
+    if (stream->mode == _IONBF)
+    {
+        return peachos_write(stream->fd, s, strlen(s)) < 0 ? EOF : 0;
+    }
+
+    for (; *s; s++)
+    {
+        if (stdio_putc(*s, stream) == EOF)
+        {
+            return EOF;
+        }
+    }
+
+    return 0;
+}
+
+// Only the mode can be changed, the buffer always lives in the FILE
+int setvbuf(FILE* stream, char* buf, int mode, unsigned int size)
+{
+    if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+    {
+        return EOF;
+    }
+
+    peachos_mutex_lock(&stream->lock);
+    stdio_flush(stream);
+    stream->mode = mode;
+    peachos_mutex_unlock(&stream->lock);
     return 0;
 }
 
+int fflush(FILE* stream)
+{
+    peachos_mutex_lock(&stream->lock);
+    int res = stdio_flush(stream);
+    peachos_mutex_unlock(&stream->lock);
+    return res;
+}
+
+int fputc(int c, FILE* stream)
+{
+    peachos_mutex_lock(&stream->lock);
+    int res = stdio_putc(c, stream);
+    peachos_mutex_unlock(&stream->lock);
+    return res;
+}
+
+int fputs(const char* s, FILE* stream)
+{
+    peachos_mutex_lock(&stream->lock);
+    int res = stdio_puts(s, stream);
+    peachos_mutex_unlock(&stream->lock);
+    return res;
+}
+
+int putchar(int c)
+{
+    return fputc(c, stdout);
+}
+
 int printf(const char *fmt, ...)
 {
     va_list ap;
@@ -16,11 +112,13 @@ int printf(const char *fmt, ...)
     int ival;
 
     va_start(ap, fmt);
+    // One printf comes out in one piece even when other threads print too
+    peachos_mutex_lock(&stdout->lock);
     for (p = fmt; *p; p++)
     {
         if (*p != '%')
         {
-            putchar(*p);
+            stdio_putc(*p, stdout);
             continue;
         }
 
@@ -28,21 +126,22 @@ int printf(const char *fmt, ...)
         {
         case 'i':
             ival = va_arg(ap, int);
-            print(itoa(ival));
+            stdio_puts(itoa(ival), stdout);
             break;
 
         case 's':
             sval = va_arg(ap, char *);
-            print(sval);
+            stdio_puts(sval, stdout);
             break;
 
         default:
-            putchar(*p);
+            stdio_putc(*p, stdout);
             break;
         }
     }
 
+    peachos_mutex_unlock(&stdout->lock);
     va_end(ap);
 
     return 0;
-}
\ No newline at end of file
+}
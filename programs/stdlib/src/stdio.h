@@ -1,7 +1,36 @@
 #ifndef PEACHOS_STDIO
 #define PEACHOS_STDIO
 
+#include "sync.h"
+
+#define EOF -1
+
+// Buffering modes for setvbuf
+#define _IOFBF 0
+#define _IOLBF 1
+#define _IONBF 2
+
+#define BUFSIZ 256
+
+typedef struct FILE
+{
+    int fd;
+    int mode;
+    int len;
+    // Held while the buffer is in use, threads print through the same FILE
+    struct peachos_mutex lock;
+    char buffer[BUFSIZ];
+} FILE;
+
+// stdout is line buffered, stderr is not buffered
+extern FILE* stdout;
+extern FILE* stderr;
+
+int setvbuf(FILE* stream, char* buf, int mode, unsigned int size);
+int fflush(FILE* stream);
+int fputc(int c, FILE* stream);
+int fputs(const char* s, FILE* stream);
 int putchar(int c);
 int printf(const char *fmt, ...);
 
-#endif
\ No newline at end of file
+#endif
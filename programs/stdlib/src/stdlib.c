@@ -1,5 +1,6 @@
 #include "stdlib.h"
 #include "peachos.h"
+#include "sync.h"
 
 char* itoa(int i)
 {
@@ -28,12 +29,138 @@ char* itoa(int i)
     return &text[loc];
 }
 
+// Small allocations come from per size free lists, classes go from 16 bytes up to 2 KiB
+#define MALLOC_MIN_SHIFT 4
+#define MALLOC_CLASSES 8
+#define MALLOC_MAX_SMALL (1 << (MALLOC_MIN_SHIFT + MALLOC_CLASSES - 1))
+#define MALLOC_REFILL_SIZE 4096
+#define MALLOC_LARGE MALLOC_CLASSES
+
+// Sits in front of every block, keeps the memory after it 8 byte aligned
+struct malloc_header
+{
+    // The size class, or MALLOC_LARGE for blocks taken from sbrk on their own
+    unsigned int class;
+    // Bytes usable after the header
+    unsigned int size;
+};
+
+struct malloc_free_block
+{
+    struct malloc_header header;
+    struct malloc_free_block* next;
+};
+
+static struct malloc_free_block* malloc_free_lists[MALLOC_CLASSES];
+static struct malloc_free_block* malloc_free_large;
+// Threads of the process share the free lists, every change to them is made holding this
+static struct peachos_mutex malloc_lock = PEACHOS_MUTEX_INIT;
+
+static void* malloc_sbrk(size_t size)
+{
+    void* ptr = peachos_sbrk(size);
+    if ((int) ptr < 0)
+    {
+        return 0;
+    }
+    return ptr;
+}
+
+static int malloc_class(size_t size)
+{
+    int class = 0;
+    while ((1u << (MALLOC_MIN_SHIFT + class)) < size)
+    {
+        class++;
+    }
+    return class;
+}
+
+// Carves a fresh chunk of the heap region into free blocks of the class
+static int malloc_refill(int class)
+{
+    unsigned int block_size = sizeof(struct malloc_header) + (1 << (MALLOC_MIN_SHIFT + class));
+    char* chunk = malloc_sbrk(MALLOC_REFILL_SIZE);
+    if (!chunk)
+    {
+        return -1;
+    }
+
+    for (unsigned int offset = 0; offset + block_size <= MALLOC_REFILL_SIZE; offset += block_size)
+    {
+        struct malloc_free_block* block = (struct malloc_free_block*)(chunk + offset);
+        block->header.class = class;
+        block->header.size = block_size - sizeof(struct malloc_header);
+        block->next = malloc_free_lists[class];
+        malloc_free_lists[class] = block;
+    }
+    return 0;
+}
+
+static void* malloc_large(size_t size)
+{
+    // Reuse the first freed large block that fits
+    struct malloc_free_block** link = &malloc_free_large;
+    while (*link)
+    {
+        struct malloc_free_block* block = *link;
+        if (block->header.size >= size)
+        {
+            *link = block->next;
+            return &block->header + 1;
+        }
+        link = &block->next;
+    }
+
+    size = (size + 7) & ~7;
+    struct malloc_header* header = malloc_sbrk(sizeof(struct malloc_header) + size);
+    if (!header)
+    {
+        return 0;
+    }
+
+    header->class = MALLOC_LARGE;
+    header->size = size;
+    return header + 1;
+}
+
+static void* malloc_small(size_t size)
+{
+    int class = malloc_class(size);
+    if (!malloc_free_lists[class] && malloc_refill(class) < 0)
+    {
+        return 0;
+    }
+
+    struct malloc_free_block* block = malloc_free_lists[class];
+    malloc_free_lists[class] = block->next;
+    return &block->header + 1;
+}
+
 void* malloc(size_t size)
 {
-    return peachos_malloc(size);
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    peachos_mutex_lock(&malloc_lock);
+    void* ptr = size > MALLOC_MAX_SMALL ? malloc_large(size) : malloc_small(size);
+    peachos_mutex_unlock(&malloc_lock);
+    return ptr;
 }
 
 void free(void* ptr)
 {
-    peachos_free(ptr);
+    if (!ptr)
+    {
+        return;
+    }
+
+    struct malloc_free_block* block = (struct malloc_free_block*)((struct malloc_header*) ptr - 1);
+    peachos_mutex_lock(&malloc_lock);
+    struct malloc_free_block** list = block->header.class == MALLOC_LARGE ? &malloc_free_large : &malloc_free_lists[block->header.class];
+    block->next = *list;
+    *list = block;
+    peachos_mutex_unlock(&malloc_lock);
 }
\ No newline at end of file
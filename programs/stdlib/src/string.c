@@ -1,5 +1,8 @@
 #include "string.h"
 
+int memory_sse2();
+int memory_strlen_sse2(const char* ptr);
+
 char tolower(char s1)
 {
     if (s1 >= 65 && s1 <= 90)
@@ -12,6 +15,11 @@ char tolower(char s1)
 
 int strlen(const char* ptr)
 {
+    if (memory_sse2())
+    {
+        return memory_strlen_sse2(ptr);
+    }
+
     int i = 0;
     while(*ptr != 0)
     {
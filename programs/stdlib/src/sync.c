@@ -0,0 +1,128 @@
+#include "sync.h"
+#include "peachos.h"
+
+#define MUTEX_UNLOCKED 0
+#define MUTEX_LOCKED 1
+#define MUTEX_CONTENDED 2
+
+void peachos_mutex_init(struct peachos_mutex* mutex)
+{
+    mutex->state = MUTEX_UNLOCKED;
+}
+
+bool peachos_mutex_trylock(struct peachos_mutex* mutex)
+{
+    return __sync_val_compare_and_swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED) == MUTEX_UNLOCKED;
+}
+
+void peachos_mutex_lock(struct peachos_mutex* mutex)
+{
+    int state = __sync_val_compare_and_swap(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED);
+    if (state == MUTEX_UNLOCKED)
+    {
+        return;
+    }
+
+    // Mark the mutex contended so that the unlock wakes us, then sleep until we get it
+    if (state != MUTEX_CONTENDED)
+    {
+        state = __sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED);
+    }
+
+    while (state != MUTEX_UNLOCKED)
+    {
+        peachos_futex_wait(&mutex->state, MUTEX_CONTENDED);
+        state = __sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED);
+    }
+}
+
+void peachos_mutex_unlock(struct peachos_mutex* mutex)
+{
+    if (__sync_fetch_and_sub(&mutex->state, 1) != MUTEX_LOCKED)
+    {
+        mutex->state = MUTEX_UNLOCKED;
+        peachos_futex_wake(&mutex->state, 1);
+    }
+}
+
+void peachos_cond_init(struct peachos_cond* cond)
+{
+    cond->sequence = 0;
+    cond->waiters = 0;
+}
+
+void peachos_cond_wait(struct peachos_cond* cond, struct peachos_mutex* mutex)
+{
+    int sequence = cond->sequence;
+    __sync_fetch_and_add(&cond->waiters, 1);
+    peachos_mutex_unlock(mutex);
+
+    // A signal between the unlock and the wait changes the sequence so we do not sleep
+    peachos_futex_wait(&cond->sequence, sequence);
+    __sync_fetch_and_sub(&cond->waiters, 1);
+
+    // Other threads may still be waiting for the mutex, lock it as contended to wake them later
+    while (__sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED) != MUTEX_UNLOCKED)
+    {
+        peachos_futex_wait(&mutex->state, MUTEX_CONTENDED);
+    }
+}
+
+void peachos_cond_signal(struct peachos_cond* cond)
+{
+    __sync_fetch_and_add(&cond->sequence, 1);
+    if (cond->waiters)
+    {
+        peachos_futex_wake(&cond->sequence, 1);
+    }
+}
+
+void peachos_cond_broadcast(struct peachos_cond* cond)
+{
+    __sync_fetch_and_add(&cond->sequence, 1);
+    if (cond->waiters)
+    {
+        peachos_futex_wake(&cond->sequence, cond->waiters);
+    }
+}
+
+void peachos_sem_init(struct peachos_sem* sem, int value)
+{
+    sem->value = value;
+    sem->waiters = 0;
+}
+
+bool peachos_sem_trywait(struct peachos_sem* sem)
+{
+    int value = sem->value;
+    while (value > 0)
+    {
+        int seen = __sync_val_compare_and_swap(&sem->value, value, value - 1);
+        if (seen == value)
+        {
+            return true;
+        }
+        value = seen;
+    }
+
+    return false;
+}
+
+void peachos_sem_wait(struct peachos_sem* sem)
+{
+    while (!peachos_sem_trywait(sem))
+    {
+        __sync_fetch_and_add(&sem->waiters, 1);
+        peachos_futex_wait(&sem->value, 0);
+        __sync_fetch_and_sub(&sem->waiters, 1);
+    }
+}
+
+void peachos_sem_post(struct peachos_sem* sem)
+{
+    __sync_fetch_and_add(&sem->value, 1);
+    if (sem->waiters)
+    {
+        peachos_futex_wake(&sem->value, 1);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef PEACHOS_SYNC_H
+#define PEACHOS_SYNC_H
+
+#include <stdbool.h>
+
+// Locks for the threads of a process, they only enter the kernel when a thread has to wait
+
+// Zero when unlocked, one when locked and two when someone may be waiting for it
+struct peachos_mutex
+{
+    int state;
+};
+
+struct peachos_cond
+{
+    // Bumped by every signal, waiters sleep on it
+    int sequence;
+    int waiters;
+};
+
+struct peachos_sem
+{
+    int value;
+    int waiters;
+};
+
+#define PEACHOS_MUTEX_INIT { 0 }
+#define PEACHOS_COND_INIT { 0, 0 }
+
+void peachos_mutex_init(struct peachos_mutex* mutex);
+void peachos_mutex_lock(struct peachos_mutex* mutex);
+bool peachos_mutex_trylock(struct peachos_mutex* mutex);
+void peachos_mutex_unlock(struct peachos_mutex* mutex);
+
+void peachos_cond_init(struct peachos_cond* cond);
+// Unlocks the mutex while it waits for a signal, it is locked again before this returns
+void peachos_cond_wait(struct peachos_cond* cond, struct peachos_mutex* mutex);
+void peachos_cond_signal(struct peachos_cond* cond);
+void peachos_cond_broadcast(struct peachos_cond* cond);
+
+void peachos_sem_init(struct peachos_sem* sem, int value);
+void peachos_sem_wait(struct peachos_sem* sem);
+bool peachos_sem_trywait(struct peachos_sem* sem);
+void peachos_sem_post(struct peachos_sem* sem);
+
+#endif
@@ -0,0 +1,113 @@
+#include "peachos.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "string.h"
+
+// Processes listed on each refresh
+#define TOP_MAX_PROCESSES 16
+#define TOP_INTERVAL_MS 1000
+
+// Process ids stay below 1024, see PEACHOS_MAX_PROCESSES in the kernel
+#define TOP_MAX_PROCESS_ID 1024
+
+static unsigned int top_last_ticks[TOP_MAX_PROCESS_ID];
+
+static int top_percent(unsigned int part, unsigned int whole)
+{
+    if (!whole)
+    {
+        return 0;
+    }
+
+    // There is no 64 bit division without libgcc, large counts give up a little precision
+    if (part > 0xffffffff / 100)
+    {
+        return part / (whole / 100);
+    }
+    return part * 100 / whole;
+}
+
+/**
+ * The command ids called the most, the first count of them end up in ids most called first
+ */
+static void top_busiest_syscalls(struct peachos_stats* stats, int* ids, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        ids[i] = -1;
+        for (int command = 0; command < PEACHOS_STATS_COMMANDS; command++)
+        {
+            bool taken = false;
+            for (int j = 0; j < i; j++)
+            {
+                taken = taken || ids[j] == command;
+            }
+
+            if (!taken && stats->syscalls[command] && (ids[i] < 0 || stats->syscalls[command] > stats->syscalls[ids[i]]))
+            {
+                ids[i] = command;
+            }
+        }
+    }
+}
+
+static void top_print(struct peachos_stats* stats, unsigned int elapsed)
+{
+    printf("up %i ticks, heap %i/%i blocks (peak %i)\n", stats->uptime_ticks, stats->heap_used_blocks,
+           stats->heap_total_blocks, stats->heap_peak_blocks);
+    printf("cache %i hits %i misses (%i%%), sectors %i read %i written, fat hops %i\n", stats->cache_hits,
+           stats->cache_misses, top_percent(stats->cache_hits, stats->cache_hits + stats->cache_misses),
+           stats->sectors_read, stats->sectors_written, stats->fat_chain_hops);
+    printf("switches %i, idle %i ticks, syscalls %i:", stats->context_switches, stats->idle_ticks,
+           stats->syscalls_total);
+
+    int busiest[3];
+    top_busiest_syscalls(stats, busiest, 3);
+    for (int i = 0; i < 3 && busiest[i] >= 0; i++)
+    {
+        printf(" #%i=%i", busiest[i], stats->syscalls[busiest[i]]);
+    }
+    printf("\n");
+
+    struct peachos_process_stat processes[TOP_MAX_PROCESSES];
+    int total = peachos_process_stats(processes, sizeof(processes));
+    printf("  PID  CPU%%  TICKS  NAME\n");
+    for (int i = 0; i < total; i++)
+    {
+        struct peachos_process_stat* process = &processes[i];
+        unsigned int ticks = process->ticks;
+        unsigned int delta = 0;
+        if (process->id < TOP_MAX_PROCESS_ID)
+        {
+            delta = ticks - top_last_ticks[process->id];
+            top_last_ticks[process->id] = ticks;
+        }
+
+        printf("  %i  %i  %i  %s\n", process->id, top_percent(delta, elapsed), ticks, process->name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    struct peachos_stats stats;
+    unsigned int last_uptime = 0;
+    while (1)
+    {
+        if (peachos_stats(-1, &stats) < 0)
+        {
+            printf("top: can not read the kernel statistics\n");
+            return -1;
+        }
+
+        top_print(&stats, stats.uptime_ticks - last_uptime);
+        last_uptime = stats.uptime_ticks;
+
+        peachos_sleep(TOP_INTERVAL_MS);
+        if (peachos_getkey() == 'q')
+        {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+[BITS 32]
+
+section .asm
+
+global bench_read_tsc
+
+; uint32_t bench_read_tsc()
+; Returns the low 32 bits of the time stamp counter
+bench_read_tsc:
+    rdtsc
+    ret
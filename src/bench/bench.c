@@ -0,0 +1,361 @@
+#include "bench.h"
+#include "config.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/paging/paging.h"
+#include "disk/streamer.h"
+#include "fs/file.h"
+#include "printf/printf.h"
+#include "kernel.h"
+
+#define BENCH_BUFFER_SIZE (64 * 1024)
+#define BENCH_ITERATIONS 16
+
+// Timed runs of each operation, the first ones pay for cold caches and show up as the max
+#define BENCH_SAMPLES 256
+#define BENCH_FILE_SAMPLES 32
+#define BENCH_FILE "0:/shell.elf"
+// Sectors the disk benchmark reads from, far enough apart to land in different cache entries
+#define BENCH_DISK_SECTORS 64
+#define BENCH_DISK_STRIDE 8
+
+static uint32_t bench_samples[BENCH_SAMPLES];
+
+/**
+ * The byte at a time loops the kernel used before, kept as a baseline
+ */
+static void* bench_memset_bytes(void* ptr, int c, size_t size)
+{
+    char* c_ptr = (char*) ptr;
+    for (int i = 0; i < size; i++)
+    {
+        c_ptr[i] = (char) c;
+    }
+    return ptr;
+}
+
+static int bench_memcmp_bytes(void* s1, void* s2, int count)
+{
+    char* c1 = s1;
+    char* c2 = s2;
+    while(count-- > 0)
+    {
+        if (*c1++ != *c2++)
+        {
+            return c1[-1] < c2[-1] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+static void* bench_memcpy_bytes(void* dest, void* src, int len)
+{
+    char *d = dest;
+    char *s = src;
+    while(len--)
+    {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+static void bench_report(const char* name, uint32_t fast, uint32_t bytes)
+{
+    printf("%s: %u cycles (byte loop %u)\n", name, fast / BENCH_ITERATIONS, bytes / BENCH_ITERATIONS);
+}
+
+/**
+ * Times the word wise memory routines against the byte loops, once on page aligned buffers
+ * and once on buffers that are misaligned by a byte
+ */
+static void bench_memory()
+{
+    char* a = kzalloc_block(BENCH_BUFFER_SIZE + PEACHOS_HEAP_BLOCK_SIZE);
+    char* b = kzalloc_block(BENCH_BUFFER_SIZE + PEACHOS_HEAP_BLOCK_SIZE);
+    if (!a || !b)
+    {
+        print("bench: out of memory\n");
+        goto out;
+    }
+
+    for (int offset = 0; offset <= 1; offset++)
+    {
+        char* dst = a + offset;
+        char* src = b + (offset * 3);
+        uint32_t fast = 0;
+        uint32_t bytes = 0;
+        printf("bench: %s buffers of %u bytes\n", offset ? "misaligned" : "page aligned", BENCH_BUFFER_SIZE);
+
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            uint32_t start = bench_read_tsc();
+            memset(dst, i, BENCH_BUFFER_SIZE);
+            fast += bench_read_tsc() - start;
+
+            start = bench_read_tsc();
+            bench_memset_bytes(dst, i, BENCH_BUFFER_SIZE);
+            bytes += bench_read_tsc() - start;
+        }
+        bench_report("  memset", fast, bytes);
+
+        fast = 0;
+        bytes = 0;
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            uint32_t start = bench_read_tsc();
+            memcpy(dst, src, BENCH_BUFFER_SIZE);
+            fast += bench_read_tsc() - start;
+
+            start = bench_read_tsc();
+            bench_memcpy_bytes(dst, src, BENCH_BUFFER_SIZE);
+            bytes += bench_read_tsc() - start;
+        }
+        bench_report("  memcpy", fast, bytes);
+
+        fast = 0;
+        bytes = 0;
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            uint32_t start = bench_read_tsc();
+            memcmp(dst, src, BENCH_BUFFER_SIZE);
+            fast += bench_read_tsc() - start;
+
+            start = bench_read_tsc();
+            bench_memcmp_bytes(dst, src, BENCH_BUFFER_SIZE);
+            bytes += bench_read_tsc() - start;
+        }
+        bench_report("  memcmp", fast, bytes);
+    }
+
+out:
+    kfree(a);
+    kfree(b);
+}
+
+/**
+ * Sorts the samples and prints the fastest, the median and the slowest of them
+ */
+static void bench_summary(const char* name, uint32_t* samples, int total)
+{
+    for (int i = 1; i < total; i++)
+    {
+        uint32_t sample = samples[i];
+        int j = i - 1;
+        for (; j >= 0 && samples[j] > sample; j--)
+        {
+            samples[j + 1] = samples[j];
+        }
+        samples[j + 1] = sample;
+    }
+
+    printf("  %s: min %u median %u max %u cycles\n", name, samples[0], samples[total / 2], samples[total - 1]);
+}
+
+static void bench_heap()
+{
+    print("bench: kernel heap\n");
+    uint32_t frees[BENCH_SAMPLES];
+    size_t sizes[] = {64, PEACHOS_HEAP_BLOCK_SIZE, 4 * PEACHOS_HEAP_BLOCK_SIZE};
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int total = 0;
+        for (; total < BENCH_SAMPLES; total++)
+        {
+            uint32_t start = bench_read_tsc();
+            void* ptr = kmalloc(sizes[s]);
+            bench_samples[total] = bench_read_tsc() - start;
+            if (!ptr)
+            {
+                break;
+            }
+
+            start = bench_read_tsc();
+            kfree(ptr);
+            frees[total] = bench_read_tsc() - start;
+        }
+
+        if (!total)
+        {
+            print("bench: out of memory\n");
+            return;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "kmalloc %u", sizes[s]);
+        bench_summary(name, bench_samples, total);
+        snprintf(name, sizeof(name), "kfree %u", sizes[s]);
+        bench_summary(name, frees, total);
+    }
+}
+
+static void bench_paging()
+{
+    print("bench: paging\n");
+    uint32_t frees[BENCH_SAMPLES];
+    int total = 0;
+    for (; total < BENCH_SAMPLES; total++)
+    {
+        uint32_t start = bench_read_tsc();
+        struct paging_4gb_chunk* chunk = paging_new_4gb(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+        bench_samples[total] = bench_read_tsc() - start;
+        if (!chunk)
+        {
+            break;
+        }
+
+        start = bench_read_tsc();
+        paging_free_4gb(chunk);
+        frees[total] = bench_read_tsc() - start;
+    }
+
+    if (!total)
+    {
+        print("bench: out of memory\n");
+        return;
+    }
+
+    bench_summary("paging_new_4gb", bench_samples, total);
+    bench_summary("paging_free_4gb", frees, total);
+}
+
+/**
+ * Sector sized reads of the boot disk through a stream, the first pass over the sectors
+ * goes to the disk and the ones after it are cache hits
+ */
+static void bench_disk()
+{
+    print("bench: disk stream\n");
+    char sector[PEACHOS_SECTOR_SIZE];
+    struct disk_stream* stream = diskstreamer_new(0);
+    if (!stream)
+    {
+        print("bench: no boot disk\n");
+        return;
+    }
+
+    int total = 0;
+    for (; total < BENCH_SAMPLES; total++)
+    {
+        int pos = (total % BENCH_DISK_SECTORS) * BENCH_DISK_STRIDE * PEACHOS_SECTOR_SIZE;
+        uint32_t start = bench_read_tsc();
+        int res = diskstreamer_seek(stream, pos);
+        if (res >= 0)
+        {
+            res = diskstreamer_read(stream, sector, sizeof(sector));
+        }
+        bench_samples[total] = bench_read_tsc() - start;
+        if (res < 0)
+        {
+            break;
+        }
+    }
+
+    diskstreamer_close(stream);
+    if (!total)
+    {
+        print("bench: disk read failed\n");
+        return;
+    }
+
+    bench_summary("diskstreamer_read 512", bench_samples, total);
+}
+
+/**
+ * Opens and reads a whole program the way the loader does, after the first run its pages
+ * come from the page cache
+ */
+static void bench_file()
+{
+    print("bench: " BENCH_FILE "\n");
+    uint32_t opens[BENCH_FILE_SAMPLES];
+    char* buf = 0;
+    int total = 0;
+    for (; total < BENCH_FILE_SAMPLES; total++)
+    {
+        uint32_t start = bench_read_tsc();
+        int fd = fopen(BENCH_FILE, "r");
+        opens[total] = bench_read_tsc() - start;
+        if (fd <= 0)
+        {
+            break;
+        }
+
+        struct file_stat stat;
+        int res = fstat(fd, &stat);
+        if (res >= 0 && !buf)
+        {
+            buf = kmalloc(stat.filesize ? stat.filesize : 1);
+        }
+
+        start = bench_read_tsc();
+        if (res >= 0 && buf)
+        {
+            res = fread(buf, stat.filesize, 1, fd);
+        }
+        bench_samples[total] = bench_read_tsc() - start;
+        fclose(fd);
+        if (res < 0 || !buf)
+        {
+            break;
+        }
+    }
+
+    kfree(buf);
+    if (!total)
+    {
+        print("bench: can not read " BENCH_FILE "\n");
+        return;
+    }
+
+    bench_summary("fopen", opens, total);
+    bench_summary("fread", bench_samples, total);
+}
+
+/**
+ * The constant format fast paths against snprintf going through the format parser, the
+ * values grow so every digit count gets its share of the samples
+ */
+static void bench_format()
+{
+    print("bench: formatting\n");
+    uint32_t fast[BENCH_SAMPLES];
+    char buffer[PRINTF_UINT_BUFFER_SIZE];
+    uint32_t value = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++, value = value * 7 + 3)
+    {
+        uint32_t start = bench_read_tsc();
+        snprintf(buffer, sizeof(buffer), "%u", value);
+        bench_samples[i] = bench_read_tsc() - start;
+
+        start = bench_read_tsc();
+        format_uint(buffer, value);
+        fast[i] = bench_read_tsc() - start;
+    }
+    bench_summary("snprintf %u", bench_samples, BENCH_SAMPLES);
+    bench_summary("format_uint", fast, BENCH_SAMPLES);
+
+    value = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++, value = value * 7 + 3)
+    {
+        uint32_t start = bench_read_tsc();
+        snprintf(buffer, sizeof(buffer), "%08x", value);
+        bench_samples[i] = bench_read_tsc() - start;
+
+        start = bench_read_tsc();
+        format_hex(buffer, value, 8);
+        fast[i] = bench_read_tsc() - start;
+    }
+    bench_summary("snprintf %08x", bench_samples, BENCH_SAMPLES);
+    bench_summary("format_hex", fast, BENCH_SAMPLES);
+}
+
+void bench_run()
+{
+    bench_memory();
+    bench_heap();
+    bench_paging();
+    bench_disk();
+    bench_file();
+    bench_format();
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+uint32_t bench_read_tsc();
+void bench_run();
+
+#endif
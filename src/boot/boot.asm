@@ -4,6 +4,13 @@ BITS 16
 CODE_SEG equ gdt_code - gdt_start
 DATA_SEG equ gdt_data - gdt_start
 
+; The kernel lives in the reserved sectors after this one, the header at the start of kernel.bin
+; says how many of them it takes. See kernel.asm
+KERNEL_ADDRESS equ 0x0100000
+KERNEL_MAX_SECTORS equ 511
+; Sectors the drive is asked to hand over per data request with READ MULTIPLE
+ATA_BLOCK_SECTORS equ 16
+
 jmp short start
 nop
 
@@ -11,7 +18,7 @@ nop
 OEMIdentifier           db 'PEACHOS '
 BytesPerSector          dw 0x0200
 SectorsPerCluster       db 0x01
-ReservedSectors         dw 200
+ReservedSectors         dw 512
 FATCopies               db 0x02
 RootDirEntries          dw 0x0200
 NumSectors              dw 0x7800
@@ -46,6 +53,29 @@ step2:
     mov sp, 0x7c00
     sti ; Enables Interrupts
 
+    ; Ask the BIOS for the memory map, the kernel builds its page frame pool from it.
+    ; The entry count goes to 0x1000 and the 24 byte entries follow it
+    xor ebx, ebx
+    xor bp, bp
+    mov di, 0x1004
+.memory_map_next:
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, 0x534D4150 ; 'SMAP'
+    int 0x15
+    jc .memory_map_done
+    cmp eax, 0x534D4150
+    jne .memory_map_done
+    inc bp
+    add di, 24
+    cmp bp, 64 ; PEACHOS_E820_MAX_ENTRIES
+    je .memory_map_done
+    test ebx, ebx
+    jnz .memory_map_next
+.memory_map_done:
+    movzx eax, bp
+    mov [0x1000], eax
+
 .load_protected:
     cli
     lgdt[gdt_descriptor]
@@ -98,14 +128,65 @@ gdt_descriptor:
     or al, 2
     out 0x92, al
 
-    ; For the loading...
+    ; Move whole blocks of sectors per data request, drives that refuse keep reading one
+    ; sector at a time
+    mov dx, 0x1F6
+    mov al, 0xE0
+    out dx, al
+    mov dx, 0x1F2
+    mov al, ATA_BLOCK_SECTORS
+    out dx, al
+    mov dx, 0x1F7
+    mov al, 0xC6 ; SET MULTIPLE MODE
+    out dx, al
+.set_multiple_wait:
+    in al, dx
+    test al, 0x80
+    jnz .set_multiple_wait
+    test al, 1
+    jz .load_header
+    mov byte [ata_read_command], 0x20
+    mov dword [ata_block_sectors], 1
+
+.load_header:
+    ; The first sector holds the kernel header
     mov eax, 1
-    mov ecx, 200
-    mov edi, 0x0100000
+    mov ecx, 1
+    mov edi, KERNEL_ADDRESS
+    call ata_lba_read
 
+    ; Without a valid header every reserved sector is loaded like before
+    mov esi, KERNEL_MAX_SECTORS
+    cmp dword [KERNEL_ADDRESS + 8], 'PEAK'
+    jne .load_rest
+    mov ecx, [KERNEL_ADDRESS + 12]
+    cmp ecx, esi
+    ja .load_rest
+    mov esi, ecx
 
+.load_rest:
+    ; One command reads at most 256 sectors, edi carries on from where the last read stopped
+    dec esi
+    mov eax, 2
+.load_kernel:
+    test esi, esi
+    jz .start_kernel
+    mov ecx, esi
+    cmp ecx, 256
+    jbe .read_chunk
+    mov ecx, 256
+.read_chunk:
+    sub esi, ecx
+    push eax
+    push ecx
     call ata_lba_read
-    jmp CODE_SEG:0x0100000
+    pop ecx
+    pop eax
+    add eax, ecx
+    jmp .load_kernel
+
+.start_kernel:
+    jmp CODE_SEG:KERNEL_ADDRESS
 
 ata_lba_read:
     mov ebx, eax, ; Backup the LBA
@@ -143,28 +224,41 @@ ata_lba_read:
     ; Finished sending upper 16 bits of the LBA
 
     mov dx, 0x1f7
-    mov al, 0x20
+    mov al, [ata_read_command]
     out dx, al
 
-    ; Read all sectors into memory
-.next_sector:
-    push ecx
+    ; Read all sectors into memory, a block at a time
+.next_block:
 
-; Checking if we need to read
+; Checking if we need to read, the drive is done once it is not busy and has data
 .try_again:
     mov dx, 0x1f7
     in al, dx
+    test al, 0x80
+    jnz .try_again
     test al, 8
     jz .try_again
 
-; We need to read 256 words at a time
-    mov ecx, 256
+; A block is ata_block_sectors sectors of 256 words, the last one may be shorter
+    mov ebx, ecx
+    cmp ebx, [ata_block_sectors]
+    jbe .read_block
+    mov ebx, [ata_block_sectors]
+.read_block:
+    sub ecx, ebx
+    push ecx
+    mov ecx, ebx
+    shl ecx, 8
     mov dx, 0x1F0
     rep insw
     pop ecx
-    loop .next_sector
+    test ecx, ecx
+    jnz .next_block
     ; End of reading sectors into memory
     ret
 
+ata_read_command db 0xC4 ; READ MULTIPLE
+ata_block_sectors dd ATA_BLOCK_SECTORS
+
 times 510-($ - $$) db 0
 dw 0xAA55
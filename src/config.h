@@ -7,34 +7,198 @@
 
 #define PEACHOS_TOTAL_INTERRUPTS 512
 
+// Vectors the master and slave PIC deliver IRQ 0-7 and IRQ 8-15 at, see kernel.asm
+#define PEACHOS_PIC_MASTER_VECTOR_START 0x20
+#define PEACHOS_PIC_SLAVE_VECTOR_START 0x28
+
+// Where the local and IO APIC registers are, and the vector spurious APIC interrupts use
+#define PEACHOS_LAPIC_ADDRESS 0xFEE00000
+#define PEACHOS_IOAPIC_ADDRESS 0xFEC00000
+#define PEACHOS_APIC_SPURIOUS_VECTOR 0xFF
+
 // 100MB heap size
 #define PEACHOS_HEAP_SIZE_BYTES 104857600
 #define PEACHOS_HEAP_BLOCK_SIZE 4096
 #define PEACHOS_HEAP_ADDRESS 0x01000000 
 #define PEACHOS_HEAP_TABLE_ADDRESS 0x00007E00
 
+// Small kmalloc requests are served from slab caches of 16, 32, 64 ... 2048 bytes
+#define PEACHOS_SLAB_MIN_OBJECT_SIZE 16
+#define PEACHOS_SLAB_MAX_OBJECT_SIZE 2048
+#define PEACHOS_SLAB_TOTAL_CACHES 8
+// Every slab is carved out of this many bytes of heap blocks
+#define PEACHOS_SLAB_SIZE 16384
+
+// Process memory and page tables come from 4KB frames of the usable RAM in this range, the BIOS
+// memory map tells which parts of it exist
+#define PEACHOS_FRAME_POOL_START (PEACHOS_HEAP_ADDRESS + PEACHOS_HEAP_SIZE_BYTES)
+#define PEACHOS_FRAME_POOL_END 0x10000000
+
+// Where boot.asm leaves the BIOS E820 memory map, a 32 bit entry count followed by the entries
+#define PEACHOS_E820_ADDRESS 0x1000
+#define PEACHOS_E820_MAX_ENTRIES 64
+
+// Everything below this address (kernel, low memory, the kernel heap and the frame pool) is
+// identity mapped into every address space through page tables shared by all of them
+#define PEACHOS_KERNEL_IDENTITY_MAP_END PEACHOS_FRAME_POOL_END
+
+// Pages below this address are never remapped by a process (kernel image, boot stack, VGA memory)
+// so they are marked global and survive address space switches in the TLB
+#define PEACHOS_KERNEL_GLOBAL_MAP_END 0x00200000
+
 #define PEACHOS_SECTOR_SIZE 512
 
+// The most sectors a single ATA read command can transfer
+#define PEACHOS_DISK_MAX_SECTORS_PER_READ 256
+// The same for the LBA48 EXT commands, their sector count register is 16 bits wide
+#define PEACHOS_DISK_MAX_SECTORS_PER_READ_LBA48 65536
+
+// Sectors kept in the block cache beneath disk_read_block, buckets must be a power of two
+#define PEACHOS_DISK_CACHE_SECTORS 256
+#define PEACHOS_DISK_CACHE_HASH_BUCKETS 64
+// Longer runs of missed sectors are streaming file data, they are not cached so they do not
+// push the FAT and directory sectors out
+#define PEACHOS_DISK_CACHE_STREAM_SECTORS 16
+// Dirty sectors the cache holds before writing them back on its own
+#define PEACHOS_DISK_CACHE_DIRTY_LIMIT 128
+// Sectors written back with a single command when flushing
+#define PEACHOS_DISK_CACHE_FLUSH_SECTORS 64
+
+// Readahead windows start at MIN sectors and double on every sequential read up to MAX
+#define PEACHOS_READAHEAD_MIN_SECTORS 8
+#define PEACHOS_READAHEAD_MAX_SECTORS 64
+
 #define PEACHOS_MAX_FILESYSTEMS 12
+// Drive the initramfs built into the kernel image is mounted as
+#define PEACHOS_INITRAMFS_DRIVE 1
+// Drive the RAM disk is mounted as, it is formatted as FAT16 at boot
+#define PEACHOS_RAMDISK_DRIVE 2
+// 4 MiB, enough clusters for FAT16 with one sector per cluster
+#define PEACHOS_RAMDISK_SECTORS 8192
+// ATA disks other than the boot disk take drive numbers from here on
+#define PEACHOS_ATA_EXTRA_DRIVES_START 3
+// Paths name their drive with a single digit
+#define PEACHOS_MAX_DISKS 10
 #define PEACHOS_MAX_FILE_DESCRIPTORS 512
+// File pages the VFS keeps cached, buckets must be a power of two
+#define PEACHOS_PAGE_CACHE_PAGES 256
+#define PEACHOS_PAGE_CACHE_HASH_BUCKETS 64
+// Missing pages of a read are read from the filesystem this many at a time
+#define PEACHOS_PAGE_CACHE_FILL_PAGES 8
+// Files a process can have open, descriptors 0 to 2 are its console
+#define PEACHOS_MAX_PROCESS_FILES 64
+// A pipe buffers this many pages, whole pages written from anonymous memory are lent to it
+#define PEACHOS_PIPE_PAGES 4
+// Named shared memory objects, they are mapped in the mmap range
+#define PEACHOS_SHM_NAME_MAX 32
+#define PEACHOS_SHM_MAX_SIZE 0x400000
 
 #define PEACHOS_MAX_PATH 108
+// Components a path may have, the parser keeps them in a fixed array
+#define PEACHOS_MAX_PATH_PARTS 32
+
+// The ELF header and program headers must fit in this many bytes at the start of the file
+#define PEACHOS_ELF_MAX_HEADERS_SIZE 4096
+// Programs in the root of drive 0 the executable table knows by name, buckets must be a
+// power of two
+#define PEACHOS_EXEC_TABLE_ENTRIES 64
+#define PEACHOS_EXEC_TABLE_HASH_BUCKETS 32
+
+// Path components remembered per FAT16 disk, buckets must be a power of two
+#define PEACHOS_FAT16_DENTRY_CACHE_SIZE 128
+#define PEACHOS_FAT16_DENTRY_HASH_BUCKETS 64
 
-#define PEACHOS_TOTAL_GDT_SEGMENTS 6
+// Processors the kernel keeps state for, each one has its own TSS in the GDT after the
+// five fixed segments
+#define PEACHOS_MAX_CPUS 4
+#define PEACHOS_GDT_TSS_INDEX 5
+#define PEACHOS_TOTAL_GDT_SEGMENTS (PEACHOS_GDT_TSS_INDEX + PEACHOS_MAX_CPUS)
 
 #define PEACHOS_PROGRAM_VIRTUAL_ADDRESS 0x400000
-#define PEACHOS_USER_PROGRAM_STACK_SIZE 1024 * 16
+// The user stack grows down from PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START a page at a time as it
+// is touched, at most this far. The page below the limit is a guard page that is never mapped
+#define PEACHOS_USER_PROGRAM_STACK_SIZE 1024 * 256
 #define PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START 0x3FF000
 #define PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START - PEACHOS_USER_PROGRAM_STACK_SIZE
 
-#define PEACHOS_MAX_PROGRAM_ALLOCATIONS 1024
-#define PEACHOS_MAX_PROCESSES 12
+// Program arguments arrive packed back to back with their terminators, at most this many bytes
+// and arguments. They are placed at the top of the user stack
+#define PEACHOS_MAX_ARGUMENTS_SIZE 1024
+#define PEACHOS_MAX_PROGRAM_ARGUMENTS 64
+
+// Stacks of the threads a process starts are placed in this range, each under a guard page
+#define PEACHOS_THREAD_STACK_SIZE 1024 * 16
+#define PEACHOS_THREAD_STACK_VIRTUAL_ADDRESS_START 0x80000000
+#define PEACHOS_THREAD_STACK_VIRTUAL_ADDRESS_END 0x90000000
+// Futexes are found through a hash of their process and address, must be a power of two
+#define PEACHOS_FUTEX_HASH_BUCKETS 64
+
+// Every task gets its own kernel stack so it can block inside a system call
+#define PEACHOS_TASK_KERNEL_STACK_SIZE 16384
+
+// Runqueue levels of the scheduler, level zero runs first. At most 32 so one word maps them
+#define PEACHOS_TASK_PRIORITY_LEVELS 8
+#define PEACHOS_TASK_DEFAULT_PRIORITY 4
+// Kernel tasks run ahead of every user task, they only run until they block
+#define PEACHOS_TASK_KERNEL_PRIORITY 0
+
+// Timer ticks per second, a divisor of 1000, and how many ticks a task runs before another gets a turn
+#define PEACHOS_TIMER_FREQUENCY 1000
+#define PEACHOS_TASK_TIMESLICE_TICKS 10
+
+// Memory a process allocates with malloc is mapped into this range of its address space
+#define PEACHOS_PROCESS_HEAP_VIRTUAL_ADDRESS_START 0x20000000
+#define PEACHOS_PROCESS_HEAP_VIRTUAL_ADDRESS_END 0x40000000
+
+// The region a process grows with sbrk, pages are allocated the first time they are touched
+#define PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_START 0x10000000
+#define PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_END 0x20000000
+
+// Files mapped into a process with mmap are placed in this range of its address space
+#define PEACHOS_MMAP_VIRTUAL_ADDRESS_START 0x40000000
+#define PEACHOS_MMAP_VIRTUAL_ADDRESS_END 0x80000000
+// Process ids are handed out below this, the process table starts small and doubles as needed
+#define PEACHOS_MAX_PROCESSES 1024
+#define PEACHOS_PROCESS_TABLE_INITIAL_SIZE 16
+// Page directories with a stack mapped that are kept ready for programs to start in
+#define PEACHOS_PROCESS_POOL_SIZE 4
+// Exited processes give their memory back from the idle loop, this many regions per step. Past
+// PEACHOS_PROCESS_MAX_EXITED waiting the oldest is released on the exit path instead
+#define PEACHOS_PROCESS_REAP_BATCH 16
+#define PEACHOS_PROCESS_MAX_EXITED 8
 
 #define USER_DATA_SEGMENT 0x23
 #define USER_CODE_SEGMENT 0x1b
 
 #define PEACHOS_MAX_ISR80H_COMMANDS 1024
+// Entries in a batched system call ring, must match the user library
+#define PEACHOS_SYSCALL_RING_ENTRIES 32
 
+// Keys a process has not read yet, more are dropped. Must be a power of two
 #define PEACHOS_KEYBOARD_BUFFER_SIZE 1024
 
+// Set to 0 to stop copying the console to COM1
+#define PEACHOS_SERIAL_CONSOLE 1
+// Bytes waiting for the serial port to send them, more are dropped. Must be a power of two
+#define PEACHOS_SERIAL_TX_BUFFER_SIZE 4096
+
+// Set to 1 to run the in kernel benchmarks during boot, make bench builds with it set
+#ifndef PEACHOS_RUN_BENCHMARKS
+#define PEACHOS_RUN_BENCHMARKS 0
+#endif
+
+// Set to 0 to compile every tracepoint out of the kernel
+#define PEACHOS_TRACE 1
+// Events each processor's trace ring holds before the oldest are overwritten, must be a power of two
+#define PEACHOS_TRACE_RING_ENTRIES 1024
+
+// System calls below this command id are counted separately in the statistics, the user library
+// has the same value
+#define PEACHOS_STATS_COMMANDS 64
+// Bytes of a process file name the statistics hand out
+#define PEACHOS_STATS_NAME_SIZE 32
+
+// Samples the profiler keeps per processor until they are read, later ones are dropped
+#define PEACHOS_PROFILE_SAMPLES 2048
+
 #endif
\ No newline at end of file
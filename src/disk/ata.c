@@ -0,0 +1,423 @@
+#include "ata.h"
+#include "disk.h"
+#include "cache.h"
+#include "io/io.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "kernel.h"
+
+// How many times IDENTIFY polls the status register before deciding nothing is there
+#define ATA_IDENTIFY_TIMEOUT_POLLS 100000
+
+static struct ata_channel ata_channels[ATA_CHANNELS] =
+{
+    { .index = 0, .io_base = 0x1F0, .control_base = 0x3F6, .irq = 14 },
+    { .index = 1, .io_base = 0x170, .control_base = 0x376, .irq = 15 }
+};
+
+struct ata_channel* ata_get_channel(int index)
+{
+    return &ata_channels[index];
+}
+
+/**
+ * Most sectors one command can move on the device, DMA is also bound by the PRD table
+ */
+int ata_max_sectors(struct ata_device* device, bool dma)
+{
+    int max = device->lba48 ? PEACHOS_DISK_MAX_SECTORS_PER_READ_LBA48 : PEACHOS_DISK_MAX_SECTORS_PER_READ;
+    if (dma && max > IDEDMA_MAX_SECTORS)
+    {
+        max = IDEDMA_MAX_SECTORS;
+    }
+
+    return max;
+}
+
+/**
+ * The EXT commands take more port writes, they are only used when a 28 bit command can't do it
+ */
+static bool ata_needs_lba48(unsigned int lba, int total)
+{
+    return total > PEACHOS_DISK_MAX_SECTORS_PER_READ || lba + total > ATA_LBA28_LIMIT;
+}
+
+/**
+ * Selects the drive, loads the address and sector count and issues the read or write. LBA48
+ * registers take their high byte first, a count of zero means the most the command can move
+ */
+void ata_send_command(struct ata_device* device, unsigned int lba, int total, bool write, bool dma)
+{
+    uint16_t io = device->channel->io_base;
+    uint8_t command = 0;
+    if (device->lba48 && ata_needs_lba48(lba, total))
+    {
+        outb(io + ATA_REG_DRIVE, ATA_DRIVE_LBA48 | (device->drive << 4));
+        outb(io + ATA_REG_SECTOR_COUNT, (unsigned char)(total >> 8));
+        outb(io + ATA_REG_LBA_LOW, (unsigned char)(lba >> 24));
+        // Our LBAs are 32 bits, the top two bytes of the 48 are always zero
+        outb(io + ATA_REG_LBA_MID, 0);
+        outb(io + ATA_REG_LBA_HIGH, 0);
+        if (dma)
+        {
+            command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        }
+        else
+        {
+            command = write ? ATA_CMD_WRITE_SECTORS_EXT : ATA_CMD_READ_SECTORS_EXT;
+        }
+    }
+    else
+    {
+        outb(io + ATA_REG_DRIVE, ATA_DRIVE_LBA | (device->drive << 4) | ((lba >> 24) & 0x0F));
+        if (dma)
+        {
+            command = write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+        }
+        else
+        {
+            command = write ? ATA_CMD_WRITE_SECTORS : ATA_CMD_READ_SECTORS;
+        }
+    }
+
+    outb(io + ATA_REG_SECTOR_COUNT, (unsigned char)(total & 0xff));
+    outb(io + ATA_REG_LBA_LOW, (unsigned char)(lba & 0xff));
+    outb(io + ATA_REG_LBA_MID, (unsigned char)(lba >> 8));
+    outb(io + ATA_REG_LBA_HIGH, (unsigned char)(lba >> 16));
+    outb(io + ATA_REG_COMMAND, command);
+}
+
+/**
+ * Reads the alternate status register a few times, the drive needs 400ns to settle after
+ * being selected
+ */
+static void ata_delay(struct ata_channel* channel)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        insb(channel->control_base);
+    }
+}
+
+/**
+ * Waits for the drive to ask for or offer the next sector
+ */
+static int ata_wait_drq(struct ata_channel* channel)
+{
+    char c = insb(channel->io_base + ATA_REG_STATUS);
+    while (!(c & ATA_STATUS_DRQ))
+    {
+        if (!(c & ATA_STATUS_BUSY) && (c & ATA_STATUS_ERROR))
+        {
+            return -EIO;
+        }
+        c = insb(channel->io_base + ATA_REG_STATUS);
+    }
+
+    return 0;
+}
+
+static int ata_read_pio(struct ata_device* device, unsigned int lba, int total, void* buf)
+{
+    if (total <= 0 || total > ata_max_sectors(device, false))
+    {
+        return -EINVARG;
+    }
+
+    uint16_t io = device->channel->io_base;
+    ata_send_command(device, lba, total, false, false);
+    unsigned short* ptr = (unsigned short*) buf;
+    for (int b = 0; b < total; b++)
+    {
+        if (ata_wait_drq(device->channel) < 0)
+        {
+            return -EIO;
+        }
+
+        // Copy from hard disk to memory
+        for (int i = 0; i < 256; i++)
+        {
+            *ptr = insw(io + ATA_REG_DATA);
+            ptr++;
+        }
+    }
+
+    return 0;
+}
+
+static int ata_write_pio(struct ata_device* device, unsigned int lba, int total, void* buf)
+{
+    if (total <= 0 || total > ata_max_sectors(device, false))
+    {
+        return -EINVARG;
+    }
+
+    uint16_t io = device->channel->io_base;
+    ata_send_command(device, lba, total, true, false);
+    unsigned short* ptr = (unsigned short*) buf;
+    for (int b = 0; b < total; b++)
+    {
+        if (ata_wait_drq(device->channel) < 0)
+        {
+            return -EIO;
+        }
+
+        for (int i = 0; i < 256; i++)
+        {
+            outw(io + ATA_REG_DATA, *ptr);
+            ptr++;
+        }
+    }
+
+    // Wait for the last sector to be written out
+    char c = insb(io + ATA_REG_STATUS);
+    while (c & ATA_STATUS_BUSY)
+    {
+        c = insb(io + ATA_REG_STATUS);
+    }
+
+    return (c & ATA_STATUS_ERROR) ? -EIO : 0;
+}
+
+static int ata_transfer_chunk(struct disk* idisk, unsigned int lba, int total, void* buf, bool write)
+{
+    struct ata_device* device = idisk->private;
+    if (idisk->type == PEACHOS_DISK_TYPE_IDE_DMA)
+    {
+        int res = write ? diskqueue_write(idisk, lba, total, buf) : diskqueue_read(idisk, lba, total, buf);
+        if (res == PEACHOS_ALL_OK || !diskqueue_idle(idisk))
+        {
+            return res;
+        }
+
+        // Fall back to programmed I/O if the DMA transfer failed and the channel is free
+    }
+
+    return write ? ata_write_pio(device, lba, total, buf) : ata_read_pio(device, lba, total, buf);
+}
+
+/**
+ * Splits the transfer into the largest commands the device and the DMA engine take. Buffers
+ * the controller can't reach go through the bounce buffer and are split to its size
+ */
+static int ata_transfer(struct disk* idisk, unsigned int lba, int total, void* buf, bool write)
+{
+    int res = 0;
+    char* ptr = buf;
+    bool dma = idisk->type == PEACHOS_DISK_TYPE_IDE_DMA;
+    int max = ata_max_sectors(idisk->private, dma);
+    if (dma && !idedma_can_use_buffer(buf, total * PEACHOS_SECTOR_SIZE) && max > IDEDMA_BOUNCE_SECTORS)
+    {
+        max = IDEDMA_BOUNCE_SECTORS;
+    }
+
+    while (total > 0)
+    {
+        int chunk = total < max ? total : max;
+        res = ata_transfer_chunk(idisk, lba, chunk, ptr, write);
+        if (res < 0)
+        {
+            break;
+        }
+
+        lba += chunk;
+        total -= chunk;
+        ptr += chunk * PEACHOS_SECTOR_SIZE;
+    }
+
+    return res;
+}
+
+static int ata_read(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    return ata_transfer(idisk, lba, total, buf, false);
+}
+
+static int ata_write(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    return ata_transfer(idisk, lba, total, buf, true);
+}
+
+static const struct disk_ops ata_ops =
+{
+    .read = ata_read,
+    .write = ata_write,
+    .cached = true
+};
+
+/**
+ * Asks the drive who it is. Returns zero and fills in the 256 identify words when an ATA disk
+ * answers, packet devices and empty positions fail
+ */
+static int ata_identify(struct ata_channel* channel, int drive, uint16_t* identify)
+{
+    uint16_t io = channel->io_base;
+    if (insb(io + ATA_REG_STATUS) == 0xFF)
+    {
+        // Floating bus, there is nothing on this channel
+        return -EIO;
+    }
+
+    outb(io + ATA_REG_DRIVE, 0xA0 | (drive << 4));
+    ata_delay(channel);
+    outb(io + ATA_REG_SECTOR_COUNT, 0);
+    outb(io + ATA_REG_LBA_LOW, 0);
+    outb(io + ATA_REG_LBA_MID, 0);
+    outb(io + ATA_REG_LBA_HIGH, 0);
+    outb(io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    if (insb(io + ATA_REG_STATUS) == 0)
+    {
+        return -EIO;
+    }
+
+    int polls = 0;
+    uint8_t status = insb(io + ATA_REG_STATUS);
+    while (status & ATA_STATUS_BUSY)
+    {
+        if (++polls > ATA_IDENTIFY_TIMEOUT_POLLS)
+        {
+            return -EIO;
+        }
+        status = insb(io + ATA_REG_STATUS);
+    }
+
+    // ATAPI and SATA devices put their signature here instead of answering
+    if (insb(io + ATA_REG_LBA_MID) || insb(io + ATA_REG_LBA_HIGH))
+    {
+        return -EIO;
+    }
+
+    while (!(status & (ATA_STATUS_DRQ | ATA_STATUS_ERROR)))
+    {
+        if (++polls > ATA_IDENTIFY_TIMEOUT_POLLS)
+        {
+            return -EIO;
+        }
+        status = insb(io + ATA_REG_STATUS);
+    }
+
+    if (status & ATA_STATUS_ERROR)
+    {
+        return -EIO;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        identify[i] = insw(io + ATA_REG_DATA);
+    }
+
+    return 0;
+}
+
+/**
+ * Sectors the drive has, capped to what our 32 bit LBAs can address
+ */
+static uint32_t ata_identify_total_sectors(uint16_t* identify, bool lba48)
+{
+    if (!lba48)
+    {
+        return identify[ATA_IDENTIFY_LBA28_SECTORS] | ((uint32_t)identify[ATA_IDENTIFY_LBA28_SECTORS + 1] << 16);
+    }
+
+    uint16_t* words = &identify[ATA_IDENTIFY_LBA48_SECTORS];
+    if (words[2] || words[3])
+    {
+        return 0xFFFFFFFF;
+    }
+
+    return words[0] | ((uint32_t)words[1] << 16);
+}
+
+static struct disk* ata_new_disk(struct ata_channel* channel, int drive, int id, uint32_t total_sectors, bool lba48)
+{
+    struct disk* disk = kzalloc(sizeof(struct disk));
+    struct ata_device* device = kzalloc(sizeof(struct ata_device));
+    if (!disk || !device)
+    {
+        kfree(disk);
+        kfree(device);
+        return 0;
+    }
+
+    device->channel = channel;
+    device->drive = drive;
+    device->lba48 = lba48;
+    disk->type = channel->dma.bus_master_base ? PEACHOS_DISK_TYPE_IDE_DMA : PEACHOS_DISK_TYPE_REAL;
+    disk->sector_size = PEACHOS_SECTOR_SIZE;
+    disk->total_sectors = total_sectors;
+    disk->max_transfer_sectors = ata_max_sectors(device, false);
+    disk->ops = &ata_ops;
+    disk->private = device;
+    disk->id = id;
+    channel->disks[drive] = disk;
+    return disk;
+}
+
+/**
+ * Probes the master and slave of both channels. The primary master is the boot disk and always
+ * becomes disk 0, even when it does not answer IDENTIFY, every other disk found takes the next
+ * free drive number from PEACHOS_ATA_EXTRA_DRIVES_START
+ */
+void ata_init()
+{
+    uint16_t identify[256];
+    int next_id = PEACHOS_ATA_EXTRA_DRIVES_START;
+    for (int c = 0; c < ATA_CHANNELS; c++)
+    {
+        struct ata_channel* channel = &ata_channels[c];
+        bool found[ATA_DRIVES_PER_CHANNEL];
+        bool lba48[ATA_DRIVES_PER_CHANNEL];
+        uint32_t total_sectors[ATA_DRIVES_PER_CHANNEL];
+        for (int drive = 0; drive < ATA_DRIVES_PER_CHANNEL; drive++)
+        {
+            found[drive] = ata_identify(channel, drive, identify) == 0;
+            lba48[drive] = found[drive] && (identify[ATA_IDENTIFY_COMMAND_SETS] & ATA_IDENTIFY_LBA48_SUPPORTED);
+            total_sectors[drive] = found[drive] ? ata_identify_total_sectors(identify, lba48[drive]) : 0;
+        }
+
+        bool boot_channel = c == 0;
+        if (!found[0] && boot_channel)
+        {
+            found[0] = true;
+        }
+
+        if ((found[0] || found[1]) && idedma_init(channel) < 0)
+        {
+            memset(&channel->dma, 0, sizeof(channel->dma));
+        }
+
+        for (int drive = 0; drive < ATA_DRIVES_PER_CHANNEL; drive++)
+        {
+            if (!found[drive])
+            {
+                continue;
+            }
+
+            bool boot_disk = boot_channel && drive == 0;
+            if (!boot_disk && next_id >= PEACHOS_MAX_DISKS)
+            {
+                print("ATA: Out of drive numbers\n");
+                continue;
+            }
+
+            struct disk* disk = ata_new_disk(channel, drive, boot_disk ? 0 : next_id, total_sectors[drive], lba48[drive]);
+            if (!disk)
+            {
+                continue;
+            }
+
+            if (diskcache_init(disk) < 0)
+            {
+                print("Disk cache unavailable, reads will go straight to the disk\n");
+            }
+
+            if (!boot_disk)
+            {
+                next_id++;
+            }
+            disk_register(disk);
+        }
+    }
+}
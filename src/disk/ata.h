@@ -0,0 +1,87 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "idedma.h"
+#include "queue.h"
+
+struct disk;
+
+// Registers relative to the I/O base of a channel
+#define ATA_REG_DATA 0x00
+#define ATA_REG_ERROR 0x01
+#define ATA_REG_SECTOR_COUNT 0x02
+#define ATA_REG_LBA_LOW 0x03
+#define ATA_REG_LBA_MID 0x04
+#define ATA_REG_LBA_HIGH 0x05
+#define ATA_REG_DRIVE 0x06
+#define ATA_REG_STATUS 0x07
+#define ATA_REG_COMMAND 0x07
+
+#define ATA_STATUS_ERROR 0x01
+#define ATA_STATUS_DRQ 0x08
+#define ATA_STATUS_BUSY 0x80
+
+#define ATA_CMD_READ_SECTORS 0x20
+#define ATA_CMD_READ_SECTORS_EXT 0x24
+#define ATA_CMD_WRITE_SECTORS 0x30
+#define ATA_CMD_WRITE_SECTORS_EXT 0x34
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_IDENTIFY 0xEC
+
+// Drive register value selecting LBA addressing, the slave also sets bit 4
+#define ATA_DRIVE_LBA 0xE0
+// The same for LBA48 commands, the drive register carries no address bits then
+#define ATA_DRIVE_LBA48 0x40
+
+// Highest sector a 28 bit LBA command can reach, plus one
+#define ATA_LBA28_LIMIT 0x10000000
+
+// IDENTIFY words
+#define ATA_IDENTIFY_LBA28_SECTORS 60
+#define ATA_IDENTIFY_COMMAND_SETS 83
+// Bit of the command set word saying the drive takes LBA48 commands
+#define ATA_IDENTIFY_LBA48_SUPPORTED (1 << 10)
+#define ATA_IDENTIFY_LBA48_SECTORS 100
+
+#define ATA_CHANNELS 2
+#define ATA_DRIVES_PER_CHANNEL 2
+
+struct ata_channel
+{
+    int index;
+    uint16_t io_base;
+    uint16_t control_base;
+    int irq;
+
+    // Bus master state, dma.bus_master_base is zero when the channel can't do DMA
+    struct idedma_channel dma;
+
+    // A channel runs one command at a time for either of its drives, these are its requests
+    struct disk_request* active;
+    // Drive of the command in flight, the other one gets the next turn if it has work waiting
+    int active_drive;
+    struct disk* disks[ATA_DRIVES_PER_CHANNEL];
+};
+
+// The private data of an ATA disk
+struct ata_device
+{
+    struct ata_channel* channel;
+    // 0 for the master, 1 for the slave
+    int drive;
+    // Set when IDENTIFY said the drive takes the EXT commands
+    bool lba48;
+    struct disk_queue queue;
+};
+
+void ata_init();
+struct ata_channel* ata_get_channel(int index);
+int ata_max_sectors(struct ata_device* device, bool dma);
+void ata_send_command(struct ata_device* device, unsigned int lba, int total, bool write, bool dma);
+
+#endif
@@ -0,0 +1,473 @@
+#include "cache.h"
+#include "disk.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "task/task.h"
+
+static uint32_t diskcache_hash(struct disk* disk, unsigned int lba)
+{
+    return (lba ^ (disk->id * 0x9E3779B1)) & (PEACHOS_DISK_CACHE_HASH_BUCKETS - 1);
+}
+
+static void diskcache_lru_unlink(struct disk_cache* cache, struct disk_cache_entry* entry)
+{
+    if (entry->lru_prev)
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else
+    {
+        cache->lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next)
+    {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else
+    {
+        cache->lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = 0;
+    entry->lru_next = 0;
+}
+
+static void diskcache_lru_push_head(struct disk_cache* cache, struct disk_cache_entry* entry)
+{
+    entry->lru_prev = 0;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+    {
+        cache->lru_head->lru_prev = entry;
+    }
+    cache->lru_head = entry;
+
+    if (!cache->lru_tail)
+    {
+        cache->lru_tail = entry;
+    }
+}
+
+static void diskcache_touch(struct disk_cache* cache, struct disk_cache_entry* entry)
+{
+    if (cache->lru_head == entry)
+    {
+        return;
+    }
+
+    diskcache_lru_unlink(cache, entry);
+    diskcache_lru_push_head(cache, entry);
+}
+
+static struct disk_cache_entry* diskcache_lookup(struct disk* disk, unsigned int lba)
+{
+    struct disk_cache* cache = disk->cache;
+    struct disk_cache_entry* entry = cache->buckets[diskcache_hash(disk, lba)];
+    while (entry)
+    {
+        if (entry->disk == disk && entry->lba == lba)
+        {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+
+    return 0;
+}
+
+static void diskcache_hash_remove(struct disk_cache* cache, struct disk_cache_entry* entry)
+{
+    struct disk_cache_entry** link = &cache->buckets[diskcache_hash(entry->disk, entry->lba)];
+    while (*link)
+    {
+        if (*link == entry)
+        {
+            *link = entry->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+
+    entry->hash_next = 0;
+}
+
+/**
+ * Finds the least recently used entry that is not waiting on a prefetch or holding unwritten
+ * data and gives it the new sector. Returns NULL if every entry is busy
+ */
+static struct disk_cache_entry* diskcache_claim(struct disk* disk, unsigned int lba)
+{
+    struct disk_cache* cache = disk->cache;
+    struct disk_cache_entry* entry = cache->lru_tail;
+    while (entry && (entry->pending || entry->dirty))
+    {
+        entry = entry->lru_prev;
+    }
+
+    if (!entry)
+    {
+        return 0;
+    }
+
+    if (entry->disk)
+    {
+        diskcache_hash_remove(cache, entry);
+    }
+
+    entry->disk = disk;
+    entry->lba = lba;
+
+    uint32_t bucket = diskcache_hash(disk, lba);
+    entry->hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    diskcache_touch(cache, entry);
+    return entry;
+}
+
+/**
+ * Stores a copy of the sector in the least recently used entry
+ */
+static void diskcache_insert(struct disk* disk, unsigned int lba, void* data)
+{
+    struct disk_cache* cache = disk->cache;
+    struct disk_cache_entry* entry = diskcache_lookup(disk, lba);
+    if (entry && (entry->pending || entry->dirty))
+    {
+        // A prefetch will fill it in, or it holds newer data than the disk
+        return;
+    }
+
+    if (!entry)
+    {
+        entry = diskcache_claim(disk, lba);
+        if (!entry)
+        {
+            return;
+        }
+    }
+
+    memcpy(entry->data, data, PEACHOS_SECTOR_SIZE);
+    diskcache_touch(cache, entry);
+}
+
+static void diskcache_prefetch_complete(struct disk_request* request)
+{
+    struct disk_cache_entry* entry = request->private;
+    struct disk_cache* cache = request->disk->cache;
+    entry->pending = false;
+    if (request->status < 0)
+    {
+        // Forget the sector, whoever wanted it will read it again
+        diskcache_hash_remove(cache, entry);
+        entry->disk = 0;
+    }
+
+    wait_queue_wake_all(&cache->pending_waiters);
+}
+
+/**
+ * Waits for a pending sector to arrive
+ */
+static void diskcache_wait_pending(struct disk* disk, struct disk_cache_entry* entry)
+{
+    struct disk_cache* cache = disk->cache;
+    while (entry->pending)
+    {
+        if (task_can_block())
+        {
+            wait_queue_sleep(&cache->pending_waiters);
+            continue;
+        }
+
+        // Nothing else can run during boot, keep the queue moving ourselves
+        diskqueue_poll(disk);
+    }
+}
+
+/**
+ * Starts reading the sectors in the background so a later read finds them in the cache.
+ * Only disks driven through the request queue can read ahead without blocking the caller
+ */
+void diskcache_prefetch(struct disk* disk, unsigned int lba, int total)
+{
+    struct disk_cache* cache = disk->cache;
+    if (!cache || disk->type != PEACHOS_DISK_TYPE_IDE_DMA)
+    {
+        return;
+    }
+
+    // Hold the queue back until every sector is submitted so neighbours get merged
+    diskqueue_plug(disk);
+    for (int i = 0; i < total; i++)
+    {
+        if (diskcache_lookup(disk, lba + i))
+        {
+            continue;
+        }
+
+        struct disk_cache_entry* entry = diskcache_claim(disk, lba + i);
+        if (!entry)
+        {
+            break;
+        }
+
+        entry->pending = true;
+        entry->request.disk = disk;
+        entry->request.lba = lba + i;
+        entry->request.total = 1;
+        entry->request.buf = entry->data;
+        entry->request.write = false;
+        entry->request.complete = diskcache_prefetch_complete;
+        entry->request.waiter = 0;
+        entry->request.private = entry;
+        entry->request.next = 0;
+        diskqueue_submit(&entry->request);
+        cache->stats.prefetched++;
+    }
+    diskqueue_unplug(disk);
+}
+
+/**
+ * Gives the disk a cache of its own, so sectors of a busy disk never push out another disk's
+ */
+int diskcache_init(struct disk* disk)
+{
+    int res = 0;
+    struct disk_cache* cache = kzalloc(sizeof(struct disk_cache));
+    if (!cache)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    cache->entries = kzalloc(sizeof(struct disk_cache_entry) * PEACHOS_DISK_CACHE_SECTORS);
+    cache->flush_list = kzalloc(sizeof(struct disk_cache_entry*) * PEACHOS_DISK_CACHE_SECTORS);
+    cache->flush_buffer = kzalloc_block(PEACHOS_DISK_CACHE_FLUSH_SECTORS * PEACHOS_SECTOR_SIZE);
+    char* data = kzalloc_block(PEACHOS_DISK_CACHE_SECTORS * PEACHOS_SECTOR_SIZE);
+    if (!cache->entries || !cache->flush_list || !cache->flush_buffer || !data)
+    {
+        kfree(cache->entries);
+        kfree(cache->flush_list);
+        kfree(cache->flush_buffer);
+        kfree(data);
+        kfree(cache);
+        res = -ENOMEM;
+        goto out;
+    }
+
+    for (int i = 0; i < PEACHOS_DISK_CACHE_SECTORS; i++)
+    {
+        cache->entries[i].data = data + (i * PEACHOS_SECTOR_SIZE);
+        diskcache_lru_push_head(cache, &cache->entries[i]);
+    }
+
+    disk->cache = cache;
+out:
+    return res;
+}
+
+/**
+ * Reads total sectors starting at lba. Cached sectors are copied from memory, every run of
+ * sectors that is not cached is read from the disk with a single command. Short runs are
+ * cached, long ones are file data passing through
+ */
+int diskcache_read(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    int res = 0;
+    char* out = buf;
+    struct disk_cache* cache = disk->cache;
+
+    if (!cache)
+    {
+        // The cache could not be set up, go straight to the disk
+        return disk_read_hardware(disk, lba, total, buf);
+    }
+
+    int i = 0;
+    while (i < total)
+    {
+        struct disk_cache_entry* entry = diskcache_lookup(disk, lba + i);
+        if (entry && entry->pending)
+        {
+            diskcache_wait_pending(disk, entry);
+            // Look it up again, the prefetch may have failed
+            continue;
+        }
+
+        if (entry)
+        {
+            memcpy(out + (i * PEACHOS_SECTOR_SIZE), entry->data, PEACHOS_SECTOR_SIZE);
+            diskcache_touch(cache, entry);
+            cache->stats.hits++;
+            i++;
+            continue;
+        }
+
+        int run = 1;
+        while (i + run < total && !diskcache_lookup(disk, lba + i + run))
+        {
+            run++;
+        }
+
+        cache->stats.misses += run;
+        res = disk_read_hardware(disk, lba + i, run, out + (i * PEACHOS_SECTOR_SIZE));
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        for (int j = 0; run <= PEACHOS_DISK_CACHE_STREAM_SECTORS && j < run; j++)
+        {
+            diskcache_insert(disk, lba + i + j, out + ((i + j) * PEACHOS_SECTOR_SIZE));
+        }
+        i += run;
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Writes every dirty sector of the disk back in LBA order. Dirty sectors that follow each
+ * other on the disk are gathered into the flush buffer and written with a single command
+ */
+int diskcache_flush(struct disk* disk)
+{
+    int res = 0;
+    struct disk_cache* cache = disk->cache;
+    if (!cache)
+    {
+        goto out;
+    }
+
+    // Insertion sort, the list is short and usually written in nearly sorted order
+    int total = 0;
+    for (int i = 0; i < PEACHOS_DISK_CACHE_SECTORS; i++)
+    {
+        struct disk_cache_entry* entry = &cache->entries[i];
+        if (!entry->dirty)
+        {
+            continue;
+        }
+
+        int pos = total;
+        while (pos > 0 && cache->flush_list[pos - 1]->lba > entry->lba)
+        {
+            cache->flush_list[pos] = cache->flush_list[pos - 1];
+            pos--;
+        }
+        cache->flush_list[pos] = entry;
+        total++;
+    }
+
+    int i = 0;
+    while (i < total)
+    {
+        int run = 1;
+        while (i + run < total && run < PEACHOS_DISK_CACHE_FLUSH_SECTORS &&
+               cache->flush_list[i + run]->lba == cache->flush_list[i]->lba + run)
+        {
+            run++;
+        }
+
+        for (int j = 0; j < run; j++)
+        {
+            memcpy(cache->flush_buffer + (j * PEACHOS_SECTOR_SIZE), cache->flush_list[i + j]->data, PEACHOS_SECTOR_SIZE);
+        }
+
+        res = disk_write_hardware(disk, cache->flush_list[i]->lba, run, cache->flush_buffer);
+        if (res < 0)
+        {
+            // Keep the sectors dirty so a later flush can try again
+            goto out;
+        }
+
+        for (int j = 0; j < run; j++)
+        {
+            cache->flush_list[i + j]->dirty = false;
+        }
+        cache->total_dirty -= run;
+        cache->stats.flushed += run;
+        i += run;
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Writes total sectors starting at lba into the cache, they reach the disk on the next flush.
+ * Sectors that can't be cached are written straight through
+ */
+int diskcache_write(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    int res = 0;
+    char* in = buf;
+    struct disk_cache* cache = disk->cache;
+
+    if (!cache)
+    {
+        return disk_write_hardware(disk, lba, total, buf);
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        char* data = in + (i * PEACHOS_SECTOR_SIZE);
+        struct disk_cache_entry* entry = diskcache_lookup(disk, lba + i);
+        if (entry && entry->pending)
+        {
+            // Let the prefetch land first or it would overwrite our data
+            diskcache_wait_pending(disk, entry);
+            entry = diskcache_lookup(disk, lba + i);
+        }
+
+        if (!entry)
+        {
+            entry = diskcache_claim(disk, lba + i);
+        }
+
+        if (!entry && cache->total_dirty > 0)
+        {
+            res = diskcache_flush(disk);
+            if (res < 0)
+            {
+                goto out;
+            }
+            entry = diskcache_claim(disk, lba + i);
+        }
+
+        if (!entry)
+        {
+            res = disk_write_hardware(disk, lba + i, 1, data);
+            if (res < 0)
+            {
+                goto out;
+            }
+            continue;
+        }
+
+        memcpy(entry->data, data, PEACHOS_SECTOR_SIZE);
+        diskcache_touch(cache, entry);
+        if (!entry->dirty)
+        {
+            entry->dirty = true;
+            cache->total_dirty++;
+        }
+    }
+
+    if (cache->total_dirty >= PEACHOS_DISK_CACHE_DIRTY_LIMIT)
+    {
+        res = diskcache_flush(disk);
+    }
+
+out:
+    return res;
+}
+
+struct disk_cache_stats* diskcache_get_stats(struct disk* disk)
+{
+    return disk->cache ? &disk->cache->stats : 0;
+}
@@ -0,0 +1,66 @@
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+#include "queue.h"
+#include "task/waitqueue.h"
+
+struct disk;
+
+struct disk_cache_entry
+{
+    // The disk this sector was read from, NULL when the entry is unused
+    struct disk* disk;
+    unsigned int lba;
+    char* data;
+
+    // Next entry in the same hash bucket
+    struct disk_cache_entry* hash_next;
+
+    // Least recently used list, the head is the most recently used entry
+    struct disk_cache_entry* lru_prev;
+    struct disk_cache_entry* lru_next;
+
+    // Set while a prefetch is reading the sector in, the data is not valid yet
+    bool pending;
+    struct disk_request request;
+
+    // Set when the sector was written to but not yet to the disk
+    bool dirty;
+};
+
+struct disk_cache_stats
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t prefetched;
+    uint32_t flushed;
+};
+
+struct disk_cache
+{
+    struct disk_cache_entry* entries;
+    struct disk_cache_entry* buckets[PEACHOS_DISK_CACHE_HASH_BUCKETS];
+    struct disk_cache_entry* lru_head;
+    struct disk_cache_entry* lru_tail;
+    struct disk_cache_stats stats;
+
+    // Readers waiting for a pending sector to arrive
+    struct wait_queue pending_waiters;
+
+    // Dirty entries are gathered here in LBA order when flushing
+    int total_dirty;
+    struct disk_cache_entry** flush_list;
+    char* flush_buffer;
+};
+
+int diskcache_init(struct disk* disk);
+int diskcache_read(struct disk* disk, unsigned int lba, int total, void* buf);
+void diskcache_prefetch(struct disk* disk, unsigned int lba, int total);
+int diskcache_write(struct disk* disk, unsigned int lba, int total, void* buf);
+int diskcache_flush(struct disk* disk);
+struct disk_cache_stats* diskcache_get_stats(struct disk* disk);
+
+#endif
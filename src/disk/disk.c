@@ -1,66 +1,160 @@
 #include "disk.h"
-#include "io/io.h"
 #include "config.h"
 #include "status.h"
 #include "memory/memory.h"
 #include "kernel.h"
+#include "cache.h"
+#include "ata.h"
+#include "ramdisk.h"
+#include "fs/fat/fat16.h"
+#include "trace/trace.h"
+#include "stats/stats.h"
 
-struct disk disk;
+static struct disk initramfs_disk;
 
-int disk_read_sector(int lba, int total, void* buf)
+// Indexed by disk id, which is also the drive number in paths
+static struct disk* disks[PEACHOS_MAX_DISKS];
+
+/**
+ * Reads straight from the disk's backend, bypassing the block cache
+ */
+int disk_read_hardware(struct disk* idisk, unsigned int lba, int total, void* buf)
 {
-    outb(0x1F6, (lba >> 24) | 0xE0);
-    outb(0x1F2, total);
-    outb(0x1F3, (unsigned char)(lba & 0xff));
-    outb(0x1F4, (unsigned char)(lba >> 8));
-    outb(0x1F5, (unsigned char)(lba >> 16));
-    outb(0x1F7, 0x20);
-
-    unsigned short* ptr = (unsigned short*) buf;
-    for (int b = 0; b < total; b++)
+    if (!idisk->ops)
     {
-        // Wait for the buffer to be ready
-        char c = insb(0x1F7);
-        while(!(c & 0x08))
-        {
-            c = insb(0x1F7);
-        }
-
-        // Copy from hard disk to memory
-        for (int i = 0; i < 256; i++)
-        {
-            *ptr = insw(0x1F0);
-            ptr++;
-        }
+        return -EIO;
+    }
 
+    if (idisk->total_sectors && (lba >= idisk->total_sectors || total > idisk->total_sectors - lba))
+    {
+        return -EINVARG;
     }
+
+    TRACE(TRACE_EVENT_DISK_READ, idisk->id, lba, total);
+    STATS_ADD(sectors_read, total);
+    return idisk->ops->read(idisk, lba, total, buf);
+}
+
+/**
+ * Writes straight to the disk's backend, bypassing the block cache
+ */
+int disk_write_hardware(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    if (!idisk->ops)
+    {
+        return -EIO;
+    }
+
+    if (idisk->total_sectors && (lba >= idisk->total_sectors || total > idisk->total_sectors - lba))
+    {
+        return -EINVARG;
+    }
+
+    TRACE(TRACE_EVENT_DISK_WRITE, idisk->id, lba, total);
+    STATS_ADD(sectors_written, total);
+    return idisk->ops->write(idisk, lba, total, buf);
+}
+
+/**
+ * Makes the disk reachable through disk_get under its id and mounts whatever filesystem is on it
+ */
+int disk_register(struct disk* idisk)
+{
+    if (idisk->id < 0 || idisk->id >= PEACHOS_MAX_DISKS)
+    {
+        return -EINVARG;
+    }
+
+    if (disks[idisk->id])
+    {
+        return -EISTKN;
+    }
+
+    disks[idisk->id] = idisk;
+    idisk->filesystem = fs_resolve(idisk);
     return 0;
 }
 
+static void disk_ramdisk_init()
+{
+    struct disk* ramdisk = ramdisk_create(PEACHOS_RAMDISK_DRIVE, PEACHOS_RAMDISK_SECTORS);
+    if (ISERR(ramdisk))
+    {
+        print("RAM disk unavailable\n");
+        return;
+    }
+
+    // Starts out as an empty FAT16 volume for scratch files
+    if (fat16_format(ramdisk) < 0)
+    {
+        print("Failed to format the RAM disk\n");
+    }
+
+    disk_register(ramdisk);
+}
+
 void disk_search_and_init()
 {
-    memset(&disk, 0, sizeof(disk));
-    disk.type = PEACHOS_DISK_TYPE_REAL;
-    disk.sector_size = PEACHOS_SECTOR_SIZE;
-    disk.id = 0;
-    disk.filesystem = fs_resolve(&disk);
+    memset(disks, 0, sizeof(disks));
+    ata_init();
+
+    // No ops, the initramfs filesystem reads the image from memory itself
+    memset(&initramfs_disk, 0, sizeof(initramfs_disk));
+    initramfs_disk.type = PEACHOS_DISK_TYPE_INITRAMFS;
+    initramfs_disk.sector_size = PEACHOS_SECTOR_SIZE;
+    initramfs_disk.id = PEACHOS_INITRAMFS_DRIVE;
+    disk_register(&initramfs_disk);
+
+    disk_ramdisk_init();
 }
 
 struct disk* disk_get(int index)
 {
-    if (index != 0)
+    if (index < 0 || index >= PEACHOS_MAX_DISKS)
         return 0;
-    
-    return &disk;
+
+    return disks[index];
 }
 
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf)
 {
-    if (idisk != &disk)
+    if (!idisk->ops)
+    {
+        return -EIO;
+    }
+
+    if (!idisk->ops->cached)
+    {
+        return disk_read_hardware(idisk, lba, total, buf);
+    }
+
+    return diskcache_read(idisk, lba, total, buf);
+}
+
+int disk_write_block(struct disk* idisk, unsigned int lba, int total, void* buf)
+{
+    if (!idisk->ops)
     {
-        print("FAT16: Failed to resolve filesystem\n");
         return -EIO;
     }
 
-    return disk_read_sector(lba, total, buf);
-}
\ No newline at end of file
+    if (!idisk->ops->cached)
+    {
+        return disk_write_hardware(idisk, lba, total, buf);
+    }
+
+    return diskcache_write(idisk, lba, total, buf);
+}
+
+/**
+ * Writes every dirty cached sector of the disk back to it
+ */
+int disk_flush(struct disk* idisk)
+{
+    if (!idisk->ops || !idisk->ops->cached)
+    {
+        return 0;
+    }
+
+    return diskcache_flush(idisk);
+}
@@ -1,18 +1,50 @@
 #ifndef DISK_H
 #define DISK_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "fs/file.h"
+#include "task/waitqueue.h"
 
 typedef unsigned int PEACHOS_DISK_TYPE;
 
 
 // Represents a real physical hard disk
 #define PEACHOS_DISK_TYPE_REAL 0
+// A real hard disk on an IDE channel driven with bus master DMA
+#define PEACHOS_DISK_TYPE_IDE_DMA 1
+// The initramfs built into the kernel image, it has no sectors
+#define PEACHOS_DISK_TYPE_INITRAMFS 2
+// Sectors kept in kernel memory
+#define PEACHOS_DISK_TYPE_RAM 3
+
+struct disk;
+struct disk_cache;
+
+typedef int (*DISK_TRANSFER_FUNCTION)(struct disk* disk, unsigned int lba, int total, void* buf);
+
+// How a disk moves sectors, disks without any can not be read or written a block at a time
+struct disk_ops
+{
+    DISK_TRANSFER_FUNCTION read;
+    DISK_TRANSFER_FUNCTION write;
+    // Set when reads and writes should go through the block cache, memory backed disks skip it
+    bool cached;
+};
 
 struct disk
 {
     PEACHOS_DISK_TYPE type;
     int sector_size;
+    // Zero if the size is not known
+    uint32_t total_sectors;
+    // Most sectors a single transfer can move, zero if there is no limit
+    int max_transfer_sectors;
+    const struct disk_ops* ops;
+    // The private data of the disk's backend
+    void* private;
+    // Block cache of the disk, NULL for disks that are not cached or if it could not be set up
+    struct disk_cache* cache;
 
     // The id of the disk
     int id;
@@ -21,10 +53,18 @@ struct disk
 
     // The private data of our filesystem
     void* fs_private;
+
+    // Held while the filesystem works on the disk, a task may block on I/O half way through
+    struct sleep_lock lock;
 };
 
 void disk_search_and_init();
 struct disk* disk_get(int index);
+int disk_read_hardware(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_write_hardware(struct disk* idisk, unsigned int lba, int total, void* buf);
 int disk_read_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_write_block(struct disk* idisk, unsigned int lba, int total, void* buf);
+int disk_flush(struct disk* idisk);
+int disk_register(struct disk* idisk);
 
 #endif
\ No newline at end of file
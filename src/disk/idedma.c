@@ -0,0 +1,231 @@
+#include "idedma.h"
+#include "disk.h"
+#include "queue.h"
+#include "ata.h"
+#include "config.h"
+#include "status.h"
+#include "io/io.h"
+#include "idt/idt.h"
+#include "pci/pci.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "kernel.h"
+
+static void idedma_irq(struct ata_channel* channel)
+{
+    if (!channel->dma.active)
+    {
+        // Not ours, reading the ATA status register acknowledges the interrupt on the drive
+        insb(channel->io_base + ATA_REG_STATUS);
+        return;
+    }
+
+    diskqueue_interrupt(channel);
+}
+
+static void idedma_primary_irq_handler(struct interrupt_frame* frame)
+{
+    idedma_irq(ata_get_channel(0));
+}
+
+static void idedma_secondary_irq_handler(struct interrupt_frame* frame)
+{
+    idedma_irq(ata_get_channel(1));
+}
+
+/**
+ * Adds PRDs for a transfer into buf, splitting it on every 64 KiB boundary.
+ * The kernel is identity mapped so the buffer address is also its physical address
+ */
+static int idedma_add_prds(struct idedma_channel* dma, int total, char* buf, uint32_t size)
+{
+    uint32_t address = (uint32_t) buf;
+    while (size > 0)
+    {
+        if (total >= IDEDMA_MAX_PRDS)
+        {
+            return -EINVARG;
+        }
+
+        uint32_t to_boundary = IDEDMA_PRD_MAX_BYTES - (address & (IDEDMA_PRD_MAX_BYTES - 1));
+        uint32_t chunk = size < to_boundary ? size : to_boundary;
+        struct idedma_prd* prd = &dma->prd_table[total];
+        prd->address = address;
+        prd->byte_count = (uint16_t)(chunk & 0xFFFF);
+        prd->flags = 0;
+
+        address += chunk;
+        size -= chunk;
+        total++;
+    }
+
+    return total;
+}
+
+bool idedma_can_use_buffer(void* buf, uint32_t size)
+{
+    uint32_t address = (uint32_t) buf;
+    // The controller needs word aligned buffers that are identity mapped
+    return !(address & 1) && address + size <= PEACHOS_KERNEL_IDENTITY_MAP_END;
+}
+
+int idedma_init(struct ata_channel* channel)
+{
+    int res = 0;
+    struct pci_device device;
+    struct idedma_channel* dma = &channel->dma;
+    memset(dma, 0, sizeof(struct idedma_channel));
+    res = pci_find_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_IDE, &device);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    uint32_t bar4 = pci_config_read(&device, PCI_CONFIG_BAR4);
+    if (!(bar4 & PCI_BAR_IO_SPACE) || !(bar4 & PCI_BAR_IO_MASK))
+    {
+        // No bus master support
+        res = -EIO;
+        goto out;
+    }
+
+    dma->prd_table = kzalloc_block(PEACHOS_HEAP_BLOCK_SIZE);
+    dma->bounce = kzalloc_block(IDEDMA_BOUNCE_SECTORS * PEACHOS_SECTOR_SIZE);
+    if (!dma->prd_table || !dma->bounce)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    uint32_t command = pci_config_read(&device, PCI_CONFIG_COMMAND);
+    pci_config_write(&device, PCI_CONFIG_COMMAND, command | PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER);
+
+    dma->bus_master_base = (bar4 & PCI_BAR_IO_MASK) + (channel->index * IDEDMA_CHANNEL_STRIDE);
+    idt_register_interrupt_callback(PEACHOS_PIC_SLAVE_VECTOR_START + (channel->irq - 8),
+        channel->index == 0 ? idedma_primary_irq_handler : idedma_secondary_irq_handler);
+
+    // Let the drives raise interrupts and unmask the channel's IRQ along with the cascade on the master
+    outb(channel->control_base, 0x00);
+    outb(0xA1, insb(0xA1) & ~(1 << (channel->irq - 8)));
+    outb(0x21, insb(0x21) & ~(1 << 2));
+
+out:
+    if (res < 0)
+    {
+        kfree(dma->prd_table);
+        kfree(dma->bounce);
+        memset(dma, 0, sizeof(struct idedma_channel));
+    }
+    return res;
+}
+
+/**
+ * Starts transferring total sectors at lba between the disk and the buffers of the chained
+ * requests, the requests must cover the sectors in order and go the same direction. A single
+ * request whose buffer the controller can't reach goes through the bounce buffer
+ */
+int idedma_start(struct ata_device* device, unsigned int lba, int total, struct disk_request* requests)
+{
+    int res = 0;
+    struct ata_channel* channel = device->channel;
+    struct idedma_channel* dma = &channel->dma;
+    uint16_t base = dma->bus_master_base;
+    if (!base)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    if (total <= 0 || total > IDEDMA_MAX_SECTORS)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    dma->bounced = false;
+    int prds = 0;
+    for (struct disk_request* request = requests; request; request = request->next)
+    {
+        uint32_t size = request->total * PEACHOS_SECTOR_SIZE;
+        char* target = request->buf;
+        if (!idedma_can_use_buffer(target, size))
+        {
+            if (request != requests || request->next || request->total > IDEDMA_BOUNCE_SECTORS)
+            {
+                res = -EINVARG;
+                goto out;
+            }
+
+            dma->bounced = true;
+            target = dma->bounce;
+            if (request->write)
+            {
+                memcpy(target, request->buf, size);
+            }
+        }
+
+        prds = idedma_add_prds(dma, prds, target, size);
+        if (prds < 0)
+        {
+            res = prds;
+            goto out;
+        }
+    }
+    dma->prd_table[prds - 1].flags = IDEDMA_PRD_END_OF_TABLE;
+
+    // Stop the engine, point it at our table and clear any old interrupt or error
+    outb(base + IDEDMA_REG_COMMAND, 0);
+    outdw(base + IDEDMA_REG_PRDT, (uint32_t) dma->prd_table);
+    outb(base + IDEDMA_REG_STATUS, insb(base + IDEDMA_REG_STATUS) | IDEDMA_STATUS_ERROR | IDEDMA_STATUS_INTERRUPT);
+
+    ata_send_command(device, lba, total, requests->write, true);
+
+    outb(base + IDEDMA_REG_COMMAND, (requests->write ? 0 : IDEDMA_COMMAND_READ) | IDEDMA_COMMAND_START);
+    dma->active = true;
+
+out:
+    return res;
+}
+
+/**
+ * True once the controller has raised its interrupt or hit an error for the transfer in flight
+ */
+bool idedma_transfer_done(struct ata_channel* channel)
+{
+    if (!channel->dma.active)
+    {
+        return false;
+    }
+
+    uint8_t status = insb(channel->dma.bus_master_base + IDEDMA_REG_STATUS);
+    return (status & (IDEDMA_STATUS_INTERRUPT | IDEDMA_STATUS_ERROR)) != 0;
+}
+
+/**
+ * Stops the engine and acknowledges the transfer in flight, returns its status
+ */
+int idedma_finish(struct ata_channel* channel, struct disk_request* requests)
+{
+    int res = 0;
+    struct idedma_channel* dma = &channel->dma;
+    uint16_t base = dma->bus_master_base;
+    outb(base + IDEDMA_REG_COMMAND, 0);
+    uint8_t status = insb(base + IDEDMA_REG_STATUS);
+    uint8_t ata_status = insb(channel->io_base + ATA_REG_STATUS);
+    outb(base + IDEDMA_REG_STATUS, status | IDEDMA_STATUS_ERROR | IDEDMA_STATUS_INTERRUPT);
+    dma->active = false;
+
+    if (!(status & IDEDMA_STATUS_INTERRUPT) || (status & IDEDMA_STATUS_ERROR) || (ata_status & 0x01))
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    if (dma->bounced && !requests->write)
+    {
+        memcpy(requests->buf, dma->bounce, requests->total * PEACHOS_SECTOR_SIZE);
+    }
+
+out:
+    return res;
+}
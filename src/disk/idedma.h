@@ -0,0 +1,65 @@
+#ifndef IDEDMA_H
+#define IDEDMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+struct disk_request;
+struct ata_channel;
+struct ata_device;
+
+// Bus master registers of a channel, relative to BAR4 of the IDE controller plus 8 for the secondary
+#define IDEDMA_REG_COMMAND 0x00
+#define IDEDMA_REG_STATUS 0x02
+#define IDEDMA_REG_PRDT 0x04
+
+#define IDEDMA_COMMAND_START 0x01
+// Set when the device writes to memory, i.e. a disk read
+#define IDEDMA_COMMAND_READ 0x08
+
+#define IDEDMA_STATUS_ACTIVE 0x01
+#define IDEDMA_STATUS_ERROR 0x02
+#define IDEDMA_STATUS_INTERRUPT 0x04
+
+
+// A physical region descriptor may not cross a 64 KiB boundary, a byte count of zero means 64 KiB
+#define IDEDMA_PRD_MAX_BYTES 0x10000
+#define IDEDMA_PRD_END_OF_TABLE 0x8000
+#define IDEDMA_MAX_PRDS 512
+// Most sectors one transfer may move, a buffer that does not start on a 64 KiB boundary needs a PRD extra
+#define IDEDMA_MAX_SECTORS (((IDEDMA_MAX_PRDS - 1) * IDEDMA_PRD_MAX_BYTES) / PEACHOS_SECTOR_SIZE)
+// The bounce buffer holds this many sectors
+#define IDEDMA_BOUNCE_SECTORS 256
+
+// The secondary channel's registers follow the primary's
+#define IDEDMA_CHANNEL_STRIDE 0x08
+
+struct idedma_prd
+{
+    uint32_t address;
+    uint16_t byte_count;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct idedma_channel
+{
+    uint16_t bus_master_base;
+    struct idedma_prd* prd_table;
+
+    // Used when the caller's buffer can't be handed to the controller directly
+    char* bounce;
+
+    // Set while a transfer is in flight
+    bool active;
+    // Whether the transfer in flight goes through the bounce buffer
+    bool bounced;
+};
+
+int idedma_init(struct ata_channel* channel);
+bool idedma_can_use_buffer(void* buf, uint32_t size);
+int idedma_start(struct ata_device* device, unsigned int lba, int total, struct disk_request* requests);
+bool idedma_transfer_done(struct ata_channel* channel);
+int idedma_finish(struct ata_channel* channel, struct disk_request* requests);
+
+#endif
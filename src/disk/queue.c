@@ -0,0 +1,254 @@
+#include "queue.h"
+#include "disk.h"
+#include "idedma.h"
+#include "ata.h"
+#include "config.h"
+#include "status.h"
+#include "task/task.h"
+
+// How many times the boot time poll loop checks the controller before giving up
+#define DISKQUEUE_TIMEOUT_POLLS 10000000
+
+static struct ata_device* diskqueue_device(struct disk* disk)
+{
+    return disk->private;
+}
+
+/**
+ * Distance the drive has to travel from the head position to reach the lba, going upwards
+ * and wrapping around to the start of the disk (C-LOOK)
+ */
+static unsigned int diskqueue_distance(struct disk_queue* queue, unsigned int lba)
+{
+    return lba - queue->head_lba;
+}
+
+static void diskqueue_insert(struct disk_queue* queue, struct disk_request* request)
+{
+    unsigned int distance = diskqueue_distance(queue, request->lba);
+    struct disk_request** link = &queue->pending;
+    while (*link && diskqueue_distance(queue, (*link)->lba) <= distance)
+    {
+        link = &(*link)->next;
+    }
+
+    request->next = *link;
+    *link = request;
+}
+
+static bool diskqueue_can_merge(struct disk_request* last, struct disk_request* next, int total)
+{
+    return next->write == last->write &&
+        next->lba == last->lba + last->total &&
+        total + next->total <= ata_max_sectors(last->disk->private, true) &&
+        idedma_can_use_buffer(last->buf, last->total * PEACHOS_SECTOR_SIZE) &&
+        idedma_can_use_buffer(next->buf, next->total * PEACHOS_SECTOR_SIZE);
+}
+
+static void diskqueue_complete_active(struct ata_channel* channel, int status)
+{
+    struct disk_request* request = channel->active;
+    channel->active = 0;
+    while (request)
+    {
+        struct disk_request* next = request->next;
+        request->next = 0;
+        request->status = status;
+        request->done = true;
+        if (request->complete)
+        {
+            request->complete(request);
+        }
+        request = next;
+    }
+}
+
+/**
+ * The drive whose queue the channel serves next, the one that did not go last wins a tie.
+ * Returns -1 when neither drive has anything it may start
+ */
+static int diskqueue_next_drive(struct ata_channel* channel)
+{
+    for (int i = 1; i <= ATA_DRIVES_PER_CHANNEL; i++)
+    {
+        int drive = (channel->active_drive + i) % ATA_DRIVES_PER_CHANNEL;
+        struct disk* disk = channel->disks[drive];
+        if (!disk)
+        {
+            continue;
+        }
+
+        struct disk_queue* queue = &diskqueue_device(disk)->queue;
+        if (!queue->plugged && queue->pending)
+        {
+            return drive;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Starts the next pending request on the channel, merging every request queued for the same
+ * drive that continues where it ends
+ */
+static void diskqueue_start_next(struct ata_channel* channel)
+{
+    while (!channel->active)
+    {
+        int drive = diskqueue_next_drive(channel);
+        if (drive < 0)
+        {
+            break;
+        }
+
+        struct ata_device* device = diskqueue_device(channel->disks[drive]);
+        struct disk_queue* queue = &device->queue;
+        struct disk_request* first = queue->pending;
+        struct disk_request* last = first;
+        int total = first->total;
+        while (last->next && diskqueue_can_merge(last, last->next, total))
+        {
+            total += last->next->total;
+            last = last->next;
+        }
+
+        queue->pending = last->next;
+        last->next = 0;
+        channel->active = first;
+        channel->active_drive = drive;
+        queue->head_lba = first->lba + total;
+
+        int res = idedma_start(device, first->lba, total, first);
+        if (res < 0)
+        {
+            diskqueue_complete_active(channel, res);
+        }
+    }
+}
+
+void diskqueue_submit(struct disk_request* request)
+{
+    struct ata_device* device = diskqueue_device(request->disk);
+    request->done = false;
+    request->status = 0;
+    diskqueue_insert(&device->queue, request);
+    diskqueue_start_next(device->channel);
+}
+
+void diskqueue_plug(struct disk* disk)
+{
+    diskqueue_device(disk)->queue.plugged++;
+}
+
+void diskqueue_unplug(struct disk* disk)
+{
+    struct ata_device* device = diskqueue_device(disk);
+    device->queue.plugged--;
+    diskqueue_start_next(device->channel);
+}
+
+/**
+ * Called when the channel raises its IRQ
+ */
+void diskqueue_interrupt(struct ata_channel* channel)
+{
+    if (!channel->active || !idedma_transfer_done(channel))
+    {
+        return;
+    }
+
+    diskqueue_complete_active(channel, idedma_finish(channel, channel->active));
+    diskqueue_start_next(channel);
+}
+
+/**
+ * Checks the channel of the disk by hand, for boot when nothing can block on the IRQ
+ */
+void diskqueue_poll(struct disk* disk)
+{
+    diskqueue_interrupt(diskqueue_device(disk)->channel);
+}
+
+/**
+ * True when the disk's channel has no command in flight and nothing waiting for either drive,
+ * programmed I/O may use it then
+ */
+bool diskqueue_idle(struct disk* disk)
+{
+    struct ata_channel* channel = diskqueue_device(disk)->channel;
+    if (channel->active)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < ATA_DRIVES_PER_CHANNEL; i++)
+    {
+        if (channel->disks[i] && diskqueue_device(channel->disks[i])->queue.pending)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void diskqueue_wake_waiter(struct disk_request* request)
+{
+    if (request->waiter)
+    {
+        task_wake(request->waiter);
+    }
+}
+
+/**
+ * Queues a transfer and waits for it. Tasks are blocked so others can run until the channel's IRQ completes
+ * the request, during boot there is nothing else to run so the controller is polled instead
+ */
+static int diskqueue_transfer(struct disk* disk, unsigned int lba, int total, void* buf, bool write)
+{
+    struct disk_request request;
+    request.disk = disk;
+    request.lba = lba;
+    request.total = total;
+    request.buf = buf;
+    request.write = write;
+    request.complete = diskqueue_wake_waiter;
+    request.waiter = task_can_block() ? task_current() : 0;
+    request.private = 0;
+    request.next = 0;
+    diskqueue_submit(&request);
+
+    int polls = 0;
+    while (!request.done)
+    {
+        if (request.waiter)
+        {
+            task_block();
+            continue;
+        }
+
+        struct ata_channel* channel = diskqueue_device(disk)->channel;
+        diskqueue_interrupt(channel);
+        if (++polls > DISKQUEUE_TIMEOUT_POLLS && channel->active)
+        {
+            // The controller never finished, stop it and fail whatever it was doing
+            idedma_finish(channel, channel->active);
+            diskqueue_complete_active(channel, -EIO);
+            diskqueue_start_next(channel);
+            polls = 0;
+        }
+    }
+
+    return request.status;
+}
+
+int diskqueue_read(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    return diskqueue_transfer(disk, lba, total, buf, false);
+}
+
+int diskqueue_write(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    return diskqueue_transfer(disk, lba, total, buf, true);
+}
@@ -0,0 +1,61 @@
+#ifndef DISKQUEUE_H
+#define DISKQUEUE_H
+
+#include <stdbool.h>
+
+struct disk;
+struct task;
+struct disk_request;
+
+typedef void (*DISK_REQUEST_COMPLETE_FUNCTION)(struct disk_request* request);
+
+struct disk_request
+{
+    struct disk* disk;
+    unsigned int lba;
+    int total;
+    void* buf;
+    // Writes buf to the disk instead of reading into it
+    bool write;
+
+    // Filled in when the request completes
+    int status;
+    bool done;
+
+    // Called from the IRQ14 handler, or the poll loop during boot, once the data has arrived
+    DISK_REQUEST_COMPLETE_FUNCTION complete;
+
+    // The task that is blocked on this request
+    struct task* waiter;
+
+    // Free for the submitter to use
+    void* private;
+
+    struct disk_request* next;
+};
+
+struct ata_channel;
+
+// Every ATA disk has one, the channel takes requests from the queues of both its drives in turn
+struct disk_queue
+{
+    // Requests waiting for the drive, in elevator order
+    struct disk_request* pending;
+
+    // Where the drive will be once its last started command is done
+    unsigned int head_lba;
+
+    // While plugged new requests are only queued, so a batch can be merged before it starts
+    int plugged;
+};
+
+void diskqueue_submit(struct disk_request* request);
+void diskqueue_interrupt(struct ata_channel* channel);
+void diskqueue_poll(struct disk* disk);
+void diskqueue_plug(struct disk* disk);
+void diskqueue_unplug(struct disk* disk);
+bool diskqueue_idle(struct disk* disk);
+int diskqueue_read(struct disk* disk, unsigned int lba, int total, void* buf);
+int diskqueue_write(struct disk* disk, unsigned int lba, int total, void* buf);
+
+#endif
@@ -0,0 +1,68 @@
+#include "ramdisk.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+
+// disk_read_hardware and disk_write_hardware keep every transfer inside the disk
+static int ramdisk_read(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    char* sectors = disk->private;
+    memcpy(buf, sectors + (lba * disk->sector_size), total * disk->sector_size);
+    return 0;
+}
+
+static int ramdisk_write(struct disk* disk, unsigned int lba, int total, void* buf)
+{
+    char* sectors = disk->private;
+    memcpy(sectors + (lba * disk->sector_size), buf, total * disk->sector_size);
+    return 0;
+}
+
+static const struct disk_ops ramdisk_ops =
+{
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    // Caching it would only copy the sectors twice
+    .cached = false
+};
+
+/**
+ * Creates a zeroed disk held in the kernel heap, it still has to be registered
+ */
+struct disk* ramdisk_create(int id, uint32_t total_sectors)
+{
+    int res = 0;
+    struct disk* disk = kzalloc(sizeof(struct disk));
+    if (!disk)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    disk->private = kzalloc(total_sectors * PEACHOS_SECTOR_SIZE);
+    if (!disk->private)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    disk->type = PEACHOS_DISK_TYPE_RAM;
+    disk->sector_size = PEACHOS_SECTOR_SIZE;
+    disk->total_sectors = total_sectors;
+    disk->ops = &ramdisk_ops;
+    disk->id = id;
+
+out:
+    if (res < 0)
+    {
+        if (disk)
+        {
+            kfree(disk->private);
+        }
+        kfree(disk);
+        return ERROR(res);
+    }
+    return disk;
+}
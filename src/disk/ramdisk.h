@@ -0,0 +1,9 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "disk.h"
+
+struct disk* ramdisk_create(int id, uint32_t total_sectors);
+
+#endif
@@ -4,6 +4,8 @@
 #include "disk/disk.h"
 #include "status.h" 
 #include "kernel.h"
+#include "memory/memory.h"
+#include "disk/cache.h"
 
 #include <stdbool.h>
 struct disk_stream* diskstreamer_new(int disk_id)
@@ -17,47 +19,184 @@ struct disk_stream* diskstreamer_new(int disk_id)
     struct disk_stream* streamer = kzalloc(sizeof(struct disk_stream));
     streamer->pos = 0;
     streamer->disk = disk;
+    streamer->readahead_pos = UINT64_MAX;
+    streamer->readahead_window = 0;
     return streamer;
 }
 
-int diskstreamer_seek(struct disk_stream* stream, int pos)
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos)
 {
+    if (pos != stream->readahead_pos)
+    {
+        // Random access, stop reading ahead until the stream is sequential again
+        stream->readahead_window = 0;
+    }
+
     stream->pos = pos;
     return 0;
 }
 
-int diskstreamer_read(struct disk_stream* stream, void* out, int total)
+/**
+ * Seeks to offset bytes past the start of the sector, the offset may reach beyond the sector
+ */
+int diskstreamer_seek_sector(struct disk_stream* stream, uint32_t sector, uint32_t offset)
 {
-    int sector = stream->pos / PEACHOS_SECTOR_SIZE;
-    int offset = stream->pos % PEACHOS_SECTOR_SIZE;
-    int total_to_read = total;
-    bool overflow = (offset+total_to_read) >= PEACHOS_SECTOR_SIZE;
-    char buf[PEACHOS_SECTOR_SIZE];
+    return diskstreamer_seek(stream, ((uint64_t) sector * PEACHOS_SECTOR_SIZE) + offset);
+}
 
-    if (overflow)
+/**
+ * Prefetches the sectors starting at the sector holding pos into the block cache
+ */
+void diskstreamer_readahead(struct disk_stream* stream, uint64_t pos, int sectors)
+{
+    diskcache_prefetch(stream->disk, pos / PEACHOS_SECTOR_SIZE, sectors);
+}
+
+static void diskstreamer_update_readahead(struct disk_stream* stream, uint64_t start)
+{
+    if (start != stream->readahead_pos)
     {
-        total_to_read -= (offset+total_to_read) - PEACHOS_SECTOR_SIZE;
+        stream->readahead_window = 0;
+        stream->readahead_pos = stream->pos;
+        return;
     }
 
-    int res = disk_read_block(stream->disk, sector, 1, buf);
-    if (res < 0)
+    stream->readahead_pos = stream->pos;
+    if (start / PEACHOS_SECTOR_SIZE == stream->pos / PEACHOS_SECTOR_SIZE)
     {
-        print("FAT16: Failed to read block\n");
-        goto out;
+        // Still inside the same sector, small reads don't need to look ahead every time
+        return;
     }
 
-   
-    for (int i = 0; i < total_to_read; i++)
+    if (!stream->readahead_window)
+    {
+        stream->readahead_window = PEACHOS_READAHEAD_MIN_SECTORS;
+    }
+    else if (stream->readahead_window < PEACHOS_READAHEAD_MAX_SECTORS)
+    {
+        stream->readahead_window *= 2;
+    }
+
+    diskstreamer_readahead(stream, stream->pos, stream->readahead_window);
+}
+
+int diskstreamer_read(struct disk_stream* stream, void* out, int total)
+{
+    int res = 0;
+    uint64_t start = stream->pos;
+    char* dst = out;
+    char buf[PEACHOS_SECTOR_SIZE];
+
+    while (total > 0)
     {
-        *(char*)out++ = buf[offset+i];
+        uint32_t sector = stream->pos / PEACHOS_SECTOR_SIZE;
+        int offset = stream->pos % PEACHOS_SECTOR_SIZE;
+        int total_to_read = 0;
+
+        if (offset == 0 && total >= PEACHOS_SECTOR_SIZE)
+        {
+            // Sector aligned, read as many whole sectors as we can straight into the caller's buffer
+            int sectors = total / PEACHOS_SECTOR_SIZE;
+            if (stream->disk->max_transfer_sectors && sectors > stream->disk->max_transfer_sectors)
+            {
+                sectors = stream->disk->max_transfer_sectors;
+            }
+
+            res = disk_read_block(stream->disk, sector, sectors, dst);
+            if (res < 0)
+            {
+                print("FAT16: Failed to read block\n");
+                goto out;
+            }
+            total_to_read = sectors * PEACHOS_SECTOR_SIZE;
+        }
+        else
+        {
+            // Unaligned head or a partial tail, go through the bounce sector
+            total_to_read = PEACHOS_SECTOR_SIZE - offset;
+            if (total_to_read > total)
+            {
+                total_to_read = total;
+            }
+
+            res = disk_read_block(stream->disk, sector, 1, buf);
+            if (res < 0)
+            {
+                print("FAT16: Failed to read block\n");
+                goto out;
+            }
+            memcpy(dst, &buf[offset], total_to_read);
+        }
+
+        // Adjust the stream
+        dst += total_to_read;
+        total -= total_to_read;
+        stream->pos += total_to_read;
     }
 
-    // Adjust the stream
-    stream->pos += total_to_read;
-    if (overflow)
+    diskstreamer_update_readahead(stream, start);
+out:
+    return res;
+}
+
+/**
+ * Writes through the block cache. Whole sectors are written as they are, a partial sector
+ * is read first so the bytes around the written range are kept
+ */
+int diskstreamer_write(struct disk_stream* stream, const void* in, int total)
+{
+    int res = 0;
+    const char* src = in;
+    char buf[PEACHOS_SECTOR_SIZE];
+
+    while (total > 0)
     {
-        res = diskstreamer_read(stream, out, total-total_to_read);
+        uint32_t sector = stream->pos / PEACHOS_SECTOR_SIZE;
+        int offset = stream->pos % PEACHOS_SECTOR_SIZE;
+        int total_to_write = 0;
+
+        if (offset == 0 && total >= PEACHOS_SECTOR_SIZE)
+        {
+            int sectors = total / PEACHOS_SECTOR_SIZE;
+            if (stream->disk->max_transfer_sectors && sectors > stream->disk->max_transfer_sectors)
+            {
+                sectors = stream->disk->max_transfer_sectors;
+            }
+
+            res = disk_write_block(stream->disk, sector, sectors, (void*) src);
+            if (res < 0)
+            {
+                goto out;
+            }
+            total_to_write = sectors * PEACHOS_SECTOR_SIZE;
+        }
+        else
+        {
+            total_to_write = PEACHOS_SECTOR_SIZE - offset;
+            if (total_to_write > total)
+            {
+                total_to_write = total;
+            }
+
+            res = disk_read_block(stream->disk, sector, 1, buf);
+            if (res < 0)
+            {
+                goto out;
+            }
+
+            memcpy(&buf[offset], (void*) src, total_to_write);
+            res = disk_write_block(stream->disk, sector, 1, buf);
+            if (res < 0)
+            {
+                goto out;
+            }
+        }
+
+        src += total_to_write;
+        total -= total_to_write;
+        stream->pos += total_to_write;
     }
+
 out:
     return res;
 }
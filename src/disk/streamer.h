@@ -2,16 +2,26 @@
 #define DISKSTREAMER_H
 
 #include "disk.h"
+#include <stdint.h>
 
 struct disk_stream
 {
-    int pos;
+    // Byte position on the disk, past 4 GiB on large volumes
+    uint64_t pos;
     struct disk* disk;
+
+    // Where the previous read ended, a read starting here is sequential
+    uint64_t readahead_pos;
+    // Sectors to read ahead of a sequential read, zero until the stream turns sequential
+    int readahead_window;
 };
 
 struct disk_stream* diskstreamer_new(int disk_id);
-int diskstreamer_seek(struct disk_stream* stream, int pos);
+int diskstreamer_seek(struct disk_stream* stream, uint64_t pos);
+int diskstreamer_seek_sector(struct disk_stream* stream, uint32_t sector, uint32_t offset);
 int diskstreamer_read(struct disk_stream* stream, void* out, int total);
+int diskstreamer_write(struct disk_stream* stream, const void* in, int total);
+void diskstreamer_readahead(struct disk_stream* stream, uint64_t pos, int sectors);
 void diskstreamer_close(struct disk_stream* stream);
 
 #endif
\ No newline at end of file
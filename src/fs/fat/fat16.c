@@ -2,16 +2,23 @@
 #include "string/string.h"
 #include "disk/disk.h"
 #include "disk/streamer.h"
+#include "disk/cache.h"
 #include "memory/heap/kheap.h"
 #include "memory/memory.h"
 #include "status.h"
 #include "kernel.h"
-#include "printf/printf.h"
+#include "trace/trace.h"
+#include "stats/stats.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 #define PEACHOS_FAT16_SIGNATURE 0x29
 #define PEACHOS_FAT16_FAT_ENTRY_SIZE 0x02
 #define PEACHOS_FAT16_BAD_SECTOR 0xFF7
+#define PEACHOS_FAT16_END_OF_CHAIN 0xFFF8
+// Written to the last FAT entry of a chain we allocate
+#define PEACHOS_FAT16_END_OF_CHAIN_MARK 0xFFFF
+#define PEACHOS_FAT16_FIRST_DATA_CLUSTER 2
 #define PEACHOS_FAT16_UNUSED 0x00
 
 typedef unsigned int FAT_ITEM_TYPE;
@@ -87,6 +94,11 @@ struct fat_directory
     int total;
     int sector_pos;
     int ending_sector_pos;
+
+    // Open addressed hash of the short names, each slot holds an item index plus one or zero
+    // when empty. NULL if the index could not be built, lookups then scan the items
+    uint16_t *index;
+    int index_size;
 };
 
 struct fat_item
@@ -99,10 +111,62 @@ struct fat_item
     FAT_ITEM_TYPE type;
 };
 
+// Remembers the last cluster found in a chain so the next lookup can carry on from there
+struct fat_cluster_cursor
+{
+    int first_cluster;
+    // Index of the cluster within the chain, zero is the first cluster
+    int index;
+    int cluster;
+};
+
 struct fat_file_descriptor
 {
     struct fat_item *item;
     uint32_t pos;
+    struct fat_cluster_cursor cursor;
+
+    // Where the previous read ended and how many sectors of the file to prefetch past it
+    uint32_t readahead_pos;
+    int readahead_window;
+
+    FILE_MODE mode;
+    struct disk *disk;
+    // Where the directory item of the file lives so size changes can be written back
+    uint32_t parent_cluster;
+    uint32_t item_pos;
+    // Set once the file has been written to, closing it then flushes the disk
+    bool dirty;
+};
+
+// Length of a short name in a directory entry, 8 name bytes followed by 3 extension bytes
+#define FAT16_SHORT_NAME_LENGTH 11
+
+/**
+ * Remembers the directory item a name resolved to inside a directory, or that it didn't resolve
+ */
+struct fat_dentry
+{
+    bool used;
+    // First cluster of the directory the name lives in, zero for the root directory
+    uint32_t parent_cluster;
+    char name[FAT16_SHORT_NAME_LENGTH];
+
+    // Set when the name is known not to exist
+    bool negative;
+    struct fat_directory_item item;
+
+    struct fat_dentry *hash_next;
+    struct fat_dentry *lru_prev;
+    struct fat_dentry *lru_next;
+};
+
+struct fat_dentry_cache
+{
+    struct fat_dentry entries[PEACHOS_FAT16_DENTRY_CACHE_SIZE];
+    struct fat_dentry *buckets[PEACHOS_FAT16_DENTRY_HASH_BUCKETS];
+    struct fat_dentry *lru_head;
+    struct fat_dentry *lru_tail;
 };
 
 struct fat_private
@@ -117,13 +181,26 @@ struct fat_private
 
     // Used in situations where we stream the directory
     struct disk_stream *directory_stream;
+
+    // The first file allocation table, loaded into memory when the filesystem is resolved
+    uint16_t *fat_table;
+    uint32_t fat_table_entries;
+
+    // Names already resolved on this disk, NULL if it could not be allocated
+    struct fat_dentry_cache *dentry_cache;
+
+    // Cluster the next free cluster search starts at
+    uint32_t free_cluster_hint;
 };
 
 int fat16_resolve(struct disk *disk);
-void *fat16_open(struct disk *disk, struct path_part *path, FILE_MODE mode);
+void *fat16_open(struct disk *disk, struct path_root *path, FILE_MODE mode);
 int fat16_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr);
+int fat16_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt);
+int fat16_write(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, const char *in);
 int fat16_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode);
 int fat16_stat(struct disk* disk, void* private, struct file_stat* stat);
+int fat16_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max);
 int fat16_close(void* private);
 
 struct filesystem fat16_fs =
@@ -131,8 +208,11 @@ struct filesystem fat16_fs =
         .resolve = fat16_resolve,
         .open = fat16_open,
         .read = fat16_read,
+        .readv = fat16_readv,
+        .write = fat16_write,
         .seek = fat16_seek,
         .stat = fat16_stat,
+        .readdir = fat16_readdir,
         .close = fat16_close
     };
 
@@ -202,12 +282,71 @@ out:
     return res;
 }
 
+/**
+ * FNV-1a over an upper case short name, seed lets callers mix in more of the key
+ */
+static uint32_t fat16_short_name_hash(const char *name, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (int i = 0; i < FAT16_SHORT_NAME_LENGTH; i++)
+    {
+        hash = (hash ^ (uint8_t)toupper(name[i])) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t fat16_dentry_hash(uint32_t parent_cluster, const char *name)
+{
+    return fat16_short_name_hash(name, parent_cluster) & (PEACHOS_FAT16_DENTRY_HASH_BUCKETS - 1);
+}
+
+static bool fat16_directory_item_is_searchable(struct fat_directory_item *item)
+{
+    return item->filename[0] != 0xE5 && !(item->attribute & FAT_FILE_VOLUME_LABEL);
+}
+
+/**
+ * Builds the name index of a directory that has just been loaded. A directory we fail to
+ * index still works, it is just searched item by item
+ */
+static void fat16_index_directory(struct fat_directory *directory)
+{
+    int size = 16;
+    while (size < directory->total * 2)
+    {
+        size *= 2;
+    }
+
+    directory->index = kzalloc(size * sizeof(uint16_t));
+    if (!directory->index)
+    {
+        return;
+    }
+    directory->index_size = size;
+
+    for (int i = 0; i < directory->total; i++)
+    {
+        struct fat_directory_item *item = &directory->item[i];
+        if (!fat16_directory_item_is_searchable(item))
+        {
+            continue;
+        }
+
+        uint32_t slot = fat16_short_name_hash((const char *)item->filename, 0) & (size - 1);
+        while (directory->index[slot])
+        {
+            slot = (slot + 1) & (size - 1);
+        }
+        directory->index[slot] = i + 1;
+    }
+}
+
 int fat16_get_root_directory(struct disk *disk, struct fat_private *fat_private, struct fat_directory *directory)
 {
     int res = 0;
     struct fat_directory_item *dir = 0x00;
     struct fat_header *primary_header = &fat_private->header.primary_header;
-    printf(" fat_copies %d, sectors_per_fat %d, res %d\n", primary_header->fat_copies, primary_header->sectors_per_fat, primary_header->reserved_sectors);
     int root_dir_sector_pos = (primary_header->fat_copies * primary_header->sectors_per_fat) + primary_header->reserved_sectors;
     int root_dir_entries = fat_private->header.primary_header.root_dir_entries;
     int root_dir_size = (root_dir_entries * sizeof(struct fat_directory_item));
@@ -219,7 +358,7 @@ int fat16_get_root_directory(struct disk *disk, struct fat_private *fat_private,
 
     int total_items = fat16_get_total_items_for_directory(disk, root_dir_sector_pos);
 
-    printf(" Total items: %d\n", total_items);
+    TRACE(TRACE_EVENT_FS_MOUNT, disk->id, root_dir_sector_pos, total_items);
     dir = kzalloc(root_dir_size);
     if (!dir)
     {
@@ -247,6 +386,7 @@ int fat16_get_root_directory(struct disk *disk, struct fat_private *fat_private,
     directory->total = total_items;
     directory->sector_pos = root_dir_sector_pos;
     directory->ending_sector_pos = root_dir_sector_pos + total_sectors;
+    fat16_index_directory(directory);
 out:
     return res;
 
@@ -258,6 +398,182 @@ err_out:
 
     return res;
 }
+static void fat16_dentry_lru_unlink(struct fat_dentry_cache *cache, struct fat_dentry *dentry)
+{
+    if (dentry->lru_prev)
+    {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    }
+    else
+    {
+        cache->lru_head = dentry->lru_next;
+    }
+
+    if (dentry->lru_next)
+    {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    }
+    else
+    {
+        cache->lru_tail = dentry->lru_prev;
+    }
+
+    dentry->lru_prev = 0;
+    dentry->lru_next = 0;
+}
+
+static void fat16_dentry_lru_push_head(struct fat_dentry_cache *cache, struct fat_dentry *dentry)
+{
+    dentry->lru_prev = 0;
+    dentry->lru_next = cache->lru_head;
+    if (cache->lru_head)
+    {
+        cache->lru_head->lru_prev = dentry;
+    }
+    cache->lru_head = dentry;
+
+    if (!cache->lru_tail)
+    {
+        cache->lru_tail = dentry;
+    }
+}
+
+static void fat16_dentry_cache_init(struct fat_private *private)
+{
+    struct fat_dentry_cache *cache = kzalloc(sizeof(struct fat_dentry_cache));
+    if (!cache)
+    {
+        print("FAT16: No dentry cache, every lookup will scan directories\n");
+        return;
+    }
+
+    for (int i = 0; i < PEACHOS_FAT16_DENTRY_CACHE_SIZE; i++)
+    {
+        fat16_dentry_lru_push_head(cache, &cache->entries[i]);
+    }
+
+    private->dentry_cache = cache;
+}
+
+static struct fat_dentry *fat16_dentry_lookup(struct fat_private *private, uint32_t parent_cluster, const char *name)
+{
+    struct fat_dentry_cache *cache = private->dentry_cache;
+    if (!cache)
+    {
+        return 0;
+    }
+
+    struct fat_dentry *dentry = cache->buckets[fat16_dentry_hash(parent_cluster, name)];
+    while (dentry)
+    {
+        if (dentry->parent_cluster == parent_cluster && memcmp(dentry->name, (void *)name, FAT16_SHORT_NAME_LENGTH) == 0)
+        {
+            if (cache->lru_head != dentry)
+            {
+                fat16_dentry_lru_unlink(cache, dentry);
+                fat16_dentry_lru_push_head(cache, dentry);
+            }
+            return dentry;
+        }
+        dentry = dentry->hash_next;
+    }
+
+    return 0;
+}
+
+static void fat16_dentry_hash_remove(struct fat_dentry_cache *cache, struct fat_dentry *dentry)
+{
+    struct fat_dentry **link = &cache->buckets[fat16_dentry_hash(dentry->parent_cluster, dentry->name)];
+    while (*link)
+    {
+        if (*link == dentry)
+        {
+            *link = dentry->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+
+    dentry->hash_next = 0;
+    dentry->used = false;
+}
+
+/**
+ * Remembers what a name resolved to, item is NULL for a name that does not exist
+ */
+static void fat16_dentry_insert(struct fat_private *private, uint32_t parent_cluster, const char *name, struct fat_directory_item *item)
+{
+    struct fat_dentry_cache *cache = private->dentry_cache;
+    if (!cache)
+    {
+        return;
+    }
+
+    // A name we already know about is updated in place
+    struct fat_dentry *dentry = fat16_dentry_lookup(private, parent_cluster, name);
+    if (!dentry)
+    {
+        dentry = cache->lru_tail;
+        if (dentry->used)
+        {
+            fat16_dentry_hash_remove(cache, dentry);
+        }
+
+        dentry->used = true;
+        dentry->parent_cluster = parent_cluster;
+        memcpy(dentry->name, (void *)name, FAT16_SHORT_NAME_LENGTH);
+
+        uint32_t bucket = fat16_dentry_hash(parent_cluster, name);
+        dentry->hash_next = cache->buckets[bucket];
+        cache->buckets[bucket] = dentry;
+
+        fat16_dentry_lru_unlink(cache, dentry);
+        fat16_dentry_lru_push_head(cache, dentry);
+    }
+
+    dentry->negative = item == 0;
+    if (item)
+    {
+        memcpy(&dentry->item, item, sizeof(dentry->item));
+    }
+}
+
+static int fat16_load_fat_table(struct disk *disk, struct fat_private *fat_private)
+{
+    int res = 0;
+    struct fat_header *primary_header = &fat_private->header.primary_header;
+    uint32_t fat_size = primary_header->sectors_per_fat * disk->sector_size;
+    uint16_t *fat_table = kzalloc(fat_size);
+    if (!fat_table)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    struct disk_stream *stream = fat_private->fat_read_stream;
+    if (diskstreamer_seek(stream, primary_header->reserved_sectors * disk->sector_size) != PEACHOS_ALL_OK)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    if (diskstreamer_read(stream, fat_table, fat_size) != PEACHOS_ALL_OK)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    fat_private->fat_table = fat_table;
+    fat_private->fat_table_entries = fat_size / PEACHOS_FAT16_FAT_ENTRY_SIZE;
+
+out:
+    if (res < 0)
+    {
+        kfree(fat_table);
+    }
+    return res;
+}
+
 int fat16_resolve(struct disk *disk)
 {
     int res = 0;
@@ -282,9 +598,8 @@ int fat16_resolve(struct disk *disk)
         goto out;
     }
 
-    printf(" Header: %d\n", fat_private->header.primary_header.bytes_per_sector);
-
-    if (fat_private->header.shared.extended_header.signature != 0x29)
+    // FAT32 keeps its FAT size further on in the header and leaves this one zero
+    if (fat_private->header.primary_header.sectors_per_fat == 0 || fat_private->header.shared.extended_header.signature != 0x29)
     {
         res = -EFSNOTUS;
         print("FAT16: Invalid signature\n");
@@ -298,15 +613,24 @@ int fat16_resolve(struct disk *disk)
         goto out;
     }
 
+    if (fat16_load_fat_table(disk, fat_private) != PEACHOS_ALL_OK)
+    {
+        // Not fatal, the FAT will be read from the disk instead
+        print("FAT16: Failed to load the FAT into memory\n");
+    }
+
+    fat16_dentry_cache_init(fat_private);
+
 out:
     if (stream)
     {
         diskstreamer_close(stream);
-        print("FAT16: Closed stream\n");
     }
 
     if (res < 0)
     {
+        kfree(fat_private->fat_table);
+        kfree(fat_private->dentry_cache);
         kfree(fat_private);
         disk->fs_private = 0;
         print("FAT16: Failed to resolve filesystem\n");
@@ -343,7 +667,6 @@ void fat16_get_full_relative_filename(struct fat_directory_item *item, char *out
         *out_tmp++ = '.';
         fat16_to_proper_string(&out_tmp, (const char *)item->ext, sizeof(item->ext));
     }
-    printf("out_tmp: %s\n", out);
 }
 
 struct fat_directory_item *fat16_clone_directory_item(struct fat_directory_item *item, int size)
@@ -383,6 +706,17 @@ static int fat16_get_fat_entry(struct disk *disk, int cluster)
 {
     int res = -1;
     struct fat_private *private = disk->fs_private;
+    if (private->fat_table)
+    {
+        if (cluster < 0 || cluster >= private->fat_table_entries)
+        {
+            goto out;
+        }
+
+        res = private->fat_table[cluster];
+        goto out;
+    }
+
     struct disk_stream *stream = private->fat_read_stream;
     if (!stream)
     {
@@ -407,20 +741,34 @@ static int fat16_get_fat_entry(struct disk *disk, int cluster)
 out:
     return res;
 }
+static void fat16_cursor_init(struct fat_cluster_cursor *cursor, int first_cluster)
+{
+    cursor->first_cluster = first_cluster;
+    cursor->index = 0;
+    cursor->cluster = first_cluster;
+}
+
 /**
- * Gets the correct cluster to use based on the starting cluster and the offset
+ * Gets the correct cluster to use based on the offset. The walk starts from the cluster the cursor
+ * was last left at when the offset is at or after it, so sequential reads only follow one link per cluster
  */
-static int fat16_get_cluster_for_offset(struct disk *disk, int starting_cluster, int offset)
+static int fat16_get_cluster_for_offset(struct disk *disk, struct fat_cluster_cursor *cursor, int offset)
 {
     int res = 0;
     struct fat_private *private = disk->fs_private;
     int size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
-    int cluster_to_use = starting_cluster;
     int clusters_ahead = offset / size_of_cluster_bytes;
-    for (int i = 0; i < clusters_ahead; i++)
+    if (clusters_ahead < cursor->index)
+    {
+        fat16_cursor_init(cursor, cursor->first_cluster);
+    }
+
+    int cluster_to_use = cursor->cluster;
+    for (int i = cursor->index; i < clusters_ahead; i++)
     {
         int entry = fat16_get_fat_entry(disk, cluster_to_use);
-        if (entry == 0xFFf8 || entry == 0xFFFF)
+        STATS_INC(fat_chain_hops);
+        if (entry >= PEACHOS_FAT16_END_OF_CHAIN)
         {
             // We are at the last entry in the file
             res = -EIO;
@@ -448,57 +796,84 @@ static int fat16_get_cluster_for_offset(struct disk *disk, int starting_cluster,
         }
 
         cluster_to_use = entry;
+        cursor->index = i + 1;
+        cursor->cluster = cluster_to_use;
     }
 
     res = cluster_to_use;
 out:
     return res;
 }
-static int fat16_read_internal_from_stream(struct disk *disk, struct disk_stream *stream, int cluster, int offset, int total, void *out)
+/**
+ * Reads total bytes starting at offset of the cluster chain. Clusters that follow each other on
+ * the disk are coalesced into one run and streamed with a single read
+ */
+static int fat16_read_internal_from_stream(struct disk *disk, struct disk_stream *stream, struct fat_cluster_cursor *cursor, int offset, int total, void *out)
 {
     int res = 0;
+    char *out_ptr = out;
     struct fat_private *private = disk->fs_private;
     int size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
-    int cluster_to_use = fat16_get_cluster_for_offset(disk, cluster, offset);
-    if (cluster_to_use < 0)
+    while (total > 0)
     {
-        res = cluster_to_use;
-        goto out;
-    }
+        int cluster_to_use = fat16_get_cluster_for_offset(disk, cursor, offset);
+        if (cluster_to_use < 0)
+        {
+            res = cluster_to_use;
+            goto out;
+        }
 
-    int offset_from_cluster = offset % size_of_cluster_bytes;
+        int offset_from_cluster = offset % size_of_cluster_bytes;
 
-    int starting_sector = fat16_cluster_to_sector(private, cluster_to_use);
-    int starting_pos = (starting_sector * disk->sector_size) + offset_from_cluster;
-    int total_to_read = total > size_of_cluster_bytes ? size_of_cluster_bytes : total;
-    res = diskstreamer_seek(stream, starting_pos);
-    if (res != PEACHOS_ALL_OK)
-    {
-        goto out;
-    }
+        // Extend the run for as long as the next cluster in the chain is the next one on the disk
+        int run_clusters = 1;
+        int last_cluster = cluster_to_use;
+        while ((run_clusters * size_of_cluster_bytes) - offset_from_cluster < total)
+        {
+            int entry = fat16_get_fat_entry(disk, last_cluster);
+            if (entry != last_cluster + 1)
+            {
+                break;
+            }
+
+            last_cluster = entry;
+            run_clusters++;
+        }
 
-    res = diskstreamer_read(stream, out, total_to_read);
-    if (res != PEACHOS_ALL_OK)
-    {
-        goto out;
-    }
+        int run_bytes = (run_clusters * size_of_cluster_bytes) - offset_from_cluster;
+        int total_to_read = total > run_bytes ? run_bytes : total;
+        int starting_sector = fat16_cluster_to_sector(private, cluster_to_use);
+        int starting_pos = (starting_sector * disk->sector_size) + offset_from_cluster;
+        res = diskstreamer_seek(stream, starting_pos);
+        if (res != PEACHOS_ALL_OK)
+        {
+            goto out;
+        }
 
-    total -= total_to_read;
-    if (total > 0)
-    {
-        // We still have more to read
-        res = fat16_read_internal_from_stream(disk, stream, cluster, offset + total_to_read, total, out + total_to_read);
+        res = diskstreamer_read(stream, out_ptr, total_to_read);
+        if (res != PEACHOS_ALL_OK)
+        {
+            goto out;
+        }
+
+        // The cursor now sits on the last cluster of the run
+        cursor->index += run_clusters - 1;
+        cursor->cluster = last_cluster;
+
+        out_ptr += total_to_read;
+        offset += total_to_read;
+        total -= total_to_read;
     }
 
 out:
     return res;
 }
 
-static int fat16_read_internal(struct disk *disk, int starting_cluster, int offset, int total, void *out)
+static int fat16_read_internal(struct disk *disk, struct fat_cluster_cursor *cursor, int offset, int total, void *out)
 {
     struct fat_private *fs_private = disk->fs_private;
     struct disk_stream *stream = fs_private->cluster_read_stream;
-    return fat16_read_internal_from_stream(disk, stream, starting_cluster, offset, total, out);
+    return fat16_read_internal_from_stream(disk, stream, cursor, offset, total, out);
 }
 
 void fat16_free_directory(struct fat_directory *directory)
@@ -513,6 +888,7 @@ void fat16_free_directory(struct fat_directory *directory)
         kfree(directory->item);
     }
 
+    kfree(directory->index);
     kfree(directory);
 }
 
@@ -530,18 +906,11 @@ void fat16_fat_item_free(struct fat_item *item)
     kfree(item);
 }
 
-struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_directory_item *item)
+static struct fat_directory *fat16_load_directory_at_cluster(struct disk *disk, int cluster)
 {
     int res = 0;
     struct fat_directory *directory = 0;
     struct fat_private *fat_private = disk->fs_private;
-    if (!(item->attribute & FAT_FILE_SUBDIRECTORY))
-    {
-        res = -EINVARG;
-        print("FAT16: Not a directory\n");
-        goto out;
-    }
-
     directory = kzalloc(sizeof(struct fat_directory));
     if (!directory)
     {
@@ -550,7 +919,6 @@ struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_dir
         goto out;
     }
 
-    int cluster = fat16_get_first_cluster(item);
     int cluster_sector = fat16_cluster_to_sector(fat_private, cluster);
     int total_items = fat16_get_total_items_for_directory(disk, cluster_sector);
     directory->total = total_items;
@@ -563,20 +931,36 @@ struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_dir
         goto out;
     }
 
-    res = fat16_read_internal(disk, cluster, 0x00, directory_size, directory->item);
+    struct fat_cluster_cursor cursor;
+    fat16_cursor_init(&cursor, cluster);
+    res = fat16_read_internal(disk, &cursor, 0x00, directory_size, directory->item);
     if (res != PEACHOS_ALL_OK)
     {
         print("FAT16: Failed to read directory items\n");
         goto out;
     }
 
+    fat16_index_directory(directory);
+
 out:
     if (res != PEACHOS_ALL_OK)
     {
         fat16_free_directory(directory);
+        directory = 0;
     }
     return directory;
 }
+
+struct fat_directory *fat16_load_fat_directory(struct disk *disk, struct fat_directory_item *item)
+{
+    if (!(item->attribute & FAT_FILE_SUBDIRECTORY))
+    {
+        print("FAT16: Not a directory\n");
+        return 0;
+    }
+
+    return fat16_load_directory_at_cluster(disk, fat16_get_first_cluster(item));
+}
 struct fat_item *fat16_new_fat_item_for_directory_item(struct disk *disk, struct fat_directory_item *item)
 {
     struct fat_item *f_item = kzalloc(sizeof(struct fat_item));
@@ -587,7 +971,13 @@ struct fat_item *fat16_new_fat_item_for_directory_item(struct disk *disk, struct
 
     if (item->attribute & FAT_FILE_SUBDIRECTORY)
     {
+        // A NULL directory stands for the root directory, a subdirectory has to load
         f_item->directory = fat16_load_fat_directory(disk, item);
+        if (!f_item->directory)
+        {
+            kfree(f_item);
+            return 0;
+        }
         f_item->type = FAT_ITEM_TYPE_DIRECTORY;
         return f_item;
     }
@@ -597,80 +987,650 @@ struct fat_item *fat16_new_fat_item_for_directory_item(struct disk *disk, struct
     return f_item;
 }
 
-struct fat_item *fat16_find_item_in_directory(struct disk *disk, struct fat_directory *directory, const char *name)
+/**
+ * Converts a path component into the blank padded, upper case 8.3 form stored on disk.
+ * Returns false if the name can not be a short name
+ */
+static bool fat16_name_to_short_name(const struct path_part *name, char *out)
 {
-    struct fat_item *f_item = 0;
-    char tmp_filename[PEACHOS_MAX_PATH];
-    for (int i = 0; i < directory->total; i++)
+    memset(out, ' ', FAT16_SHORT_NAME_LENGTH);
+    const char *str = name->part;
+    int i = 0;
+    int len = 0;
+    while (i < name->len && str[i] != '.')
     {
-        fat16_get_full_relative_filename(&directory->item[i], tmp_filename, sizeof(tmp_filename));
-        if (istrncmp(tmp_filename, name, sizeof(tmp_filename)) == 0)
+        if (len >= 8)
         {
-            // Found it let's create a new fat_item
-            f_item = fat16_new_fat_item_for_directory_item(disk, &directory->item[i]);
+            return false;
         }
+        out[len++] = toupper(str[i++]);
     }
 
-    return f_item;
-}
-struct fat_item *fat16_get_directory_entry(struct disk *disk, struct path_part *path)
-{
-    struct fat_private *fat_private = disk->fs_private;
-    struct fat_item *current_item = 0;
-    struct fat_item *root_item = fat16_find_item_in_directory(disk, &fat_private->root_directory, path->part);
-    if (!root_item)
+    if (len == 0)
     {
-        print("FAT16: Failed to find root item\n");
-        goto out;
+        return false;
     }
 
-    struct path_part *next_part = path->next;
-    current_item = root_item;
-    while (next_part != 0)
+    if (i < name->len)
     {
-        if (current_item->type != FAT_ITEM_TYPE_DIRECTORY)
+        i++;
+        len = 0;
+        while (i < name->len)
         {
-            current_item = 0;
-            break;
+            if (len >= 3 || str[i] == '.')
+            {
+                return false;
+            }
+            out[8 + len++] = toupper(str[i++]);
         }
-
-        struct fat_item *tmp_item = fat16_find_item_in_directory(disk, current_item->directory, next_part->part);
-        fat16_fat_item_free(current_item);
-        current_item = tmp_item;
-        next_part = next_part->next;
     }
-out:
-    return current_item;
+
+    return true;
 }
 
-void *fat16_open(struct disk *disk, struct path_part *path, FILE_MODE mode)
+static bool fat16_item_has_short_name(struct fat_directory_item *item, const char *short_name)
 {
-    struct fat_file_descriptor *descriptor = 0;
-    int err_code = 0;
-    if (mode != FILE_MODE_READ)
+    const char *raw = (const char *)item->filename;
+    for (int i = 0; i < FAT16_SHORT_NAME_LENGTH; i++)
     {
-        err_code = -ERDONLY;
-        print("FAT16: Only read mode is supported\n");
-        goto err_out;
+        if (toupper(raw[i]) != short_name[i])
+        {
+            return false;
+        }
     }
 
-    descriptor = kzalloc(sizeof(struct fat_file_descriptor));
-    if (!descriptor)
-    {
-        err_code = -ENOMEM;
-        print("FAT16: Failed to allocate file descriptor\n");
-        goto err_out;
-    }
+    return true;
+}
 
-    descriptor->item = fat16_get_directory_entry(disk, path);
-    if (!descriptor->item)
+/**
+ * Returns the first item in the directory that has the short name, NULL if there is none
+ */
+static struct fat_directory_item *fat16_search_directory(struct fat_directory *directory, const char *short_name)
+{
+    if (directory->index)
     {
-        err_code = -EIO;
-        print("FAT16: Failed to find file in directory\n");
-        goto err_out;
+        int mask = directory->index_size - 1;
+        uint32_t slot = fat16_short_name_hash(short_name, 0) & mask;
+        while (directory->index[slot])
+        {
+            struct fat_directory_item *item = &directory->item[directory->index[slot] - 1];
+            if (fat16_item_has_short_name(item, short_name))
+            {
+                return item;
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        return 0;
     }
 
-    descriptor->pos = 0;
+    for (int i = 0; i < directory->total; i++)
+    {
+        struct fat_directory_item *item = &directory->item[i];
+        if (fat16_directory_item_is_searchable(item) && fat16_item_has_short_name(item, short_name))
+        {
+            return item;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Resolves one path component inside the directory starting at parent_cluster, zero being
+ * the root directory. The dentry cache is consulted first and the directory is only read
+ * from the disk when the name has not been seen before
+ */
+static int fat16_lookup(struct disk *disk, uint32_t parent_cluster, const struct path_part *name, struct fat_directory_item *item_out)
+{
+    int res = 0;
+    struct fat_private *fat_private = disk->fs_private;
+    struct fat_directory *directory = 0;
+    char short_name[FAT16_SHORT_NAME_LENGTH];
+    if (!fat16_name_to_short_name(name, short_name))
+    {
+        res = -EBADPATH;
+        goto out;
+    }
+
+    struct fat_dentry *dentry = fat16_dentry_lookup(fat_private, parent_cluster, short_name);
+    if (dentry)
+    {
+        if (dentry->negative)
+        {
+            res = -EBADPATH;
+            goto out;
+        }
+
+        memcpy(item_out, &dentry->item, sizeof(*item_out));
+        goto out;
+    }
+
+    struct fat_directory *search = &fat_private->root_directory;
+    if (parent_cluster != 0)
+    {
+        directory = fat16_load_directory_at_cluster(disk, parent_cluster);
+        if (!directory)
+        {
+            res = -EIO;
+            goto out;
+        }
+        search = directory;
+    }
+
+    struct fat_directory_item *item = fat16_search_directory(search, short_name);
+    fat16_dentry_insert(fat_private, parent_cluster, short_name, item);
+    if (!item)
+    {
+        res = -EBADPATH;
+        goto out;
+    }
+
+    memcpy(item_out, item, sizeof(*item_out));
+
+out:
+    fat16_free_directory(directory);
+    return res;
+}
+
+struct fat_item *fat16_get_directory_entry(struct disk *disk, struct path_root *path)
+{
+    struct fat_directory_item item;
+    uint32_t parent_cluster = 0;
+    for (int i = 0; i < path->total; i++)
+    {
+        if (fat16_lookup(disk, parent_cluster, &path->parts[i], &item) < 0)
+        {
+            return 0;
+        }
+
+        if (i + 1 < path->total)
+        {
+            if (!(item.attribute & FAT_FILE_SUBDIRECTORY))
+            {
+                return 0;
+            }
+            parent_cluster = fat16_get_first_cluster(&item);
+        }
+    }
+
+    return fat16_new_fat_item_for_directory_item(disk, &item);
+}
+
+static int fat16_cluster_size(struct disk *disk)
+{
+    struct fat_private *private = disk->fs_private;
+    return private->header.primary_header.sectors_per_cluster * disk->sector_size;
+}
+
+/**
+ * Number of the first cluster past the end of the data area
+ */
+static uint32_t fat16_total_clusters(struct disk *disk)
+{
+    struct fat_private *private = disk->fs_private;
+    struct fat_header *header = &private->header.primary_header;
+    uint32_t total_sectors = header->number_of_sectors ? header->number_of_sectors : header->sectors_big;
+    uint32_t data_sectors = total_sectors - private->root_directory.ending_sector_pos;
+    uint32_t total = (data_sectors / header->sectors_per_cluster) + PEACHOS_FAT16_FIRST_DATA_CLUSTER;
+    if (total > private->fat_table_entries)
+    {
+        total = private->fat_table_entries;
+    }
+
+    return total;
+}
+
+/**
+ * Sets a FAT entry in memory and in every copy of the FAT on the disk
+ */
+static int fat16_set_fat_entry(struct disk *disk, int cluster, uint16_t value)
+{
+    int res = 0;
+    struct fat_private *private = disk->fs_private;
+    struct fat_header *header = &private->header.primary_header;
+    private->fat_table[cluster] = value;
+
+    for (int i = 0; i < header->fat_copies; i++)
+    {
+        uint32_t fat_sector = fat16_get_first_fat_sector(private) + (i * header->sectors_per_fat);
+        res = diskstreamer_seek(private->fat_read_stream, (fat_sector * disk->sector_size) + (cluster * PEACHOS_FAT16_FAT_ENTRY_SIZE));
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(private->fat_read_stream, &value, sizeof(value));
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Takes a free cluster and links it after prev, zero starts a new chain. Returns the cluster
+ */
+static int fat16_allocate_cluster(struct disk *disk, int prev)
+{
+    int res = -EIO;
+    struct fat_private *private = disk->fs_private;
+    if (!private->fat_table)
+    {
+        // Allocating needs the whole FAT in memory to search it
+        res = -EUNIMP;
+        goto out;
+    }
+
+    uint32_t total = fat16_total_clusters(disk);
+    uint32_t start = private->free_cluster_hint;
+    if (start < PEACHOS_FAT16_FIRST_DATA_CLUSTER || start >= total)
+    {
+        start = PEACHOS_FAT16_FIRST_DATA_CLUSTER;
+    }
+
+    // Start after the last cluster we handed out so files grow into neighbouring clusters
+    uint32_t cluster = start;
+    do
+    {
+        if (private->fat_table[cluster] == PEACHOS_FAT16_UNUSED)
+        {
+            res = fat16_set_fat_entry(disk, cluster, PEACHOS_FAT16_END_OF_CHAIN_MARK);
+            if (res < 0)
+            {
+                goto out;
+            }
+
+            if (prev)
+            {
+                res = fat16_set_fat_entry(disk, prev, cluster);
+                if (res < 0)
+                {
+                    goto out;
+                }
+            }
+
+            private->free_cluster_hint = cluster + 1;
+            res = cluster;
+            goto out;
+        }
+
+        cluster++;
+        if (cluster >= total)
+        {
+            cluster = PEACHOS_FAT16_FIRST_DATA_CLUSTER;
+        }
+    } while (cluster != start);
+
+    // The disk is full
+    res = -ENOMEM;
+out:
+    return res;
+}
+
+static int fat16_free_chain(struct disk *disk, int cluster)
+{
+    int res = 0;
+    struct fat_private *private = disk->fs_private;
+    if (!private->fat_table)
+    {
+        res = -EUNIMP;
+        goto out;
+    }
+
+    uint32_t total = fat16_total_clusters(disk);
+    while (cluster >= PEACHOS_FAT16_FIRST_DATA_CLUSTER && cluster < total)
+    {
+        int next = private->fat_table[cluster];
+        res = fat16_set_fat_entry(disk, cluster, PEACHOS_FAT16_UNUSED);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        if (cluster < private->free_cluster_hint)
+        {
+            private->free_cluster_hint = cluster;
+        }
+        cluster = next;
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Gets the position on the disk of the item at index in the directory starting at
+ * parent_cluster, zero being the root directory. Negative past the end of the directory
+ */
+static int fat16_directory_slot_position(struct disk *disk, uint32_t parent_cluster, struct fat_cluster_cursor *cursor, int index)
+{
+    struct fat_private *private = disk->fs_private;
+    int offset = index * sizeof(struct fat_directory_item);
+    if (parent_cluster == 0)
+    {
+        if (index >= private->header.primary_header.root_dir_entries)
+        {
+            return -EIO;
+        }
+
+        return (private->root_directory.sector_pos * disk->sector_size) + offset;
+    }
+
+    int cluster = fat16_get_cluster_for_offset(disk, cursor, offset);
+    if (cluster < 0)
+    {
+        return cluster;
+    }
+
+    return (fat16_cluster_to_sector(private, cluster) * disk->sector_size) + (offset % fat16_cluster_size(disk));
+}
+
+/**
+ * Scans the directory on the disk for the short name. Gives the position of the item when
+ * it is found, otherwise the position of the first free slot, growing a subdirectory by a
+ * cluster when it has none. Returns zero when the name was found
+ */
+static int fat16_find_directory_slot(struct disk *disk, uint32_t parent_cluster, const char *short_name, struct fat_directory_item *item_out, uint32_t *pos_out)
+{
+    int res = 0;
+    struct fat_private *private = disk->fs_private;
+    struct disk_stream *stream = private->directory_stream;
+    struct fat_cluster_cursor cursor;
+    fat16_cursor_init(&cursor, parent_cluster);
+
+    bool have_free = false;
+    int index = 0;
+    while (1)
+    {
+        int pos = fat16_directory_slot_position(disk, parent_cluster, &cursor, index);
+        if (pos < 0)
+        {
+            break;
+        }
+
+        struct fat_directory_item item;
+        res = diskstreamer_seek(stream, pos);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_read(stream, &item, sizeof(item));
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        if (item.filename[0] == 0x00 || item.filename[0] == 0xE5)
+        {
+            if (!have_free)
+            {
+                have_free = true;
+                *pos_out = pos;
+            }
+
+            if (item.filename[0] == 0x00)
+            {
+                // Nothing is stored past the end marker
+                break;
+            }
+        }
+        else if (fat16_directory_item_is_searchable(&item) && fat16_item_has_short_name(&item, short_name))
+        {
+            memcpy(item_out, &item, sizeof(item));
+            *pos_out = pos;
+            res = 0;
+            goto out;
+        }
+        index++;
+    }
+
+    res = -EBADPATH;
+    if (have_free)
+    {
+        goto out;
+    }
+
+    if (parent_cluster == 0)
+    {
+        // The root directory can't grow
+        res = -ENOMEM;
+        goto out;
+    }
+
+    // The cursor was left on the last cluster of the directory
+    int cluster = fat16_allocate_cluster(disk, cursor.cluster);
+    if (cluster < 0)
+    {
+        res = cluster;
+        goto out;
+    }
+
+    char zero[PEACHOS_SECTOR_SIZE];
+    memset(zero, 0, sizeof(zero));
+    int cluster_sector = fat16_cluster_to_sector(private, cluster);
+    for (int i = 0; i < private->header.primary_header.sectors_per_cluster; i++)
+    {
+        res = disk_write_block(disk, cluster_sector + i, 1, zero);
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+    *pos_out = cluster_sector * disk->sector_size;
+    res = -EBADPATH;
+out:
+    return res;
+}
+
+/**
+ * Writes a directory item back to the disk and keeps the copies we hold in memory in step
+ */
+static int fat16_write_directory_item(struct disk *disk, uint32_t parent_cluster, uint32_t pos, struct fat_directory_item *item)
+{
+    int res = 0;
+    struct fat_private *private = disk->fs_private;
+    res = diskstreamer_seek(private->directory_stream, pos);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = diskstreamer_write(private->directory_stream, item, sizeof(*item));
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (parent_cluster == 0)
+    {
+        struct fat_directory *root = &private->root_directory;
+        int index = (pos - (root->sector_pos * disk->sector_size)) / sizeof(struct fat_directory_item);
+        bool new_name = index >= root->total || !fat16_item_has_short_name(&root->item[index], (const char *)item->filename);
+        memcpy(&root->item[index], item, sizeof(*item));
+        if (new_name)
+        {
+            if (index >= root->total)
+            {
+                root->total = index + 1;
+            }
+
+            kfree(root->index);
+            root->index = 0;
+            fat16_index_directory(root);
+        }
+    }
+
+    fat16_dentry_insert(private, parent_cluster, (const char *)item->filename, item);
+out:
+    return res;
+}
+
+/**
+ * Opens a file for writing, creating it in its directory when it does not exist yet.
+ * Write mode truncates the file, append mode starts at its end
+ */
+static struct fat_item *fat16_open_for_write(struct disk *disk, struct path_root *path, struct fat_file_descriptor *descriptor)
+{
+    int res = 0;
+    struct fat_item *f_item = 0;
+    struct fat_directory_item item;
+    uint32_t parent_cluster = 0;
+    struct path_part *part = path->parts;
+    while (part != &path->parts[path->total - 1])
+    {
+        res = fat16_lookup(disk, parent_cluster, part, &item);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        if (!(item.attribute & FAT_FILE_SUBDIRECTORY))
+        {
+            res = -EBADPATH;
+            goto out;
+        }
+        parent_cluster = fat16_get_first_cluster(&item);
+        part++;
+    }
+
+    char short_name[FAT16_SHORT_NAME_LENGTH];
+    if (!fat16_name_to_short_name(part, short_name))
+    {
+        res = -EBADPATH;
+        goto out;
+    }
+
+    uint32_t pos = 0;
+    res = fat16_find_directory_slot(disk, parent_cluster, short_name, &item, &pos);
+    if (res == -EBADPATH)
+    {
+        memset(&item, 0, sizeof(item));
+        memcpy(item.filename, short_name, FAT16_SHORT_NAME_LENGTH);
+        item.attribute = FAT_FILE_ARCHIVED;
+        res = fat16_write_directory_item(disk, parent_cluster, pos, &item);
+    }
+    else if (res == 0)
+    {
+        if (item.attribute & (FAT_FILE_SUBDIRECTORY | FAT_FILE_VOLUME_LABEL))
+        {
+            res = -EINVARG;
+            goto out;
+        }
+
+        if (item.attribute & FAT_FILE_READ_ONLY)
+        {
+            res = -ERDONLY;
+            goto out;
+        }
+
+        if (descriptor->mode == FILE_MODE_WRITE && (item.filesize || fat16_get_first_cluster(&item)))
+        {
+            res = fat16_free_chain(disk, fat16_get_first_cluster(&item));
+            if (res < 0)
+            {
+                goto out;
+            }
+
+            item.high_16_bits_first_cluster = 0;
+            item.low_16_bits_first_cluster = 0;
+            item.filesize = 0;
+            res = fat16_write_directory_item(disk, parent_cluster, pos, &item);
+            descriptor->dirty = true;
+        }
+    }
+
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    f_item = kzalloc(sizeof(struct fat_item));
+    if (!f_item)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    f_item->type = FAT_ITEM_TYPE_FILE;
+    f_item->item = fat16_clone_directory_item(&item, sizeof(item));
+    if (!f_item->item)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    descriptor->parent_cluster = parent_cluster;
+    descriptor->item_pos = pos;
+out:
+    if (res < 0)
+    {
+        kfree(f_item);
+        f_item = ERROR(res);
+    }
+    return f_item;
+}
+
+void *fat16_open(struct disk *disk, struct path_root *path, FILE_MODE mode)
+{
+    struct fat_file_descriptor *descriptor = 0;
+    int err_code = 0;
+    descriptor = kzalloc(sizeof(struct fat_file_descriptor));
+    if (!descriptor)
+    {
+        err_code = -ENOMEM;
+        print("FAT16: Failed to allocate file descriptor\n");
+        goto err_out;
+    }
+
+    descriptor->mode = mode;
+    descriptor->disk = disk;
+    if (mode != FILE_MODE_READ)
+    {
+        descriptor->item = fat16_open_for_write(disk, path, descriptor);
+        if (ISERR(descriptor->item))
+        {
+            err_code = ERROR_I(descriptor->item);
+            print("FAT16: Failed to open file for writing\n");
+            goto err_out;
+        }
+    }
+    else if (path->total == 0)
+    {
+        // The root directory stays loaded in the private data, the item only points at it
+        descriptor->item = kzalloc(sizeof(struct fat_item));
+        if (!descriptor->item)
+        {
+            err_code = -ENOMEM;
+            goto err_out;
+        }
+        descriptor->item->type = FAT_ITEM_TYPE_DIRECTORY;
+    }
+    else
+    {
+        descriptor->item = fat16_get_directory_entry(disk, path);
+        if (!descriptor->item)
+        {
+            err_code = -EIO;
+            print("FAT16: Failed to find file in directory\n");
+            goto err_out;
+        }
+    }
+
+    descriptor->pos = 0;
+    if (mode == FILE_MODE_APPEND)
+    {
+        descriptor->pos = descriptor->item->item->filesize;
+    }
+    if (descriptor->item->type == FAT_ITEM_TYPE_FILE)
+    {
+        fat16_cursor_init(&descriptor->cursor, fat16_get_first_cluster(descriptor->item->item));
+    }
     return descriptor;
 
 err_out:
@@ -684,14 +1644,23 @@ static void fat16_free_file_descriptor(struct fat_file_descriptor* desc)
 {
     fat16_fat_item_free(desc->item);
     kfree(desc);
-    print("FAT16: Freed file descriptor\n");
 }
 
 
 int fat16_close(void* private)
 {
-    fat16_free_file_descriptor((struct fat_file_descriptor*) private);
-    print("FAT16: Closed file\n");
+    struct fat_file_descriptor* desc = private;
+    if (desc->dirty)
+    {
+        // Everything written to the file reaches the disk in one sorted batch
+        if (disk_flush(desc->disk) < 0)
+        {
+            print("FAT16: Failed to flush the disk\n");
+        }
+    }
+
+    TRACE(TRACE_EVENT_FS_CLOSE, desc->disk->id, desc->item->type, desc->dirty);
+    fat16_free_file_descriptor(desc);
     return 0;
 }
 
@@ -719,27 +1688,215 @@ out:
     return res;
 }
 
+/**
+ * Prefetches the clusters that follow a sequential read. The chain is walked with a copy
+ * of the cursor so the descriptor stays where the caller left it
+ */
+static void fat16_readahead(struct disk *disk, struct fat_file_descriptor *desc, uint32_t start)
+{
+    struct fat_private *private = disk->fs_private;
+    int size_of_cluster_bytes = private->header.primary_header.sectors_per_cluster * disk->sector_size;
+    if (start != desc->readahead_pos)
+    {
+        desc->readahead_window = 0;
+        desc->readahead_pos = desc->pos;
+        return;
+    }
+
+    desc->readahead_pos = desc->pos;
+    if (start / size_of_cluster_bytes == desc->pos / size_of_cluster_bytes)
+    {
+        // Still in the same cluster
+        return;
+    }
+
+    if (!desc->readahead_window)
+    {
+        desc->readahead_window = PEACHOS_READAHEAD_MIN_SECTORS;
+    }
+    else if (desc->readahead_window < PEACHOS_READAHEAD_MAX_SECTORS)
+    {
+        desc->readahead_window *= 2;
+    }
+
+    struct fat_cluster_cursor cursor = desc->cursor;
+    uint32_t filesize = desc->item->item->filesize;
+    uint32_t pos = desc->pos;
+    int sectors_left = desc->readahead_window;
+    while (sectors_left > 0 && pos < filesize)
+    {
+        int cluster = fat16_get_cluster_for_offset(disk, &cursor, pos);
+        if (cluster < 0)
+        {
+            break;
+        }
+
+        int offset_from_cluster = pos % size_of_cluster_bytes;
+        int sector = fat16_cluster_to_sector(private, cluster) + (offset_from_cluster / disk->sector_size);
+        int sectors = (size_of_cluster_bytes - offset_from_cluster + disk->sector_size - 1) / disk->sector_size;
+        if (sectors > sectors_left)
+        {
+            sectors = sectors_left;
+        }
+
+        diskcache_prefetch(disk, sector, sectors);
+        sectors_left -= sectors;
+        pos += size_of_cluster_bytes - offset_from_cluster;
+    }
+}
+
 int fat16_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr)
 {
     int res = 0;
     struct fat_file_descriptor *fat_desc = descriptor;
-    struct fat_directory_item *item = fat_desc->item->item;
-    int offset = fat_desc->pos;
-    for (uint32_t i = 0; i < nmemb; i++)
+    uint32_t total = size * nmemb;
+    if (nmemb != 0 && total / nmemb != size)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    // All the elements are contiguous in the file, so read them in one go
+    res = fat16_read_internal(disk, &fat_desc->cursor, fat_desc->pos, total, out_ptr);
+    if (ISERR(res))
     {
-        res = fat16_read_internal(disk, fat16_get_first_cluster(item), offset, size, out_ptr);
+        print("FAT16: Read error\n");
+        goto out;
+    }
+
+    uint32_t start = fat_desc->pos;
+    fat_desc->pos += total;
+    fat16_readahead(disk, fat_desc, start);
+    res = nmemb;
+out:
+    return res;
+}
+
+int fat16_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt)
+{
+    int res = 0;
+    struct fat_file_descriptor *fat_desc = descriptor;
+    uint32_t start = fat_desc->pos;
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len == 0)
+        {
+            continue;
+        }
+
+        // The cursor carries on from the previous buffer so no chain is walked twice
+        res = fat16_read_internal(disk, &fat_desc->cursor, fat_desc->pos, iov[i].len, iov[i].base);
         if (ISERR(res))
         {
             print("FAT16: Read error\n");
             goto out;
         }
 
-        out_ptr += size;
-        offset += size;
+        fat_desc->pos += iov[i].len;
+        total += iov[i].len;
+    }
+
+    fat16_readahead(disk, fat_desc, start);
+    res = total;
+out:
+    return res;
+}
+
+int fat16_write(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, const char *in)
+{
+    int res = 0;
+    struct fat_file_descriptor *fat_desc = descriptor;
+    struct fat_private *private = disk->fs_private;
+    struct fat_directory_item *item = fat_desc->item->item;
+    uint32_t total = size * nmemb;
+    if (fat_desc->mode == FILE_MODE_READ)
+    {
+        res = -ERDONLY;
+        goto out;
     }
-    fat_desc->pos = offset;
+
+    if (nmemb != 0 && total / nmemb != size)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (fat16_get_first_cluster(item) == 0)
+    {
+        int cluster = fat16_allocate_cluster(disk, 0);
+        if (cluster < 0)
+        {
+            res = cluster;
+            goto out;
+        }
+
+        item->high_16_bits_first_cluster = cluster >> 16;
+        item->low_16_bits_first_cluster = cluster & 0xffff;
+        fat16_cursor_init(&fat_desc->cursor, cluster);
+    }
+
+    // The data lands in the block cache, consecutive sectors are merged when it is flushed
+    int size_of_cluster_bytes = fat16_cluster_size(disk);
+    const char *in_ptr = in;
+    uint32_t left = total;
+    while (left > 0)
+    {
+        int cluster = fat16_get_cluster_for_offset(disk, &fat_desc->cursor, fat_desc->pos);
+        if (cluster < 0)
+        {
+            // Past the end of the chain, the cursor sits on its last cluster
+            res = fat16_allocate_cluster(disk, fat_desc->cursor.cluster);
+            if (res < 0)
+            {
+                goto out;
+            }
+            continue;
+        }
+
+        int offset_from_cluster = fat_desc->pos % size_of_cluster_bytes;
+        int total_to_write = size_of_cluster_bytes - offset_from_cluster;
+        if (total_to_write > left)
+        {
+            total_to_write = left;
+        }
+
+        int starting_pos = (fat16_cluster_to_sector(private, cluster) * disk->sector_size) + offset_from_cluster;
+        res = diskstreamer_seek(private->cluster_read_stream, starting_pos);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(private->cluster_read_stream, in_ptr, total_to_write);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        in_ptr += total_to_write;
+        left -= total_to_write;
+        fat_desc->pos += total_to_write;
+    }
+
+    if (fat_desc->pos > item->filesize)
+    {
+        item->filesize = fat_desc->pos;
+    }
+
+    fat_desc->dirty = true;
+    res = fat16_write_directory_item(disk, fat_desc->parent_cluster, fat_desc->item_pos, item);
+    if (res < 0)
+    {
+        goto out;
+    }
+
     res = nmemb;
 out:
+    if (res < 0)
+    {
+        print("FAT16: Write error\n");
+    }
     return res;
 }
 
@@ -756,13 +1913,17 @@ int fat16_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode)
     }
 
     struct fat_directory_item *ritem = desc_item->item;
-    if (offset >= ritem->filesize)
+    // The end of the file is where appending writes go
+    if (offset > ritem->filesize)
     {
         res = -EIO;
         print("FAT16: Offset exceeds file size\n");
         goto out;
     }
 
+    // Reading ahead only pays off for sequential reads
+    desc->readahead_window = 0;
+
     switch (seek_mode)
     {
     case SEEK_SET:
@@ -783,4 +1944,150 @@ int fat16_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode)
     }
 out:
     return res;
-}
\ No newline at end of file
+}
+
+static void fat16_dirent_from_item(struct fat_directory_item *item, struct file_dirent *dirent)
+{
+    fat16_get_full_relative_filename(item, dirent->name, sizeof(dirent->name));
+    dirent->size = item->filesize;
+    dirent->first_cluster = fat16_get_first_cluster(item);
+    dirent->attributes = 0;
+    if (item->attribute & FAT_FILE_SUBDIRECTORY)
+    {
+        dirent->attributes |= FILE_DIRENT_DIRECTORY;
+    }
+    if (item->attribute & FAT_FILE_READ_ONLY)
+    {
+        dirent->attributes |= FILE_DIRENT_READ_ONLY;
+    }
+    if (item->attribute & FAT_FILE_HIDDEN)
+    {
+        dirent->attributes |= FILE_DIRENT_HIDDEN;
+    }
+    if (item->attribute & FAT_FILE_SYSTEM)
+    {
+        dirent->attributes |= FILE_DIRENT_SYSTEM;
+    }
+}
+
+/**
+ * Lists the directory loaded when it was opened, *pos is an index into its items. Deleted
+ * entries, volume labels and long name entries are skipped
+ */
+int fat16_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max)
+{
+    struct fat_file_descriptor *desc = private;
+    if (desc->item->type != FAT_ITEM_TYPE_DIRECTORY)
+    {
+        return -EINVARG;
+    }
+
+    struct fat_private *fat_private = disk->fs_private;
+    struct fat_directory *directory = desc->item->directory ? desc->item->directory : &fat_private->root_directory;
+    int total = 0;
+    while (total < max && *pos < (uint32_t)directory->total)
+    {
+        struct fat_directory_item *item = &directory->item[*pos];
+        if (item->filename[0] == 0x00)
+        {
+            // Nothing follows the first unused entry
+            *pos = directory->total;
+            break;
+        }
+
+        *pos += 1;
+        if (fat16_directory_item_is_searchable(item))
+        {
+            fat16_dirent_from_item(item, &out[total++]);
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Writes an empty FAT16 volume over the whole disk: a boot sector, two FATs and an empty root
+ * directory. The cluster size is the smallest one that keeps the cluster count in FAT16's range
+ */
+int fat16_format(struct disk *disk)
+{
+    int res = 0;
+    char sector[PEACHOS_SECTOR_SIZE];
+    uint32_t total_sectors = disk->total_sectors;
+    uint32_t root_dir_entries = 512;
+    uint32_t root_dir_sectors = (root_dir_entries * sizeof(struct fat_directory_item)) / PEACHOS_SECTOR_SIZE;
+    uint32_t reserved_sectors = 1;
+    if (disk->sector_size != PEACHOS_SECTOR_SIZE || total_sectors <= reserved_sectors + root_dir_sectors)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    uint32_t sectors_per_cluster = 1;
+    while ((total_sectors - reserved_sectors - root_dir_sectors) / sectors_per_cluster > 65524 && sectors_per_cluster < 128)
+    {
+        sectors_per_cluster *= 2;
+    }
+
+    // Sized as if no sectors went to the FATs, a few spare entries at the end do no harm
+    uint32_t clusters = (total_sectors - reserved_sectors - root_dir_sectors) / sectors_per_cluster;
+    uint32_t sectors_per_fat = (((clusters + PEACHOS_FAT16_FIRST_DATA_CLUSTER) * PEACHOS_FAT16_FAT_ENTRY_SIZE) + PEACHOS_SECTOR_SIZE - 1) / PEACHOS_SECTOR_SIZE;
+    uint32_t first_data_sector = reserved_sectors + (2 * sectors_per_fat) + root_dir_sectors;
+    if (first_data_sector >= total_sectors || (total_sectors - first_data_sector) / sectors_per_cluster < 4085)
+    {
+        // Too small to be FAT16 or too large for it
+        res = -EINVARG;
+        goto out;
+    }
+
+    memset(sector, 0, sizeof(sector));
+    struct fat_h *header = (struct fat_h *)sector;
+    struct fat_header *primary_header = &header->primary_header;
+    memcpy(primary_header->short_jmp_ins, "\xEB\x3C\x90", 3);
+    memcpy(primary_header->oem_identifier, "PEACHOS ", 8);
+    primary_header->bytes_per_sector = PEACHOS_SECTOR_SIZE;
+    primary_header->sectors_per_cluster = sectors_per_cluster;
+    primary_header->reserved_sectors = reserved_sectors;
+    primary_header->fat_copies = 2;
+    primary_header->root_dir_entries = root_dir_entries;
+    primary_header->number_of_sectors = total_sectors < 0x10000 ? total_sectors : 0;
+    primary_header->sectors_big = total_sectors < 0x10000 ? 0 : total_sectors;
+    primary_header->media_type = 0xF8;
+    primary_header->sectors_per_fat = sectors_per_fat;
+    primary_header->sectors_per_track = 32;
+    primary_header->number_of_heads = 2;
+
+    struct fat_header_extended *extended_header = &header->shared.extended_header;
+    extended_header->drive_number = 0x80;
+    extended_header->signature = PEACHOS_FAT16_SIGNATURE;
+    extended_header->volume_id = disk->id;
+    memcpy(extended_header->volume_id_string, "NO NAME    ", 11);
+    memcpy(extended_header->system_id_string, "FAT16   ", 8);
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+    res = disk_write_block(disk, 0, 1, sector);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // Both FATs and the root directory start out zeroed apart from the two reserved FAT entries
+    memset(sector, 0, sizeof(sector));
+    for (uint32_t lba = reserved_sectors; lba < first_data_sector; lba++)
+    {
+        uint32_t fat_sector = (lba - reserved_sectors) % sectors_per_fat;
+        bool first_fat_sector = lba < reserved_sectors + (2 * sectors_per_fat) && fat_sector == 0;
+        uint16_t *entries = (uint16_t *)sector;
+        entries[0] = first_fat_sector ? 0xFFF8 : 0x0000;
+        entries[1] = first_fat_sector ? PEACHOS_FAT16_END_OF_CHAIN_MARK : 0x0000;
+        res = disk_write_block(disk, lba, 1, sector);
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+    res = disk_flush(disk);
+out:
+    return res;
+}
@@ -1,6 +1,9 @@
 #ifndef FAT16_H
 #define FAT16_H
 
-#include "file.h"
+#include "fs/file.h"
 struct filesystem* fat16_init();
+
+struct disk;
+int fat16_format(struct disk* disk);
 #endif
\ No newline at end of file
@@ -0,0 +1,1261 @@
+#include "fat32.h"
+#include "string/string.h"
+#include "disk/disk.h"
+#include "disk/streamer.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "status.h"
+#include "kernel.h"
+#include "stats/stats.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PEACHOS_FAT32_SIGNATURE 0x29
+#define PEACHOS_FAT32_OLD_SIGNATURE 0x28
+#define PEACHOS_FAT32_FAT_ENTRY_SIZE 0x04
+// Only the low 28 bits of an entry are the cluster number
+#define PEACHOS_FAT32_ENTRY_MASK 0x0FFFFFFF
+#define PEACHOS_FAT32_BAD_CLUSTER 0x0FFFFFF7
+#define PEACHOS_FAT32_END_OF_CHAIN 0x0FFFFFF8
+#define PEACHOS_FAT32_END_OF_CHAIN_MARK 0x0FFFFFFF
+#define PEACHOS_FAT32_FIRST_DATA_CLUSTER 2
+#define PEACHOS_FAT32_UNUSED 0x00
+
+#define PEACHOS_FAT32_FSINFO_LEAD_SIGNATURE 0x41615252
+#define PEACHOS_FAT32_FSINFO_STRUCT_SIGNATURE 0x61417272
+// FSInfo uses this for a count or hint it does not know
+#define PEACHOS_FAT32_FSINFO_UNKNOWN 0xFFFFFFFF
+
+// Fat directory entry attributes bitmask
+#define FAT32_FILE_READ_ONLY 0x01
+#define FAT32_FILE_HIDDEN 0x02
+#define FAT32_FILE_SYSTEM 0x04
+#define FAT32_FILE_VOLUME_LABEL 0x08
+#define FAT32_FILE_SUBDIRECTORY 0x10
+#define FAT32_FILE_ARCHIVED 0x20
+
+// Length of a short name in a directory entry, 8 name bytes followed by 3 extension bytes
+#define FAT32_SHORT_NAME_LENGTH 11
+
+struct fat32_header
+{
+    uint8_t short_jmp_ins[3];
+    uint8_t oem_identifier[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fat_copies;
+    // Both zero on FAT32, the root directory is a cluster chain like any other
+    uint16_t root_dir_entries;
+    uint16_t number_of_sectors;
+    uint8_t media_type;
+    uint16_t sectors_per_fat16;
+    uint16_t sectors_per_track;
+    uint16_t number_of_heads;
+    uint32_t hidden_sectors;
+    uint32_t sectors_big;
+
+    uint32_t sectors_per_fat;
+    uint16_t flags;
+    uint16_t version;
+    uint32_t root_cluster;
+    uint16_t fsinfo_sector;
+    uint16_t backup_boot_sector;
+    uint8_t reserved[12];
+    uint8_t drive_number;
+    uint8_t win_nt_bit;
+    uint8_t signature;
+    uint32_t volume_id;
+    uint8_t volume_id_string[11];
+    uint8_t system_id_string[8];
+} __attribute__((packed));
+
+struct fat32_fsinfo
+{
+    uint32_t lead_signature;
+    uint8_t reserved[480];
+    uint32_t struct_signature;
+    uint32_t free_count;
+    uint32_t next_free;
+    uint8_t reserved2[12];
+    uint32_t trail_signature;
+} __attribute__((packed));
+
+struct fat32_directory_item
+{
+    uint8_t filename[8];
+    uint8_t ext[3];
+    uint8_t attribute;
+    uint8_t reserved;
+    uint8_t creation_time_tenths_of_a_sec;
+    uint16_t creation_time;
+    uint16_t creation_date;
+    uint16_t last_access;
+    uint16_t high_16_bits_first_cluster;
+    uint16_t last_mod_time;
+    uint16_t last_mod_date;
+    uint16_t low_16_bits_first_cluster;
+    uint32_t filesize;
+} __attribute__((packed));
+
+// Remembers the last cluster found in a chain so the next lookup can carry on from there
+struct fat32_cluster_cursor
+{
+    uint32_t first_cluster;
+    // Index of the cluster within the chain, zero is the first cluster
+    uint32_t index;
+    uint32_t cluster;
+};
+
+struct fat32_file_descriptor
+{
+    struct disk *disk;
+    FILE_MODE mode;
+    // The item of the file, the root directory gets one made up with its first cluster
+    struct fat32_directory_item item;
+    uint32_t pos;
+    struct fat32_cluster_cursor cursor;
+
+    // Where the directory item lives on the disk so size changes can be written back
+    uint64_t item_pos;
+    // Set once the file has been written to, closing it then flushes the disk
+    bool dirty;
+};
+
+struct fat32_private
+{
+    struct fat32_header header;
+
+    // Used to stream data clusters
+    struct disk_stream *cluster_stream;
+    // Used for directories, the FAT copies and FSInfo
+    struct disk_stream *meta_stream;
+
+    uint32_t first_data_sector;
+    // Number of the first cluster past the end of the data area
+    uint32_t total_clusters;
+
+    // The first FAT, the whole of it stays in memory
+    uint32_t *fat_table;
+    // Bit n is set while cluster n is in use, so finding a free cluster never reads the FAT.
+    // Clusters 0, 1 and everything past the data area are marked used
+    uint32_t *free_map;
+    uint32_t free_map_words;
+    uint32_t free_count;
+    // Cluster the next free cluster search starts at, seeded from FSInfo
+    uint32_t free_cluster_hint;
+    // Set when free_count or the hint changed since FSInfo was last written
+    bool fsinfo_dirty;
+};
+
+int fat32_resolve(struct disk *disk);
+void *fat32_open(struct disk *disk, struct path_root *path, FILE_MODE mode);
+int fat32_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr);
+int fat32_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt);
+int fat32_write(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, const char *in);
+int fat32_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode);
+int fat32_stat(struct disk *disk, void *private, struct file_stat *stat);
+int fat32_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max);
+int fat32_close(void *private);
+
+struct filesystem fat32_fs =
+    {
+        .resolve = fat32_resolve,
+        .open = fat32_open,
+        .read = fat32_read,
+        .readv = fat32_readv,
+        .write = fat32_write,
+        .seek = fat32_seek,
+        .stat = fat32_stat,
+        .readdir = fat32_readdir,
+        .close = fat32_close
+    };
+
+struct filesystem *fat32_init()
+{
+    strcpy(fat32_fs.name, "FAT32");
+    return &fat32_fs;
+}
+
+static uint32_t fat32_cluster_size(struct disk *disk)
+{
+    struct fat32_private *private = disk->fs_private;
+    return private->header.sectors_per_cluster * disk->sector_size;
+}
+
+static uint32_t fat32_cluster_to_sector(struct fat32_private *private, uint32_t cluster)
+{
+    return private->first_data_sector + ((cluster - PEACHOS_FAT32_FIRST_DATA_CLUSTER) * private->header.sectors_per_cluster);
+}
+
+static uint32_t fat32_get_first_cluster(struct fat32_directory_item *item)
+{
+    return (item->high_16_bits_first_cluster << 16) | item->low_16_bits_first_cluster;
+}
+
+static void fat32_set_first_cluster(struct fat32_directory_item *item, uint32_t cluster)
+{
+    item->high_16_bits_first_cluster = cluster >> 16;
+    item->low_16_bits_first_cluster = cluster & 0xffff;
+}
+
+static bool fat32_cluster_valid(struct fat32_private *private, uint32_t cluster)
+{
+    return cluster >= PEACHOS_FAT32_FIRST_DATA_CLUSTER && cluster < private->total_clusters;
+}
+
+static void fat32_free_map_set(struct fat32_private *private, uint32_t cluster, bool used)
+{
+    uint32_t bit = 1U << (cluster % 32);
+    bool was_used = private->free_map[cluster / 32] & bit;
+    if (used == was_used)
+    {
+        return;
+    }
+
+    if (used)
+    {
+        private->free_map[cluster / 32] |= bit;
+        private->free_count--;
+    }
+    else
+    {
+        private->free_map[cluster / 32] &= ~bit;
+        private->free_count++;
+    }
+    private->fsinfo_dirty = true;
+}
+
+/**
+ * Reads the FAT into memory and marks every cluster it uses in the free map
+ */
+static int fat32_load_fat_table(struct disk *disk, struct fat32_private *private)
+{
+    int res = 0;
+    uint32_t fat_size = private->header.sectors_per_fat * disk->sector_size;
+    private->fat_table = kzalloc(fat_size);
+    if (!private->fat_table)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    res = diskstreamer_seek_sector(private->meta_stream, private->header.reserved_sectors, 0);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = diskstreamer_read(private->meta_stream, private->fat_table, fat_size);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (private->total_clusters > fat_size / PEACHOS_FAT32_FAT_ENTRY_SIZE)
+    {
+        private->total_clusters = fat_size / PEACHOS_FAT32_FAT_ENTRY_SIZE;
+    }
+
+    private->free_map_words = (private->total_clusters + 31) / 32;
+    private->free_map = kzalloc(private->free_map_words * sizeof(uint32_t));
+    if (!private->free_map)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    // Everything starts out used, only the clusters the FAT calls unused are cleared
+    memset(private->free_map, 0xff, private->free_map_words * sizeof(uint32_t));
+    private->free_count = 0;
+    for (uint32_t cluster = PEACHOS_FAT32_FIRST_DATA_CLUSTER; cluster < private->total_clusters; cluster++)
+    {
+        if ((private->fat_table[cluster] & PEACHOS_FAT32_ENTRY_MASK) == PEACHOS_FAT32_UNUSED)
+        {
+            private->free_map[cluster / 32] &= ~(1U << (cluster % 32));
+            private->free_count++;
+        }
+    }
+
+out:
+    return res;
+}
+
+/**
+ * The free count is recounted from the FAT, FSInfo only gives the place to start looking
+ */
+static void fat32_read_fsinfo(struct disk *disk, struct fat32_private *private)
+{
+    struct fat32_fsinfo fsinfo;
+    private->free_cluster_hint = PEACHOS_FAT32_FIRST_DATA_CLUSTER;
+    if (!private->header.fsinfo_sector || private->header.fsinfo_sector == 0xffff)
+    {
+        return;
+    }
+
+    if (disk_read_block(disk, private->header.fsinfo_sector, 1, &fsinfo) < 0)
+    {
+        print("FAT32: Failed to read FSInfo\n");
+        return;
+    }
+
+    if (fsinfo.lead_signature != PEACHOS_FAT32_FSINFO_LEAD_SIGNATURE || fsinfo.struct_signature != PEACHOS_FAT32_FSINFO_STRUCT_SIGNATURE)
+    {
+        print("FAT32: Invalid FSInfo\n");
+        return;
+    }
+
+    if (fsinfo.next_free != PEACHOS_FAT32_FSINFO_UNKNOWN && fat32_cluster_valid(private, fsinfo.next_free))
+    {
+        private->free_cluster_hint = fsinfo.next_free;
+    }
+
+    // Written back with the recounted value the next time a file is closed
+    private->fsinfo_dirty = fsinfo.free_count != private->free_count;
+}
+
+static int fat32_write_fsinfo(struct disk *disk)
+{
+    int res = 0;
+    struct fat32_private *private = disk->fs_private;
+    struct fat32_fsinfo fsinfo;
+    if (!private->fsinfo_dirty || !private->header.fsinfo_sector || private->header.fsinfo_sector == 0xffff)
+    {
+        goto out;
+    }
+
+    res = disk_read_block(disk, private->header.fsinfo_sector, 1, &fsinfo);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (fsinfo.lead_signature != PEACHOS_FAT32_FSINFO_LEAD_SIGNATURE || fsinfo.struct_signature != PEACHOS_FAT32_FSINFO_STRUCT_SIGNATURE)
+    {
+        goto out;
+    }
+
+    fsinfo.free_count = private->free_count;
+    fsinfo.next_free = private->free_cluster_hint;
+    res = disk_write_block(disk, private->header.fsinfo_sector, 1, &fsinfo);
+    if (res == 0)
+    {
+        private->fsinfo_dirty = false;
+    }
+out:
+    return res;
+}
+
+static bool fat32_header_valid(struct disk *disk, struct fat32_header *header)
+{
+    return header->bytes_per_sector == disk->sector_size && header->sectors_per_cluster != 0 &&
+           header->fat_copies != 0 && header->root_dir_entries == 0 && header->sectors_per_fat16 == 0 &&
+           header->sectors_per_fat != 0 && header->sectors_big != 0 &&
+           (header->signature == PEACHOS_FAT32_SIGNATURE || header->signature == PEACHOS_FAT32_OLD_SIGNATURE);
+}
+
+int fat32_resolve(struct disk *disk)
+{
+    int res = 0;
+    struct fat32_private *private = kzalloc(sizeof(struct fat32_private));
+    if (!private)
+    {
+        return -ENOMEM;
+    }
+
+    private->cluster_stream = diskstreamer_new(disk->id);
+    private->meta_stream = diskstreamer_new(disk->id);
+    if (!private->cluster_stream || !private->meta_stream)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    if (diskstreamer_read(private->meta_stream, &private->header, sizeof(private->header)) != PEACHOS_ALL_OK)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    if (!fat32_header_valid(disk, &private->header))
+    {
+        res = -EFSNOTUS;
+        goto out;
+    }
+
+    struct fat32_header *header = &private->header;
+    private->first_data_sector = header->reserved_sectors + (header->fat_copies * header->sectors_per_fat);
+    if (private->first_data_sector >= header->sectors_big)
+    {
+        res = -EFSNOTUS;
+        goto out;
+    }
+    private->total_clusters = ((header->sectors_big - private->first_data_sector) / header->sectors_per_cluster) + PEACHOS_FAT32_FIRST_DATA_CLUSTER;
+
+    // Resolving claims the disk, the rest of the filesystem expects these set
+    disk->fs_private = private;
+    disk->filesystem = &fat32_fs;
+    res = fat32_load_fat_table(disk, private);
+    if (res < 0)
+    {
+        print("FAT32: Failed to load the FAT into memory\n");
+        goto out;
+    }
+
+    if (!fat32_cluster_valid(private, header->root_cluster))
+    {
+        res = -EINFORMAT;
+        goto out;
+    }
+
+    fat32_read_fsinfo(disk, private);
+
+out:
+    if (res < 0)
+    {
+        if (private->cluster_stream)
+        {
+            diskstreamer_close(private->cluster_stream);
+        }
+        if (private->meta_stream)
+        {
+            diskstreamer_close(private->meta_stream);
+        }
+        kfree(private->fat_table);
+        kfree(private->free_map);
+        kfree(private);
+        disk->fs_private = 0;
+        disk->filesystem = 0;
+    }
+    return res;
+}
+
+static uint32_t fat32_get_fat_entry(struct fat32_private *private, uint32_t cluster)
+{
+    return private->fat_table[cluster] & PEACHOS_FAT32_ENTRY_MASK;
+}
+
+/**
+ * Sets a FAT entry in memory and in every copy of the FAT on the disk, the reserved high bits
+ * of the entry are kept
+ */
+static int fat32_set_fat_entry(struct disk *disk, uint32_t cluster, uint32_t value)
+{
+    int res = 0;
+    struct fat32_private *private = disk->fs_private;
+    struct fat32_header *header = &private->header;
+    uint32_t entry = (private->fat_table[cluster] & ~PEACHOS_FAT32_ENTRY_MASK) | (value & PEACHOS_FAT32_ENTRY_MASK);
+    private->fat_table[cluster] = entry;
+    fat32_free_map_set(private, cluster, value != PEACHOS_FAT32_UNUSED);
+
+    for (int i = 0; i < header->fat_copies; i++)
+    {
+        uint32_t fat_sector = header->reserved_sectors + (i * header->sectors_per_fat);
+        res = diskstreamer_seek_sector(private->meta_stream, fat_sector, cluster * PEACHOS_FAT32_FAT_ENTRY_SIZE);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(private->meta_stream, &entry, sizeof(entry));
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Finds the first free cluster at or after start in the free map, wrapping around once.
+ * Returns zero when the volume is full
+ */
+static uint32_t fat32_find_free_cluster(struct fat32_private *private, uint32_t start)
+{
+    if (private->free_count == 0)
+    {
+        return 0;
+    }
+
+    uint32_t word = start / 32;
+    // Bits below start in its word count as used for the first look
+    uint32_t bits = private->free_map[word] | ((1U << (start % 32)) - 1);
+    for (uint32_t i = 0; i <= private->free_map_words; i++)
+    {
+        if (bits != 0xffffffff)
+        {
+            return word * 32 + __builtin_ctz(~bits);
+        }
+
+        word = (word + 1) % private->free_map_words;
+        bits = private->free_map[word];
+    }
+
+    return 0;
+}
+
+/**
+ * Takes a free cluster and links it after prev, zero starts a new chain. Returns the cluster
+ */
+static int fat32_allocate_cluster(struct disk *disk, uint32_t prev)
+{
+    int res = 0;
+    struct fat32_private *private = disk->fs_private;
+    uint32_t start = private->free_cluster_hint;
+    if (!fat32_cluster_valid(private, start))
+    {
+        start = PEACHOS_FAT32_FIRST_DATA_CLUSTER;
+    }
+
+    // Start after the last cluster we handed out so files grow into neighbouring clusters
+    uint32_t cluster = fat32_find_free_cluster(private, start);
+    if (!cluster)
+    {
+        // The disk is full
+        res = -ENOMEM;
+        goto out;
+    }
+
+    res = fat32_set_fat_entry(disk, cluster, PEACHOS_FAT32_END_OF_CHAIN_MARK);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (prev)
+    {
+        res = fat32_set_fat_entry(disk, prev, cluster);
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+    private->free_cluster_hint = cluster + 1;
+    private->fsinfo_dirty = true;
+    res = cluster;
+out:
+    return res;
+}
+
+static int fat32_free_chain(struct disk *disk, uint32_t cluster)
+{
+    int res = 0;
+    struct fat32_private *private = disk->fs_private;
+    while (fat32_cluster_valid(private, cluster))
+    {
+        uint32_t next = fat32_get_fat_entry(private, cluster);
+        res = fat32_set_fat_entry(disk, cluster, PEACHOS_FAT32_UNUSED);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        if (cluster < private->free_cluster_hint)
+        {
+            private->free_cluster_hint = cluster;
+        }
+        cluster = next;
+    }
+
+out:
+    return res;
+}
+
+static void fat32_cursor_init(struct fat32_cluster_cursor *cursor, uint32_t first_cluster)
+{
+    cursor->first_cluster = first_cluster;
+    cursor->index = 0;
+    cursor->cluster = first_cluster;
+}
+
+/**
+ * Gets the cluster holding offset of the chain. The walk starts from the cluster the cursor was
+ * last left at when the offset is at or after it, so sequential access follows one link per cluster
+ */
+static int fat32_get_cluster_for_offset(struct disk *disk, struct fat32_cluster_cursor *cursor, uint32_t offset)
+{
+    struct fat32_private *private = disk->fs_private;
+    uint32_t clusters_ahead = offset / fat32_cluster_size(disk);
+    if (clusters_ahead < cursor->index)
+    {
+        fat32_cursor_init(cursor, cursor->first_cluster);
+    }
+
+    if (!fat32_cluster_valid(private, cursor->cluster))
+    {
+        return -EIO;
+    }
+
+    for (uint32_t i = cursor->index; i < clusters_ahead; i++)
+    {
+        uint32_t entry = fat32_get_fat_entry(private, cursor->cluster);
+        STATS_INC(fat_chain_hops);
+        if (!fat32_cluster_valid(private, entry))
+        {
+            // The end of the chain, a bad cluster or a broken link
+            return -EIO;
+        }
+
+        cursor->index = i + 1;
+        cursor->cluster = entry;
+    }
+
+    return cursor->cluster;
+}
+
+/**
+ * Reads total bytes starting at offset of the cluster chain. Clusters that follow each other on
+ * the disk are coalesced into one run and streamed with a single read
+ */
+static int fat32_read_internal(struct disk *disk, struct fat32_cluster_cursor *cursor, uint32_t offset, uint32_t total, void *out)
+{
+    int res = 0;
+    char *out_ptr = out;
+    struct fat32_private *private = disk->fs_private;
+    uint32_t cluster_size = fat32_cluster_size(disk);
+    while (total > 0)
+    {
+        int cluster = fat32_get_cluster_for_offset(disk, cursor, offset);
+        if (cluster < 0)
+        {
+            res = cluster;
+            goto out;
+        }
+
+        uint32_t offset_from_cluster = offset % cluster_size;
+        uint32_t run_clusters = 1;
+        uint32_t last_cluster = cluster;
+        while ((run_clusters * cluster_size) - offset_from_cluster < total &&
+               fat32_get_fat_entry(private, last_cluster) == last_cluster + 1)
+        {
+            last_cluster++;
+            run_clusters++;
+        }
+
+        uint32_t run_bytes = (run_clusters * cluster_size) - offset_from_cluster;
+        uint32_t total_to_read = total > run_bytes ? run_bytes : total;
+        res = diskstreamer_seek_sector(private->cluster_stream, fat32_cluster_to_sector(private, cluster), offset_from_cluster);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_read(private->cluster_stream, out_ptr, total_to_read);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        // The cursor now sits on the last cluster of the run
+        cursor->index += run_clusters - 1;
+        cursor->cluster = last_cluster;
+
+        out_ptr += total_to_read;
+        offset += total_to_read;
+        total -= total_to_read;
+    }
+
+out:
+    return res;
+}
+
+/**
+ * Converts a path component into the blank padded, upper case 8.3 form stored on disk.
+ * Returns false if the name can not be a short name
+ */
+static bool fat32_name_to_short_name(const struct path_part *name, char *out)
+{
+    memset(out, ' ', FAT32_SHORT_NAME_LENGTH);
+    const char *str = name->part;
+    int i = 0;
+    int len = 0;
+    while (i < name->len && str[i] != '.')
+    {
+        if (len >= 8)
+        {
+            return false;
+        }
+        out[len++] = toupper(str[i++]);
+    }
+
+    if (len == 0)
+    {
+        return false;
+    }
+
+    if (i < name->len)
+    {
+        i++;
+        len = 0;
+        while (i < name->len)
+        {
+            if (len >= 3 || str[i] == '.')
+            {
+                return false;
+            }
+            out[8 + len++] = toupper(str[i++]);
+        }
+    }
+
+    return true;
+}
+
+static bool fat32_item_has_short_name(struct fat32_directory_item *item, const char *short_name)
+{
+    const char *raw = (const char *)item->filename;
+    for (int i = 0; i < FAT32_SHORT_NAME_LENGTH; i++)
+    {
+        if (toupper(raw[i]) != short_name[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool fat32_item_is_listed(struct fat32_directory_item *item)
+{
+    // Long name entries have the volume label bit set as well
+    return item->filename[0] != 0xE5 && !(item->attribute & FAT32_FILE_VOLUME_LABEL);
+}
+
+/**
+ * First cluster of the directory an item refers to, ".." of a top level directory says zero
+ */
+static uint32_t fat32_directory_cluster(struct fat32_private *private, struct fat32_directory_item *item)
+{
+    uint32_t cluster = fat32_get_first_cluster(item);
+    return cluster ? cluster : private->header.root_cluster;
+}
+
+/**
+ * Reads the item at index of the directory the cursor walks and gives its position on the disk.
+ * Negative past the end of the directory's chain
+ */
+static int fat32_read_directory_item(struct disk *disk, struct fat32_cluster_cursor *cursor, uint32_t index, struct fat32_directory_item *item_out, uint64_t *pos_out)
+{
+    struct fat32_private *private = disk->fs_private;
+    uint32_t offset = index * sizeof(struct fat32_directory_item);
+    int cluster = fat32_get_cluster_for_offset(disk, cursor, offset);
+    if (cluster < 0)
+    {
+        return cluster;
+    }
+
+    uint32_t sector = fat32_cluster_to_sector(private, cluster);
+    uint32_t offset_from_cluster = offset % fat32_cluster_size(disk);
+    int res = diskstreamer_seek_sector(private->meta_stream, sector, offset_from_cluster);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    res = diskstreamer_read(private->meta_stream, item_out, sizeof(*item_out));
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (pos_out)
+    {
+        *pos_out = ((uint64_t) sector * PEACHOS_SECTOR_SIZE) + offset_from_cluster;
+    }
+    return 0;
+}
+
+static int fat32_zero_cluster(struct disk *disk, uint32_t cluster)
+{
+    int res = 0;
+    struct fat32_private *private = disk->fs_private;
+    char zero[PEACHOS_SECTOR_SIZE];
+    memset(zero, 0, sizeof(zero));
+    uint32_t sector = fat32_cluster_to_sector(private, cluster);
+    for (int i = 0; i < private->header.sectors_per_cluster && res == 0; i++)
+    {
+        res = disk_write_block(disk, sector + i, 1, zero);
+    }
+
+    return res;
+}
+
+/**
+ * Scans the directory for the short name. Gives the position of the item when it is found and
+ * returns zero. Otherwise returns -EBADPATH and, when free_pos is given, the position of the
+ * first free slot in it, growing the directory by a cluster when it has none
+ */
+static int fat32_find_in_directory(struct disk *disk, uint32_t directory_cluster, const char *short_name, struct fat32_directory_item *item_out, uint64_t *pos_out, uint64_t *free_pos)
+{
+    int res = 0;
+    struct fat32_cluster_cursor cursor;
+    fat32_cursor_init(&cursor, directory_cluster);
+
+    bool have_free = false;
+    for (uint32_t index = 0;; index++)
+    {
+        struct fat32_directory_item item;
+        uint64_t pos = 0;
+        if (fat32_read_directory_item(disk, &cursor, index, &item, &pos) < 0)
+        {
+            break;
+        }
+
+        if (item.filename[0] == 0x00 || item.filename[0] == 0xE5)
+        {
+            if (!have_free && free_pos)
+            {
+                have_free = true;
+                *free_pos = pos;
+            }
+
+            if (item.filename[0] == 0x00)
+            {
+                // Nothing is stored past the end marker
+                break;
+            }
+        }
+        else if (fat32_item_is_listed(&item) && fat32_item_has_short_name(&item, short_name))
+        {
+            memcpy(item_out, &item, sizeof(item));
+            *pos_out = pos;
+            goto out;
+        }
+    }
+
+    res = -EBADPATH;
+    if (have_free || !free_pos)
+    {
+        goto out;
+    }
+
+    // The cursor was left on the last cluster of the directory
+    int cluster = fat32_allocate_cluster(disk, cursor.cluster);
+    if (cluster < 0)
+    {
+        res = cluster;
+        goto out;
+    }
+
+    res = fat32_zero_cluster(disk, cluster);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    *free_pos = (uint64_t) fat32_cluster_to_sector(disk->fs_private, cluster) * PEACHOS_SECTOR_SIZE;
+    res = -EBADPATH;
+out:
+    return res;
+}
+
+static int fat32_write_directory_item(struct disk *disk, uint64_t pos, struct fat32_directory_item *item)
+{
+    struct fat32_private *private = disk->fs_private;
+    int res = diskstreamer_seek(private->meta_stream, pos);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    return diskstreamer_write(private->meta_stream, item, sizeof(*item));
+}
+
+/**
+ * Walks every component of the path but the last, giving the first cluster of the directory
+ * the last one lives in
+ */
+static int fat32_walk_parent(struct disk *disk, struct path_root *path, uint32_t *cluster_out)
+{
+    struct fat32_private *private = disk->fs_private;
+    uint32_t cluster = private->header.root_cluster;
+    for (int i = 0; i + 1 < path->total; i++)
+    {
+        char short_name[FAT32_SHORT_NAME_LENGTH];
+        if (!fat32_name_to_short_name(&path->parts[i], short_name))
+        {
+            return -EBADPATH;
+        }
+
+        struct fat32_directory_item item;
+        uint64_t pos = 0;
+        int res = fat32_find_in_directory(disk, cluster, short_name, &item, &pos, 0);
+        if (res < 0)
+        {
+            return res;
+        }
+
+        if (!(item.attribute & FAT32_FILE_SUBDIRECTORY))
+        {
+            return -EBADPATH;
+        }
+        cluster = fat32_directory_cluster(private, &item);
+    }
+
+    *cluster_out = cluster;
+    return 0;
+}
+
+/**
+ * Finds the file for the descriptor. Writing creates it when it does not exist yet, write mode
+ * truncates it and append mode starts at its end
+ */
+static int fat32_open_item(struct disk *disk, struct path_root *path, struct fat32_file_descriptor *descriptor)
+{
+    struct fat32_private *private = disk->fs_private;
+    if (path->total == 0)
+    {
+        // The root directory has no item of its own
+        descriptor->item.attribute = FAT32_FILE_SUBDIRECTORY;
+        fat32_set_first_cluster(&descriptor->item, private->header.root_cluster);
+        return descriptor->mode == FILE_MODE_READ ? 0 : -EINVARG;
+    }
+
+    uint32_t parent = 0;
+    int res = fat32_walk_parent(disk, path, &parent);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    char short_name[FAT32_SHORT_NAME_LENGTH];
+    if (!fat32_name_to_short_name(&path->parts[path->total - 1], short_name))
+    {
+        return -EBADPATH;
+    }
+
+    uint64_t free_pos = 0;
+    bool writing = descriptor->mode != FILE_MODE_READ;
+    res = fat32_find_in_directory(disk, parent, short_name, &descriptor->item, &descriptor->item_pos, writing ? &free_pos : 0);
+    if (res == -EBADPATH && writing)
+    {
+        memset(&descriptor->item, 0, sizeof(descriptor->item));
+        memcpy(descriptor->item.filename, short_name, FAT32_SHORT_NAME_LENGTH);
+        descriptor->item.attribute = FAT32_FILE_ARCHIVED;
+        descriptor->item_pos = free_pos;
+        return fat32_write_directory_item(disk, free_pos, &descriptor->item);
+    }
+
+    if (res < 0 || !writing)
+    {
+        return res;
+    }
+
+    if (descriptor->item.attribute & (FAT32_FILE_SUBDIRECTORY | FAT32_FILE_VOLUME_LABEL))
+    {
+        return -EINVARG;
+    }
+
+    if (descriptor->item.attribute & FAT32_FILE_READ_ONLY)
+    {
+        return -ERDONLY;
+    }
+
+    if (descriptor->mode == FILE_MODE_WRITE && (descriptor->item.filesize || fat32_get_first_cluster(&descriptor->item)))
+    {
+        res = fat32_free_chain(disk, fat32_get_first_cluster(&descriptor->item));
+        if (res < 0)
+        {
+            return res;
+        }
+
+        fat32_set_first_cluster(&descriptor->item, 0);
+        descriptor->item.filesize = 0;
+        descriptor->dirty = true;
+        res = fat32_write_directory_item(disk, descriptor->item_pos, &descriptor->item);
+    }
+
+    return res;
+}
+
+void *fat32_open(struct disk *disk, struct path_root *path, FILE_MODE mode)
+{
+    struct fat32_file_descriptor *descriptor = kzalloc(sizeof(struct fat32_file_descriptor));
+    if (!descriptor)
+    {
+        return ERROR(-ENOMEM);
+    }
+
+    descriptor->disk = disk;
+    descriptor->mode = mode;
+    int res = fat32_open_item(disk, path, descriptor);
+    if (res < 0)
+    {
+        kfree(descriptor);
+        return ERROR(res);
+    }
+
+    descriptor->pos = mode == FILE_MODE_APPEND ? descriptor->item.filesize : 0;
+    fat32_cursor_init(&descriptor->cursor, fat32_get_first_cluster(&descriptor->item));
+    return descriptor;
+}
+
+int fat32_close(void *private)
+{
+    struct fat32_file_descriptor *desc = private;
+    if (desc->dirty)
+    {
+        // FSInfo goes out with the file's data in the same sorted batch
+        if (fat32_write_fsinfo(desc->disk) < 0 || disk_flush(desc->disk) < 0)
+        {
+            print("FAT32: Failed to flush the disk\n");
+        }
+    }
+
+    kfree(desc);
+    return 0;
+}
+
+int fat32_stat(struct disk *disk, void *private, struct file_stat *stat)
+{
+    struct fat32_file_descriptor *descriptor = private;
+    if (descriptor->item.attribute & FAT32_FILE_SUBDIRECTORY)
+    {
+        return -EINVARG;
+    }
+
+    stat->filesize = descriptor->item.filesize;
+    stat->flags = 0x00;
+    if (descriptor->item.attribute & FAT32_FILE_READ_ONLY)
+    {
+        stat->flags |= FILE_STAT_READ_ONLY;
+    }
+    return 0;
+}
+
+int fat32_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr)
+{
+    struct fat32_file_descriptor *desc = descriptor;
+    uint32_t total = size * nmemb;
+    if (nmemb != 0 && total / nmemb != size)
+    {
+        return -EINVARG;
+    }
+
+    // All the elements are contiguous in the file, so read them in one go
+    int res = fat32_read_internal(disk, &desc->cursor, desc->pos, total, out_ptr);
+    if (res < 0)
+    {
+        print("FAT32: Read error\n");
+        return res;
+    }
+
+    desc->pos += total;
+    return nmemb;
+}
+
+int fat32_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt)
+{
+    struct fat32_file_descriptor *desc = descriptor;
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        // The cursor carries on from the previous buffer so no chain is walked twice
+        int res = fat32_read_internal(disk, &desc->cursor, desc->pos, iov[i].len, iov[i].base);
+        if (res < 0)
+        {
+            print("FAT32: Read error\n");
+            return res;
+        }
+
+        desc->pos += iov[i].len;
+        total += iov[i].len;
+    }
+
+    return total;
+}
+
+int fat32_write(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, const char *in)
+{
+    int res = 0;
+    struct fat32_file_descriptor *desc = descriptor;
+    struct fat32_private *private = disk->fs_private;
+    uint32_t total = size * nmemb;
+    if (desc->mode == FILE_MODE_READ)
+    {
+        res = -ERDONLY;
+        goto out;
+    }
+
+    if (nmemb != 0 && total / nmemb != size)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (fat32_get_first_cluster(&desc->item) == 0)
+    {
+        int cluster = fat32_allocate_cluster(disk, 0);
+        if (cluster < 0)
+        {
+            res = cluster;
+            goto out;
+        }
+
+        fat32_set_first_cluster(&desc->item, cluster);
+        fat32_cursor_init(&desc->cursor, cluster);
+    }
+
+    // The data lands in the block cache, consecutive sectors are merged when it is flushed
+    uint32_t cluster_size = fat32_cluster_size(disk);
+    const char *in_ptr = in;
+    uint32_t left = total;
+    while (left > 0)
+    {
+        int cluster = fat32_get_cluster_for_offset(disk, &desc->cursor, desc->pos);
+        if (cluster < 0)
+        {
+            // Past the end of the chain, the cursor sits on its last cluster
+            res = fat32_allocate_cluster(disk, desc->cursor.cluster);
+            if (res < 0)
+            {
+                goto out;
+            }
+            continue;
+        }
+
+        uint32_t offset_from_cluster = desc->pos % cluster_size;
+        uint32_t total_to_write = cluster_size - offset_from_cluster;
+        if (total_to_write > left)
+        {
+            total_to_write = left;
+        }
+
+        res = diskstreamer_seek_sector(private->cluster_stream, fat32_cluster_to_sector(private, cluster), offset_from_cluster);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        res = diskstreamer_write(private->cluster_stream, in_ptr, total_to_write);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        in_ptr += total_to_write;
+        left -= total_to_write;
+        desc->pos += total_to_write;
+    }
+
+    if (desc->pos > desc->item.filesize)
+    {
+        desc->item.filesize = desc->pos;
+    }
+
+    desc->dirty = true;
+    res = fat32_write_directory_item(disk, desc->item_pos, &desc->item);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = nmemb;
+out:
+    if (res < 0)
+    {
+        print("FAT32: Write error\n");
+    }
+    return res;
+}
+
+int fat32_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode)
+{
+    struct fat32_file_descriptor *desc = private;
+    if (desc->item.attribute & FAT32_FILE_SUBDIRECTORY)
+    {
+        return -EINVARG;
+    }
+
+    // The end of the file is where appending writes go
+    if (offset > desc->item.filesize)
+    {
+        return -EIO;
+    }
+
+    switch (seek_mode)
+    {
+    case SEEK_SET:
+        desc->pos = offset;
+        break;
+
+    case SEEK_CUR:
+        desc->pos += offset;
+        break;
+
+    default:
+        return -EUNIMP;
+    }
+
+    return 0;
+}
+
+/**
+ * Lists the directory from its chain on the disk, *pos is the index of an item in it. Deleted
+ * entries, volume labels and long name entries are skipped
+ */
+int fat32_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max)
+{
+    struct fat32_file_descriptor *desc = private;
+    if (!(desc->item.attribute & FAT32_FILE_SUBDIRECTORY))
+    {
+        return -EINVARG;
+    }
+
+    int total = 0;
+    while (total < max)
+    {
+        struct fat32_directory_item item;
+        if (fat32_read_directory_item(disk, &desc->cursor, *pos, &item, 0) < 0 || item.filename[0] == 0x00)
+        {
+            // Nothing follows the first unused entry
+            break;
+        }
+
+        *pos += 1;
+        if (!fat32_item_is_listed(&item))
+        {
+            continue;
+        }
+
+        struct file_dirent *dirent = &out[total++];
+        char *name = dirent->name;
+        for (int i = 0; i < 8 && item.filename[i] != ' '; i++)
+        {
+            *name++ = item.filename[i];
+        }
+        if (item.ext[0] != ' ')
+        {
+            *name++ = '.';
+            for (int i = 0; i < 3 && item.ext[i] != ' '; i++)
+            {
+                *name++ = item.ext[i];
+            }
+        }
+        *name = 0x00;
+
+        dirent->size = item.filesize;
+        dirent->first_cluster = fat32_get_first_cluster(&item);
+        dirent->attributes = 0;
+        if (item.attribute & FAT32_FILE_SUBDIRECTORY)
+        {
+            dirent->attributes |= FILE_DIRENT_DIRECTORY;
+        }
+        if (item.attribute & FAT32_FILE_READ_ONLY)
+        {
+            dirent->attributes |= FILE_DIRENT_READ_ONLY;
+        }
+        if (item.attribute & FAT32_FILE_HIDDEN)
+        {
+            dirent->attributes |= FILE_DIRENT_HIDDEN;
+        }
+        if (item.attribute & FAT32_FILE_SYSTEM)
+        {
+            dirent->attributes |= FILE_DIRENT_SYSTEM;
+        }
+    }
+
+    return total;
+}
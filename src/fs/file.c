@@ -5,11 +5,24 @@
 #include "string/string.h"
 #include "disk/disk.h"
 #include "fat/fat16.h"
+#include "fat/fat32.h"
+#include "initramfs/initramfs.h"
+#include "vfs.h"
+#include "loader/exectable.h"
+#include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+#include "memory/frame/frame.h"
 #include "status.h"
 #include "kernel.h"
 struct filesystem* filesystems[PEACHOS_MAX_FILESYSTEMS];
 struct file_descriptor* file_descriptors[PEACHOS_MAX_FILE_DESCRIPTORS];
 
+#define FILE_DESCRIPTOR_MAP_WORDS (PEACHOS_MAX_FILE_DESCRIPTORS / 32)
+
+// Bit n is set while file_descriptors[n] is taken, no word below the hint has a free bit
+static uint32_t file_descriptor_map[FILE_DESCRIPTOR_MAP_WORDS];
+static int file_descriptor_hint = 0;
+
 static struct filesystem** fs_get_free_filesystem()
 {
     int i = 0;
@@ -39,7 +52,10 @@ void fs_insert_filesystem(struct filesystem* filesystem)
 
 static void fs_static_load()
 {
+    // First, it turns down every other disk without reading from it
+    fs_insert_filesystem(initramfs_init());
     fs_insert_filesystem(fat16_init());
+    fs_insert_filesystem(fat32_init());
 }
 
 void fs_load()
@@ -51,29 +67,50 @@ void fs_load()
 void fs_init()
 {
     memset(file_descriptors, 0, sizeof(file_descriptors));
+    memset(file_descriptor_map, 0, sizeof(file_descriptor_map));
     fs_load();
 }
 
 static void file_free_descriptor(struct file_descriptor* desc)
 {
-    file_descriptors[desc->index-1] = 0x00;
+    int i = desc->index - 1;
+    file_descriptors[i] = 0x00;
+    file_descriptor_map[i / 32] &= ~(1U << (i % 32));
+    if (desc->inode)
+    {
+        vfs_inode_put(desc->inode);
+    }
+    if (i / 32 < file_descriptor_hint)
+    {
+        file_descriptor_hint = i / 32;
+    }
     kfree(desc);
 }
 
+/**
+ * Takes the lowest free descriptor, the hint skips the words that are full
+ */
 static int file_new_descriptor(struct file_descriptor** desc_out)
 {
     int res = -ENOMEM;
-    for (int i = 0; i < PEACHOS_MAX_FILE_DESCRIPTORS; i++)
+    while (file_descriptor_hint < FILE_DESCRIPTOR_MAP_WORDS && file_descriptor_map[file_descriptor_hint] == 0xffffffff)
+    {
+        file_descriptor_hint++;
+    }
+
+    if (file_descriptor_hint < FILE_DESCRIPTOR_MAP_WORDS)
     {
-        if (file_descriptors[i] == 0)
+        int i = file_descriptor_hint * 32 + __builtin_ctz(~file_descriptor_map[file_descriptor_hint]);
+        struct file_descriptor* desc = kzalloc(sizeof(struct file_descriptor));
+        if (desc)
         {
-            struct file_descriptor* desc = kzalloc(sizeof(struct file_descriptor));
             // Descriptors start at 1
             desc->index = i + 1;
+            desc->refcount = 1;
             file_descriptors[i] = desc;
+            file_descriptor_map[i / 32] |= 1U << (i % 32);
             *desc_out = desc;
             res = 0;
-            break;
         }
     }
 
@@ -92,6 +129,54 @@ static struct file_descriptor* file_get_descriptor(int fd)
     return file_descriptors[index];
 }
 
+// Files without a disk, such as pipes, look after their own locking
+static void file_lock(struct file_descriptor* desc)
+{
+    if (desc->disk)
+    {
+        sleep_lock_acquire(&desc->disk->lock);
+    }
+}
+
+static void file_unlock(struct file_descriptor* desc)
+{
+    if (desc->disk)
+    {
+        sleep_lock_release(&desc->disk->lock);
+    }
+}
+
+/**
+ * Opens a descriptor for a file that lives on no disk, returns the descriptor or a negative error
+ */
+int file_new(struct filesystem* filesystem, void* private)
+{
+    struct file_descriptor* desc = 0;
+    int res = file_new_descriptor(&desc);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    desc->filesystem = filesystem;
+    desc->private = private;
+    return desc->index;
+}
+
+/**
+ * Returns the private data of the descriptor when it belongs to the filesystem, NULL otherwise
+ */
+void* file_private(int fd, struct filesystem* filesystem)
+{
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc || desc->filesystem != filesystem)
+    {
+        return 0;
+    }
+
+    return desc->private;
+}
+
 struct filesystem* fs_resolve(struct disk* disk)
 {
     struct filesystem* fs = 0;
@@ -135,22 +220,17 @@ int fopen(const char* filename, const char* mode_str)
     FILE_MODE mode = FILE_MODE_INVALID;
     void* descriptor_private_data = NULL;
     struct file_descriptor* desc = 0;
-    struct path_root* root_path = pathparser_parse(filename, NULL);
-    if (!root_path)
+    struct path_root root_path;
+    res = pathparser_parse(&root_path, filename);
+    if (res < 0)
     {
         res = -EINVARG;
         goto out;
     }
 
-    // We cannot have just a root path 0:/ 0:/test.txt
-    if (!root_path->first)
-    {
-        res = -EINVARG;
-        goto out;
-    }
 
     // Ensure the disk we are reading from exists
-    disk = disk_get(root_path->drive_no);
+    disk = disk_get(root_path.drive_no);
     if (!disk)
     {
         res = -EIO;
@@ -170,7 +250,16 @@ int fopen(const char* filename, const char* mode_str)
         goto out;
     }
 
-    descriptor_private_data = disk->filesystem->open(disk, root_path->first, mode);
+    // Just the drive 0:/ is its root directory, it can only be listed
+    if (root_path.total == 0 && mode != FILE_MODE_READ)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    sleep_lock_acquire(&disk->lock);
+    descriptor_private_data = disk->filesystem->open(disk, &root_path, mode);
+    sleep_lock_release(&disk->lock);
     if (ISERR(descriptor_private_data))
     {
         res = ERROR_I(descriptor_private_data);
@@ -186,6 +275,32 @@ int fopen(const char* filename, const char* mode_str)
     desc->filesystem = disk->filesystem;
     desc->private = descriptor_private_data;
     desc->disk = disk;
+    desc->inode = vfs_inode_get(disk, &root_path);
+    if (!desc->inode)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    if (mode != FILE_MODE_READ)
+    {
+        // Opening for writing may truncate the file, what is cached of it is stale then
+        vfs_inode_invalidate(desc->inode);
+        exectable_invalidate(disk);
+    }
+
+    if (mode == FILE_MODE_APPEND)
+    {
+        struct file_stat stat;
+        sleep_lock_acquire(&disk->lock);
+        res = disk->filesystem->stat(disk, descriptor_private_data, &stat);
+        sleep_lock_release(&disk->lock);
+        if (res < 0)
+        {
+            goto out;
+        }
+        desc->pos = stat.filesize;
+    }
     res = desc->index;
 
 out:
@@ -193,15 +308,11 @@ out:
     if (res < 0)
     {
         // ERROR
-        if (root_path)
-        {
-            pathparser_free(root_path);
-            root_path = NULL;
-        }
-
-        if (disk && descriptor_private_data)
+        if (disk && descriptor_private_data && !ISERR(descriptor_private_data))
         {
+            sleep_lock_acquire(&disk->lock);
             disk->filesystem->close(descriptor_private_data);
+            sleep_lock_release(&disk->lock);
             descriptor_private_data = NULL;
         }
 
@@ -229,7 +340,35 @@ int fstat(int fd, struct file_stat* stat)
         goto out;
     }
 
+    file_lock(desc);
     res = desc->filesystem->stat(desc->disk, desc->private, stat);
+    file_unlock(desc);
+out:
+    return res;
+}
+
+/**
+ * Lists an open directory, see FS_READDIR_FUNCTION
+ */
+int freaddir(int fd, uint32_t* pos, struct file_dirent* out, int max)
+{
+    int res = 0;
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc || max <= 0)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (!desc->filesystem->readdir)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    file_lock(desc);
+    res = desc->filesystem->readdir(desc->disk, desc->private, pos, out, max);
+    file_unlock(desc);
 out:
     return res;
 }
@@ -244,7 +383,14 @@ int fclose(int fd)
         goto out;
     }
 
+    if (--desc->refcount > 0)
+    {
+        goto out;
+    }
+
+    file_lock(desc);
     res = desc->filesystem->close(desc->private);
+    file_unlock(desc);
     if (res == PEACHOS_ALL_OK)
     {
         file_free_descriptor(desc);
@@ -253,6 +399,24 @@ out:
     return res;
 }
 
+/**
+ * Takes another reference on an open file, it stays open until every holder closes it
+ */
+int fdup(int fd)
+{
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc)
+    {
+        return -EIO;
+    }
+
+    desc->refcount++;
+    return fd;
+}
+
+/**
+ * The position of a file with an inode is kept here, its filesystem is told before each write
+ */
 int fseek(int fd, int offset, FILE_SEEK_MODE whence)
 {
     int res = 0;
@@ -263,10 +427,182 @@ int fseek(int fd, int offset, FILE_SEEK_MODE whence)
         goto out;
     }
 
-    res = desc->filesystem->seek(desc->private, offset, whence);
+    file_lock(desc);
+    if (!desc->inode)
+    {
+        res = desc->filesystem->seek(desc->private, offset, whence);
+        goto out_unlock;
+    }
+
+    switch (whence)
+    {
+        case SEEK_SET:
+            desc->pos = offset;
+            break;
+
+        case SEEK_CUR:
+            desc->pos += offset;
+            break;
+
+        case SEEK_END:
+        {
+            struct file_stat stat;
+            res = desc->filesystem->stat(desc->disk, desc->private, &stat);
+            if (res == 0)
+            {
+                desc->pos = stat.filesize + offset;
+            }
+            break;
+        }
+
+        default:
+            res = -EINVARG;
+            break;
+    }
+out_unlock:
+    file_unlock(desc);
 out:
     return res;
 }
+
+/**
+ * Reads count pages of the file from page index on into the cache, the caller holds the disk
+ */
+static int file_fill_pages(struct file_descriptor* desc, uint32_t index, int count, uint32_t filesize)
+{
+    int res = 0;
+    void* pages[PEACHOS_PAGE_CACHE_FILL_PAGES];
+    struct file_iovec iov[PEACHOS_PAGE_CACHE_FILL_PAGES];
+    int total = 0;
+    for (total = 0; total < count; total++)
+    {
+        pages[total] = frame_zalloc();
+        if (!pages[total])
+        {
+            res = -ENOMEM;
+            goto out;
+        }
+
+        uint32_t pos = (index + total) * PAGING_PAGE_SIZE;
+        iov[total].base = pages[total];
+        iov[total].len = filesize - pos < PAGING_PAGE_SIZE ? filesize - pos : PAGING_PAGE_SIZE;
+    }
+
+    res = desc->filesystem->seek(desc->private, index * PAGING_PAGE_SIZE, SEEK_SET);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (desc->filesystem->readv)
+    {
+        res = desc->filesystem->readv(desc->disk, desc->private, iov, count);
+    }
+    else
+    {
+        for (int i = 0; i < count && res >= 0; i++)
+        {
+            res = desc->filesystem->read(desc->disk, desc->private, iov[i].len, 1, iov[i].base);
+        }
+    }
+
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        void* cached = vfs_page_add(desc->inode, index + i, pages[i]);
+        if (ISERR(cached))
+        {
+            res = ERROR_I(cached);
+            // The rest was never handed over
+            for (i++; i < count; i++)
+            {
+                frame_free(pages[i]);
+            }
+            break;
+        }
+    }
+    total = 0;
+out:
+    for (int i = 0; i < total; i++)
+    {
+        frame_free(pages[i]);
+    }
+    return res;
+}
+
+/**
+ * Returns cached page index of the file, reading it in with up to ahead more missing pages
+ * that follow it when it is not cached. The caller holds the disk
+ */
+static void* file_cached_page(struct file_descriptor* desc, uint32_t index, int ahead, uint32_t filesize)
+{
+    void* page = vfs_page_find(desc->inode, index);
+    if (page)
+    {
+        return page;
+    }
+
+    uint32_t last = (filesize - 1) / PAGING_PAGE_SIZE;
+    int count = 1;
+    while (count <= ahead && count < PEACHOS_PAGE_CACHE_FILL_PAGES && index + count <= last &&
+           !vfs_page_find(desc->inode, index + count))
+    {
+        count++;
+    }
+
+    int res = file_fill_pages(desc, index, count, filesize);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+
+    page = vfs_page_find(desc->inode, index);
+    return page ? page : ERROR(-EIO);
+}
+
+/**
+ * Copies total bytes from the position of a file with an inode through the page cache. The
+ * caller holds the disk
+ */
+static int file_read_cached(struct file_descriptor* desc, char* out, uint32_t total)
+{
+    struct file_stat stat;
+    int res = desc->filesystem->stat(desc->disk, desc->private, &stat);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (desc->pos > stat.filesize || total > stat.filesize - desc->pos)
+    {
+        return -EIO;
+    }
+
+    while (total)
+    {
+        uint32_t index = desc->pos / PAGING_PAGE_SIZE;
+        uint32_t offset = desc->pos % PAGING_PAGE_SIZE;
+        uint32_t len = PAGING_PAGE_SIZE - offset < total ? PAGING_PAGE_SIZE - offset : total;
+        int ahead = (total - len + PAGING_PAGE_SIZE - 1) / PAGING_PAGE_SIZE;
+        char* page = file_cached_page(desc, index, ahead, stat.filesize);
+        if (ISERR(page))
+        {
+            return ERROR_I(page);
+        }
+
+        memcpy(out, page + offset, len);
+        out += len;
+        desc->pos += len;
+        total -= len;
+    }
+
+    return 0;
+}
+
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd)
 {
     int res = 0;
@@ -283,7 +619,184 @@ int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd)
         goto out;
     }
 
-    res = desc->filesystem->read(desc->disk, desc->private, size, nmemb, (char*) ptr);
+    file_lock(desc);
+    if (desc->inode)
+    {
+        uint32_t total = size * nmemb;
+        res = total / nmemb != size ? -EINVARG : file_read_cached(desc, ptr, total);
+        if (res == 0)
+        {
+            res = nmemb;
+        }
+    }
+    else
+    {
+        res = desc->filesystem->read(desc->disk, desc->private, size, nmemb, (char*) ptr);
+    }
+    file_unlock(desc);
 out:
     return res;
-}
\ No newline at end of file
+}
+
+int freadv(int fd, struct file_iovec* iov, int iovcnt)
+{
+    int res = 0;
+    if (!iov || iovcnt <= 0 || fd < 1)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    file_lock(desc);
+    if (desc->filesystem->readv && !desc->inode)
+    {
+        res = desc->filesystem->readv(desc->disk, desc->private, iov, iovcnt);
+    }
+    else
+    {
+        int total = 0;
+        for (int i = 0; i < iovcnt; i++)
+        {
+            if (iov[i].len == 0)
+            {
+                continue;
+            }
+
+            if (desc->inode)
+            {
+                res = file_read_cached(desc, iov[i].base, iov[i].len);
+            }
+            else
+            {
+                res = desc->filesystem->read(desc->disk, desc->private, iov[i].len, 1, (char*) iov[i].base);
+            }
+
+            if (res < 0)
+            {
+                break;
+            }
+            total += iov[i].len;
+        }
+
+        if (res >= 0)
+        {
+            res = total;
+        }
+    }
+    file_unlock(desc);
+out:
+    return res;
+}
+
+/**
+ * Returns the cached page of the file that starts at offset and takes a reference on it for
+ * the caller, who drops it with cow_page_put. length is set to the bytes of the file in the
+ * page, the rest of it is zero
+ */
+void* file_get_page(int fd, uint32_t offset, uint32_t* length)
+{
+    void* page = 0;
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc || !desc->inode || offset % PAGING_PAGE_SIZE)
+    {
+        return ERROR(-EINVARG);
+    }
+
+    file_lock(desc);
+    struct file_stat stat;
+    int res = desc->filesystem->stat(desc->disk, desc->private, &stat);
+    if (res < 0 || offset >= stat.filesize)
+    {
+        page = ERROR(res < 0 ? res : -EIO);
+        goto out;
+    }
+
+    page = file_cached_page(desc, offset / PAGING_PAGE_SIZE, 0, stat.filesize);
+    if (!ISERR(page))
+    {
+        cow_page_get(page);
+        *length = stat.filesize - offset < PAGING_PAGE_SIZE ? stat.filesize - offset : PAGING_PAGE_SIZE;
+    }
+out:
+    file_unlock(desc);
+    return page;
+}
+
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd)
+{
+    int res = 0;
+    if (size == 0 || nmemb == 0 || fd < 1)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (!desc->filesystem->write)
+    {
+        res = -ERDONLY;
+        goto out;
+    }
+
+    file_lock(desc);
+    if (desc->inode)
+    {
+        res = desc->filesystem->seek(desc->private, desc->pos, SEEK_SET);
+        if (res < 0)
+        {
+            goto out_unlock;
+        }
+
+        // Mappings keep the pages they hold, only later reads see the new data
+        vfs_inode_invalidate(desc->inode);
+        exectable_invalidate(desc->disk);
+    }
+
+    res = desc->filesystem->write(desc->disk, desc->private, size, nmemb, (const char*) ptr);
+    if (res > 0 && desc->inode)
+    {
+        desc->pos += res * size;
+    }
+out_unlock:
+    file_unlock(desc);
+out:
+    return res;
+}
+
+/**
+ * Writes everything cached for the file's disk back to it
+ */
+int fsync(int fd)
+{
+    int res = 0;
+    struct file_descriptor* desc = file_get_descriptor(fd);
+    if (!desc)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (!desc->disk)
+    {
+        goto out;
+    }
+
+    file_lock(desc);
+    res = disk_flush(desc->disk);
+    file_unlock(desc);
+out:
+    return res;
+}
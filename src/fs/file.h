@@ -29,9 +29,21 @@ enum
 
 typedef unsigned int FILE_STAT_FLAGS;
 
+// One buffer of a scatter read
+struct file_iovec
+{
+    void* base;
+    uint32_t len;
+};
+
 struct disk;
-typedef void*(*FS_OPEN_FUNCTION)(struct disk* disk, struct path_part* path, FILE_MODE mode);
+struct inode;
+typedef void*(*FS_OPEN_FUNCTION)(struct disk* disk, struct path_root* path, FILE_MODE mode);
 typedef int (*FS_READ_FUNCTION)(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+// Fills every buffer in turn from the current position, returns the total bytes read
+typedef int (*FS_READV_FUNCTION)(struct disk* disk, void* private, struct file_iovec* iov, int iovcnt);
+// Writes at the current position, growing the file as needed. Returns the items written
+typedef int (*FS_WRITE_FUNCTION)(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
 typedef int (*FS_RESOLVE_FUNCTION)(struct disk* disk);
 
 typedef int (*FS_CLOSE_FUNCTION)(void* private);
@@ -47,14 +59,44 @@ struct file_stat
 
 typedef int (*FS_STAT_FUNCTION)(struct disk* disk, void* private, struct file_stat* stat);
 
+enum
+{
+    FILE_DIRENT_DIRECTORY = 0b00000001,
+    FILE_DIRENT_READ_ONLY = 0b00000010,
+    FILE_DIRENT_HIDDEN = 0b00000100,
+    FILE_DIRENT_SYSTEM = 0b00001000
+};
+
+// An 8.3 name with its dot and terminator
+#define FILE_DIRENT_NAME_MAX 13
+
+// An entry of a directory listing, user programs get the same layout
+struct file_dirent
+{
+    uint32_t size;
+    uint32_t first_cluster;
+    uint8_t attributes;
+    char name[FILE_DIRENT_NAME_MAX];
+};
+
+// Fills up to max entries from entry *pos of an open directory on, moving *pos past the last one
+// looked at. Returns how many were filled, zero at the end of the directory
+typedef int (*FS_READDIR_FUNCTION)(struct disk* disk, void* private, uint32_t* pos, struct file_dirent* out, int max);
+
 struct filesystem
 {
     // Filesystem should return zero from resolve if the provided disk is using its filesystem
     FS_RESOLVE_FUNCTION resolve;
     FS_OPEN_FUNCTION open;
     FS_READ_FUNCTION read;
+    // Optional, freadv falls back to one read per buffer without it
+    FS_READV_FUNCTION readv;
+    // Optional, files can only be opened for reading without it
+    FS_WRITE_FUNCTION write;
     FS_SEEK_FUNCTION seek;
     FS_STAT_FUNCTION stat;
+    // Optional, only filesystems with directories have it
+    FS_READDIR_FUNCTION readdir;
     FS_CLOSE_FUNCTION close;
     char name[20];
 };
@@ -70,6 +112,14 @@ struct file_descriptor
 
     // The disk that the file descriptor should be used on
     struct disk* disk;
+
+    // Holders of the descriptor, fdup adds one and the last fclose closes the file
+    int refcount;
+
+    // Files on a disk are read through the page cache of their inode, NULL for pipes
+    struct inode* inode;
+    // Where the next read or write of a file with an inode happens
+    uint32_t pos;
 };
 
 
@@ -78,8 +128,16 @@ void fs_init();
 int fopen(const char* filename, const char* mode_str);
 int fseek(int fd, int offset, FILE_SEEK_MODE whence);
 int fread(void* ptr, uint32_t size, uint32_t nmemb, int fd);
+int freadv(int fd, struct file_iovec* iov, int iovcnt);
+int fwrite(const void* ptr, uint32_t size, uint32_t nmemb, int fd);
+int fsync(int fd);
 int fstat(int fd, struct file_stat* stat);
+int freaddir(int fd, uint32_t* pos, struct file_dirent* out, int max);
 int fclose(int fd);
+int fdup(int fd);
+int file_new(struct filesystem* filesystem, void* private);
+void* file_private(int fd, struct filesystem* filesystem);
+void* file_get_page(int fd, uint32_t offset, uint32_t* length);
 
 void fs_insert_filesystem(struct filesystem* filesystem);
 struct filesystem* fs_resolve(struct disk* disk);
@@ -0,0 +1,45 @@
+#ifndef INITRAMFS_FORMAT_H
+#define INITRAMFS_FORMAT_H
+
+#include <stdint.h>
+
+// Layout of the initramfs image, shared with tools/mkinitramfs.c so keep it free of kernel headers.
+// The header is followed by the index and then the data of every file
+
+#define INITRAMFS_MAGIC 0x44524950 // "PIRD"
+#define INITRAMFS_VERSION 1
+#define INITRAMFS_NAME_MAX 32
+
+// The file's data is LZSS packed, otherwise it is stored as it is
+#define INITRAMFS_ENTRY_PACKED 0x01
+
+// LZSS groups start with a flag byte, read from its lowest bit up. A set bit is a literal byte, a
+// clear bit a two byte match: the low 12 bits are the distance back minus one, the high 4 bits the
+// length minus INITRAMFS_LZ_MIN_MATCH
+#define INITRAMFS_LZ_WINDOW 4096
+#define INITRAMFS_LZ_MIN_MATCH 3
+#define INITRAMFS_LZ_MAX_MATCH 18
+
+struct initramfs_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_entries;
+    // Size of the whole image in bytes
+    uint32_t image_size;
+} __attribute__((packed));
+
+// The index is sorted by name so a lookup is a binary search
+struct initramfs_entry
+{
+    // Lower case and terminated
+    char name[INITRAMFS_NAME_MAX];
+    // From the start of the image
+    uint32_t offset;
+    uint32_t size;
+    // Bytes the data takes up in the image, the same as size unless it is packed
+    uint32_t stored_size;
+    uint32_t flags;
+} __attribute__((packed));
+
+#endif
@@ -0,0 +1,12 @@
+[BITS 32]
+
+section .asm
+
+global initramfs_image
+global initramfs_image_end
+
+; The archive built from ./rootfs goes out with kernel.bin so the boot loader loads it as well
+align 4
+initramfs_image:
+    incbin "./bin/initramfs.img"
+initramfs_image_end:
@@ -0,0 +1,411 @@
+#include "initramfs.h"
+#include "format.h"
+#include "disk/disk.h"
+#include "string/string.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "status.h"
+#include "kernel.h"
+#include <stdbool.h>
+
+// Both provided by initramfs.asm
+extern char initramfs_image[];
+extern char initramfs_image_end[];
+
+struct initramfs_private
+{
+    struct initramfs_header *header;
+    struct initramfs_entry *entries;
+    // Data of every entry once it has been needed, packed entries are unpacked on their first open
+    // and stay in the heap from then on
+    const char **data;
+};
+
+struct initramfs_file_descriptor
+{
+    // Zero for the root directory, the only directory there is
+    struct initramfs_entry *entry;
+    const char *data;
+    uint32_t pos;
+};
+
+int initramfs_resolve(struct disk *disk);
+void *initramfs_open(struct disk *disk, struct path_root *path, FILE_MODE mode);
+int initramfs_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr);
+int initramfs_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt);
+int initramfs_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode);
+int initramfs_stat(struct disk *disk, void *private, struct file_stat *stat);
+int initramfs_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max);
+int initramfs_close(void *private);
+
+struct filesystem initramfs_fs =
+    {
+        .resolve = initramfs_resolve,
+        .open = initramfs_open,
+        .read = initramfs_read,
+        .readv = initramfs_readv,
+        .seek = initramfs_seek,
+        .stat = initramfs_stat,
+        .readdir = initramfs_readdir,
+        .close = initramfs_close
+    };
+
+struct filesystem *initramfs_init()
+{
+    strcpy(initramfs_fs.name, "INITRAMFS");
+    return &initramfs_fs;
+}
+
+static bool initramfs_image_valid(struct initramfs_header *header, uint32_t length)
+{
+    if (length < sizeof(struct initramfs_header) || header->magic != INITRAMFS_MAGIC ||
+        header->version != INITRAMFS_VERSION || header->image_size > length)
+    {
+        return false;
+    }
+
+    struct initramfs_entry *entries = (struct initramfs_entry *)(header + 1);
+    uint32_t index_end = sizeof(struct initramfs_header) + header->total_entries * sizeof(struct initramfs_entry);
+    if (header->total_entries > length / sizeof(struct initramfs_entry) || index_end > header->image_size)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->total_entries; i++)
+    {
+        struct initramfs_entry *entry = &entries[i];
+        if (entry->name[INITRAMFS_NAME_MAX - 1] != 0x00 || entry->offset < index_end ||
+            entry->offset > header->image_size || entry->stored_size > header->image_size - entry->offset)
+        {
+            return false;
+        }
+
+        if (!(entry->flags & INITRAMFS_ENTRY_PACKED) && entry->stored_size != entry->size)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int initramfs_resolve(struct disk *disk)
+{
+    int res = 0;
+    if (disk->type != PEACHOS_DISK_TYPE_INITRAMFS)
+    {
+        res = -EFSNOTUS;
+        goto out;
+    }
+
+    struct initramfs_header *header = (struct initramfs_header *)initramfs_image;
+    if (!initramfs_image_valid(header, initramfs_image_end - initramfs_image))
+    {
+        print("INITRAMFS: Invalid image\n");
+        res = -EINFORMAT;
+        goto out;
+    }
+
+    struct initramfs_private *private = kzalloc(sizeof(struct initramfs_private));
+    if (!private)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    private->header = header;
+    private->entries = (struct initramfs_entry *)(header + 1);
+    private->data = kzalloc((header->total_entries ? header->total_entries : 1) * sizeof(char *));
+    if (!private->data)
+    {
+        kfree(private);
+        res = -ENOMEM;
+        goto out;
+    }
+
+    disk->fs_private = private;
+    disk->filesystem = &initramfs_fs;
+out:
+    return res;
+}
+
+/**
+ * Undoes the LZSS packing of tools/mkinitramfs.c, see format.h
+ */
+static int initramfs_unpack(const unsigned char *in, uint32_t in_size, char *out, uint32_t out_size)
+{
+    uint32_t in_pos = 0;
+    uint32_t out_pos = 0;
+    while (out_pos < out_size)
+    {
+        if (in_pos >= in_size)
+        {
+            return -EINFORMAT;
+        }
+
+        uint8_t flags = in[in_pos++];
+        for (int bit = 0; bit < 8 && out_pos < out_size; bit++)
+        {
+            if (flags & (1 << bit))
+            {
+                if (in_pos >= in_size)
+                {
+                    return -EINFORMAT;
+                }
+                out[out_pos++] = in[in_pos++];
+                continue;
+            }
+
+            if (in_pos + 2 > in_size)
+            {
+                return -EINFORMAT;
+            }
+
+            uint32_t distance = (in[in_pos] | ((in[in_pos + 1] & 0xf0) << 4)) + 1;
+            uint32_t length = (in[in_pos + 1] & 0x0f) + INITRAMFS_LZ_MIN_MATCH;
+            in_pos += 2;
+            if (distance > out_pos || length > out_size - out_pos)
+            {
+                return -EINFORMAT;
+            }
+
+            // Byte by byte, a match may overlap the bytes it produces
+            for (uint32_t i = 0; i < length; i++, out_pos++)
+            {
+                out[out_pos] = out[out_pos - distance];
+            }
+        }
+    }
+
+    return 0;
+}
+
+static const char *initramfs_entry_data(struct initramfs_private *private, struct initramfs_entry *entry)
+{
+    int index = entry - private->entries;
+    if (private->data[index])
+    {
+        return private->data[index];
+    }
+
+    const char *stored = (const char *)private->header + entry->offset;
+    if (!(entry->flags & INITRAMFS_ENTRY_PACKED))
+    {
+        private->data[index] = stored;
+        return stored;
+    }
+
+    char *unpacked = kmalloc(entry->size ? entry->size : 1);
+    if (!unpacked)
+    {
+        return ERROR(-ENOMEM);
+    }
+
+    int res = initramfs_unpack((const unsigned char *)stored, entry->stored_size, unpacked, entry->size);
+    if (res < 0)
+    {
+        print("INITRAMFS: Corrupt file\n");
+        kfree(unpacked);
+        return ERROR(res);
+    }
+
+    private->data[index] = unpacked;
+    return unpacked;
+}
+
+/**
+ * Binary search of the sorted index, names are stored in lower case
+ */
+static struct initramfs_entry *initramfs_lookup(struct initramfs_private *private, const struct path_part *part)
+{
+    if (part->len >= INITRAMFS_NAME_MAX)
+    {
+        return 0;
+    }
+
+    char name[INITRAMFS_NAME_MAX];
+    for (int i = 0; i < part->len; i++)
+    {
+        name[i] = tolower(part->part[i]);
+    }
+    name[part->len] = 0x00;
+
+    int low = 0;
+    int high = private->header->total_entries - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        struct initramfs_entry *entry = &private->entries[middle];
+        int cmp = strncmp(name, entry->name, INITRAMFS_NAME_MAX);
+        if (cmp == 0)
+        {
+            return entry;
+        }
+
+        if (cmp < 0)
+        {
+            high = middle - 1;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return 0;
+}
+
+void *initramfs_open(struct disk *disk, struct path_root *path, FILE_MODE mode)
+{
+    struct initramfs_private *private = disk->fs_private;
+    if (mode != FILE_MODE_READ)
+    {
+        return ERROR(-ERDONLY);
+    }
+
+    // Every file sits in the root directory
+    struct initramfs_entry *entry = 0;
+    const char *data = 0;
+    if (path->total > 1)
+    {
+        return ERROR(-EBADPATH);
+    }
+
+    if (path->total == 1)
+    {
+        entry = initramfs_lookup(private, &path->parts[0]);
+        if (!entry)
+        {
+            return ERROR(-EBADPATH);
+        }
+
+        data = initramfs_entry_data(private, entry);
+        if (ISERR(data))
+        {
+            return (void *)data;
+        }
+    }
+
+    struct initramfs_file_descriptor *descriptor = kzalloc(sizeof(struct initramfs_file_descriptor));
+    if (!descriptor)
+    {
+        return ERROR(-ENOMEM);
+    }
+
+    descriptor->entry = entry;
+    descriptor->data = data;
+    return descriptor;
+}
+
+int initramfs_read(struct disk *disk, void *descriptor, uint32_t size, uint32_t nmemb, char *out_ptr)
+{
+    struct initramfs_file_descriptor *desc = descriptor;
+    uint32_t total = size * nmemb;
+    if (!desc->entry || (nmemb != 0 && total / nmemb != size))
+    {
+        return -EINVARG;
+    }
+
+    if (total > desc->entry->size - desc->pos)
+    {
+        return -EIO;
+    }
+
+    memcpy(out_ptr, (void *)(desc->data + desc->pos), total);
+    desc->pos += total;
+    return nmemb;
+}
+
+int initramfs_readv(struct disk *disk, void *descriptor, struct file_iovec *iov, int iovcnt)
+{
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        int res = initramfs_read(disk, descriptor, iov[i].len, 1, iov[i].base);
+        if (res < 0)
+        {
+            return res;
+        }
+        total += iov[i].len;
+    }
+
+    return total;
+}
+
+int initramfs_seek(void *private, uint32_t offset, FILE_SEEK_MODE seek_mode)
+{
+    struct initramfs_file_descriptor *desc = private;
+    if (!desc->entry)
+    {
+        return -EINVARG;
+    }
+
+    uint32_t pos = offset;
+    switch (seek_mode)
+    {
+    case SEEK_SET:
+        break;
+
+    case SEEK_CUR:
+        pos += desc->pos;
+        break;
+
+    default:
+        return -EUNIMP;
+    }
+
+    if (pos > desc->entry->size)
+    {
+        return -EIO;
+    }
+
+    desc->pos = pos;
+    return 0;
+}
+
+int initramfs_stat(struct disk *disk, void *private, struct file_stat *stat)
+{
+    struct initramfs_file_descriptor *desc = private;
+    if (!desc->entry)
+    {
+        return -EINVARG;
+    }
+
+    stat->filesize = desc->entry->size;
+    stat->flags = FILE_STAT_READ_ONLY;
+    return 0;
+}
+
+/**
+ * Lists the root directory in index order, *pos is the index of the next entry
+ */
+int initramfs_readdir(struct disk *disk, void *private, uint32_t *pos, struct file_dirent *out, int max)
+{
+    struct initramfs_private *fs_private = disk->fs_private;
+    struct initramfs_file_descriptor *desc = private;
+    if (desc->entry)
+    {
+        return -EINVARG;
+    }
+
+    int total = 0;
+    while (total < max && *pos < fs_private->header->total_entries)
+    {
+        struct initramfs_entry *entry = &fs_private->entries[*pos];
+        struct file_dirent *dirent = &out[total++];
+        // Names longer than a dirent holds are cut short, they can still be opened in full
+        strncpy(dirent->name, entry->name, sizeof(dirent->name));
+        dirent->size = entry->size;
+        dirent->first_cluster = 0;
+        dirent->attributes = FILE_DIRENT_READ_ONLY;
+        *pos += 1;
+    }
+
+    return total;
+}
+
+int initramfs_close(void *private)
+{
+    kfree(private);
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include "file.h"
+struct filesystem* initramfs_init();
+#endif
@@ -0,0 +1,340 @@
+#include "pipe.h"
+#include "file.h"
+#include "status.h"
+#include "kernel.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+
+static int pipe_fs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out);
+static int pipe_fs_write(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in);
+static int pipe_fs_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode);
+static int pipe_fs_stat(struct disk* disk, void* private, struct file_stat* stat);
+static int pipe_fs_close(void* private);
+
+// Pipe ends are file descriptors without a disk
+static struct filesystem pipe_fs =
+{
+    .read = pipe_fs_read,
+    .write = pipe_fs_write,
+    .seek = pipe_fs_seek,
+    .stat = pipe_fs_stat,
+    .close = pipe_fs_close,
+    .name = "PIPE"
+};
+
+// Pipes are read and written through their system calls, straight from user memory
+static int pipe_fs_read(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, char* out)
+{
+    return -EUNIMP;
+}
+
+static int pipe_fs_write(struct disk* disk, void* private, uint32_t size, uint32_t nmemb, const char* in)
+{
+    return -EUNIMP;
+}
+
+static int pipe_fs_seek(void* private, uint32_t offset, FILE_SEEK_MODE seek_mode)
+{
+    return -EUNIMP;
+}
+
+static int pipe_fs_stat(struct disk* disk, void* private, struct file_stat* stat)
+{
+    struct pipe* pipe = ((struct pipe_end*) private)->pipe;
+    stat->flags = 0;
+    stat->filesize = 0;
+    for (int i = 0; i < pipe->count; i++)
+    {
+        stat->filesize += pipe->buffers[(pipe->head + i) % PEACHOS_PIPE_PAGES].length;
+    }
+    return 0;
+}
+
+static void pipe_free(struct pipe* pipe)
+{
+    for (int i = 0; i < pipe->count; i++)
+    {
+        cow_page_put(pipe->buffers[(pipe->head + i) % PEACHOS_PIPE_PAGES].page);
+    }
+    kfree(pipe);
+}
+
+static int pipe_fs_close(void* private)
+{
+    struct pipe_end* end = private;
+    struct pipe* pipe = end->pipe;
+    if (end->write)
+    {
+        pipe->writers--;
+        wait_queue_wake_all(&pipe->read_waiters);
+    }
+    else
+    {
+        pipe->readers--;
+        wait_queue_wake_all(&pipe->write_waiters);
+    }
+    kfree(end);
+
+    if (pipe->readers == 0 && pipe->writers == 0)
+    {
+        pipe_free(pipe);
+    }
+    return 0;
+}
+
+static int pipe_open_end(struct pipe* pipe, bool write)
+{
+    struct pipe_end* end = kzalloc(sizeof(struct pipe_end));
+    if (!end)
+    {
+        return -ENOMEM;
+    }
+
+    end->pipe = pipe;
+    end->write = write;
+    int fd = file_new(&pipe_fs, end);
+    if (fd < 0)
+    {
+        kfree(end);
+        return fd;
+    }
+
+    if (write)
+    {
+        pipe->writers++;
+    }
+    else
+    {
+        pipe->readers++;
+    }
+    return fd;
+}
+
+/**
+ * Creates a pipe, bytes written to write_fd come out of read_fd in the same order
+ */
+int pipe_new(int* read_fd, int* write_fd)
+{
+    struct pipe* pipe = kzalloc(sizeof(struct pipe));
+    if (!pipe)
+    {
+        return -ENOMEM;
+    }
+
+    int res = pipe_open_end(pipe, false);
+    if (res < 0)
+    {
+        kfree(pipe);
+        return res;
+    }
+    *read_fd = res;
+
+    res = pipe_open_end(pipe, true);
+    if (res < 0)
+    {
+        // Closing the only end frees the pipe
+        fclose(*read_fd);
+        return res;
+    }
+    *write_fd = res;
+    return 0;
+}
+
+bool pipe_is_pipe(int fd)
+{
+    return file_private(fd, &pipe_fs) != 0;
+}
+
+static struct pipe* pipe_get(int fd, bool write)
+{
+    struct pipe_end* end = file_private(fd, &pipe_fs);
+    if (!end || end->write != write)
+    {
+        return 0;
+    }
+
+    return end->pipe;
+}
+
+static struct pipe_buffer* pipe_tail(struct pipe* pipe)
+{
+    return &pipe->buffers[(pipe->head + pipe->count - 1) % PEACHOS_PIPE_PAGES];
+}
+
+static int pipe_push(struct pipe* pipe, void* page, uint16_t length)
+{
+    if (pipe->count == PEACHOS_PIPE_PAGES)
+    {
+        return -EISTKN;
+    }
+
+    pipe->count++;
+    struct pipe_buffer* buffer = pipe_tail(pipe);
+    buffer->page = page;
+    buffer->offset = 0;
+    buffer->length = length;
+    return 0;
+}
+
+/**
+ * Moves up to len bytes of user memory into the pipe without blocking, returns how many went in
+ */
+static int pipe_write_some(struct pipe* pipe, struct task* task, const void* buf, uint32_t len)
+{
+    // A whole page lends the writer's page to the pipe, the writer copies it if it writes again
+    if (len >= PAGING_PAGE_SIZE && paging_is_aligned((void*) buf) && pipe->count < PEACHOS_PIPE_PAGES)
+    {
+        void* page = process_lend_page(task->process, (void*) buf);
+        if (page)
+        {
+            pipe_push(pipe, page, PAGING_PAGE_SIZE);
+            return PAGING_PAGE_SIZE;
+        }
+    }
+
+    // Otherwise fill up the last page with room left, it is always one the pipe owns
+    struct pipe_buffer* buffer = pipe->count ? pipe_tail(pipe) : 0;
+    if (!buffer || buffer->offset + buffer->length == PAGING_PAGE_SIZE || cow_page_shared(buffer->page))
+    {
+        void* page = frame_alloc();
+        if (!page)
+        {
+            return -ENOMEM;
+        }
+
+        if (pipe_push(pipe, page, 0) < 0)
+        {
+            frame_free(page);
+            return 0;
+        }
+        buffer = pipe_tail(pipe);
+    }
+
+    uint32_t end = buffer->offset + buffer->length;
+    uint32_t total = PAGING_PAGE_SIZE - end;
+    if (total > len)
+    {
+        total = len;
+    }
+
+    // Frames are identity mapped in the kernel so the page is filled through its address
+    int res = copy_from_task(task, buffer->page + end, (void*) buf, total);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    buffer->length += total;
+    return total;
+}
+
+/**
+ * Writes all of buf to the pipe, sleeping while it is full. Fails once nobody can read it
+ */
+int pipe_write(int fd, struct task* task, const void* buf, uint32_t len)
+{
+    struct pipe* pipe = pipe_get(fd, true);
+    if (!pipe)
+    {
+        return -EINVARG;
+    }
+
+    uint32_t written = 0;
+    while (written < len)
+    {
+        if (pipe->readers == 0)
+        {
+            return written ? written : -EIO;
+        }
+
+        int res = pipe_write_some(pipe, task, buf + written, len - written);
+        if (res < 0)
+        {
+            return written ? written : res;
+        }
+
+        if (res > 0)
+        {
+            written += res;
+            wait_queue_wake_all(&pipe->read_waiters);
+            continue;
+        }
+
+        if (!task_can_block())
+        {
+            break;
+        }
+        wait_queue_sleep(&pipe->write_waiters);
+    }
+
+    return written;
+}
+
+/**
+ * Reads whatever is in the pipe up to len bytes, sleeping until something is written when it
+ * is empty. Returns zero at the end of the pipe. A whole page read into a page aligned anonymous
+ * buffer is mapped there instead of copied
+ */
+int pipe_read(int fd, struct task* task, void* buf, uint32_t len)
+{
+    struct pipe* pipe = pipe_get(fd, false);
+    if (!pipe)
+    {
+        return -EINVARG;
+    }
+
+    while (pipe->count == 0)
+    {
+        if (pipe->writers == 0 || len == 0 || !task_can_block())
+        {
+            return 0;
+        }
+        wait_queue_sleep(&pipe->read_waiters);
+    }
+
+    int res = 0;
+    uint32_t total = 0;
+    while (total < len && pipe->count)
+    {
+        struct pipe_buffer* buffer = &pipe->buffers[pipe->head];
+        void* virt = buf + total;
+        if (buffer->offset == 0 && buffer->length == PAGING_PAGE_SIZE && len - total >= PAGING_PAGE_SIZE &&
+            process_adopt_page(task->process, virt, buffer->page) == 0)
+        {
+            // The pipe reference on the page went to the reader
+            total += PAGING_PAGE_SIZE;
+            pipe->head = (pipe->head + 1) % PEACHOS_PIPE_PAGES;
+            pipe->count--;
+            continue;
+        }
+
+        uint32_t count = buffer->length;
+        if (count > len - total)
+        {
+            count = len - total;
+        }
+
+        res = copy_to_task(task, virt, buffer->page + buffer->offset, count);
+        if (res < 0)
+        {
+            break;
+        }
+
+        total += count;
+        buffer->offset += count;
+        buffer->length -= count;
+        if (buffer->length == 0)
+        {
+            cow_page_put(buffer->page);
+            pipe->head = (pipe->head + 1) % PEACHOS_PIPE_PAGES;
+            pipe->count--;
+        }
+    }
+
+    wait_queue_wake_all(&pipe->write_waiters);
+    return total ? total : res;
+}
@@ -0,0 +1,45 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+#include "task/waitqueue.h"
+
+struct task;
+
+// Bytes [offset, offset + length) of the page are waiting to be read
+struct pipe_buffer
+{
+    void* page;
+    uint16_t offset;
+    uint16_t length;
+};
+
+// A ring of page buffers, writes of whole pages lend the writer's page instead of copying it
+struct pipe
+{
+    struct pipe_buffer buffers[PEACHOS_PIPE_PAGES];
+    int head;
+    int count;
+
+    // Open ends, reads see the end of the pipe once there are no writers left
+    int readers;
+    int writers;
+
+    struct wait_queue read_waiters;
+    struct wait_queue write_waiters;
+};
+
+struct pipe_end
+{
+    struct pipe* pipe;
+    bool write;
+};
+
+int pipe_new(int* read_fd, int* write_fd);
+bool pipe_is_pipe(int fd);
+int pipe_read(int fd, struct task* task, void* buf, uint32_t len);
+int pipe_write(int fd, struct task* task, const void* buf, uint32_t len);
+
+#endif
@@ -1,19 +1,24 @@
 #ifndef PATHPARSER_H
 #define PATHPARSER_H
 
-struct path_root
-{
-    int drive_no;
-    struct path_part* first;
-};
+#include "config.h"
 
+// A component of a path, it is not terminated, len bytes from part make the name
 struct path_part
 {
     const char* part;
-    struct path_part* next;
+    int len;
+};
+
+// A parsed path, the parts point into the copy of the path held here
+struct path_root
+{
+    int drive_no;
+    int total;
+    struct path_part parts[PEACHOS_MAX_PATH_PARTS];
+    char path[PEACHOS_MAX_PATH];
 };
 
-struct path_root* pathparser_parse(const char* path, const char* current_directory_path);
-void pathparser_free(struct path_root* root);
+int pathparser_parse(struct path_root* root, const char* path);
 
-#endif
\ No newline at end of file
+#endif
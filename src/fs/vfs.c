@@ -0,0 +1,247 @@
+#include "vfs.h"
+#include "status.h"
+#include "kernel.h"
+#include "string/string.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/paging/cow.h"
+
+static struct inode* inodes = 0;
+
+static struct inode_page* vfs_page_buckets[PEACHOS_PAGE_CACHE_HASH_BUCKETS];
+static struct inode_page* vfs_lru_head = 0;
+static struct inode_page* vfs_lru_tail = 0;
+static int vfs_total_pages = 0;
+
+static uint32_t vfs_page_hash(struct inode* inode, uint32_t index)
+{
+    return (index ^ ((uint32_t) inode * 0x9E3779B1)) & (PEACHOS_PAGE_CACHE_HASH_BUCKETS - 1);
+}
+
+static void vfs_lru_unlink(struct inode_page* page)
+{
+    if (page->lru_prev)
+    {
+        page->lru_prev->lru_next = page->lru_next;
+    }
+    else
+    {
+        vfs_lru_head = page->lru_next;
+    }
+
+    if (page->lru_next)
+    {
+        page->lru_next->lru_prev = page->lru_prev;
+    }
+    else
+    {
+        vfs_lru_tail = page->lru_prev;
+    }
+
+    page->lru_prev = 0;
+    page->lru_next = 0;
+}
+
+static void vfs_lru_push_head(struct inode_page* page)
+{
+    page->lru_prev = 0;
+    page->lru_next = vfs_lru_head;
+    if (vfs_lru_head)
+    {
+        vfs_lru_head->lru_prev = page;
+    }
+    vfs_lru_head = page;
+
+    if (!vfs_lru_tail)
+    {
+        vfs_lru_tail = page;
+    }
+}
+
+static void vfs_inode_free(struct inode* inode)
+{
+    struct inode** link = &inodes;
+    while (*link)
+    {
+        if (*link == inode)
+        {
+            *link = inode->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    kfree(inode);
+}
+
+/**
+ * Drops the page from the cache, processes that map it keep their own reference
+ */
+static void vfs_page_evict(struct inode_page* page)
+{
+    struct inode_page** link = &vfs_page_buckets[vfs_page_hash(page->inode, page->index)];
+    while (*link)
+    {
+        if (*link == page)
+        {
+            *link = page->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+
+    vfs_lru_unlink(page);
+    vfs_total_pages--;
+
+    struct inode* inode = page->inode;
+    inode->pages--;
+    if (inode->refcount == 0 && inode->pages == 0)
+    {
+        vfs_inode_free(inode);
+    }
+
+    cow_page_put(page->page);
+    kfree(page);
+}
+
+/**
+ * Joins the components of the path into key, it is never longer than the path it came from
+ */
+static void vfs_path_key(struct path_root* path, char* key)
+{
+    int len = 0;
+    for (int i = 0; i < path->total; i++)
+    {
+        if (i > 0)
+        {
+            key[len++] = '/';
+        }
+
+        memcpy(&key[len], (void*) path->parts[i].part, path->parts[i].len);
+        len += path->parts[i].len;
+    }
+    key[len] = 0x00;
+}
+
+/**
+ * Gets the inode of the file at path on disk and takes a reference on it, NULL when out of memory
+ */
+struct inode* vfs_inode_get(struct disk* disk, struct path_root* path)
+{
+    char key[PEACHOS_MAX_PATH];
+    vfs_path_key(path, key);
+    for (struct inode* inode = inodes; inode; inode = inode->next)
+    {
+        if (inode->disk == disk && istrncmp(inode->path, key, sizeof(inode->path)) == 0)
+        {
+            inode->refcount++;
+            return inode;
+        }
+    }
+
+    struct inode* inode = kzalloc(sizeof(struct inode));
+    if (!inode)
+    {
+        return 0;
+    }
+
+    inode->disk = disk;
+    strncpy(inode->path, key, sizeof(inode->path));
+    inode->refcount = 1;
+    inode->next = inodes;
+    inodes = inode;
+    return inode;
+}
+
+/**
+ * An open file went away, the inode goes once its cached pages have been evicted as well
+ */
+void vfs_inode_put(struct inode* inode)
+{
+    inode->refcount--;
+    if (inode->refcount == 0 && inode->pages == 0)
+    {
+        vfs_inode_free(inode);
+    }
+}
+
+/**
+ * Returns the cached page index of the file, NULL if it is not in the cache. The page belongs
+ * to the cache, take a reference with cow_page_get to keep it
+ */
+void* vfs_page_find(struct inode* inode, uint32_t index)
+{
+    struct inode_page* page = vfs_page_buckets[vfs_page_hash(inode, index)];
+    while (page)
+    {
+        if (page->inode == inode && page->index == index)
+        {
+            if (vfs_lru_head != page)
+            {
+                vfs_lru_unlink(page);
+                vfs_lru_push_head(page);
+            }
+            return page->page;
+        }
+        page = page->hash_next;
+    }
+
+    return 0;
+}
+
+/**
+ * Hands a page just read from the file to the cache, evicting the least recently used page
+ * when the cache is full. Returns the cached page, which is an earlier copy if another task
+ * read the same page in meanwhile, or ERROR(-ENOMEM). The page is freed unless it was cached
+ */
+void* vfs_page_add(struct inode* inode, uint32_t index, void* page)
+{
+    void* cached = vfs_page_find(inode, index);
+    if (cached)
+    {
+        cow_page_put(page);
+        return cached;
+    }
+
+    struct inode_page* inode_page = kzalloc(sizeof(struct inode_page));
+    if (!inode_page)
+    {
+        cow_page_put(page);
+        return ERROR(-ENOMEM);
+    }
+
+    if (vfs_total_pages >= PEACHOS_PAGE_CACHE_PAGES)
+    {
+        vfs_page_evict(vfs_lru_tail);
+    }
+
+    inode_page->inode = inode;
+    inode_page->index = index;
+    inode_page->page = page;
+
+    uint32_t bucket = vfs_page_hash(inode, index);
+    inode_page->hash_next = vfs_page_buckets[bucket];
+    vfs_page_buckets[bucket] = inode_page;
+    vfs_lru_push_head(inode_page);
+    inode->pages++;
+    vfs_total_pages++;
+    return page;
+}
+
+/**
+ * Forgets every cached page of the file after it was written to
+ */
+void vfs_inode_invalidate(struct inode* inode)
+{
+    // Evicting the last page may free an open inode, it can't while the caller holds it
+    struct inode_page* page = vfs_lru_head;
+    while (page && inode->pages)
+    {
+        struct inode_page* next = page->lru_next;
+        if (page->inode == inode)
+        {
+            vfs_page_evict(page);
+        }
+        page = next;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "pparser.h"
+
+struct disk;
+
+/**
+ * A file on a disk that is open or still has pages cached. Every open of the same path shares
+ * it, names are compared without case like FAT does
+ */
+struct inode
+{
+    struct disk* disk;
+    // The path below the drive, components joined with '/'
+    char path[PEACHOS_MAX_PATH];
+
+    // Open files referring to the inode
+    int refcount;
+    // Pages of the file in the page cache, the inode stays while there are any
+    int pages;
+
+    struct inode* next;
+};
+
+// A page of a file in the page cache, bytes past the end of the file are zero
+struct inode_page
+{
+    struct inode* inode;
+    uint32_t index;
+    void* page;
+
+    // Next page in the same hash bucket
+    struct inode_page* hash_next;
+
+    // Least recently used list, the head is the most recently used page
+    struct inode_page* lru_prev;
+    struct inode_page* lru_next;
+};
+
+struct inode* vfs_inode_get(struct disk* disk, struct path_root* path);
+void vfs_inode_put(struct inode* inode);
+void* vfs_page_find(struct inode* inode, uint32_t index);
+void* vfs_page_add(struct inode* inode, uint32_t index, void* page);
+void vfs_inode_invalidate(struct inode* inode);
+
+#endif
@@ -0,0 +1,153 @@
+#include "apic.h"
+#include "config.h"
+#include "io/io.h"
+#include "kernel.h"
+#include "status.h"
+#include "memory/paging/paging.h"
+#include "task/cpu.h"
+
+// Local APIC registers, offsets from PEACHOS_LAPIC_ADDRESS
+#define APIC_REGISTER_ID 0x20
+#define APIC_REGISTER_EOI 0xB0
+#define APIC_REGISTER_SPURIOUS 0xF0
+#define APIC_REGISTER_LVT_TIMER 0x320
+#define APIC_REGISTER_TIMER_INITIAL_COUNT 0x380
+#define APIC_REGISTER_TIMER_CURRENT_COUNT 0x390
+#define APIC_REGISTER_TIMER_DIVIDE 0x3E0
+
+#define APIC_SPURIOUS_ENABLE 0x100
+#define APIC_LVT_MASKED 0x10000
+// Divide the bus clock by 16
+#define APIC_TIMER_DIVIDE_16 0x03
+
+// IO APIC registers are reached through a select and a window register
+#define IOAPIC_REGISTER_SELECT 0x00
+#define IOAPIC_REGISTER_WINDOW 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECTION_TABLE 0x10
+#define IOAPIC_REDIRECTION_MASKED 0x10000
+
+// The PIT is wired to pin 2 instead of pin 0 on the PC chipsets we run on
+#define IOAPIC_PIT_PIN 2
+
+static bool apic_active = false;
+static int ioapic_total_pins = 0;
+
+static uint32_t apic_read(uint32_t reg)
+{
+    return *(volatile uint32_t*)(PEACHOS_LAPIC_ADDRESS + reg);
+}
+
+static void apic_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t*)(PEACHOS_LAPIC_ADDRESS + reg) = value;
+}
+
+static uint32_t ioapic_read(uint32_t reg)
+{
+    *(volatile uint32_t*)(PEACHOS_IOAPIC_ADDRESS + IOAPIC_REGISTER_SELECT) = reg;
+    return *(volatile uint32_t*)(PEACHOS_IOAPIC_ADDRESS + IOAPIC_REGISTER_WINDOW);
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value)
+{
+    *(volatile uint32_t*)(PEACHOS_IOAPIC_ADDRESS + IOAPIC_REGISTER_SELECT) = reg;
+    *(volatile uint32_t*)(PEACHOS_IOAPIC_ADDRESS + IOAPIC_REGISTER_WINDOW) = value;
+}
+
+static int ioapic_pin(int irq)
+{
+    return irq == 0 ? IOAPIC_PIT_PIN : irq;
+}
+
+bool apic_enabled()
+{
+    return apic_active;
+}
+
+uint8_t apic_id()
+{
+    return apic_read(APIC_REGISTER_ID) >> 24;
+}
+
+/**
+ * A single write to the local APIC acknowledges any interrupt, from either controller
+ */
+void apic_eoi()
+{
+    apic_write(APIC_REGISTER_EOI, 0);
+}
+
+/**
+ * Starts the one shot local APIC timer, it raises the timer vector after count bus clocks / 16
+ */
+void apic_timer_start(uint32_t count)
+{
+    apic_write(APIC_REGISTER_LVT_TIMER, PEACHOS_PIC_MASTER_VECTOR_START);
+    apic_write(APIC_REGISTER_TIMER_INITIAL_COUNT, count);
+}
+
+uint32_t apic_timer_remaining()
+{
+    return apic_read(APIC_REGISTER_TIMER_CURRENT_COUNT);
+}
+
+/**
+ * Delivers the ISA irq to the processor with the given local APIC id
+ */
+int ioapic_set_affinity(int irq, uint8_t apic_id)
+{
+    int pin = ioapic_pin(irq);
+    if (!apic_active || pin >= ioapic_total_pins)
+    {
+        return -EINVARG;
+    }
+
+    ioapic_write(IOAPIC_REDIRECTION_TABLE + pin * 2 + 1, (uint32_t) apic_id << 24);
+    return 0;
+}
+
+/**
+ * Moves interrupt delivery from the 8259 PICs to the local and IO APIC when the processor
+ * has one. ISA interrupts keep the vectors the PICs gave them. Returns false if we stay on the PICs
+ */
+bool apic_init()
+{
+    if (!(cpu_features() & CPU_FEATURE_APIC))
+    {
+        return false;
+    }
+
+    if (paging_map_mmio((void*) PEACHOS_LAPIC_ADDRESS) < 0 || paging_map_mmio((void*) PEACHOS_IOAPIC_ADDRESS) < 0)
+    {
+        print("apic: Failed to map the APIC registers\n");
+        return false;
+    }
+
+    // Mask everything on the PICs, from now on they only pass through the IO APIC
+    outb(0x21, 0xFF);
+    outb(0xA1, 0xFF);
+
+    apic_write(APIC_REGISTER_SPURIOUS, APIC_SPURIOUS_ENABLE | PEACHOS_APIC_SPURIOUS_VECTOR);
+    apic_write(APIC_REGISTER_TIMER_DIVIDE, APIC_TIMER_DIVIDE_16);
+    apic_write(APIC_REGISTER_LVT_TIMER, APIC_LVT_MASKED);
+
+    ioapic_total_pins = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+    uint32_t destination = (uint32_t) apic_id() << 24;
+    for (int irq = 1; irq < 16 && irq < ioapic_total_pins; irq++)
+    {
+        if (irq == IOAPIC_PIT_PIN)
+        {
+            // The PIT pin, either IRQ 0 or unused. Our timer is the local APIC one
+            ioapic_write(IOAPIC_REDIRECTION_TABLE + irq * 2, IOAPIC_REDIRECTION_MASKED);
+            continue;
+        }
+
+        // Edge triggered, active high, fixed delivery to the boot processor
+        ioapic_write(IOAPIC_REDIRECTION_TABLE + irq * 2 + 1, destination);
+        ioapic_write(IOAPIC_REDIRECTION_TABLE + irq * 2, PEACHOS_PIC_MASTER_VECTOR_START + irq);
+    }
+
+    apic_active = true;
+    return true;
+}
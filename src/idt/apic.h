@@ -0,0 +1,17 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool apic_init();
+bool apic_enabled();
+uint8_t apic_id();
+void apic_eoi();
+
+void apic_timer_start(uint32_t count);
+uint32_t apic_timer_remaining();
+
+int ioapic_set_affinity(int irq, uint8_t apic_id);
+
+#endif
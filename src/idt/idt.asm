@@ -10,7 +10,12 @@ global no_interrupt
 global enable_interrupts
 global disable_interrupts
 global isr80h_wrapper
+global isr80h_sysenter
+
+USER_CODE_SEGMENT equ 0x1b
+USER_DATA_SEGMENT equ 0x23
 global interrupt_pointer_table
+global interrupt_error_code
 
 enable_interrupts:
     sti
@@ -40,6 +45,11 @@ no_interrupt:
 %macro interrupt 1
     global int%1
     int%1:
+%if %1 == 8 || (%1 >= 10 && %1 <= 14) || %1 == 17 || %1 == 21 || %1 == 29 || %1 == 30
+        ; The processor pushed an error code for this exception, take it off
+        ; so the frame looks the same as every other interrupt and iret works
+        pop dword [interrupt_error_code]
+%endif
         ; INTERRUPT FRAME START
         ; ALREADY PUSHED TO US BY THE PROCESSOR UPON ENTRY TO THIS INTERRUPT
         ; uint32_t ip
@@ -91,9 +101,40 @@ isr80h_wrapper:
     mov eax, [tmp_res]
     iretd
 
+; Entered from user land with sysenter, user land wants to continue at edx with its stack in ecx.
+; The processor loaded esp from the SYSENTER_ESP MSR, which points at this processor's tss.esp0
+isr80h_sysenter:
+    mov esp, [esp]
+    ; Build the same frame int 0x80 gets so both entries share isr80h_handler.
+    ; Interrupts were enabled in user land, sysenter only cleared them for us
+    push dword USER_DATA_SEGMENT
+    push ecx
+    pushfd
+    or dword [esp], 0x200
+    push dword USER_CODE_SEGMENT
+    push edx
+    pushad
+
+    push esp
+    push eax
+    call isr80h_handler
+    mov dword[tmp_res], eax
+    add esp, 8
+
+    popad
+    mov eax, [tmp_res]
+    ; sysexit returns to edx with the stack in ecx, take them from the frame
+    mov edx, [esp]
+    mov ecx, [esp+12]
+    ; sti holds interrupts off for one more instruction so they come back on in user land
+    sti
+    sysexit
+
 section .data
 ; Inside here is stored the return result from isr80h_handler
 tmp_res: dd 0
+; Error code of the last exception that had one
+interrupt_error_code: dd 0
 
 
 %macro interrupt_array_entry 1
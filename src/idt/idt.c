@@ -5,7 +5,16 @@
 #include "task/task.h"
 #include "task/process.h"
 #include "io/io.h"
+#include "memory/paging/paging.h"
+#include "timer/timer.h"
+#include "apic.h"
+#include "task/cpu.h"
+#include "task/workqueue.h"
 #include "status.h"
+#include "trace/trace.h"
+#include "stats/stats.h"
+#include "profile/profile.h"
+#include <stdbool.h>
 struct idt_desc idt_descriptors[PEACHOS_TOTAL_INTERRUPTS];
 struct idtr_desc idtr_descriptor;
 
@@ -19,23 +28,74 @@ extern void idt_load(struct idtr_desc* ptr);
 extern void int21h();
 extern void no_interrupt();
 extern void isr80h_wrapper();
+extern void isr80h_sysenter();
+extern uint32_t interrupt_error_code;
 
-void no_interrupt_handler()
+/**
+ * Acknowledges an IRQ vector, exceptions and system calls need no acknowledgement
+ */
+static void idt_irq_eoi(int interrupt)
 {
+    if (interrupt < PEACHOS_PIC_MASTER_VECTOR_START || interrupt >= PEACHOS_PIC_SLAVE_VECTOR_START + 8)
+    {
+        return;
+    }
+
+    if (apic_enabled())
+    {
+        apic_eoi();
+        return;
+    }
+
+    if (interrupt >= PEACHOS_PIC_SLAVE_VECTOR_START)
+    {
+        // Interrupts from the slave PIC must be acknowledged on both controllers
+        outb(0xA0, 0x20);
+    }
     outb(0x20, 0x20);
 }
 
+void no_interrupt_handler()
+{
+    idt_irq_eoi(PEACHOS_PIC_MASTER_VECTOR_START);
+}
+
+/**
+ * Interrupts normally arrive from user land, but they can also arrive while a blocked
+ * task waits for one inside the kernel
+ */
+static bool idt_frame_from_user(struct interrupt_frame* frame)
+{
+    return (frame->cs & 0x03) != 0;
+}
+
 void interrupt_handler(int interrupt, struct interrupt_frame* frame)
 {
-    kernel_page();
+    // The kernel is mapped into every task so we can stay on the task's page tables
+    kernel_registers();
+    bool from_user = idt_frame_from_user(frame);
+
+    // Acknowledged up front as handlers like the clock may switch tasks and never return here.
+    // Interrupts stay disabled until we return so the same line can not interrupt us again
+    idt_irq_eoi(interrupt);
     if (interrupt_callbacks[interrupt] != 0)
     {
-        task_current_save_state(frame);
+        if (from_user)
+        {
+            task_current_save_state(frame);
+        }
         interrupt_callbacks[interrupt](frame);
     }
 
-    task_page();
-    outb(0x20, 0x20);
+    if (from_user)
+    {
+        // Work the handler deferred runs before user land does, the worker comes first
+        if (work_pending())
+        {
+            task_next();
+        }
+        task_page();
+    }
 }
 
 void idt_zero()
@@ -55,14 +115,43 @@ void idt_set(int interrupt_no, void* address)
 
 void idt_handle_exception()
 {
+    if (!task_current()->process)
+    {
+        panic("Exception in a kernel task\n");
+    }
+
     process_terminate(task_current()->process);
     task_next();
 }
 
-void idt_clock()
+/**
+ * Not present pages inside a file mapping are read in on first touch, the faulting
+ * instruction runs again once we return. Any other fault kills the process
+ */
+void idt_page_fault(struct interrupt_frame* frame)
 {
-    outb(0x20, 0x20);
-    
+    void* address = paging_fault_address();
+    struct task* task = task_current();
+    TRACE(TRACE_EVENT_PAGE_FAULT, address, interrupt_error_code, task && task->process ? task->process->id : 0);
+    if (task && process_handle_page_fault(task->process, address, interrupt_error_code) == 0)
+    {
+        return;
+    }
+
+    idt_handle_exception();
+}
+
+void idt_clock(struct interrupt_frame* frame)
+{
+    timer_interrupt();
+    profile_sample(frame);
+
+    // The kernel is not preemptible, only switch tasks when we interrupted user land
+    if (!idt_frame_from_user(frame))
+    {
+        return;
+    }
+
     // Switch to the next task
     task_next();
 }
@@ -88,10 +177,19 @@ void idt_init()
     }
     
 
+    idt_register_interrupt_callback(0x0E, idt_page_fault);
     idt_register_interrupt_callback(0x20, idt_clock);
 
     // Load the interrupt descriptor table
     idt_load(&idtr_descriptor);
+
+    // System calls can also come in through sysenter, it uses the same command table
+    if (cpu_features() & CPU_FEATURE_SYSENTER)
+    {
+        cpu_write_msr(CPU_MSR_SYSENTER_CS, KERNEL_CODE_SELECTOR, 0);
+        cpu_write_msr(CPU_MSR_SYSENTER_ESP, (uint32_t) &cpu_current()->tss.esp0, 0);
+        cpu_write_msr(CPU_MSR_SYSENTER_EIP, (uint32_t) isr80h_sysenter, 0);
+    }
 }
 
 int idt_register_interrupt_callback(int interrupt, INTERRUPT_CALLBACK_FUNCTION interrupt_callback)
@@ -136,14 +234,17 @@ void* isr80h_handle_command(int command, struct interrupt_frame* frame)
         return 0;
     }
 
+    stats_syscall(command);
+    TRACE(TRACE_EVENT_SYSCALL_ENTER, command, 0, 0);
     result = command_func(frame);
+    TRACE(TRACE_EVENT_SYSCALL_EXIT, command, result, 0);
     return result;
 }
 
 void* isr80h_handler(int command, struct interrupt_frame* frame)
 {
     void* res = 0;
-    kernel_page();
+    kernel_registers();
     task_current_save_state(frame);
     res = isr80h_handle_command(command, frame);
     task_page();
@@ -4,6 +4,8 @@ global insb
 global insw
 global outb
 global outw
+global insdw
+global outdw
 
 insb:
     push ebp
@@ -47,4 +49,25 @@ outw:
     out dx, ax
 
     pop ebp
-    ret
\ No newline at end of file
+    ret
+
+insdw:
+    push ebp
+    mov ebp, esp
+
+    mov edx, [ebp+8]
+    in eax, dx
+
+    pop ebp
+    ret
+
+outdw:
+    push ebp
+    mov ebp, esp
+
+    mov eax, [ebp+12]
+    mov edx, [ebp+8]
+    out dx, eax
+
+    pop ebp
+    ret
@@ -4,14 +4,20 @@
 #include <stddef.h>
 void* isr80h_command4_malloc(struct interrupt_frame* frame)
 {
-    size_t size = (int)task_get_stack_item(task_current(), 0);
+    size_t size = (int)task_get_syscall_argument(task_current(), 0);
     return process_malloc(task_current()->process, size);
 }
 
 
 void* isr80h_command5_free(struct interrupt_frame* frame)
 {
-    void* ptr_to_free = task_get_stack_item(task_current(), 0);
+    void* ptr_to_free = task_get_syscall_argument(task_current(), 0);
     process_free(task_current()->process, ptr_to_free);
     return 0;
-}
\ No newline at end of file
+}
+
+void* isr80h_command18_sbrk(struct interrupt_frame* frame)
+{
+    int increment = (int) task_get_syscall_argument(task_current(), 0);
+    return process_sbrk(task_current()->process, increment);
+}
@@ -2,9 +2,14 @@
 #include "task/task.h"
 #include "keyboard/keyboard.h"
 #include "kernel.h"
+#include "status.h"
+#include "fs/file.h"
+#include "fs/pipe.h"
+#include "task/fdtable.h"
+#include "config.h"
 void* isr80h_command1_print(struct interrupt_frame* frame)
 {
-    void* user_space_msg_buffer = task_get_stack_item(task_current(), 0);
+    void* user_space_msg_buffer = task_get_syscall_argument(task_current(), 0);
     char buf[1024];
     copy_string_from_task(task_current(), user_space_msg_buffer, buf, sizeof(buf));
 
@@ -19,9 +24,335 @@ void* isr80h_command2_getkey(struct interrupt_frame* frame)
     return (void*)((int)c);
 }
 
+void* isr80h_command13_getkey_block(struct interrupt_frame* frame)
+{
+    char c = keyboard_pop_wait();
+    return (void*)((int)c);
+}
+
 void* isr80h_command3_putchar(struct interrupt_frame* frame)
 {
-    char c = (char)(int) task_get_stack_item(task_current(), 0);
+    char c = (char)(int) task_get_syscall_argument(task_current(), 0);
     terminal_writechar(c, 15);
     return 0;
-}
\ No newline at end of file
+}
+
+void* isr80h_command17_write(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int fd = (int) task_get_syscall_argument(task, 0);
+    const char* buf = task_get_syscall_argument(task, 1);
+    size_t len = (size_t) task_get_syscall_argument(task, 2);
+    struct process_file* file = 0;
+    int res = 0;
+
+    // 1 is stdout and 2 is stderr, anything else has to be open in the process
+    if (fd != 1 && fd != 2)
+    {
+        file = fdtable_get(task->process, fd);
+        if (!file)
+        {
+            res = -EINVARG;
+            goto out;
+        }
+
+        if (pipe_is_pipe(file->fd))
+        {
+            res = pipe_write(file->fd, task, buf, len);
+            goto out;
+        }
+    }
+
+    if (len == 0)
+    {
+        goto out;
+    }
+
+    res = task_check_user_range(task, (void*) buf, len, false);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // The caller's pages are mapped during its system call, write straight out of them
+    if (!file)
+    {
+        terminal_write(buf, len);
+        res = len;
+        goto out;
+    }
+
+    res = fseek(file->fd, file->pos, SEEK_SET);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = fwrite(buf, len, 1, file->fd);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    file->pos += len;
+    res = len;
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+void* isr80h_command24_read(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int fd = (int) task_get_syscall_argument(task, 0);
+    void* buf = task_get_syscall_argument(task, 1);
+    size_t len = (size_t) task_get_syscall_argument(task, 2);
+    int res = 0;
+
+    // The keyboard has its own calls
+    struct process_file* file = fdtable_get(task->process, fd);
+    if (!file)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (pipe_is_pipe(file->fd))
+    {
+        res = pipe_read(file->fd, task, buf, len);
+        goto out;
+    }
+
+    // Filesystems read whole requests, stop them at the end of the file
+    struct file_stat stat;
+    res = fstat(file->fd, &stat);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (file->pos >= stat.filesize || len == 0)
+    {
+        res = 0;
+        goto out;
+    }
+
+    if (len > stat.filesize - file->pos)
+    {
+        len = stat.filesize - file->pos;
+    }
+
+    res = task_check_user_range(task, buf, len, true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = fseek(file->fd, file->pos, SEEK_SET);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = fread(buf, len, 1, file->fd);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    file->pos += len;
+    res = len;
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+void* isr80h_command25_pipe(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    void* fds_user_ptr = task_get_syscall_argument(task, 0);
+    int pipe_fds[2];
+    int fds[2] = {-1, -1};
+    int res = pipe_new(&pipe_fds[0], &pipe_fds[1]);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    // From here on the table owns the ends, closing a descriptor closes its end
+    for (int i = 0; i < 2; i++)
+    {
+        res = fdtable_install(task->process, pipe_fds[i], 0);
+        if (res < 0)
+        {
+            fclose(pipe_fds[i]);
+            if (i == 0)
+            {
+                fclose(pipe_fds[1]);
+            }
+            goto out;
+        }
+        fds[i] = res;
+    }
+
+    res = copy_to_task(task, fds_user_ptr, fds, sizeof(fds));
+out:
+    if (res < 0)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i] >= 0)
+            {
+                fdtable_close(task->process, fds[i]);
+            }
+        }
+        return ERROR(res);
+    }
+    return 0;
+}
+
+void* isr80h_command26_close(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int fd = (int) task_get_syscall_argument(task, 0);
+    int res = fdtable_close(task->process, fd);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return 0;
+}
+
+void* isr80h_command30_open(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    void* path_user_ptr = task_get_syscall_argument(task, 0);
+    void* mode_user_ptr = task_get_syscall_argument(task, 1);
+    char path[PEACHOS_MAX_PATH];
+    char mode[4];
+    uint32_t pos = 0;
+    int kernel_fd = 0;
+    int res = copy_string_from_task(task, path_user_ptr, path, sizeof(path));
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = copy_string_from_task(task, mode_user_ptr, mode, sizeof(mode));
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    kernel_fd = fopen(path, mode);
+    if (kernel_fd <= 0)
+    {
+        res = kernel_fd < 0 ? kernel_fd : -EIO;
+        kernel_fd = 0;
+        goto out;
+    }
+
+    // Appending starts past the last byte, everything else at the first
+    if (mode[0] == 'a')
+    {
+        struct file_stat stat;
+        res = fstat(kernel_fd, &stat);
+        if (res < 0)
+        {
+            goto out;
+        }
+        pos = stat.filesize;
+    }
+
+    res = fdtable_install(task->process, kernel_fd, pos);
+out:
+    if (res < 0)
+    {
+        if (kernel_fd > 0)
+        {
+            fclose(kernel_fd);
+        }
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+/**
+ * Fills the caller's buffer with as many entries of an open directory as fit, the position of
+ * the descriptor remembers where the next call carries on
+ */
+void* isr80h_command31_readdir(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int fd = (int) task_get_syscall_argument(task, 0);
+    struct file_dirent* buf = task_get_syscall_argument(task, 1);
+    size_t size = (size_t) task_get_syscall_argument(task, 2);
+    int max = size / sizeof(struct file_dirent);
+    int res = 0;
+    struct process_file* file = fdtable_get(task->process, fd);
+    if (!file || max == 0)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    res = task_check_user_range(task, buf, max * sizeof(struct file_dirent), true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = freaddir(file->fd, &file->pos, buf, max);
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+/**
+ * Drains up to size keys into the buffer in one go, with wait set it blocks until there is at
+ * least one. Returns how many keys were read
+ */
+void* isr80h_command36_getkeys(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    char* buf = task_get_syscall_argument(task, 0);
+    size_t size = (size_t) task_get_syscall_argument(task, 1);
+    bool wait = task_get_syscall_argument(task, 2) != 0;
+    char keys[PEACHOS_KEYBOARD_BUFFER_SIZE];
+    if (size > sizeof(keys))
+    {
+        size = sizeof(keys);
+    }
+
+    // Checked first so keys are never taken out of the buffer for nothing
+    int res = task_check_user_range(task, buf, size, true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = keyboard_read(keys, size, wait);
+    if (res > 0)
+    {
+        int copied = copy_to_task(task, buf, keys, res);
+        if (copied < 0)
+        {
+            res = copied;
+        }
+    }
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
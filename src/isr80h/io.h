@@ -5,4 +5,12 @@ struct interrupt_frame;
 void* isr80h_command1_print(struct interrupt_frame* frame);
 void* isr80h_command2_getkey(struct interrupt_frame* frame);
 void* isr80h_command3_putchar(struct interrupt_frame* frame);
+void* isr80h_command13_getkey_block(struct interrupt_frame* frame);
+void* isr80h_command17_write(struct interrupt_frame* frame);
+void* isr80h_command24_read(struct interrupt_frame* frame);
+void* isr80h_command25_pipe(struct interrupt_frame* frame);
+void* isr80h_command26_close(struct interrupt_frame* frame);
+void* isr80h_command30_open(struct interrupt_frame* frame);
+void* isr80h_command31_readdir(struct interrupt_frame* frame);
+void* isr80h_command36_getkeys(struct interrupt_frame* frame);
 #endif
\ No newline at end of file
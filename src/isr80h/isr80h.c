@@ -4,6 +4,10 @@
 #include "io.h"
 #include "heap.h"
 #include "process.h"
+#include "mmap.h"
+#include "time.h"
+#include "ring.h"
+#include "thread.h"
 void isr80h_register_commands()
 {
     isr80h_register_command(SYSTEM_COMMAND0_SUM, isr80h_command0_sum);
@@ -16,4 +20,31 @@ void isr80h_register_commands()
     isr80h_register_command(SYSTEM_COMMAND7_INVOKE_SYSTEM_COMMAND, isr80h_command7_invoke_system_command);
     isr80h_register_command(SYSTEM_COMMAND8_GET_PROGRAM_ARGUMENTS, isr80h_command8_get_program_arguments);
     isr80h_register_command(SYSTEM_COMMAND9_EXIT, isr80h_command9_exit);
+    isr80h_register_command(SYSTEM_COMMAND10_MMAP, isr80h_command10_mmap);
+    isr80h_register_command(SYSTEM_COMMAND11_MUNMAP, isr80h_command11_munmap);
+    isr80h_register_command(SYSTEM_COMMAND12_FORK, isr80h_command12_fork);
+    isr80h_register_command(SYSTEM_COMMAND13_GETKEY_BLOCK, isr80h_command13_getkey_block);
+    isr80h_register_command(SYSTEM_COMMAND14_SLEEP, isr80h_command14_sleep);
+    isr80h_register_command(SYSTEM_COMMAND15_GET_TIME, isr80h_command15_get_time);
+    isr80h_register_command(SYSTEM_COMMAND16_RING_ENTER, isr80h_command16_ring_enter);
+    isr80h_register_command(SYSTEM_COMMAND17_WRITE, isr80h_command17_write);
+    isr80h_register_command(SYSTEM_COMMAND18_SBRK, isr80h_command18_sbrk);
+    isr80h_register_command(SYSTEM_COMMAND19_THREAD_CREATE, isr80h_command19_thread_create);
+    isr80h_register_command(SYSTEM_COMMAND20_THREAD_EXIT, isr80h_command20_thread_exit);
+    isr80h_register_command(SYSTEM_COMMAND21_THREAD_JOIN, isr80h_command21_thread_join);
+    isr80h_register_command(SYSTEM_COMMAND22_FUTEX_WAIT, isr80h_command22_futex_wait);
+    isr80h_register_command(SYSTEM_COMMAND23_FUTEX_WAKE, isr80h_command23_futex_wake);
+    isr80h_register_command(SYSTEM_COMMAND24_READ, isr80h_command24_read);
+    isr80h_register_command(SYSTEM_COMMAND25_PIPE, isr80h_command25_pipe);
+    isr80h_register_command(SYSTEM_COMMAND26_CLOSE, isr80h_command26_close);
+    isr80h_register_command(SYSTEM_COMMAND27_SHM_CREATE, isr80h_command27_shm_create);
+    isr80h_register_command(SYSTEM_COMMAND28_SHM_MAP, isr80h_command28_shm_map);
+    isr80h_register_command(SYSTEM_COMMAND29_SHM_UNMAP, isr80h_command29_shm_unmap);
+    isr80h_register_command(SYSTEM_COMMAND30_OPEN, isr80h_command30_open);
+    isr80h_register_command(SYSTEM_COMMAND31_READDIR, isr80h_command31_readdir);
+    isr80h_register_command(SYSTEM_COMMAND32_TRACE_READ, isr80h_command32_trace_read);
+    isr80h_register_command(SYSTEM_COMMAND33_STATS, isr80h_command33_stats);
+    isr80h_register_command(SYSTEM_COMMAND34_PROCESS_STATS, isr80h_command34_process_stats);
+    isr80h_register_command(SYSTEM_COMMAND35_PROFILE, isr80h_command35_profile);
+    isr80h_register_command(SYSTEM_COMMAND36_GETKEYS, isr80h_command36_getkeys);
 }
\ No newline at end of file
@@ -12,7 +12,34 @@ enum SystemCommands
     SYSTEM_COMMAND6_PROCESS_LOAD_START,
     SYSTEM_COMMAND7_INVOKE_SYSTEM_COMMAND,
     SYSTEM_COMMAND8_GET_PROGRAM_ARGUMENTS,
-    SYSTEM_COMMAND9_EXIT
+    SYSTEM_COMMAND9_EXIT,
+    SYSTEM_COMMAND10_MMAP,
+    SYSTEM_COMMAND11_MUNMAP,
+    SYSTEM_COMMAND12_FORK,
+    SYSTEM_COMMAND13_GETKEY_BLOCK,
+    SYSTEM_COMMAND14_SLEEP,
+    SYSTEM_COMMAND15_GET_TIME,
+    SYSTEM_COMMAND16_RING_ENTER,
+    SYSTEM_COMMAND17_WRITE,
+    SYSTEM_COMMAND18_SBRK,
+    SYSTEM_COMMAND19_THREAD_CREATE,
+    SYSTEM_COMMAND20_THREAD_EXIT,
+    SYSTEM_COMMAND21_THREAD_JOIN,
+    SYSTEM_COMMAND22_FUTEX_WAIT,
+    SYSTEM_COMMAND23_FUTEX_WAKE,
+    SYSTEM_COMMAND24_READ,
+    SYSTEM_COMMAND25_PIPE,
+    SYSTEM_COMMAND26_CLOSE,
+    SYSTEM_COMMAND27_SHM_CREATE,
+    SYSTEM_COMMAND28_SHM_MAP,
+    SYSTEM_COMMAND29_SHM_UNMAP,
+    SYSTEM_COMMAND30_OPEN,
+    SYSTEM_COMMAND31_READDIR,
+    SYSTEM_COMMAND32_TRACE_READ,
+    SYSTEM_COMMAND33_STATS,
+    SYSTEM_COMMAND34_PROCESS_STATS,
+    SYSTEM_COMMAND35_PROFILE,
+    SYSTEM_COMMAND36_GETKEYS
 };
 
 void isr80h_register_commands();
@@ -1,10 +1,120 @@
 #include "misc.h"
 #include "idt/idt.h"
 #include "task/task.h"
+#include "trace/trace.h"
+#include "stats/stats.h"
+#include "task/process.h"
+#include "profile/profile.h"
+#include "kernel.h"
+#include "status.h"
+#include <stdbool.h>
 
 void* isr80h_command0_sum(struct interrupt_frame* frame)
 {
-    int v2 = (int) task_get_stack_item(task_current(), 1);
-    int v1 = (int) task_get_stack_item(task_current(), 0);
+    int v2 = (int) task_get_syscall_argument(task_current(), 1);
+    int v1 = (int) task_get_syscall_argument(task_current(), 0);
     return (void*)(v1 + v2);
-}
\ No newline at end of file
+}
+void* isr80h_command32_trace_read(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int cpu = (int) task_get_syscall_argument(task, 0);
+    struct trace_event* buf = task_get_syscall_argument(task, 1);
+    size_t size = (size_t) task_get_syscall_argument(task, 2);
+    int max = size / sizeof(struct trace_event);
+    int res = task_check_user_range(task, buf, max * sizeof(struct trace_event), true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = trace_read(cpu, buf, max);
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+void* isr80h_command33_stats(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int cpu = (int) task_get_syscall_argument(task, 0);
+    struct stats_snapshot* stats = task_get_syscall_argument(task, 1);
+    int res = task_check_user_range(task, stats, sizeof(struct stats_snapshot), true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = stats_get(cpu, stats);
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+void* isr80h_command34_process_stats(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    struct stats_process* buf = task_get_syscall_argument(task, 0);
+    size_t size = (size_t) task_get_syscall_argument(task, 1);
+    int max = size / sizeof(struct stats_process);
+    int res = task_check_user_range(task, buf, max * sizeof(struct stats_process), true);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = process_get_stats(buf, max);
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
+
+/**
+ * Starts the profiler with arg as the sample interval in milliseconds, stops it, or reads the
+ * samples into buf which holds arg bytes
+ */
+void* isr80h_command35_profile(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int command = (int) task_get_syscall_argument(task, 0);
+    struct profile_sample* buf = task_get_syscall_argument(task, 1);
+    uint32_t arg = (uint32_t) task_get_syscall_argument(task, 2);
+    int res = 0;
+    switch (command)
+    {
+    case PROFILE_COMMAND_START:
+        res = profile_start(arg);
+        break;
+
+    case PROFILE_COMMAND_STOP:
+        profile_stop();
+        break;
+
+    case PROFILE_COMMAND_READ:
+        res = task_check_user_range(task, buf, (arg / sizeof(struct profile_sample)) * sizeof(struct profile_sample), true);
+        if (res < 0)
+        {
+            break;
+        }
+        res = profile_read(buf, arg / sizeof(struct profile_sample));
+        break;
+
+    default:
+        res = -EINVARG;
+    }
+
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return (void*) res;
+}
@@ -3,4 +3,8 @@
 
 struct interrupt_frame;
 void* isr80h_command0_sum(struct interrupt_frame* frame);
+void* isr80h_command32_trace_read(struct interrupt_frame* frame);
+void* isr80h_command33_stats(struct interrupt_frame* frame);
+void* isr80h_command34_process_stats(struct interrupt_frame* frame);
+void* isr80h_command35_profile(struct interrupt_frame* frame);
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "mmap.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "config.h"
+#include "kernel.h"
+#include "memory/shm/shm.h"
+#include <stdint.h>
+
+void* isr80h_command10_mmap(struct interrupt_frame* frame)
+{
+    void* filename_user_ptr = task_get_syscall_argument(task_current(), 0);
+    uint32_t offset = (uint32_t) task_get_syscall_argument(task_current(), 1);
+    uint32_t size = (uint32_t) task_get_syscall_argument(task_current(), 2);
+
+    char filename[PEACHOS_MAX_PATH];
+    int res = copy_string_from_task(task_current(), filename_user_ptr, filename, sizeof(filename));
+    if (res < 0)
+    {
+        return 0;
+    }
+
+    return process_mmap(task_current()->process, filename, offset, size);
+}
+
+void* isr80h_command11_munmap(struct interrupt_frame* frame)
+{
+    void* ptr = task_get_syscall_argument(task_current(), 0);
+    return (void*) process_munmap(task_current()->process, ptr);
+}
+
+void* isr80h_command27_shm_create(struct interrupt_frame* frame)
+{
+    void* name_user_ptr = task_get_syscall_argument(task_current(), 0);
+    uint32_t size = (uint32_t) task_get_syscall_argument(task_current(), 1);
+
+    char name[PEACHOS_SHM_NAME_MAX];
+    int res = copy_string_from_task(task_current(), name_user_ptr, name, sizeof(name));
+    if (res < 0)
+    {
+        return 0;
+    }
+
+    struct shm* shm = shm_create(name, size);
+    if (ISERR(shm))
+    {
+        return 0;
+    }
+
+    return process_shm_map(task_current()->process, shm);
+}
+
+void* isr80h_command28_shm_map(struct interrupt_frame* frame)
+{
+    void* name_user_ptr = task_get_syscall_argument(task_current(), 0);
+
+    char name[PEACHOS_SHM_NAME_MAX];
+    int res = copy_string_from_task(task_current(), name_user_ptr, name, sizeof(name));
+    if (res < 0)
+    {
+        return 0;
+    }
+
+    struct shm* shm = shm_get(name);
+    if (!shm)
+    {
+        return 0;
+    }
+
+    return process_shm_map(task_current()->process, shm);
+}
+
+void* isr80h_command29_shm_unmap(struct interrupt_frame* frame)
+{
+    void* ptr = task_get_syscall_argument(task_current(), 0);
+    return (void*) process_shm_unmap(task_current()->process, ptr);
+}
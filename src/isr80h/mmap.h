@@ -0,0 +1,11 @@
+#ifndef ISR80H_MMAP_H
+#define ISR80H_MMAP_H
+
+struct interrupt_frame;
+void* isr80h_command10_mmap(struct interrupt_frame* frame);
+void* isr80h_command11_munmap(struct interrupt_frame* frame);
+void* isr80h_command27_shm_create(struct interrupt_frame* frame);
+void* isr80h_command28_shm_map(struct interrupt_frame* frame);
+void* isr80h_command29_shm_unmap(struct interrupt_frame* frame);
+
+#endif
@@ -9,7 +9,7 @@
 
 void* isr80h_command6_process_load_start(struct interrupt_frame* frame)
 {
-    void* filename_user_ptr = task_get_stack_item(task_current(), 0);
+    void* filename_user_ptr = task_get_syscall_argument(task_current(), 0);
     char filename[PEACHOS_MAX_PATH];
     int res = copy_string_from_task(task_current(), filename_user_ptr, filename, sizeof(filename));
     if (res < 0)
@@ -37,27 +37,37 @@ out:
 
 void* isr80h_command7_invoke_system_command(struct interrupt_frame* frame)
 {
-    struct command_argument* arguments = task_virtual_address_to_physical(task_current(), task_get_stack_item(task_current(), 0));
-    if (!arguments || strlen(arguments[0].argument) == 0)
+    // The arguments arrive packed back to back with their terminators, the first names the program
+    char strings[PEACHOS_MAX_ARGUMENTS_SIZE];
+    size_t size = (size_t) task_get_syscall_argument(task_current(), 1);
+    if (!size || size > sizeof(strings))
     {
         return ERROR(-EINVARG);
     }
 
-    struct command_argument* root_command_argument = &arguments[0];
-    const char* program_name = root_command_argument->argument;
+    int res = copy_from_task(task_current(), strings, task_get_syscall_argument(task_current(), 0), size);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+
+    if (strings[0] == 0x00 || strings[size - 1] != 0x00)
+    {
+        return ERROR(-EINVARG);
+    }
 
     char path[PEACHOS_MAX_PATH];
     strcpy(path, "0:/");
-    strncpy(path+3, program_name, sizeof(path));
+    strncpy(path+3, strings, sizeof(path) - 3);
     
     struct process* process = 0;
-    int res = process_load_switch(path, &process);
+    res = process_load_switch(path, &process);
     if (res < 0)
     {
         return ERROR(res);
     }
     
-    res = process_inject_arguments(process, root_command_argument);
+    res = process_inject_arguments(process, strings, size);
     if (res < 0)
     {
         return ERROR(res);
@@ -72,9 +82,15 @@ void* isr80h_command7_invoke_system_command(struct interrupt_frame* frame)
 void* isr80h_command8_get_program_arguments(struct interrupt_frame* frame)
 {
     struct process* process = task_current()->process;
-    struct process_arguments* arguments = task_virtual_address_to_physical(task_current(), task_get_stack_item(task_current(), 0));
+    struct process_arguments arguments;
+    process_get_arguments(process, &arguments.argc, &arguments.argv);
+
+    int res = copy_to_task(task_current(), task_get_syscall_argument(task_current(), 0), &arguments, sizeof(arguments));
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
 
-    process_get_arguments(process, &arguments->argc, &arguments->argv);
     return 0;
 }
 
@@ -84,4 +100,22 @@ void* isr80h_command9_exit(struct interrupt_frame* frame)
     process_terminate(process);
     task_next();
     return 0;
-}
\ No newline at end of file
+}
+void* isr80h_command12_fork(struct interrupt_frame* frame)
+{
+    // The child would only get the main task, a thread has nothing to resume on there
+    if (task_current()->thread)
+    {
+        return ERROR(-EUNIMP);
+    }
+
+    struct process* child = 0;
+    int res = process_fork(task_current()->process, &child);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+
+    // The child returns zero from its copy of the saved registers
+    return (void*)(int) child->id;
+}
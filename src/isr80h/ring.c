@@ -0,0 +1,62 @@
+#include "ring.h"
+#include "isr80h.h"
+#include "idt/idt.h"
+#include "task/task.h"
+#include "status.h"
+#include "kernel.h"
+
+// Only commands that return to the caller can run from a ring, anything that may block
+// or switch tasks has to be made on its own. That rules out write, a file write may wait
+// on the disk and a pipe write on a reader
+static bool isr80h_ring_command_allowed(uint32_t command)
+{
+    switch (command)
+    {
+        case SYSTEM_COMMAND0_SUM:
+        case SYSTEM_COMMAND1_PRINT:
+        case SYSTEM_COMMAND2_GETKEY:
+        case SYSTEM_COMMAND3_PUTCHAR:
+        case SYSTEM_COMMAND4_MALLOC:
+        case SYSTEM_COMMAND5_FREE:
+        case SYSTEM_COMMAND15_GET_TIME:
+            return true;
+    }
+
+    return false;
+}
+
+void* isr80h_command16_ring_enter(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    struct syscall_ring* ring = task_get_syscall_argument(task, 0);
+    int res = task_check_user_range(task, ring, sizeof(*ring), true);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+
+    // The handlers read their arguments from the saved registers
+    struct registers saved = task->registers;
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    int completed = 0;
+    while (head != tail && completed < PEACHOS_SYSCALL_RING_ENTRIES)
+    {
+        struct syscall_ring_entry* entry = &ring->entries[head % PEACHOS_SYSCALL_RING_ENTRIES];
+        entry->result = -EINVARG;
+        if (isr80h_ring_command_allowed(entry->command))
+        {
+            task->registers.ebx = entry->arguments[0];
+            task->registers.esi = entry->arguments[1];
+            task->registers.edi = entry->arguments[2];
+            entry->result = (int32_t) isr80h_handle_command(entry->command, frame);
+        }
+
+        head++;
+        completed++;
+    }
+
+    ring->head = head;
+    task->registers = saved;
+    return (void*) completed;
+}
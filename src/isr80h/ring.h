@@ -0,0 +1,26 @@
+#ifndef ISR80H_RING_H
+#define ISR80H_RING_H
+
+#include <stdint.h>
+#include "config.h"
+
+// One queued system call, the kernel writes the result back into it
+struct syscall_ring_entry
+{
+    uint32_t command;
+    uint32_t arguments[3];
+    int32_t result;
+};
+
+// Lives in process memory. The process queues at tail, the kernel completes entries
+// from head up to tail and moves head along
+struct syscall_ring
+{
+    uint32_t head;
+    uint32_t tail;
+    struct syscall_ring_entry entries[PEACHOS_SYSCALL_RING_ENTRIES];
+};
+
+struct interrupt_frame;
+void* isr80h_command16_ring_enter(struct interrupt_frame* frame);
+#endif
@@ -0,0 +1,81 @@
+#include "thread.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "task/thread.h"
+#include "task/futex.h"
+#include "status.h"
+#include "kernel.h"
+
+void* isr80h_command19_thread_create(struct interrupt_frame* frame)
+{
+    void* entry = task_get_syscall_argument(task_current(), 0);
+    uint32_t arg0 = (uint32_t) task_get_syscall_argument(task_current(), 1);
+    uint32_t arg1 = (uint32_t) task_get_syscall_argument(task_current(), 2);
+    int res = thread_create(task_current()->process, entry, arg0, arg1);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+
+    return (void*) res;
+}
+
+void* isr80h_command20_thread_exit(struct interrupt_frame* frame)
+{
+    struct task* task = task_current();
+    int exit_code = (int) task_get_syscall_argument(task, 0);
+    if (task->thread)
+    {
+        thread_exit(task, exit_code);
+    }
+    else
+    {
+        // The main task leaving takes the whole process with it
+        process_terminate(task->process);
+    }
+
+    task_next();
+    return 0;
+}
+
+void* isr80h_command21_thread_join(struct interrupt_frame* frame)
+{
+    int id = (int) task_get_syscall_argument(task_current(), 0);
+    void* exit_code_user_ptr = task_get_syscall_argument(task_current(), 1);
+    int exit_code = 0;
+    int res = thread_join(task_current()->process, id, &exit_code);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    if (exit_code_user_ptr)
+    {
+        res = copy_to_task(task_current(), exit_code_user_ptr, &exit_code, sizeof(exit_code));
+    }
+out:
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return 0;
+}
+
+void* isr80h_command22_futex_wait(struct interrupt_frame* frame)
+{
+    void* address = task_get_syscall_argument(task_current(), 0);
+    int expected = (int) task_get_syscall_argument(task_current(), 1);
+    int res = futex_wait(task_current()->process, address, expected);
+    if (res < 0)
+    {
+        return ERROR(res);
+    }
+    return 0;
+}
+
+void* isr80h_command23_futex_wake(struct interrupt_frame* frame)
+{
+    void* address = task_get_syscall_argument(task_current(), 0);
+    int count = (int) task_get_syscall_argument(task_current(), 1);
+    return (void*) futex_wake(task_current()->process, address, count);
+}
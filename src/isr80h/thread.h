@@ -0,0 +1,11 @@
+#ifndef ISR80H_THREAD_H
+#define ISR80H_THREAD_H
+
+struct interrupt_frame;
+void* isr80h_command19_thread_create(struct interrupt_frame* frame);
+void* isr80h_command20_thread_exit(struct interrupt_frame* frame);
+void* isr80h_command21_thread_join(struct interrupt_frame* frame);
+void* isr80h_command22_futex_wait(struct interrupt_frame* frame);
+void* isr80h_command23_futex_wake(struct interrupt_frame* frame);
+
+#endif
@@ -0,0 +1,16 @@
+#include "time.h"
+#include "task/task.h"
+#include "timer/timer.h"
+
+void* isr80h_command14_sleep(struct interrupt_frame* frame)
+{
+    uint32_t ms = (uint32_t) task_get_syscall_argument(task_current(), 0);
+    task_sleep(timer_ms_to_ticks(ms));
+    return 0;
+}
+
+void* isr80h_command15_get_time(struct interrupt_frame* frame)
+{
+    // Milliseconds since boot
+    return (void*) timer_ms();
+}
@@ -0,0 +1,7 @@
+#ifndef ISR80H_TIME_H
+#define ISR80H_TIME_H
+
+struct interrupt_frame;
+void* isr80h_command14_sleep(struct interrupt_frame* frame);
+void* isr80h_command15_get_time(struct interrupt_frame* frame);
+#endif
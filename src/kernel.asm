@@ -6,9 +6,11 @@
 ;   - Sets up segment registers (DS, ES, FS, GS, SS) to the data segment.
 ;   - Initializes the stack pointer (ESP) and base pointer (EBP) to a known
 ;     memory location (0x00200000).
-;   - Remaps the master Programmable Interrupt Controller (PIC) to avoid
-;     conflicts with CPU exceptions by configuring its interrupt vector offset.
+;   - Zeroes the .bss, which is not part of kernel.bin.
+;   - Remaps the master and slave Programmable Interrupt Controllers (PIC) to
+;     avoid conflicts with CPU exceptions by configuring their vector offsets.
 ;   - Calls the main kernel entry point (kernel_main).
+;   - Starts kernel.bin with a header telling the boot sector how much to load.
 ;   - Provides a utility routine (kernel_registers) to reset segment registers.
 ;   - Pads the file to 512 bytes for boot sector alignment.
 ;
@@ -26,10 +28,23 @@
 global _start
 global kernel_registers
 extern kernel_main
+extern kernel_sectors
+extern __bss_start
+extern __bss_end
 
 CODE_SEG equ 0x08
 DATA_SEG equ 0x10
 
+; The linker script puts this first in kernel.bin. The boot sector loads the first sector,
+; checks the magic at offset 8 and then reads the rest of the sectors given at offset 12
+section .header
+kernel_header:
+    jmp near _start
+    times 8-($ - $$) db 0x90
+    dd 'PEAK'
+    dd kernel_sectors
+
+section .text
 _start:
     mov ax, DATA_SEG
     mov ds, ax
@@ -40,6 +55,13 @@ _start:
     mov ebp, 0x00200000
     mov esp, ebp
 
+    ; The boot sector only loads the file image, zero the .bss that follows it
+    cld
+    xor eax, eax
+    mov edi, __bss_start
+    mov ecx, __bss_end
+    sub ecx, edi
+    rep stosb
 
     ; Remap the master PIC
     mov al, 00010001b
@@ -55,6 +77,20 @@ _start:
     out 0x21, al
     ; End remap of the master PIC
 
+    ; Remap the slave PIC so IRQ 8-15 (IRQ14 is the primary IDE channel) land at 0x28
+    mov al, 00010001b
+    out 0xA0, al
+
+    mov al, 0x28
+    out 0xA1, al
+
+    mov al, 0x02 ; ICW3, cascaded on IRQ2 of the master
+    out 0xA1, al
+
+    mov al, 00000001b
+    out 0xA1, al
+    ; End remap of the slave PIC
+
     call kernel_main
 
     jmp $
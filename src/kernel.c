@@ -16,7 +16,9 @@
 #include <stdint.h>
 #include "idt/idt.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
 #include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
 #include "memory/memory.h"
 #include "keyboard/keyboard.h"
 #include "string/string.h"
@@ -28,9 +30,18 @@
 #include "fs/pparser.h"
 #include "disk/streamer.h"
 #include "task/tss.h"
+#include "task/cpu.h"
+#include "task/fpu.h"
+#include "task/workqueue.h"
 #include "gdt/gdt.h"
+#include "bench/bench.h"
+#include "timer/timer.h"
+#include "idt/apic.h"
 #include "config.h"
 #include "status.h"
+#include "trace/trace.h"
+#include "serial/serial.h"
+#include "io/io.h"
 
 /*
  * Global variables and definitions for PeachOS kernel:
@@ -40,7 +51,6 @@
  * - terminal_col: Current column position of the terminal cursor.
  * - TERMINAL_COLOUR: Attribute byte for terminal text color (0x0F = white on black).
  * - kernel_chunk: Pointer to the kernel's 4GB paging chunk structure.
- * - tss: Task State Segment structure for CPU task management.
  * - gdt_real: Array holding the actual Global Descriptor Table (GDT) segments.
  */
 uint16_t* video_mem = 0;
@@ -53,8 +63,6 @@ uint16_t terminal_col = 0;
 
 static struct paging_4gb_chunk* kernel_chunk = 0;
 
-struct tss tss;
-
 struct gdt gdt_real[PEACHOS_TOTAL_GDT_SEGMENTS];
 
 struct gdt_structured gdt_structured[PEACHOS_TOTAL_GDT_SEGMENTS] = {
@@ -63,7 +71,7 @@ struct gdt_structured gdt_structured[PEACHOS_TOTAL_GDT_SEGMENTS] = {
     {.base = 0x00, .limit = 0xffffffff, .type = 0x92},            // Kernel data segment
     {.base = 0x00, .limit = 0xffffffff, .type = 0xf8},              // User code segment
     {.base = 0x00, .limit = 0xffffffff, .type = 0xf2},             // User data segment
-    {.base = (uintptr_t)&tss, .limit=sizeof(tss), .type = 0xE9}      // TSS Segment
+    // TSS segments of every processor follow, see kernel_main
 };
 
 /** 
@@ -96,6 +104,46 @@ void terminal_putchar(int x, int y, char c, char colour)
     video_mem[(y * VGA_WIDTH) + x] = terminal_make_char(c, colour);
 }
 
+/**
+ * @brief terminal_update_cursor - Moves the blinking hardware cursor to the current position
+ * @return void
+ * @details The CRT controller takes the position in two port writes each, so this is done once per
+ * write rather than for every character.
+ */
+static void terminal_update_cursor()
+{
+    uint16_t position = terminal_row * VGA_WIDTH + terminal_col;
+    outb(0x3D4, 0x0F);
+    outb(0x3D5, position & 0xFF);
+    outb(0x3D4, 0x0E);
+    outb(0x3D5, position >> 8);
+}
+
+/**
+ * @brief terminal_scroll - Moves every line up by one and clears the bottom line
+ * @return void
+ * @details The whole screen moves with a single memmove, the cursor ends up on the new bottom line.
+ */
+static void terminal_scroll()
+{
+    memmove(video_mem, video_mem + VGA_WIDTH, (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
+    for (int x = 0; x < VGA_WIDTH; x++)
+    {
+        terminal_putchar(x, VGA_HEIGHT - 1, ' ', TERMINAL_COLOUR);
+    }
+    terminal_row = VGA_HEIGHT - 1;
+}
+
+static void terminal_newline()
+{
+    terminal_col = 0;
+    terminal_row += 1;
+    if (terminal_row >= VGA_HEIGHT)
+    {
+        terminal_scroll();
+    }
+}
+
 /** 
  * @brief terminal_backspace - Handles backspace functionality in the terminal
  * @return void
@@ -117,26 +165,24 @@ void terminal_backspace()
     }
 
     terminal_col -=1;
-    terminal_writechar(' ', 15);
-    terminal_col -=1;
+    terminal_putchar(terminal_col, terminal_row, ' ', 15);
 }
 
-/** 
- * @brief terminal_writechar - Writes a character to the terminal
- * @param[in] c The character to write to the terminal
+/**
+ * @brief terminal_emit - Puts one character on the screen without moving the hardware cursor
+ * @param[in] c The character, new lines and backspaces are handled
  * @param[in] colour The colour of the character
  * @return void
- * @details This function writes a single character to the terminal at the current cursor position.
- * It handles special characters like newline and backspace, and updates the cursor position accordingly.
- * If the cursor reaches the end of the line, it wraps to the next line.
- * If the cursor reaches the bottom of the screen, it wraps to the top.
  */
-void terminal_writechar(char c, char colour)
+static void terminal_emit(char c, char colour)
 {
+#if PEACHOS_SERIAL_CONSOLE
+    serial_putchar(c);
+#endif
+
     if (c == '\n')
     {
-        terminal_row += 1;
-        terminal_col = 0;
+        terminal_newline();
         return;
     }
 
@@ -146,19 +192,30 @@ void terminal_writechar(char c, char colour)
         return;
     }
 
-    terminal_putchar(terminal_col, terminal_row, c, colour);
+    video_mem[(terminal_row * VGA_WIDTH) + terminal_col] = terminal_make_char(c, colour);
     terminal_col += 1;
     if (terminal_col >= VGA_WIDTH)
     {
-        terminal_col = 0;
-        terminal_row += 1;
-    }
-    if(terminal_row >= VGA_HEIGHT)
-    {
-        terminal_row = 0;
+        terminal_newline();
     }
 }
 
+/** 
+ * @brief terminal_writechar - Writes a character to the terminal
+ * @param[in] c The character to write to the terminal
+ * @param[in] colour The colour of the character
+ * @return void
+ * @details This function writes a single character to the terminal at the current cursor position.
+ * It handles special characters like newline and backspace, and updates the cursor position accordingly.
+ * If the cursor reaches the end of the line, it wraps to the next line.
+ * If the cursor reaches the bottom of the screen, the screen scrolls up by a line.
+ */
+void terminal_writechar(char c, char colour)
+{
+    terminal_emit(c, colour);
+    terminal_update_cursor();
+}
+
 /** 
  * @brief terminal_initialize - Initializes the terminal
  * @return void
@@ -177,6 +234,7 @@ void terminal_initialize()
             terminal_putchar(x, y, ' ', TERMINAL_COLOUR);
         }
     }   
+    terminal_update_cursor();
 }
 
 /** 
@@ -186,9 +244,7 @@ void terminal_initialize()
  * @details This function writes a single character to the terminal
  * using the terminal_writechar function with a predefined colour.
  * It is typically used by higher-level functions to output characters like printf.
- * This function does not handle special characters like newline or backspace.
  * This function does not handle UTF-8 characters.
- * This function does not handle cursor positioning.
  * This function does not handle colours.
  */
 void _putchar(char character)
@@ -196,24 +252,50 @@ void _putchar(char character)
     terminal_writechar(character, TERMINAL_COLOUR);
 }
 
+/**
+ * @brief _putstring - Writes a run of printf output to the terminal
+ * @param[in] str The characters to write, they are not terminated
+ * @param[in] length How many characters to write
+ * @return void
+ * @details printf buffers its output and hands it over here in runs,
+ * the hardware cursor is moved once per run instead of once per character.
+ */
+void _putstring(const char* str, size_t length)
+{
+    terminal_write(str, length);
+}
+
 /** 
  * @brief print - Prints a string to the terminal
  * @param[in] str The string to print to the terminal
  * @return void
- * @details This function prints a null-terminated string to the terminal
- * by iterating through each character in the string and using the terminal_writechar function.
- * It does not handle special characters like newline or backspace.
+ * @details This function prints a null-terminated string to the terminal in a single pass,
+ * the hardware cursor is moved once at the end.
  * It does not handle UTF-8 characters.
- * It does not handle cursor positioning.
  * It does not handle colours.
  */
 void print(const char* str)
 {
-    size_t len = strlen(str);
+    for (; *str; str++)
+    {
+        terminal_emit(*str, TERMINAL_COLOUR);
+    }
+    terminal_update_cursor();
+}
+
+/**
+ * @brief terminal_write - Writes len bytes of buf to the terminal
+ * @param[in] buf The characters to write, they do not need a terminator
+ * @param[in] len How many characters to write
+ * @return void
+ */
+void terminal_write(const char* buf, size_t len)
+{
     for (size_t i = 0; i < len; i++)
     {
-        terminal_writechar(str[i], TERMINAL_COLOUR);
+        terminal_emit(buf[i], TERMINAL_COLOUR);
     }
+    terminal_update_cursor();
 }
 
 /** 
@@ -227,6 +309,11 @@ void print(const char* str)
 void panic(const char* msg)
 {
     print(msg);
+#if PEACHOS_TRACE
+    trace_dump();
+#endif
+    // Interrupts are not coming back, push out what the serial port still has queued
+    serial_flush();
     while(1) {}
 }
 
@@ -244,6 +331,16 @@ void kernel_page()
     paging_switch(kernel_chunk);
 }
 
+/**
+ * @brief kernel_directory - Returns the kernel's 4GB paging chunk
+ * @return struct paging_4gb_chunk* The chunk kernel_page switches to
+ * @details Kernel tasks have no process of their own and run on these page tables.
+ */
+struct paging_4gb_chunk* kernel_directory()
+{
+    return kernel_chunk;
+}
+
 /** 
  * @brief kernel_main - The main entry point for the kernel
  * @return void
@@ -256,6 +353,12 @@ void kernel_page()
 void kernel_main()
 {
     terminal_initialize();
+    serial_init();
+    cpu_init();
+    for (int i = 0; i < PEACHOS_MAX_CPUS; i++)
+    {
+        gdt_structured[PEACHOS_GDT_TSS_INDEX + i] = (struct gdt_structured) {.base = (uintptr_t)&cpus[i].tss, .limit = sizeof(struct tss), .type = 0xE9};
+    }
     memset(gdt_real, 0x00, sizeof(gdt_real));
     gdt_structured_to_gdt(gdt_real, gdt_structured, PEACHOS_TOTAL_GDT_SEGMENTS);
 
@@ -264,6 +367,14 @@ void kernel_main()
 
     // Initialize the heap
     kheap_init();
+    if (frame_init() < 0)
+    {
+        print("No BIOS memory map, process memory comes from the kernel heap\n");
+    }
+    if (cow_init() < 0)
+    {
+        panic("Failed to allocate the page reference counts\n");
+    }
     print("Welcome to PeachOS!\n");
 
     // Initialize filesystems
@@ -275,16 +386,19 @@ void kernel_main()
     // Initialize the interrupt descriptor table
     idt_init();
 
+    // User land gets the FPU and SSE, their registers are switched lazily
+    fpu_init();
+
     // Setup the TSS
-    memset(&tss, 0x00, sizeof(tss));
-    tss.esp0 = 0x600000;
-    tss.ss0 = KERNEL_DATA_SELECTOR;
+    struct cpu* cpu = cpu_current();
+    cpu->tss.esp0 = 0x600000;
+    cpu->tss.ss0 = KERNEL_DATA_SELECTOR;
 
     // Load the TSS
-    tss_load(0x28);
+    tss_load(cpu_tss_selector(cpu));
 
-    // Setup paging
-    kernel_chunk = paging_new_4gb(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+    // Setup paging, the kernel shares its page tables with every task so they must be kernel only
+    kernel_chunk = paging_new_4gb(PAGING_IS_WRITEABLE | PAGING_IS_PRESENT);
     
     // Switch to kernel paging chunk
     paging_switch(kernel_chunk);
@@ -292,38 +406,49 @@ void kernel_main()
     // Enable paging
     enable_paging();
 
+    // Move interrupts over to the APICs when we have them, their registers need paging set up
+    if (apic_init())
+    {
+        cpu_current()->apic_id = apic_id();
+    }
+
+    // Take over the timer, it only interrupts when the next timeslice ends
+    timer_init();
+
     // Register the kernel commands
     isr80h_register_commands();
 
     // Initialize all the system keyboards
     keyboard_init();
 
+#if PEACHOS_RUN_BENCHMARKS
+    bench_run();
+#endif
+
     struct process* process = NULL;
 
-    int res = process_load_switch("0:/blank.elf", &process);
+    int res = process_load_switch("1:/blank.elf", &process);
     if (res != PEACHOS_ALL_OK)
     {
         panic("Failed to load blank.elf\n");
     }
 
 
-    struct command_argument argument;
-    memset(&argument, 0x00, sizeof(argument));
+    process_inject_arguments(process, "Testing!", sizeof("Testing!"));
 
-    strcpy(argument.argument, "Testing!");
-    argument.next = NULL;
-
-    process_inject_arguments(process, &argument);
-
-    res = process_load_switch("0:/blank.elf", &process);
+    res = process_load_switch("1:/blank.elf", &process);
     if (res != PEACHOS_ALL_OK)
     {
         panic("Failed to load blank.elf\n");
     }
 
-    strcpy(argument.argument, "Abc!");
-    argument.next = NULL;
-    process_inject_arguments(process, &argument);
+    process_inject_arguments(process, "Abc!", sizeof("Abc!"));
+
+    // Created after the first programs, task_run_first_ever_task starts the first task there is
+    if (workqueue_init() < 0)
+    {
+        panic("Failed to create the kernel worker\n");
+    }
 
     task_run_first_ever_task();
 
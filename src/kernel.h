@@ -17,6 +17,7 @@
  *   - panic(const char* msg): Halt the system with an error message.
  *   - kernel_page(): Set up kernel paging.
  *   - kernel_registers(): Initialize or display CPU registers.
+ *   - kernel_directory(): The kernel's 4GB paging chunk, kernel tasks run on it.
  *
  * Error Handling Macros:
  *   - ERROR(value): Casts a value to a void pointer for error signaling.
@@ -26,19 +27,25 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
+#include <stddef.h>
+
 #define VGA_WIDTH 80
-#define VGA_HEIGHT 20
+#define VGA_HEIGHT 25
 
 #define PEACHOS_MAX_PATH 108
 
 void kernel_main();
 void print(const char* str);
+void terminal_write(const char* buf, size_t len);
 void terminal_writechar(char c, char colour);
 
 void panic(const char* msg);
 void kernel_page();
 void kernel_registers();
 
+struct paging_4gb_chunk;
+struct paging_4gb_chunk* kernel_directory();
+
 #define ERROR(value) (void*)(value)
 #define ERROR_I(value) (int)(value)
 #define ISERR(value) ((int)value < 0)
@@ -4,11 +4,14 @@
 #include "kernel.h"
 #include "idt/idt.h"
 #include "task/task.h"
+#include "task/workqueue.h"
 
 #include <stdint.h>
 #include <stddef.h>
 
 #define CLASSIC_KEYBOARD_CAPSLOCK 0x3A
+// Scancodes the interrupt read that the worker has not translated yet, a power of two
+#define CLASSIC_KEYBOARD_SCANCODES 32
 
 int classic_keyboard_init();
 
@@ -35,6 +38,11 @@ struct keyboard classic_keyboard = {
 
 void classic_keyboard_handle_interrupt();
 
+static uint8_t classic_keyboard_scancodes[CLASSIC_KEYBOARD_SCANCODES];
+static uint32_t classic_keyboard_scancode_head;
+static uint32_t classic_keyboard_scancode_tail;
+static struct work classic_keyboard_work;
+
 int classic_keyboard_init()
 {
     idt_register_interrupt_callback(ISR_KEYBOARD_INTERRUPT, classic_keyboard_handle_interrupt);
@@ -65,9 +73,33 @@ uint8_t classic_keyboard_scancode_to_char(uint8_t scancode)
 }
 
 
+/**
+ * Runs on the worker task, turns the scancodes read so far into keys
+ */
+static void classic_keyboard_translate(void* data)
+{
+    while (classic_keyboard_scancode_head != classic_keyboard_scancode_tail)
+    {
+        uint8_t scancode = classic_keyboard_scancodes[classic_keyboard_scancode_head++ % CLASSIC_KEYBOARD_SCANCODES];
+        if (scancode == CLASSIC_KEYBOARD_CAPSLOCK)
+        {
+            KEYBOARD_CAPS_LOCK_STATE old_state = keyboard_get_capslock(&classic_keyboard);
+            keyboard_set_capslock(&classic_keyboard, old_state == KEYBOARD_CAPS_LOCK_ON ? KEYBOARD_CAPS_LOCK_OFF : KEYBOARD_CAPS_LOCK_ON);
+        }
+
+        uint8_t c = classic_keyboard_scancode_to_char(scancode);
+        if (c != 0)
+        {
+            keyboard_push(c);
+        }
+    }
+}
+
+/**
+ * Only reads the scancode, the translation is left to the worker task
+ */
 void classic_keyboard_handle_interrupt()
 {
-    kernel_page();
     uint8_t scancode = 0;
     scancode = insb(KEYBOARD_INPUT_PORT);
     insb(KEYBOARD_INPUT_PORT);
@@ -77,20 +109,14 @@ void classic_keyboard_handle_interrupt()
         return;
     }
 
-    if (scancode == CLASSIC_KEYBOARD_CAPSLOCK)
-    {
-        KEYBOARD_CAPS_LOCK_STATE old_state = keyboard_get_capslock(&classic_keyboard);
-        keyboard_set_capslock(&classic_keyboard, old_state == KEYBOARD_CAPS_LOCK_ON ? KEYBOARD_CAPS_LOCK_OFF : KEYBOARD_CAPS_LOCK_ON);
-    }
-
-    uint8_t c = classic_keyboard_scancode_to_char(scancode);
-    if (c != 0)
+    // Dropped when the worker is that far behind
+    if (classic_keyboard_scancode_tail - classic_keyboard_scancode_head == CLASSIC_KEYBOARD_SCANCODES)
     {
-        keyboard_push(c);
+        return;
     }
 
-    task_page();
-
+    classic_keyboard_scancodes[classic_keyboard_scancode_tail++ % CLASSIC_KEYBOARD_SCANCODES] = scancode;
+    work_queue(&classic_keyboard_work, classic_keyboard_translate, 0);
 }
 
 struct keyboard* classic_init()
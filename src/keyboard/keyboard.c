@@ -4,6 +4,7 @@
 #include "task/process.h"
 #include "task/task.h"
 #include "classic.h"
+#include "memory/heap/kheap.h"
 
 static struct keyboard* keyboard_list_head = 0;
 static struct keyboard* keyboard_list_last = 0;
@@ -39,16 +40,59 @@ out:
     return res;
 }
 
-static int keyboard_get_tail_index(struct process* process)
+#define KEYBOARD_BUFFER_MASK (PEACHOS_KEYBOARD_BUFFER_SIZE - 1)
+
+// The process keys go to, whichever read the keyboard last. Keys typed while it is NULL are lost
+static struct process* keyboard_focus = 0;
+
+/**
+ * Returns the keyboard buffer of the process, it is allocated when the process first reads a
+ * key. Reading also gives the process the keyboard focus
+ */
+static struct keyboard_buffer* keyboard_buffer(struct process* process, bool reading)
 {
-    return process->keyboard.tail % sizeof(process->keyboard.buffer);
+    if (!process->keyboard && reading)
+    {
+        process->keyboard = kzalloc(sizeof(struct keyboard_buffer));
+    }
+
+    if (reading && process->keyboard)
+    {
+        keyboard_focus = process;
+    }
+
+    return process->keyboard;
 }
 
+/**
+ * Takes back the last key pushed while it is unread, from the producer side like keyboard_push
+ */
 void keyboard_backspace(struct process* process)
 {
-    process->keyboard.tail -=1 ;
-    int real_index = keyboard_get_tail_index(process);
-    process->keyboard.buffer[real_index] = 0x00;
+    struct keyboard_buffer* keyboard = keyboard_buffer(process, false);
+    if (!keyboard)
+    {
+        return;
+    }
+
+    uint32_t tail = keyboard->tail;
+    if (tail == __atomic_load_n(&keyboard->head, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    __atomic_store_n(&keyboard->tail, tail - 1, __ATOMIC_RELEASE);
+}
+
+void keyboard_free(struct process* process)
+{
+    if (keyboard_focus == process)
+    {
+        keyboard_focus = 0;
+    }
+
+    kfree(process->keyboard);
+    process->keyboard = 0;
 }
 
 void keyboard_set_capslock(struct keyboard* keyboard, KEYBOARD_CAPS_LOCK_STATE state)
@@ -61,41 +105,91 @@ KEYBOARD_CAPS_LOCK_STATE keyboard_get_capslock(struct keyboard* keyboard)
     return keyboard->capslock_state;
 }
 
+/**
+ * Called from the keyboard interrupt, the only producer of every buffer. A full buffer drops
+ * the key rather than overwriting one that was not read yet
+ */
 void keyboard_push(char c)
 {
-    struct process* process = process_current();
-    if (!process)
+    struct process* process = keyboard_focus;
+    if (c == 0 || !process || !process->keyboard)
     {
         return;
     }
 
-    if(c == 0)
+    struct keyboard_buffer* keyboard = process->keyboard;
+    uint32_t tail = keyboard->tail;
+    uint32_t head = __atomic_load_n(&keyboard->head, __ATOMIC_ACQUIRE);
+    if (tail - head == PEACHOS_KEYBOARD_BUFFER_SIZE)
     {
         return;
     }
 
-    int real_index = keyboard_get_tail_index(process);
-    process->keyboard.buffer[real_index] = c;
-    process->keyboard.tail++;
+    keyboard->buffer[tail & KEYBOARD_BUFFER_MASK] = c;
+    __atomic_store_n(&keyboard->tail, tail + 1, __ATOMIC_RELEASE);
+
+    // Readers only sleep on an empty buffer, a burst of keys wakes them once
+    if (tail == head)
+    {
+        wait_queue_wake_all(&keyboard->readers);
+    }
 }
 
-char keyboard_pop()
+static int keyboard_take(struct keyboard_buffer* keyboard, char* out, int max)
+{
+    uint32_t head = keyboard->head;
+    uint32_t tail = __atomic_load_n(&keyboard->tail, __ATOMIC_ACQUIRE);
+    int total = 0;
+    while (total < max && head != tail)
+    {
+        out[total++] = keyboard->buffer[head & KEYBOARD_BUFFER_MASK];
+        head++;
+    }
+
+    __atomic_store_n(&keyboard->head, head, __ATOMIC_RELEASE);
+    return total;
+}
+
+/**
+ * Moves up to max keys of the current process to out, the only consumer of its buffer. With
+ * wait set the task blocks until there is at least one. Returns how many keys were taken
+ */
+int keyboard_read(char* out, int max, bool wait)
 {
     if (!task_current())
     {
         return 0;
     }
 
-    struct process* process = task_current()->process;
-    int real_index = process->keyboard.head % sizeof(process->keyboard.buffer);
-    char c = process->keyboard.buffer[real_index];
-    if (c == 0x00)
+    struct keyboard_buffer* keyboard = keyboard_buffer(task_current()->process, true);
+    if (!keyboard)
     {
-        // Nothing to pop return zero.
         return 0;
     }
 
-    process->keyboard.buffer[real_index] = 0;
-    process->keyboard.head++;
+    int total = keyboard_take(keyboard, out, max);
+    while (total == 0 && max > 0 && wait && task_can_block())
+    {
+        wait_queue_sleep(&keyboard->readers);
+        total = keyboard_take(keyboard, out, max);
+    }
+
+    return total;
+}
+
+char keyboard_pop()
+{
+    char c = 0;
+    keyboard_read(&c, 1, false);
     return c;
-}
\ No newline at end of file
+}
+
+/**
+ * Pops a key, blocking the current task until one is pushed when the buffer is empty
+ */
+char keyboard_pop_wait()
+{
+    char c = 0;
+    keyboard_read(&c, 1, true);
+    return c;
+}
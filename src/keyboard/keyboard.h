@@ -1,6 +1,8 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+#include <stdbool.h>
+
 #define KEYBOARD_CAPS_LOCK_ON 1
 #define KEYBOARD_CAPS_LOCK_OFF 0
 
@@ -23,6 +25,9 @@ void keyboard_init();
 void keyboard_backspace(struct process* process);
 void keyboard_push(char c);
 char keyboard_pop();
+char keyboard_pop_wait();
+int keyboard_read(char* out, int max, bool wait);
+void keyboard_free(struct process* process);
 int keyboard_insert(struct keyboard* keyboard);
 void keyboard_set_capslock(struct keyboard* keyboard, KEYBOARD_CAPS_LOCK_STATE state);
 KEYBOARD_CAPS_LOCK_STATE keyboard_get_capslock(struct keyboard* keyboard);
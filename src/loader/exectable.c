@@ -0,0 +1,237 @@
+#include "exectable.h"
+#include "fs/file.h"
+#include "disk/disk.h"
+#include "string/string.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "status.h"
+#include "config.h"
+#include <stdbool.h>
+
+// Programs are started by name from the root of this drive, see isr80h/process.c
+#define EXECTABLE_ROOT "0:/"
+#define EXECTABLE_ROOT_LEN 3
+
+struct exectable_entry
+{
+    char name[FILE_DIRENT_NAME_MAX];
+    // The table holds a reference once the program has been loaded, NULL until then
+    struct elf_file* elf;
+    struct exectable_entry* hash_next;
+};
+
+static struct exectable_entry exectable_entries[PEACHOS_EXEC_TABLE_ENTRIES];
+static struct exectable_entry* exectable_buckets[PEACHOS_EXEC_TABLE_HASH_BUCKETS];
+static int exectable_total = 0;
+// Set when every file of the root directory made it into the table, a miss is final then
+static bool exectable_complete = false;
+// Set by anything that may change the root directory, the next load lists it again
+static bool exectable_stale = true;
+// Bumped by every rebuild, entries seen before a rebuild are gone after it
+static uint32_t exectable_generation = 0;
+
+static uint32_t exectable_hash(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+    {
+        hash = (hash ^ (uint8_t) tolower(*name)) * 16777619u;
+    }
+    return hash & (PEACHOS_EXEC_TABLE_HASH_BUCKETS - 1);
+}
+
+/**
+ * Names are matched without case like the filesystems match them
+ */
+static struct exectable_entry* exectable_find(const char* name)
+{
+    for (struct exectable_entry* entry = exectable_buckets[exectable_hash(name)]; entry; entry = entry->hash_next)
+    {
+        if (istrncmp(entry->name, name, sizeof(entry->name)) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Lists the root directory again. Reading it may sleep, so the old table stays in use until
+ * the listing is done and is then replaced in one go
+ */
+static int exectable_rebuild()
+{
+    int res = 0;
+    int total = 0;
+    bool complete = true;
+    uint32_t pos = 0;
+
+    exectable_stale = false;
+    int fd = 0;
+    struct file_dirent* dirents = kzalloc(PEACHOS_EXEC_TABLE_ENTRIES * sizeof(struct file_dirent));
+    if (!dirents)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    fd = fopen(EXECTABLE_ROOT, "r");
+    if (!fd)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    while (total < PEACHOS_EXEC_TABLE_ENTRIES)
+    {
+        res = freaddir(fd, &pos, &dirents[total], PEACHOS_EXEC_TABLE_ENTRIES - total);
+        if (res <= 0)
+        {
+            break;
+        }
+        total += res;
+    }
+
+    if (res >= 0 && total == PEACHOS_EXEC_TABLE_ENTRIES)
+    {
+        // More files than the table holds, the ones left out are still found on the disk
+        struct file_dirent more;
+        res = freaddir(fd, &pos, &more, 1);
+        complete = res == 0;
+    }
+
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    struct elf_file* released[PEACHOS_EXEC_TABLE_ENTRIES];
+    int total_released = 0;
+    for (int i = 0; i < exectable_total; i++)
+    {
+        if (exectable_entries[i].elf)
+        {
+            released[total_released++] = exectable_entries[i].elf;
+        }
+    }
+
+    memset(exectable_buckets, 0, sizeof(exectable_buckets));
+    exectable_total = 0;
+    for (int i = 0; i < total; i++)
+    {
+        struct file_dirent* dirent = &dirents[i];
+        if (dirent->attributes & FILE_DIRENT_DIRECTORY)
+        {
+            continue;
+        }
+
+        // A name that fills the dirent may have been cut short, it has to be looked up on the disk
+        if (strnlen(dirent->name, sizeof(dirent->name)) >= sizeof(dirent->name) - 1)
+        {
+            complete = false;
+            continue;
+        }
+
+        struct exectable_entry* entry = &exectable_entries[exectable_total++];
+        strncpy(entry->name, dirent->name, sizeof(entry->name));
+        entry->elf = 0;
+        uint32_t bucket = exectable_hash(entry->name);
+        entry->hash_next = exectable_buckets[bucket];
+        exectable_buckets[bucket] = entry;
+    }
+    exectable_complete = complete;
+    exectable_generation++;
+
+    // Processes running these programs hold references of their own
+    for (int i = 0; i < total_released; i++)
+    {
+        elf_close(released[i]);
+    }
+
+out:
+    if (res < 0)
+    {
+        exectable_stale = true;
+    }
+    if (fd)
+    {
+        fclose(fd);
+    }
+    if (dirents)
+    {
+        kfree(dirents);
+    }
+    return res;
+}
+
+/**
+ * elf_load for the programs in the root directory. A program that was loaded before is handed
+ * out again without opening it, a name that is not in the directory fails without reading the disk
+ */
+int exectable_load(const char* filename, struct elf_file** file_out)
+{
+    int res = 0;
+    if (strncmp(filename, EXECTABLE_ROOT, EXECTABLE_ROOT_LEN) != 0)
+    {
+        return elf_load(filename, file_out);
+    }
+
+    const char* name = filename + EXECTABLE_ROOT_LEN;
+    for (const char* c = name; *c; c++)
+    {
+        if (*c == '/')
+        {
+            return elf_load(filename, file_out);
+        }
+    }
+
+    if (exectable_stale)
+    {
+        exectable_rebuild();
+    }
+
+    // The rebuild failed or the directory changed while it was listed
+    if (exectable_stale)
+    {
+        return elf_load(filename, file_out);
+    }
+
+    struct exectable_entry* entry = exectable_find(name);
+    if (!entry)
+    {
+        return exectable_complete ? -EBADPATH : elf_load(filename, file_out);
+    }
+
+    if (entry->elf)
+    {
+        *file_out = elf_dup(entry->elf);
+        return 0;
+    }
+
+    uint32_t generation = exectable_generation;
+    res = elf_load(filename, file_out);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    // Loading may sleep, the entry only still exists if the table was not rebuilt meanwhile
+    if (generation == exectable_generation && !exectable_stale && !entry->elf)
+    {
+        entry->elf = elf_dup(*file_out);
+    }
+
+    return res;
+}
+
+/**
+ * Called before anything is written to the disk, the table is listed again on its next use
+ */
+void exectable_invalidate(struct disk* disk)
+{
+    if (disk == disk_get(0))
+    {
+        exectable_stale = true;
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef EXECTABLE_H
+#define EXECTABLE_H
+
+#include "loader/formats/elfloader.h"
+
+struct disk;
+
+int exectable_load(const char* filename, struct elf_file** file_out);
+void exectable_invalidate(struct disk* disk);
+
+#endif
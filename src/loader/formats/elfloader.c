@@ -48,11 +48,6 @@ struct elf_header* elf_header(struct elf_file* file)
     return file->elf_memory;
 }
 
-struct elf32_shdr* elf_sheader(struct elf_header* header)
-{
-    return (struct elf32_shdr*)((int)header+header->e_shoff);
-}
-
 struct elf32_phdr* elf_pheader(struct elf_header* header)
 {
     if(header->e_phoff == 0)
@@ -68,20 +63,9 @@ struct elf32_phdr* elf_program_header(struct elf_header* header, int index)
     return &elf_pheader(header)[index];
 }
 
-struct elf32_shdr* elf_section(struct elf_header* header, int index)
+int elf_fd(struct elf_file* file)
 {
-    return &elf_sheader(header)[index];
-}
-
-
-void* elf_phdr_phys_address(struct elf_file* file, struct elf32_phdr* phdr)
-{
-    return elf_memory(file)+phdr->p_offset;
-}
-
-char* elf_str_table(struct elf_header* header)
-{
-    return (char*) header + elf_section(header, header->e_shstrndx)->sh_offset;
+    return file->fd;
 }
 
 void* elf_virtual_base(struct elf_file* file)
@@ -94,16 +78,6 @@ void* elf_virtual_end(struct elf_file* file)
     return file->virtual_end_address;
 }
 
-void* elf_phys_base(struct elf_file* file)
-{
-    return file->physical_base_address;
-}
-
-void* elf_phys_end(struct elf_file* file)
-{
-    return file->physical_end_address;
-}
-
 int elf_validate_loaded(struct elf_header* header)
 {
     return (elf_valid_signature(header) && elf_valid_class(header) && elf_valid_encoding(header) && elf_has_program_header(header) && elf_is_executable(header)) ? PEACHOS_ALL_OK : -EINFORMAT;
@@ -114,14 +88,12 @@ int elf_process_phdr_pt_load(struct elf_file* elf_file, struct elf32_phdr* phdr)
     if (elf_file->virtual_base_address >= (void*) phdr->p_vaddr || elf_file->virtual_base_address == 0x00)
     {
         elf_file->virtual_base_address = (void*) phdr->p_vaddr;
-        elf_file->physical_base_address = elf_memory(elf_file)+phdr->p_offset;
     }
 
-    unsigned int end_virtual_address = phdr->p_vaddr + phdr->p_filesz;
+    unsigned int end_virtual_address = phdr->p_vaddr + phdr->p_memsz;
     if (elf_file->virtual_end_address <= (void*)(end_virtual_address) || elf_file->virtual_end_address == 0x00)
     {
         elf_file->virtual_end_address = (void*) end_virtual_address;
-        elf_file->physical_end_address = elf_memory(elf_file)+phdr->p_offset+phdr->p_filesz;
     }
     return 0;
 }
@@ -180,6 +152,11 @@ void elf_file_free(struct elf_file* elf_file)
         kfree(elf_file->elf_memory);
     }
 
+    if (elf_file->fd > 0)
+    {
+        fclose(elf_file->fd);
+    }
+
     kfree(elf_file);
 }
 struct elf_file* elf_file_new()
@@ -200,6 +177,9 @@ int elf_load(const char* filename, struct elf_file** file_out)
     }
 
     fd = res;
+    elf_file->fd = fd;
+    elf_file->refcount = 1;
+    strncpy(elf_file->filename, filename, sizeof(elf_file->filename));
     struct file_stat stat;
     res = fstat(fd, &stat);
     if (res < 0)
@@ -208,10 +188,39 @@ int elf_load(const char* filename, struct elf_file** file_out)
         goto out;
     }
 
-    elf_file->elf_memory = kzalloc(stat.filesize);
-    res = fread(elf_file->elf_memory, stat.filesize, 1, fd);
+    // Only the headers are read now, the segments are paged in as the program touches them
+    struct elf_header header;
+    if (stat.filesize < sizeof(header) || fread(&header, sizeof(header), 1, fd) != 1)
+    {
+        res = -EINFORMAT;
+        goto out;
+    }
+
+    res = elf_validate_loaded(&header);
     if (res < 0)
     {
+        goto out;
+    }
+
+    uint32_t headers_size = header.e_phoff + (header.e_phnum * sizeof(struct elf32_phdr));
+    if (header.e_phentsize != sizeof(struct elf32_phdr) || headers_size > stat.filesize || headers_size > PEACHOS_ELF_MAX_HEADERS_SIZE)
+    {
+        res = -EINFORMAT;
+        goto out;
+    }
+
+    elf_file->elf_memory = kzalloc(headers_size);
+    if (!elf_file->elf_memory)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+    elf_file->in_memory_size = headers_size;
+
+    res = fseek(fd, 0, SEEK_SET);
+    if (res < 0 || fread(elf_file->elf_memory, headers_size, 1, fd) != 1)
+    {
+        res = -EIO;
         print("elf_load: Failed to read file\n");
         goto out;
     }
@@ -229,15 +238,22 @@ out:
     {
         elf_file_free(elf_file);
     }
-    fclose(fd);
     return res;
 }
 
+struct elf_file* elf_dup(struct elf_file* file)
+{
+    file->refcount++;
+    return file;
+}
+
 void elf_close(struct elf_file* file)
 {
     if (!file)
         return;
 
-    kfree(file->elf_memory);
-    kfree(file);
+    if (--file->refcount > 0)
+        return;
+
+    elf_file_free(file);
 }
\ No newline at end of file
@@ -14,31 +14,29 @@ struct elf_file
     int in_memory_size;
 
     /**
-     * The physical memory address that this elf file is loaded at
+     * The ELF header and program headers, the rest of the file is read on demand
      */
     void* elf_memory;
 
     /**
-     * The virtual base address of this binary
+     * The open ELF file, segments are paged in from it
      */
-    void* virtual_base_address;
+    int fd;
 
     /**
-     * The ending virtual address
+     * Processes running this file, forked processes share it with their parent
      */
-    void* virtual_end_address;
+    int refcount;
 
     /**
-     * The physical base address of this binary
+     * The virtual base address of this binary
      */
-    void* physical_base_address;
+    void* virtual_base_address;
 
     /**
-     * The physical end address of this bunary
+     * The ending virtual address
      */
-    void* physical_end_address;
-    
-
+    void* virtual_end_address;
 };
 
 int elf_load(const char* filename, struct elf_file** file_out);
@@ -46,17 +44,14 @@ struct elf_file* elf_file_new();
 void elf_file_free(struct elf_file* file);
 
 void elf_close(struct elf_file* file);
+struct elf_file* elf_dup(struct elf_file* file);
 void* elf_virtual_base(struct elf_file* file);
 void* elf_virtual_end(struct elf_file* file);
-void* elf_phys_base(struct elf_file* file);
-void* elf_phys_end(struct elf_file* file);
+int elf_fd(struct elf_file* file);
 
 struct elf_header* elf_header(struct elf_file* file);
-struct elf32_shdr* elf_sheader(struct elf_header* header);
 void* elf_memory(struct elf_file* file);
 struct elf32_phdr* elf_pheader(struct elf_header* header);
 struct elf32_phdr* elf_program_header(struct elf_header* header, int index);
-struct elf32_shdr* elf_section(struct elf_header* header, int index);
-void* elf_phdr_phys_address(struct elf_file* file, struct elf32_phdr* phdr);
 
 #endif
\ No newline at end of file
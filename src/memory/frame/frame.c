@@ -0,0 +1,151 @@
+#include "frame.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/paging/paging.h"
+#include "task/spinlock.h"
+
+// Usable memory of the frame pool that has not been handed out yet
+struct frame_range
+{
+    uint32_t next;
+    uint32_t end;
+};
+
+static struct frame_range frame_ranges[PEACHOS_E820_MAX_ENTRIES];
+static int frame_total_ranges = 0;
+static int frame_current_range = 0;
+
+// Freed frames, each one holds the address of the next
+static uint32_t* frame_free_list = 0;
+
+static uint32_t frames_total = 0;
+static uint32_t frames_used = 0;
+static struct spinlock frame_lock;
+
+/**
+ * Builds the pool from the usable parts of the BIOS memory map that fall between the end of
+ * the kernel heap and the end of the kernel identity map
+ */
+int frame_init()
+{
+    uint32_t count = *(uint32_t*) PEACHOS_E820_ADDRESS;
+    struct e820_entry* entries = (struct e820_entry*)(PEACHOS_E820_ADDRESS + sizeof(uint32_t));
+    if (count > PEACHOS_E820_MAX_ENTRIES)
+    {
+        count = PEACHOS_E820_MAX_ENTRIES;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct e820_entry* entry = &entries[i];
+        if (entry->type != E820_TYPE_USABLE || entry->base >= PEACHOS_FRAME_POOL_END)
+        {
+            continue;
+        }
+
+        uint64_t start = entry->base < PEACHOS_FRAME_POOL_START ? PEACHOS_FRAME_POOL_START : entry->base;
+        uint64_t end = entry->base + entry->length;
+        if (end > PEACHOS_FRAME_POOL_END)
+        {
+            end = PEACHOS_FRAME_POOL_END;
+        }
+
+        start = (start + PAGING_PAGE_SIZE - 1) & ~(uint64_t)(PAGING_PAGE_SIZE - 1);
+        end &= ~(uint64_t)(PAGING_PAGE_SIZE - 1);
+        if (start >= end)
+        {
+            continue;
+        }
+
+        frame_ranges[frame_total_ranges].next = start;
+        frame_ranges[frame_total_ranges].end = end;
+        frame_total_ranges++;
+        frames_total += (end - start) / PAGING_PAGE_SIZE;
+    }
+
+    return frames_total ? 0 : -ENOMEM;
+}
+
+/**
+ * Hands out a 4KB frame. Without a BIOS memory map or once the pool runs dry a page of the
+ * kernel heap is used instead, frame_free takes either
+ */
+void* frame_alloc()
+{
+    void* frame = 0;
+    spinlock_acquire(&frame_lock);
+    if (frame_free_list)
+    {
+        frame = frame_free_list;
+        frame_free_list = (uint32_t*) *frame_free_list;
+    }
+    else
+    {
+        while (frame_current_range < frame_total_ranges)
+        {
+            struct frame_range* range = &frame_ranges[frame_current_range];
+            if (range->next < range->end)
+            {
+                frame = (void*) range->next;
+                range->next += PAGING_PAGE_SIZE;
+                break;
+            }
+            frame_current_range++;
+        }
+    }
+
+    if (frame)
+    {
+        frames_used++;
+    }
+    spinlock_release(&frame_lock);
+
+    if (!frame)
+    {
+        frame = kmalloc_block(PAGING_PAGE_SIZE);
+    }
+    return frame;
+}
+
+void* frame_zalloc()
+{
+    void* frame = frame_alloc();
+    if (frame)
+    {
+        memset(frame, 0, PAGING_PAGE_SIZE);
+    }
+    return frame;
+}
+
+void frame_free(void* frame)
+{
+    if (!frame_owns(frame))
+    {
+        // A heap page, either a fallback frame or one block of a larger allocation
+        kfree_page(frame);
+        return;
+    }
+
+    spinlock_acquire(&frame_lock);
+    *(uint32_t*) frame = (uint32_t) frame_free_list;
+    frame_free_list = frame;
+    frames_used--;
+    spinlock_release(&frame_lock);
+}
+
+bool frame_owns(void* page)
+{
+    return (uint32_t) page >= PEACHOS_FRAME_POOL_START && (uint32_t) page < PEACHOS_FRAME_POOL_END;
+}
+
+uint32_t frame_total()
+{
+    return frames_total;
+}
+
+uint32_t frame_used()
+{
+    return frames_used;
+}
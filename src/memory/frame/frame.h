@@ -0,0 +1,26 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One entry of the BIOS E820 memory map as boot.asm stored it
+struct e820_entry
+{
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi;
+} __attribute__((packed));
+
+#define E820_TYPE_USABLE 1
+
+int frame_init();
+void* frame_alloc();
+void* frame_zalloc();
+void frame_free(void* frame);
+bool frame_owns(void* page);
+uint32_t frame_total();
+uint32_t frame_used();
+
+#endif
@@ -16,6 +16,12 @@ static int heap_validate_table(void* ptr, void* end, struct heap_table* table)
         goto out;
     }
 
+    if (!table->free_map || !table->full_map)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
 out:
     return res;
 }
@@ -25,6 +31,74 @@ static bool heap_validate_alignment(void* ptr)
     return ((unsigned int)ptr % PEACHOS_HEAP_BLOCK_SIZE) == 0;
 }
 
+static void heap_full_map_update(struct heap_table* table, size_t word)
+{
+    HEAP_FREE_MAP_WORD bit = (HEAP_FREE_MAP_WORD)1 << (word % HEAP_FREE_MAP_BITS_PER_WORD);
+    size_t full_word = word / HEAP_FREE_MAP_BITS_PER_WORD;
+    if (table->free_map[word] == HEAP_FREE_MAP_WORD_FULL)
+    {
+        table->full_map[full_word] |= bit;
+    }
+    else
+    {
+        table->full_map[full_word] &= ~bit;
+    }
+}
+
+/**
+ * Marks "count" blocks starting at "start" as taken or free in the free map,
+ * whole words are written in one go
+ */
+static void heap_free_map_set(struct heap_table* table, size_t start, size_t count, bool taken)
+{
+    size_t block = start;
+    size_t end = start + count;
+    while (block < end)
+    {
+        size_t word = block / HEAP_FREE_MAP_BITS_PER_WORD;
+        size_t bit = block % HEAP_FREE_MAP_BITS_PER_WORD;
+        size_t bits = HEAP_FREE_MAP_BITS_PER_WORD - bit;
+        if (bits > end - block)
+        {
+            bits = end - block;
+        }
+
+        HEAP_FREE_MAP_WORD mask = HEAP_FREE_MAP_WORD_FULL;
+        if (bits != HEAP_FREE_MAP_BITS_PER_WORD)
+        {
+            mask = (((HEAP_FREE_MAP_WORD)1 << bits) - 1) << bit;
+        }
+
+        if (taken)
+        {
+            table->free_map[word] |= mask;
+        }
+        else
+        {
+            table->free_map[word] &= ~mask;
+        }
+
+        heap_full_map_update(table, word);
+        block += bits;
+    }
+}
+
+static void heap_free_map_init(struct heap_table* table)
+{
+    size_t total_words = HEAP_FREE_MAP_TOTAL_WORDS(table->total);
+    memset(table->free_map, 0x00, total_words * sizeof(HEAP_FREE_MAP_WORD));
+    memset(table->full_map, 0x00, HEAP_FULL_MAP_TOTAL_WORDS(table->total) * sizeof(HEAP_FREE_MAP_WORD));
+
+    // Bits past the last block of the final word are never free
+    size_t padding = (total_words * HEAP_FREE_MAP_BITS_PER_WORD) - table->total;
+    if (padding)
+    {
+        heap_free_map_set(table, table->total, padding, true);
+    }
+
+    table->free_hint = 0;
+}
+
 int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table)
 {
     int res = 0;
@@ -45,8 +119,9 @@ int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* tabl
         goto out;
     }
 
-    size_t table_size = sizeof(HEAP_BLOCK_TABLE_ENTRY) * table->total;
-    memset(table->entries, HEAP_BLOCK_TABLE_ENTRY_FREE, table_size);
+    // Only the free map says whether a block is free, entries are written when their blocks are
+    // allocated so the table is left as it is
+    heap_free_map_init(table);
 
 out:
     return res;
@@ -69,34 +144,76 @@ static int heap_get_entry_type(HEAP_BLOCK_TABLE_ENTRY entry)
     return entry & 0x0f;
 }
 
+/**
+ * First fit search for "total_blocks" free blocks in a row. Fully taken words
+ * of the free map are skipped 32 blocks at a time, and fully taken summary words 1024 at a time.
+ */
 int heap_get_start_block(struct heap* heap, uint32_t total_blocks)
 {
     struct heap_table* table = heap->table;
-    int bc = 0;
+    size_t total_words = HEAP_FREE_MAP_TOTAL_WORDS(table->total);
+    uint32_t bc = 0;
     int bs = -1;
 
-    for (size_t i = 0; i < table->total; i++)
+    size_t word = table->free_hint / HEAP_FREE_MAP_BITS_PER_WORD;
+    while (word < total_words)
     {
-        if (heap_get_entry_type(table->entries[i]) != HEAP_BLOCK_TABLE_ENTRY_FREE)
+        HEAP_FREE_MAP_WORD summary = table->full_map[word / HEAP_FREE_MAP_BITS_PER_WORD];
+        if (summary == HEAP_FREE_MAP_WORD_FULL)
         {
+            // The next 1024 blocks are all taken
             bc = 0;
             bs = -1;
+            word = (word - (word % HEAP_FREE_MAP_BITS_PER_WORD)) + HEAP_FREE_MAP_BITS_PER_WORD;
             continue;
         }
 
-        // If this is the first block
-        if (bs == -1)
+        HEAP_FREE_MAP_WORD map = table->free_map[word];
+        if (map == HEAP_FREE_MAP_WORD_FULL)
+        {
+            bc = 0;
+            bs = -1;
+        }
+        else if (map == 0)
         {
-            bs = i;
+            if (bs == -1)
+            {
+                bs = word * HEAP_FREE_MAP_BITS_PER_WORD;
+            }
+            bc += HEAP_FREE_MAP_BITS_PER_WORD;
+        }
+        else
+        {
+            for (int bit = 0; bit < HEAP_FREE_MAP_BITS_PER_WORD; bit++)
+            {
+                if (map & ((HEAP_FREE_MAP_WORD)1 << bit))
+                {
+                    bc = 0;
+                    bs = -1;
+                    continue;
+                }
+
+                // If this is the first block
+                if (bs == -1)
+                {
+                    bs = (word * HEAP_FREE_MAP_BITS_PER_WORD) + bit;
+                }
+                bc++;
+                if (bc >= total_blocks)
+                {
+                    break;
+                }
+            }
         }
-        bc++;
-        if (bc == total_blocks)
+
+        if (bc >= total_blocks)
         {
             break;
         }
+        word++;
     }
 
-    if (bs == -1)
+    if (bs == -1 || bc < total_blocks)
     {
         return -ENOMEM;
     }
@@ -129,6 +246,18 @@ void heap_mark_blocks_taken(struct heap* heap, int start_block, int total_blocks
             entry |= HEAP_BLOCK_HAS_NEXT;
         }
     }
+
+    heap_free_map_set(heap->table, start_block, total_blocks, true);
+    heap->used_blocks += total_blocks;
+    if (heap->used_blocks > heap->peak_blocks)
+    {
+        heap->peak_blocks = heap->used_blocks;
+    }
+
+    if (heap->table->free_hint == start_block)
+    {
+        heap->table->free_hint = end_block + 1;
+    }
 }
 
 void* heap_malloc_blocks(struct heap* heap, uint32_t total_blocks)
@@ -150,18 +279,33 @@ out:
     return address;
 }
 
+static bool heap_block_taken(struct heap_table* table, int block)
+{
+    HEAP_FREE_MAP_WORD bit = (HEAP_FREE_MAP_WORD)1 << (block % HEAP_FREE_MAP_BITS_PER_WORD);
+    return table->free_map[block / HEAP_FREE_MAP_BITS_PER_WORD] & bit;
+}
+
 void heap_mark_blocks_free(struct heap* heap, int starting_block)
 {
     struct heap_table* table = heap->table;
-    for (int i = starting_block; i < (int)table->total; i++)
+    int i = 0;
+    for (i = starting_block; i < (int)table->total; i++)
     {
         HEAP_BLOCK_TABLE_ENTRY entry = table->entries[i];
         table->entries[i] = HEAP_BLOCK_TABLE_ENTRY_FREE;
         if (!(entry & HEAP_BLOCK_HAS_NEXT))
         {
+            i++;
             break;
         }
     }
+
+    heap_free_map_set(table, starting_block, i - starting_block, false);
+    heap->used_blocks -= i - starting_block;
+    if (starting_block < table->free_hint)
+    {
+        table->free_hint = starting_block;
+    }
 }
 
 int heap_address_to_block(struct heap* heap, void* address)
@@ -176,7 +320,48 @@ void* heap_malloc(struct heap* heap, size_t size)
     return heap_malloc_blocks(heap, total_blocks);
 }
 
+/**
+ * Frees the single block at ptr, which may sit anywhere inside an allocation. The blocks
+ * around it stay allocated as two separate allocations
+ */
+void heap_free_block(struct heap* heap, void* ptr)
+{
+    struct heap_table* table = heap->table;
+    int block = heap_address_to_block(heap, ptr);
+    if (!heap_block_taken(table, block))
+    {
+        return;
+    }
+
+    HEAP_BLOCK_TABLE_ENTRY entry = table->entries[block];
+
+    if (!(entry & HEAP_BLOCK_IS_FIRST))
+    {
+        // The block before ends its allocation now
+        table->entries[block - 1] &= ~HEAP_BLOCK_HAS_NEXT;
+    }
+
+    if (entry & HEAP_BLOCK_HAS_NEXT)
+    {
+        table->entries[block + 1] |= HEAP_BLOCK_IS_FIRST;
+    }
+
+    table->entries[block] = HEAP_BLOCK_TABLE_ENTRY_FREE;
+    heap_free_map_set(table, block, 1, false);
+    heap->used_blocks--;
+    if (block < table->free_hint)
+    {
+        table->free_hint = block;
+    }
+}
+
 void heap_free(struct heap* heap, void* ptr)
 {
-    heap_mark_blocks_free(heap, heap_address_to_block(heap, ptr));
+    int block = heap_address_to_block(heap, ptr);
+    if (!ptr || !heap_block_taken(heap->table, block))
+    {
+        return;
+    }
+
+    heap_mark_blocks_free(heap, block);
 }
\ No newline at end of file
@@ -13,10 +13,31 @@
 
 typedef unsigned char HEAP_BLOCK_TABLE_ENTRY;
 
+// One bit per block in the free map, a set bit means the block is taken
+typedef uint32_t HEAP_FREE_MAP_WORD;
+#define HEAP_FREE_MAP_BITS_PER_WORD 32
+#define HEAP_FREE_MAP_WORD_FULL 0xFFFFFFFF
+
+// Number of free map words needed to index the given amount of blocks
+#define HEAP_FREE_MAP_TOTAL_WORDS(total_blocks) (((total_blocks) + HEAP_FREE_MAP_BITS_PER_WORD - 1) / HEAP_FREE_MAP_BITS_PER_WORD)
+
+// Number of summary words needed, one summary bit per free map word
+#define HEAP_FULL_MAP_TOTAL_WORDS(total_blocks) HEAP_FREE_MAP_TOTAL_WORDS(HEAP_FREE_MAP_TOTAL_WORDS(total_blocks))
+
 struct heap_table
 {
     HEAP_BLOCK_TABLE_ENTRY* entries;
     size_t total;
+
+    // Free block index, one bit per entry. Lets us skip 32 blocks at a time
+    HEAP_FREE_MAP_WORD* free_map;
+
+    // Summary of the free map, a set bit means the matching free map word is completely taken.
+    // Lets us skip 1024 taken blocks at a time.
+    HEAP_FREE_MAP_WORD* full_map;
+
+    // No block below this index is free
+    size_t free_hint;
 };
 
 
@@ -26,9 +47,14 @@ struct heap
 
     // Start address of the heap data pool
     void* saddr;
+
+    // Blocks allocated right now and the most that ever were at once
+    uint32_t used_blocks;
+    uint32_t peak_blocks;
 };
 
 int heap_create(struct heap* heap, void* ptr, void* end, struct heap_table* table);
 void* heap_malloc(struct heap* heap, size_t size);
 void heap_free(struct heap* heap, void* ptr);
+void heap_free_block(struct heap* heap, void* ptr);
 #endif
\ No newline at end of file
@@ -1,17 +1,29 @@
 #include "kheap.h"
 #include "heap.h"
+#include "slab.h"
 #include "config.h"
 #include "kernel.h"
 #include "memory/memory.h"
+#include "task/spinlock.h"
+#include "trace/trace.h"
+
+#define KHEAP_TOTAL_BLOCKS (PEACHOS_HEAP_SIZE_BYTES / PEACHOS_HEAP_BLOCK_SIZE)
 
 struct heap kernel_heap;
 struct heap_table kernel_heap_table;
+static struct spinlock kernel_heap_lock;
+
+// Free block index for the kernel heap
+static HEAP_FREE_MAP_WORD kernel_heap_free_map[HEAP_FREE_MAP_TOTAL_WORDS(KHEAP_TOTAL_BLOCKS)];
+static HEAP_FREE_MAP_WORD kernel_heap_full_map[HEAP_FULL_MAP_TOTAL_WORDS(KHEAP_TOTAL_BLOCKS)];
 
 void kheap_init()
 {
-    int total_table_entries = PEACHOS_HEAP_SIZE_BYTES / PEACHOS_HEAP_BLOCK_SIZE;
+    int total_table_entries = KHEAP_TOTAL_BLOCKS;
     kernel_heap_table.entries = (HEAP_BLOCK_TABLE_ENTRY*)(PEACHOS_HEAP_TABLE_ADDRESS);
     kernel_heap_table.total = total_table_entries;
+    kernel_heap_table.free_map = kernel_heap_free_map;
+    kernel_heap_table.full_map = kernel_heap_full_map;
 
     void* end = (void*)(PEACHOS_HEAP_ADDRESS + PEACHOS_HEAP_SIZE_BYTES);
     int res = heap_create(&kernel_heap, (void*)(PEACHOS_HEAP_ADDRESS), end, &kernel_heap_table);
@@ -20,11 +32,24 @@ void kheap_init()
         print("Failed to create heap\n");
     }
 
+    slab_init(&kernel_heap);
 }
 
 void* kmalloc(size_t size)
 {
-    return heap_malloc(&kernel_heap, size);
+    void* ptr = 0;
+    spinlock_acquire(&kernel_heap_lock);
+    if (size <= PEACHOS_SLAB_MAX_OBJECT_SIZE)
+    {
+        ptr = slab_alloc(size);
+    }
+    else
+    {
+        ptr = heap_malloc(&kernel_heap, size);
+    }
+    spinlock_release(&kernel_heap_lock);
+    TRACE(TRACE_EVENT_KMALLOC, size, ptr, 0);
+    return ptr;
 }
 
 void* kzalloc(size_t size)
@@ -37,7 +62,60 @@ void* kzalloc(size_t size)
     return ptr;
 }
 
+/**
+ * Allocates whole heap blocks, the returned memory is always aligned to PEACHOS_HEAP_BLOCK_SIZE.
+ * Use this for memory that gets mapped into page tables.
+ */
+void* kmalloc_block(size_t size)
+{
+    spinlock_acquire(&kernel_heap_lock);
+    void* ptr = heap_malloc(&kernel_heap, size);
+    spinlock_release(&kernel_heap_lock);
+    TRACE(TRACE_EVENT_KMALLOC, size, ptr, 0);
+    return ptr;
+}
+
+void* kzalloc_block(size_t size)
+{
+    void* ptr = kmalloc_block(size);
+    if (!ptr)
+        return 0;
+
+    memset(ptr, 0x00, size);
+    return ptr;
+}
+
+/**
+ * Frees one page of memory allocated with kmalloc_block, the rest of the allocation is kept
+ */
+void kfree_page(void* ptr)
+{
+    TRACE(TRACE_EVENT_KFREE, ptr, 0, 0);
+    spinlock_acquire(&kernel_heap_lock);
+    heap_free_block(&kernel_heap, ptr);
+    spinlock_release(&kernel_heap_lock);
+}
+
 void kfree(void* ptr)
 {
-    heap_free(&kernel_heap, ptr);
-}
\ No newline at end of file
+    TRACE(TRACE_EVENT_KFREE, ptr, 0, 0);
+    spinlock_acquire(&kernel_heap_lock);
+    if (slab_owns(ptr))
+    {
+        slab_free(ptr);
+    }
+    else
+    {
+        heap_free(&kernel_heap, ptr);
+    }
+    spinlock_release(&kernel_heap_lock);
+}
+
+void kheap_get_usage(uint32_t* total_blocks, uint32_t* used_blocks, uint32_t* peak_blocks)
+{
+    spinlock_acquire(&kernel_heap_lock);
+    *total_blocks = kernel_heap_table.total;
+    *used_blocks = kernel_heap.used_blocks;
+    *peak_blocks = kernel_heap.peak_blocks;
+    spinlock_release(&kernel_heap_lock);
+}
@@ -7,6 +7,10 @@
 void kheap_init();
 void* kmalloc(size_t size);
 void* kzalloc(size_t size);
+void* kmalloc_block(size_t size);
+void* kzalloc_block(size_t size);
 void kfree(void* ptr);
+void kfree_page(void* ptr);
+void kheap_get_usage(uint32_t* total_blocks, uint32_t* used_blocks, uint32_t* peak_blocks);
 
 #endif
\ No newline at end of file
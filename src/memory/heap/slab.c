@@ -0,0 +1,248 @@
+#include "slab.h"
+#include "heap.h"
+#include "config.h"
+#include "kernel.h"
+#include "memory/memory.h"
+
+// Objects are handed out on this alignment
+#define SLAB_OBJECT_ALIGNMENT 16
+
+// The heap our slabs are carved out of
+static struct heap* slab_heap = 0;
+
+// Maps every heap block to the slab living in it, zero if the block is not used by a slab
+static struct slab** slab_owner = 0;
+
+static struct slab_cache slab_caches[PEACHOS_SLAB_TOTAL_CACHES];
+
+static size_t slab_header_size()
+{
+    size_t size = sizeof(struct slab);
+    if (size % SLAB_OBJECT_ALIGNMENT)
+    {
+        size += SLAB_OBJECT_ALIGNMENT - (size % SLAB_OBJECT_ALIGNMENT);
+    }
+    return size;
+}
+
+void slab_init(struct heap* heap)
+{
+    memset(slab_caches, 0, sizeof(slab_caches));
+    size_t object_size = PEACHOS_SLAB_MIN_OBJECT_SIZE;
+    for (int i = 0; i < PEACHOS_SLAB_TOTAL_CACHES; i++)
+    {
+        slab_caches[i].object_size = object_size;
+        object_size *= 2;
+    }
+
+    slab_heap = heap;
+    size_t owner_table_size = sizeof(struct slab*) * heap->table->total;
+    slab_owner = heap_malloc(heap, owner_table_size);
+    if (!slab_owner)
+    {
+        panic("Failed to allocate the slab owner table\n");
+    }
+
+    memset(slab_owner, 0, owner_table_size);
+}
+
+static int slab_cache_index(size_t size)
+{
+    size_t object_size = PEACHOS_SLAB_MIN_OBJECT_SIZE;
+    for (int i = 0; i < PEACHOS_SLAB_TOTAL_CACHES; i++)
+    {
+        if (size <= object_size)
+        {
+            return i;
+        }
+        object_size *= 2;
+    }
+
+    return -1;
+}
+
+static int slab_block(void* ptr)
+{
+    return (int)(ptr - slab_heap->saddr) / PEACHOS_HEAP_BLOCK_SIZE;
+}
+
+static void slab_set_owner(struct slab* slab, struct slab* owner)
+{
+    int start_block = slab_block(slab);
+    for (int i = 0; i < PEACHOS_SLAB_SIZE / PEACHOS_HEAP_BLOCK_SIZE; i++)
+    {
+        slab_owner[start_block + i] = owner;
+    }
+}
+
+static void slab_partial_insert(struct slab_cache* cache, struct slab* slab)
+{
+    slab->prev = 0;
+    slab->next = cache->partial;
+    if (cache->partial)
+    {
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+static void slab_partial_remove(struct slab_cache* cache, struct slab* slab)
+{
+    if (slab->prev)
+    {
+        slab->prev->next = slab->next;
+    }
+
+    if (slab->next)
+    {
+        slab->next->prev = slab->prev;
+    }
+
+    if (cache->partial == slab)
+    {
+        cache->partial = slab->next;
+    }
+
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+static struct slab* slab_new(struct slab_cache* cache)
+{
+    struct slab* slab = heap_malloc(slab_heap, PEACHOS_SLAB_SIZE);
+    if (!slab)
+    {
+        return 0;
+    }
+
+    memset(slab, 0, sizeof(struct slab));
+    slab->cache = cache;
+    slab->objects_total = (PEACHOS_SLAB_SIZE - slab_header_size()) / cache->object_size;
+
+    // Thread the free list through the objects, lowest address first
+    char* objects = (char*) slab + slab_header_size();
+    for (int i = slab->objects_total - 1; i >= 0; i--)
+    {
+        void** object = (void**)(objects + (i * cache->object_size));
+        *object = slab->free_list;
+        slab->free_list = object;
+    }
+
+    slab_set_owner(slab, slab);
+    slab_partial_insert(cache, slab);
+
+    cache->total_slabs++;
+    cache->objects_total += slab->objects_total;
+    return slab;
+}
+
+static void slab_release(struct slab* slab)
+{
+    struct slab_cache* cache = slab->cache;
+    slab_partial_remove(cache, slab);
+    slab_set_owner(slab, 0);
+
+    cache->total_slabs--;
+    cache->objects_total -= slab->objects_total;
+    heap_free(slab_heap, slab);
+}
+
+bool slab_owns(void* ptr)
+{
+    if (!slab_owner || ptr < slab_heap->saddr)
+    {
+        return false;
+    }
+
+    int block = slab_block(ptr);
+    if (block >= (int) slab_heap->table->total)
+    {
+        return false;
+    }
+
+    return slab_owner[block] != 0;
+}
+
+void* slab_alloc(size_t size)
+{
+    int index = slab_cache_index(size);
+    if (index < 0)
+    {
+        return 0;
+    }
+
+    struct slab_cache* cache = &slab_caches[index];
+    struct slab* slab = cache->partial;
+    if (!slab)
+    {
+        slab = slab_new(cache);
+        if (!slab)
+        {
+            return 0;
+        }
+    }
+
+    void** object = slab->free_list;
+    slab->free_list = *object;
+    slab->objects_in_use++;
+    if (!slab->free_list)
+    {
+        // The slab is full, stop looking at it until something is freed
+        slab_partial_remove(cache, slab);
+    }
+
+    cache->objects_in_use++;
+    cache->total_allocations++;
+    return object;
+}
+
+void slab_free(void* ptr)
+{
+    struct slab* slab = slab_owner[slab_block(ptr)];
+    struct slab_cache* cache = slab->cache;
+    bool was_full = slab->free_list == 0;
+
+    void** object = ptr;
+    *object = slab->free_list;
+    slab->free_list = object;
+    slab->objects_in_use--;
+
+    cache->objects_in_use--;
+    cache->total_frees++;
+
+    if (was_full)
+    {
+        slab_partial_insert(cache, slab);
+    }
+
+    // Give empty slabs back to the heap, but keep one around so we dont thrash
+    if (slab->objects_in_use == 0 && (cache->partial != slab || slab->next))
+    {
+        slab_release(slab);
+    }
+}
+
+struct slab_cache* slab_get_cache(int index)
+{
+    if (index < 0 || index >= PEACHOS_SLAB_TOTAL_CACHES)
+    {
+        return 0;
+    }
+
+    return &slab_caches[index];
+}
+
+/**
+ * Returns how many bytes the slabs save compared to giving every live object its own heap block
+ */
+int slab_bytes_saved()
+{
+    int saved = 0;
+    for (int i = 0; i < PEACHOS_SLAB_TOTAL_CACHES; i++)
+    {
+        struct slab_cache* cache = &slab_caches[i];
+        saved += (cache->objects_in_use * PEACHOS_HEAP_BLOCK_SIZE) - (cache->total_slabs * PEACHOS_SLAB_SIZE);
+    }
+
+    return saved;
+}
@@ -0,0 +1,50 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+
+struct heap;
+struct slab_cache;
+
+// A slab lives at the start of its own heap block run, the objects follow it
+struct slab
+{
+    struct slab_cache* cache;
+
+    // Next/previous slab in the partially full list of the cache
+    struct slab* next;
+    struct slab* prev;
+
+    // Singly linked list threaded through the free objects
+    void* free_list;
+
+    uint32_t objects_in_use;
+    uint32_t objects_total;
+};
+
+struct slab_cache
+{
+    size_t object_size;
+
+    // Slabs with at least one free object
+    struct slab* partial;
+
+    // Usage counters
+    uint32_t total_slabs;
+    uint32_t objects_in_use;
+    uint32_t objects_total;
+    uint32_t total_allocations;
+    uint32_t total_frees;
+};
+
+void slab_init(struct heap* heap);
+void* slab_alloc(size_t size);
+void slab_free(void* ptr);
+bool slab_owns(void* ptr);
+struct slab_cache* slab_get_cache(int index);
+int slab_bytes_saved();
+
+#endif
@@ -0,0 +1,40 @@
+[BITS 32]
+
+section .asm
+
+global memory_copy_dwords
+global memory_set_dwords
+
+; void memory_copy_dwords(void* dest, void* src, size_t count)
+memory_copy_dwords:
+    push ebp
+    mov ebp, esp
+    push esi
+    push edi
+
+    mov edi, [ebp+8]
+    mov esi, [ebp+12]
+    mov ecx, [ebp+16]
+    cld
+    rep movsd
+
+    pop edi
+    pop esi
+    pop ebp
+    ret
+
+; void memory_set_dwords(void* dest, uint32_t value, size_t count)
+memory_set_dwords:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edi, [ebp+8]
+    mov eax, [ebp+12]
+    mov ecx, [ebp+16]
+    cld
+    rep stosd
+
+    pop edi
+    pop ebp
+    ret
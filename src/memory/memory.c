@@ -1,11 +1,45 @@
 #include "memory.h"
+#include <stdint.h>
+
+#define MEMORY_PAGE_SIZE 4096
+
+void memory_copy_dwords(void* dest, void* src, size_t count);
+void memory_set_dwords(void* dest, uint32_t value, size_t count);
+
+static int memory_is_whole_pages(void* ptr, size_t size)
+{
+    return size && ((uint32_t)ptr % MEMORY_PAGE_SIZE) == 0 && (size % MEMORY_PAGE_SIZE) == 0;
+}
 
 void* memset(void* ptr, int c, size_t size)
 {
+    uint32_t pattern = (uint32_t)(uint8_t) c * 0x01010101u;
+    if (memory_is_whole_pages(ptr, size))
+    {
+        memory_set_dwords(ptr, pattern, size / sizeof(uint32_t));
+        return ptr;
+    }
+
     char* c_ptr = (char*) ptr;
-    for (int i = 0; i < size; i++)
+
+    // Byte writes until we are aligned, then whole words
+    while (size && ((uint32_t)c_ptr % sizeof(uint32_t)))
+    {
+        *c_ptr++ = (char) c;
+        size--;
+    }
+
+    if (size >= sizeof(uint32_t))
+    {
+        size_t words = size / sizeof(uint32_t);
+        memory_set_dwords(c_ptr, pattern, words);
+        c_ptr += words * sizeof(uint32_t);
+        size -= words * sizeof(uint32_t);
+    }
+
+    while (size--)
     {
-        c_ptr[i] = (char) c;
+        *c_ptr++ = (char) c;
     }
     return ptr;
 }
@@ -14,6 +48,15 @@ int memcmp(void* s1, void* s2, int count)
 {
     char* c1 = s1;
     char* c2 = s2;
+
+    // Skip over equal words, the byte loop below finds the difference
+    while (count >= (int) sizeof(uint32_t) && *(uint32_t*)c1 == *(uint32_t*)c2)
+    {
+        c1 += sizeof(uint32_t);
+        c2 += sizeof(uint32_t);
+        count -= sizeof(uint32_t);
+    }
+
     while(count-- > 0)
     {
         if (*c1++ != *c2++)
@@ -27,11 +70,59 @@ int memcmp(void* s1, void* s2, int count)
 
 void* memcpy(void* dest, void* src, int len)
 {
+    if (len <= 0)
+    {
+        return dest;
+    }
+
+    if (memory_is_whole_pages(dest, len) && ((uint32_t)src % MEMORY_PAGE_SIZE) == 0)
+    {
+        memory_copy_dwords(dest, src, len / sizeof(uint32_t));
+        return dest;
+    }
+
     char *d = dest;
     char *s = src;
+
+    // Align the destination, unaligned source reads are cheap on x86
+    while (len && ((uint32_t)d % sizeof(uint32_t)))
+    {
+        *d++ = *s++;
+        len--;
+    }
+
+    if (len >= (int) sizeof(uint32_t))
+    {
+        int words = len / sizeof(uint32_t);
+        memory_copy_dwords(d, s, words);
+        d += words * sizeof(uint32_t);
+        s += words * sizeof(uint32_t);
+        len -= words * sizeof(uint32_t);
+    }
+
     while(len--)
     {
         *d++ = *s++;
     }
     return dest;
-}
\ No newline at end of file
+}
+
+/**
+ * Copies len bytes between buffers that may overlap
+ */
+void* memmove(void* dest, void* src, int len)
+{
+    char* d = dest;
+    char* s = src;
+    // Copying forward is safe whenever the destination starts below the source
+    if (d <= s || d >= s + len)
+    {
+        return memcpy(dest, src, len);
+    }
+
+    while (len--)
+    {
+        d[len] = s[len];
+    }
+    return dest;
+}
@@ -6,5 +6,6 @@
 void* memset(void* ptr, int c, size_t size);
 int memcmp(void* s1, void* s2, int count);
 void* memcpy(void* dest, void* src, int len);
+void* memmove(void* dest, void* src, int len);
 
 #endif
\ No newline at end of file
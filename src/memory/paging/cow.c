@@ -0,0 +1,162 @@
+#include "cow.h"
+#include "paging.h"
+#include "config.h"
+#include "status.h"
+#include "memory/memory.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+
+// Process pages come from the kernel heap or the frame pool right after it
+#define COW_TOTAL_PAGES ((PEACHOS_FRAME_POOL_END - PEACHOS_HEAP_ADDRESS) / PAGING_PAGE_SIZE)
+
+// How many address spaces map each page besides its first one
+static uint16_t* cow_refcounts = 0;
+
+// Anonymous pages nobody has written to yet all map this page read only, a write fault gives
+// the process a private copy. It sits outside the counted range so it is never freed
+static uint8_t cow_zero_page[PAGING_PAGE_SIZE] __attribute__((aligned(PAGING_PAGE_SIZE)));
+
+int cow_init()
+{
+    cow_refcounts = kzalloc(sizeof(uint16_t) * COW_TOTAL_PAGES);
+    return cow_refcounts ? 0 : -ENOMEM;
+}
+
+/**
+ * Maps the zero page at virt, the page turns private and writable on the first write
+ */
+int cow_map_zero_page(uint32_t* directory, void* virt)
+{
+    return paging_set(directory, virt, (uint32_t) cow_zero_page | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_COPY_ON_WRITE);
+}
+
+bool cow_is_zero_page(void* page)
+{
+    return page == (void*) cow_zero_page;
+}
+
+static int cow_page_index(void* page)
+{
+    uint32_t address = (uint32_t) page;
+    if (address < PEACHOS_HEAP_ADDRESS || address >= PEACHOS_FRAME_POOL_END)
+    {
+        return -EINVARG;
+    }
+
+    return (address - PEACHOS_HEAP_ADDRESS) / PAGING_PAGE_SIZE;
+}
+
+/**
+ * Another address space maps the page
+ */
+void cow_page_get(void* page)
+{
+    int index = cow_page_index(page);
+    if (index >= 0)
+    {
+        cow_refcounts[index]++;
+    }
+}
+
+/**
+ * An address space stopped mapping the page, the last one frees it
+ */
+void cow_page_put(void* page)
+{
+    int index = cow_page_index(page);
+    if (index < 0)
+    {
+        return;
+    }
+
+    if (cow_refcounts[index])
+    {
+        cow_refcounts[index]--;
+        return;
+    }
+
+    frame_free(page);
+}
+
+bool cow_page_shared(void* page)
+{
+    int index = cow_page_index(page);
+    return cow_is_zero_page(page) || (index >= 0 && cow_refcounts[index] != 0);
+}
+
+/**
+ * Maps the page mapped at virt in from into to as well. A writable page turns read only in
+ * both so whichever writes to it first gets its own copy
+ */
+int cow_share_page(uint32_t* from, uint32_t* to, void* virt)
+{
+    int res = 0;
+    uint32_t entry = paging_get(from, virt);
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        goto out;
+    }
+
+    if (entry & PAGING_IS_WRITEABLE)
+    {
+        entry = (entry & ~PAGING_IS_WRITEABLE) | PAGING_IS_COPY_ON_WRITE;
+        res = paging_set(from, virt, entry);
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+    res = paging_set(to, virt, entry);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    cow_page_get((void*)(entry & 0xfffff000));
+out:
+    return res;
+}
+
+/**
+ * Handles a write to a copy on write page. The page is copied unless every other address
+ * space has already taken its own copy, then it is simply made writable again
+ */
+int cow_break(uint32_t* directory, void* virt)
+{
+    int res = 0;
+    virt = paging_align_to_lower_page(virt);
+    uint32_t entry = paging_get(directory, virt);
+    if (!(entry & PAGING_IS_PRESENT) || !(entry & PAGING_IS_COPY_ON_WRITE))
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    void* page = (void*)(entry & 0xfffff000);
+    uint32_t flags = ((entry & 0xfff) & ~PAGING_IS_COPY_ON_WRITE) | PAGING_IS_WRITEABLE;
+    if (!cow_page_shared(page))
+    {
+        res = paging_set(directory, virt, (uint32_t) page | flags);
+        goto out;
+    }
+
+    void* copy = frame_alloc();
+    if (!copy)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    memcpy(copy, page, PAGING_PAGE_SIZE);
+    res = paging_set(directory, virt, (uint32_t) copy | flags);
+    if (res < 0)
+    {
+        frame_free(copy);
+        goto out;
+    }
+
+    cow_page_put(page);
+out:
+    return res;
+}
@@ -0,0 +1,17 @@
+#ifndef COW_H
+#define COW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+int cow_init();
+void cow_page_get(void* page);
+void cow_page_put(void* page);
+bool cow_page_shared(void* page);
+int cow_map_zero_page(uint32_t* directory, void* virt);
+bool cow_is_zero_page(void* page);
+
+int cow_share_page(uint32_t* from, uint32_t* to, void* virt);
+int cow_break(uint32_t* directory, void* virt);
+
+#endif
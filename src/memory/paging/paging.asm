@@ -4,6 +4,8 @@ section .asm
 
 global paging_load_directory
 global enable_paging
+global paging_fault_address
+global paging_invalidate_page
 
 paging_load_directory:
     push ebp
@@ -16,8 +18,25 @@ paging_load_directory:
 enable_paging:
     push ebp
     mov ebp, esp
+    ; Enable global pages so the shared kernel mappings survive CR3 reloads, and 4MB pages
+    ; for the kernel identity map
+    mov eax, cr4
+    or eax, 0x90
+    mov cr4, eax
+    ; Write protect, the kernel must fault on copy on write pages too
     mov eax, cr0
-    or eax, 0x80000000
+    or eax, 0x80010000
     mov cr0, eax
     pop ebp
     ret
+
+; void* paging_fault_address()
+paging_fault_address:
+    mov eax, cr2
+    ret
+
+; void paging_invalidate_page(void* virt)
+paging_invalidate_page:
+    mov eax, [esp+4]
+    invlpg [eax]
+    ret
@@ -1,45 +1,175 @@
 #include "paging.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/memory.h"
 #include "status.h"
 void paging_load_directory(uint32_t *directory);
+void paging_invalidate_page(void *virt);
 
 static uint32_t *current_directory = 0;
-struct paging_4gb_chunk *paging_new_4gb(uint8_t flags)
+static int paging_set_entry(uint32_t *directory, void *virt, uint32_t val);
+
+// Identity mapped page tables for the kernel region, shared by every directory created with the same flags
+struct paging_kernel_table_set
+{
+    uint8_t flags;
+    uint32_t *tables[PAGING_SMALL_KERNEL_TABLES];
+};
+
+static struct paging_kernel_table_set kernel_table_sets[PAGING_MAX_KERNEL_TABLE_SETS];
+static int total_kernel_table_sets = 0;
+
+// Device registers the kernel reaches at their physical address, e.g. the APICs. They all sit
+// in the last few megabytes below 4GB and get one page table shared by every directory
+#define PAGING_MMIO_DIRECTORY_INDEX (PEACHOS_IOAPIC_ADDRESS / PAGING_TABLE_SPAN)
+static uint32_t *paging_mmio_table = 0;
+
+static struct paging_kernel_table_set *paging_get_kernel_table_set(uint8_t flags)
 {
-    uint32_t *directory = kzalloc(sizeof(uint32_t) * PAGING_TOTAL_ENTRIES_PER_TABLE);
+    for (int i = 0; i < total_kernel_table_sets; i++)
+    {
+        if (kernel_table_sets[i].flags == flags)
+        {
+            return &kernel_table_sets[i];
+        }
+    }
+
+    if (total_kernel_table_sets >= PAGING_MAX_KERNEL_TABLE_SETS)
+    {
+        return 0;
+    }
+
+    struct paging_kernel_table_set *set = &kernel_table_sets[total_kernel_table_sets];
     int offset = 0;
-    for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+    for (int i = 0; i < PAGING_SMALL_KERNEL_TABLES; i++)
     {
-        uint32_t *entry = kzalloc(sizeof(uint32_t) * PAGING_TOTAL_ENTRIES_PER_TABLE);
+        uint32_t *entry = frame_zalloc();
+        if (!entry)
+        {
+            for (int b = 0; b < i; b++)
+            {
+                frame_free(set->tables[b]);
+            }
+            return 0;
+        }
+
         for (int b = 0; b < PAGING_TOTAL_ENTRIES_PER_TABLE; b++)
         {
-            entry[b] = (offset + (b * PAGING_PAGE_SIZE)) | flags;
+            uint32_t address = offset + (b * PAGING_PAGE_SIZE);
+            entry[b] = address | flags;
+            if (address < PEACHOS_KERNEL_GLOBAL_MAP_END)
+            {
+                entry[b] |= PAGING_IS_GLOBAL;
+            }
+        }
+        offset += PAGING_TABLE_SPAN;
+        set->tables[i] = entry;
+    }
+
+    set->flags = flags;
+    total_kernel_table_sets++;
+    return set;
+}
+
+static bool paging_is_kernel_table(uint32_t directory_index, uint32_t *table)
+{
+    if (directory_index >= PAGING_SMALL_KERNEL_TABLES)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < total_kernel_table_sets; i++)
+    {
+        if (kernel_table_sets[i].tables[directory_index] == table)
+        {
+            return true;
         }
-        offset += (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE);
-        directory[i] = (uint32_t)entry | flags | PAGING_IS_WRITEABLE;
+    }
+
+    return false;
+}
+
+/**
+ * Creates a new directory, the kernel identity map is shared with every other directory
+ * created with the same flags. Page tables outside of it are created on first use by paging_set
+ */
+struct paging_4gb_chunk *paging_new_4gb(uint8_t flags)
+{
+    struct paging_kernel_table_set *set = paging_get_kernel_table_set(flags);
+    if (!set)
+    {
+        return 0;
+    }
+
+    uint32_t *directory = frame_zalloc();
+    if (!directory)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < PAGING_SMALL_KERNEL_TABLES; i++)
+    {
+        directory[i] = (uint32_t)set->tables[i] | flags | PAGING_IS_WRITEABLE;
+    }
+
+    for (int i = PAGING_SMALL_KERNEL_TABLES; i < PAGING_KERNEL_TABLES; i++)
+    {
+        directory[i] = (i * PAGING_TABLE_SPAN) | flags | PAGING_IS_LARGE;
+    }
+
+    if (paging_mmio_table)
+    {
+        directory[PAGING_MMIO_DIRECTORY_INDEX] = (uint32_t)paging_mmio_table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE;
     }
 
     struct paging_4gb_chunk *chunk_4gb = kzalloc(sizeof(struct paging_4gb_chunk));
+    if (!chunk_4gb)
+    {
+        frame_free(directory);
+        return 0;
+    }
+
     chunk_4gb->directory_entry = directory;
     return chunk_4gb;
 }
 
 void paging_switch(struct paging_4gb_chunk *directory)
 {
+    // Reloading CR3 flushes the TLB, dont do it if we are already there
+    if (current_directory == directory->directory_entry)
+    {
+        return;
+    }
+
     paging_load_directory(directory->directory_entry);
     current_directory = directory->directory_entry;
 }
 
+uint32_t *paging_current_directory()
+{
+    return current_directory;
+}
+
 void paging_free_4gb(struct paging_4gb_chunk *chunk)
 {
-    for (int i = 0; i < 1024; i++)
+    for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
     {
         uint32_t entry = chunk->directory_entry[i];
+        if (!(entry & PAGING_IS_PRESENT) || (entry & PAGING_IS_LARGE))
+        {
+            continue;
+        }
+
         uint32_t *table = (uint32_t *)(entry & 0xfffff000);
-        kfree(table);
+        if (paging_is_kernel_table(i, table) || table == paging_mmio_table)
+        {
+            continue;
+        }
+
+        frame_free(table);
     }
 
-    kfree(chunk->directory_entry);
+    frame_free(chunk->directory_entry);
     kfree(chunk);
 }
 
@@ -95,18 +225,52 @@ int paging_map(struct paging_4gb_chunk* directory, void* virt, void* phys, int f
     return paging_set(directory->directory_entry, virt, (uint32_t) phys | flags);
 }
 
+/**
+ * Maps 4MB with a single directory entry, virt and phys must be 4MB aligned and nothing may be
+ * mapped there yet
+ */
+static int paging_map_large(struct paging_4gb_chunk* directory, void* virt, void* phys, int flags)
+{
+    uint32_t directory_index = (uint32_t) virt / PAGING_TABLE_SPAN;
+    if (((uint32_t) virt % PAGING_TABLE_SPAN) || ((uint32_t) phys % PAGING_TABLE_SPAN) ||
+        (directory->directory_entry[directory_index] & PAGING_IS_PRESENT))
+    {
+        return -EINVARG;
+    }
+
+    directory->directory_entry[directory_index] = (uint32_t) phys | flags | PAGING_IS_LARGE;
+    return 0;
+}
+
 int paging_map_range(struct paging_4gb_chunk* directory, void* virt, void* phys, int count, int flags)
 {
+    if (((uint32_t) virt % PAGING_PAGE_SIZE) || ((uint32_t) phys % PAGING_PAGE_SIZE))
+    {
+        return -EINVARG;
+    }
+
+    // The TLB is flushed once for the whole range at the end
     int res = 0;
+    void* start = virt;
     for (int i = 0; i < count; i++)
     {
-        res = paging_map(directory, virt, phys, flags);
+        if (count - i >= PAGING_TOTAL_ENTRIES_PER_TABLE && paging_map_large(directory, virt, phys, flags) == 0)
+        {
+            // A whole aligned 4MB run went into one entry
+            i += PAGING_TOTAL_ENTRIES_PER_TABLE - 1;
+            virt += PAGING_TABLE_SPAN;
+            phys += PAGING_TABLE_SPAN;
+            continue;
+        }
+
+        res = paging_set_entry(directory->directory_entry, virt, (uint32_t) phys | flags);
         if (res < 0)
             break;
         virt += PAGING_PAGE_SIZE;
         phys += PAGING_PAGE_SIZE;
     }
 
+    paging_invalidate_range(directory->directory_entry, start, virt - start);
     return res;
 }
 
@@ -141,7 +305,53 @@ int paging_map_to(struct paging_4gb_chunk *directory, void *virt, void *phys, vo
 out:
     return res;
 }
+
+/**
+ * Drops the TLB entry for virt if directory is the one loaded. invlpg also forgets the cached
+ * directory entry, so a table that was split or copied is picked up too
+ */
+void paging_invalidate(uint32_t *directory, void *virt)
+{
+    if (directory == current_directory)
+    {
+        paging_invalidate_page(virt);
+    }
+}
+
+/**
+ * Drops the TLB entries for size bytes from virt, past PAGING_INVALIDATE_RANGE_PAGES pages one
+ * CR3 reload is cheaper. Global kernel pages survive that but are never remapped
+ */
+void paging_invalidate_range(uint32_t *directory, void *virt, uint32_t size)
+{
+    if (directory != current_directory)
+    {
+        return;
+    }
+
+    if (size / PAGING_PAGE_SIZE > PAGING_INVALIDATE_RANGE_PAGES)
+    {
+        paging_load_directory(directory);
+        return;
+    }
+
+    for (uint32_t offset = 0; offset < size; offset += PAGING_PAGE_SIZE)
+    {
+        paging_invalidate_page(virt + offset);
+    }
+}
+
 int paging_set(uint32_t *directory, void *virt, uint32_t val)
+{
+    int res = paging_set_entry(directory, virt, val);
+    if (res == 0)
+    {
+        paging_invalidate(directory, virt);
+    }
+    return res;
+}
+
+static int paging_set_entry(uint32_t *directory, void *virt, uint32_t val)
 {
     if (!paging_is_aligned(virt))
     {
@@ -158,8 +368,64 @@ int paging_set(uint32_t *directory, void *virt, uint32_t val)
 
     uint32_t entry = directory[directory_index];
     uint32_t *table = (uint32_t *)(entry & 0xfffff000);
-    table[table_index] = val;
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        if (!(val & PAGING_IS_PRESENT))
+        {
+            // Nothing is mapped here anyway
+            return 0;
+        }
+
+        table = frame_zalloc();
+        if (!table)
+        {
+            return -ENOMEM;
+        }
+
+        directory[directory_index] = (uint32_t)table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL;
+    }
+    else if (entry & PAGING_IS_LARGE)
+    {
+        if (paging_get(directory, virt) == val)
+        {
+            return 0;
+        }
 
+        // Split the 4MB page into a table of its 4KB pages before changing one of them
+        table = frame_alloc();
+        if (!table)
+        {
+            return -ENOMEM;
+        }
+
+        uint32_t base = entry & 0xffc00000;
+        uint32_t flags = entry & 0xfff & ~PAGING_IS_LARGE;
+        for (int i = 0; i < PAGING_TOTAL_ENTRIES_PER_TABLE; i++)
+        {
+            table[i] = (base + i * PAGING_PAGE_SIZE) | flags;
+        }
+        directory[directory_index] = (uint32_t)table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL;
+    }
+    else if (paging_is_kernel_table(directory_index, table))
+    {
+        if (table[table_index] == val)
+        {
+            return 0;
+        }
+
+        // Take a private copy before changing a shared kernel table
+        uint32_t *private_table = frame_alloc();
+        if (!private_table)
+        {
+            return -ENOMEM;
+        }
+
+        memcpy(private_table, table, sizeof(uint32_t) * PAGING_TOTAL_ENTRIES_PER_TABLE);
+        table = private_table;
+        directory[directory_index] = (uint32_t)table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL;
+    }
+
+    table[table_index] = val;
     return 0;
 }
 
@@ -177,6 +443,46 @@ uint32_t paging_get(uint32_t* directory, void* virt)
     paging_get_indexes(virt, &directory_index, &table_index);
     
     uint32_t entry = directory[directory_index];
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        return 0;
+    }
+
+    if (entry & PAGING_IS_LARGE)
+    {
+        // Give back what the page table entry would hold, bit 7 means something else there
+        return ((entry & 0xffc00000) + table_index * PAGING_PAGE_SIZE) | (entry & 0xfff & ~PAGING_IS_LARGE);
+    }
+
     uint32_t* table = (uint32_t*)(entry & 0xfffff000);
     return table[table_index];
-}
\ No newline at end of file
+}
+
+/**
+ * Maps the page of device registers at phys to the same address, uncached and kernel only.
+ * Directories made before the first call only get the mapping if they are the current one
+ */
+int paging_map_mmio(void *phys)
+{
+    uint32_t directory_index = 0;
+    uint32_t table_index = 0;
+    int res = paging_get_indexes(phys, &directory_index, &table_index);
+    if (res < 0 || directory_index != PAGING_MMIO_DIRECTORY_INDEX)
+    {
+        return -EINVARG;
+    }
+
+    if (!paging_mmio_table)
+    {
+        paging_mmio_table = frame_zalloc();
+        if (!paging_mmio_table)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    paging_mmio_table[table_index] = (uint32_t)phys | PAGING_CACHE_DISABLED | PAGING_WRITE_THROUGH | PAGING_IS_WRITEABLE | PAGING_IS_PRESENT;
+    current_directory[directory_index] = (uint32_t)paging_mmio_table | PAGING_IS_PRESENT | PAGING_IS_WRITEABLE;
+    paging_invalidate(current_directory, phys);
+    return 0;
+}
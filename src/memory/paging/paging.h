@@ -4,7 +4,13 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "config.h"
 
+// Available to the OS, marks a page shared read only until somebody writes to it
+#define PAGING_IS_COPY_ON_WRITE 0b1000000000
+#define PAGING_IS_GLOBAL       0b100000000
+// In a directory entry, maps 4MB straight to physical memory without a page table
+#define PAGING_IS_LARGE        0b10000000
 #define PAGING_CACHE_DISABLED  0b00010000
 #define PAGING_WRITE_THROUGH   0b00001000
 #define PAGING_ACCESS_FROM_ALL 0b00000100
@@ -14,6 +20,20 @@
 
 #define PAGING_TOTAL_ENTRIES_PER_TABLE 1024
 #define PAGING_PAGE_SIZE 4096
+#define PAGING_TABLE_SPAN (PAGING_TOTAL_ENTRIES_PER_TABLE * PAGING_PAGE_SIZE)
+
+// Directory slots covering the kernel identity map
+#define PAGING_KERNEL_TABLES ((PEACHOS_KERNEL_IDENTITY_MAP_END + PAGING_TABLE_SPAN - 1) / PAGING_TABLE_SPAN)
+// The first 4MB keeps real page tables, shared between directories, so low memory and the kernel
+// image can be global and the user stack can sit right below the program. The rest of the
+// identity map is made of 4MB pages
+#define PAGING_SMALL_KERNEL_TABLES 1
+
+// Range invalidations of more pages than this reload CR3 instead of using invlpg per page
+#define PAGING_INVALIDATE_RANGE_PAGES 32
+
+// How many different flag combinations of shared kernel tables we keep around
+#define PAGING_MAX_KERNEL_TABLE_SETS 4
 
 
 struct paging_4gb_chunk
@@ -23,9 +43,15 @@ struct paging_4gb_chunk
 
 struct paging_4gb_chunk* paging_new_4gb(uint8_t flags);
 void paging_switch(struct paging_4gb_chunk* directory);
+uint32_t* paging_current_directory();
+int paging_map_mmio(void* phys);
 void enable_paging();
+// The address the last page fault happened at
+void* paging_fault_address();
 
 int paging_set(uint32_t* directory, void* virt, uint32_t val);
+void paging_invalidate(uint32_t* directory, void* virt);
+void paging_invalidate_range(uint32_t* directory, void* virt, uint32_t size);
 bool paging_is_aligned(void* addr);
 
 uint32_t* paging_4gb_chunk_get_directory(struct paging_4gb_chunk* chunk);
@@ -0,0 +1,139 @@
+#include "shm.h"
+#include "status.h"
+#include "kernel.h"
+#include "string/string.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+
+static struct shm* shm_objects = 0;
+
+static struct shm* shm_find(const char* name)
+{
+    for (struct shm* shm = shm_objects; shm; shm = shm->next)
+    {
+        if (strncmp(shm->name, name, sizeof(shm->name)) == 0)
+        {
+            return shm;
+        }
+    }
+
+    return 0;
+}
+
+static void shm_free(struct shm* shm)
+{
+    if (shm->pages)
+    {
+        for (uint32_t i = 0; i < shm->size / PAGING_PAGE_SIZE; i++)
+        {
+            if (shm->pages[i])
+            {
+                cow_page_put(shm->pages[i]);
+            }
+        }
+        kfree(shm->pages);
+    }
+    kfree(shm);
+}
+
+/**
+ * Creates the object with size bytes of zeroed frames, the caller holds its first mapping
+ */
+struct shm* shm_create(const char* name, uint32_t size)
+{
+    int res = 0;
+    struct shm* shm = 0;
+    size = (uint32_t) paging_align_address((void*) size);
+    if (size == 0 || size > PEACHOS_SHM_MAX_SIZE || strlen(name) == 0)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (shm_find(name))
+    {
+        res = -EISTKN;
+        goto out;
+    }
+
+    shm = kzalloc(sizeof(struct shm));
+    if (!shm)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    strncpy(shm->name, name, sizeof(shm->name));
+    shm->size = size;
+    shm->pages = kzalloc(sizeof(void*) * (size / PAGING_PAGE_SIZE));
+    if (!shm->pages)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    for (uint32_t i = 0; i < size / PAGING_PAGE_SIZE; i++)
+    {
+        shm->pages[i] = frame_zalloc();
+        if (!shm->pages[i])
+        {
+            res = -ENOMEM;
+            goto out;
+        }
+    }
+
+    shm->mappings = 1;
+    shm->next = shm_objects;
+    shm_objects = shm;
+out:
+    if (res < 0)
+    {
+        if (shm)
+        {
+            shm_free(shm);
+        }
+        return ERROR(res);
+    }
+    return shm;
+}
+
+/**
+ * Finds the object by name and takes a mapping reference on it, NULL if there is none
+ */
+struct shm* shm_get(const char* name)
+{
+    struct shm* shm = shm_find(name);
+    return shm ? shm_dup(shm) : 0;
+}
+
+struct shm* shm_dup(struct shm* shm)
+{
+    shm->mappings++;
+    return shm;
+}
+
+/**
+ * Drops a mapping reference, the last one removes the name and frees the frames once the
+ * mappings have let go of them
+ */
+void shm_put(struct shm* shm)
+{
+    if (--shm->mappings > 0)
+    {
+        return;
+    }
+
+    struct shm** link = &shm_objects;
+    while (*link)
+    {
+        if (*link == shm)
+        {
+            *link = shm->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    shm_free(shm);
+}
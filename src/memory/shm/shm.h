@@ -0,0 +1,25 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include "config.h"
+
+// A named run of frames that every process mapping it sees, it goes away with its last mapping
+struct shm
+{
+    char name[PEACHOS_SHM_NAME_MAX];
+    // Page aligned size in bytes
+    uint32_t size;
+    void** pages;
+
+    // Processes mapping the object, each mapping also holds a reference on every page
+    int mappings;
+    struct shm* next;
+};
+
+struct shm* shm_create(const char* name, uint32_t size);
+struct shm* shm_get(const char* name);
+struct shm* shm_dup(struct shm* shm);
+void shm_put(struct shm* shm);
+
+#endif
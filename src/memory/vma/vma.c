@@ -0,0 +1,240 @@
+#include "vma.h"
+#include "status.h"
+#include <stddef.h>
+
+static int vma_height(struct vma* vma)
+{
+    return vma ? vma->height : 0;
+}
+
+static void vma_update_height(struct vma* vma)
+{
+    int left = vma_height(vma->left);
+    int right = vma_height(vma->right);
+    vma->height = (left > right ? left : right) + 1;
+}
+
+static struct vma* vma_rotate_right(struct vma* vma)
+{
+    struct vma* left = vma->left;
+    vma->left = left->right;
+    left->right = vma;
+    vma_update_height(vma);
+    vma_update_height(left);
+    return left;
+}
+
+static struct vma* vma_rotate_left(struct vma* vma)
+{
+    struct vma* right = vma->right;
+    vma->right = right->left;
+    right->left = vma;
+    vma_update_height(vma);
+    vma_update_height(right);
+    return right;
+}
+
+static struct vma* vma_balance(struct vma* vma)
+{
+    vma_update_height(vma);
+    int balance = vma_height(vma->left) - vma_height(vma->right);
+    if (balance > 1)
+    {
+        if (vma_height(vma->left->left) < vma_height(vma->left->right))
+        {
+            vma->left = vma_rotate_left(vma->left);
+        }
+        return vma_rotate_right(vma);
+    }
+
+    if (balance < -1)
+    {
+        if (vma_height(vma->right->right) < vma_height(vma->right->left))
+        {
+            vma->right = vma_rotate_right(vma->right);
+        }
+        return vma_rotate_left(vma);
+    }
+
+    return vma;
+}
+
+static struct vma* vma_insert_node(struct vma* root, struct vma* vma)
+{
+    if (!root)
+    {
+        return vma;
+    }
+
+    if (vma->start < root->start)
+    {
+        root->left = vma_insert_node(root->left, vma);
+    }
+    else
+    {
+        root->right = vma_insert_node(root->right, vma);
+    }
+
+    return vma_balance(root);
+}
+
+static struct vma* vma_remove_min(struct vma* root, struct vma** min)
+{
+    if (!root->left)
+    {
+        *min = root;
+        return root->right;
+    }
+
+    root->left = vma_remove_min(root->left, min);
+    return vma_balance(root);
+}
+
+static struct vma* vma_remove_node(struct vma* root, struct vma* vma)
+{
+    if (!root)
+    {
+        return 0;
+    }
+
+    if (vma->start < root->start)
+    {
+        root->left = vma_remove_node(root->left, vma);
+    }
+    else if (vma->start > root->start)
+    {
+        root->right = vma_remove_node(root->right, vma);
+    }
+    else
+    {
+        if (!root->right)
+        {
+            return root->left;
+        }
+
+        // The smallest region on the right takes the place of the removed one
+        struct vma* min = 0;
+        struct vma* right = vma_remove_min(root->right, &min);
+        min->left = root->left;
+        min->right = right;
+        root = min;
+    }
+
+    return vma_balance(root);
+}
+
+/**
+ * Finds the region with the highest start below end, the only one that can overlap a range
+ * ending there
+ */
+static struct vma* vma_floor(struct vma_tree* tree, uint32_t end)
+{
+    struct vma* found = 0;
+    struct vma* node = tree->root;
+    while (node)
+    {
+        if (node->start < end)
+        {
+            found = node;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
+    }
+
+    return found;
+}
+
+struct vma* vma_find_overlap(struct vma_tree* tree, uint32_t start, uint32_t end)
+{
+    struct vma* vma = vma_floor(tree, end);
+    if (vma && vma->end > start)
+    {
+        return vma;
+    }
+
+    return 0;
+}
+
+struct vma* vma_find(struct vma_tree* tree, uint32_t address)
+{
+    return vma_find_overlap(tree, address, address + 1);
+}
+
+int vma_insert(struct vma_tree* tree, struct vma* vma)
+{
+    if (vma->end <= vma->start)
+    {
+        return -EINVARG;
+    }
+
+    if (vma_find_overlap(tree, vma->start, vma->end))
+    {
+        return -EISTKN;
+    }
+
+    vma->left = 0;
+    vma->right = 0;
+    vma->height = 1;
+    tree->root = vma_insert_node(tree->root, vma);
+    return 0;
+}
+
+void vma_remove(struct vma_tree* tree, struct vma* vma)
+{
+    tree->root = vma_remove_node(tree->root, vma);
+    vma->left = 0;
+    vma->right = 0;
+}
+
+/**
+ * Finds the lowest address in [low, high) with size free bytes after it, zero if there is none
+ */
+uint32_t vma_find_free(struct vma_tree* tree, uint32_t low, uint32_t high, uint32_t size)
+{
+    uint32_t candidate = low;
+    while (candidate + size >= candidate && candidate + size <= high)
+    {
+        struct vma* vma = vma_find_overlap(tree, candidate, candidate + size);
+        if (!vma)
+        {
+            return candidate;
+        }
+        candidate = vma->end;
+    }
+
+    return 0;
+}
+
+struct vma* vma_first(struct vma_tree* tree)
+{
+    struct vma* node = tree->root;
+    while (node && node->left)
+    {
+        node = node->left;
+    }
+
+    return node;
+}
+
+struct vma* vma_next(struct vma_tree* tree, struct vma* vma)
+{
+    struct vma* found = 0;
+    struct vma* node = tree->root;
+    while (node)
+    {
+        if (node->start > vma->start)
+        {
+            found = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+
+    return found;
+}
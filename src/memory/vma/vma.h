@@ -0,0 +1,41 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include <stdint.h>
+
+// What a region of a process address space holds
+#define VMA_TYPE_PROGRAM 0
+#define VMA_TYPE_STACK 1
+#define VMA_TYPE_ALLOCATION 2
+#define VMA_TYPE_MAPPING 3
+#define VMA_TYPE_BRK 4
+#define VMA_TYPE_THREAD_STACK 5
+#define VMA_TYPE_SHARED 6
+
+// A region [start, end) of an address space, embedded in whatever owns the region
+struct vma
+{
+    uint32_t start;
+    uint32_t end;
+    int type;
+
+    // AVL tree links, regions never overlap so they are ordered by start
+    struct vma* left;
+    struct vma* right;
+    int height;
+};
+
+struct vma_tree
+{
+    struct vma* root;
+};
+
+int vma_insert(struct vma_tree* tree, struct vma* vma);
+void vma_remove(struct vma_tree* tree, struct vma* vma);
+struct vma* vma_find(struct vma_tree* tree, uint32_t address);
+struct vma* vma_find_overlap(struct vma_tree* tree, uint32_t start, uint32_t end);
+uint32_t vma_find_free(struct vma_tree* tree, uint32_t low, uint32_t high, uint32_t size);
+struct vma* vma_first(struct vma_tree* tree);
+struct vma* vma_next(struct vma_tree* tree, struct vma* vma);
+
+#endif
@@ -0,0 +1,73 @@
+#include "pci.h"
+#include "io/io.h"
+#include "status.h"
+
+static uint32_t pci_config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    return 0x80000000 | (bus << 16) | (slot << 11) | (function << 8) | (offset & 0xFC);
+}
+
+static uint32_t pci_config_read_at(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    outdw(PCI_CONFIG_ADDRESS_PORT, pci_config_address(bus, slot, function, offset));
+    return insdw(PCI_CONFIG_DATA_PORT);
+}
+
+uint32_t pci_config_read(struct pci_device* device, uint8_t offset)
+{
+    return pci_config_read_at(device->bus, device->slot, device->function, offset);
+}
+
+void pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value)
+{
+    outdw(PCI_CONFIG_ADDRESS_PORT, pci_config_address(device->bus, device->slot, device->function, offset));
+    outdw(PCI_CONFIG_DATA_PORT, value);
+}
+
+/**
+ * Scans every bus, slot and function for the first device of the given class and subclass
+ */
+int pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_device* device_out)
+{
+    for (int bus = 0; bus < PCI_TOTAL_BUSES; bus++)
+    {
+        for (int slot = 0; slot < PCI_TOTAL_SLOTS; slot++)
+        {
+            for (int function = 0; function < PCI_TOTAL_FUNCTIONS; function++)
+            {
+                uint32_t id = pci_config_read_at(bus, slot, function, PCI_CONFIG_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF)
+                {
+                    // Nothing here, if function zero is missing the whole slot is empty
+                    if (function == 0)
+                    {
+                        break;
+                    }
+                    continue;
+                }
+
+                uint32_t class_info = pci_config_read_at(bus, slot, function, PCI_CONFIG_CLASS);
+                if ((class_info >> 24) == class_code && ((class_info >> 16) & 0xFF) == subclass)
+                {
+                    device_out->bus = bus;
+                    device_out->slot = slot;
+                    device_out->function = function;
+                    device_out->vendor_id = id & 0xFFFF;
+                    device_out->device_id = id >> 16;
+                    device_out->class_code = class_code;
+                    device_out->subclass = subclass;
+                    device_out->prog_if = (class_info >> 8) & 0xFF;
+                    return 0;
+                }
+
+                // Single function devices only answer on function zero
+                if (function == 0 && !(pci_config_read_at(bus, slot, 0, PCI_CONFIG_HEADER_TYPE) & 0x00800000))
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    return -EIO;
+}
@@ -0,0 +1,48 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+#define PCI_CONFIG_ADDRESS_PORT 0xCF8
+#define PCI_CONFIG_DATA_PORT 0xCFC
+
+// Offsets into the configuration space header
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_COMMAND 0x04
+#define PCI_CONFIG_CLASS 0x08
+#define PCI_CONFIG_HEADER_TYPE 0x0C
+#define PCI_CONFIG_BAR0 0x10
+#define PCI_CONFIG_BAR4 0x20
+#define PCI_CONFIG_INTERRUPT_LINE 0x3C
+
+#define PCI_COMMAND_IO_SPACE 0x01
+#define PCI_COMMAND_BUS_MASTER 0x04
+
+#define PCI_BAR_IO_SPACE 0x01
+#define PCI_BAR_IO_MASK 0xFFFFFFFC
+
+#define PCI_CLASS_MASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+#define PCI_TOTAL_BUSES 256
+#define PCI_TOTAL_SLOTS 32
+#define PCI_TOTAL_FUNCTIONS 8
+
+struct pci_device
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+};
+
+uint32_t pci_config_read(struct pci_device* device, uint8_t offset);
+void pci_config_write(struct pci_device* device, uint8_t offset, uint32_t value);
+int pci_find_class(uint8_t class_code, uint8_t subclass, struct pci_device* device_out);
+
+#endif
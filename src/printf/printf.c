@@ -157,6 +157,33 @@ static inline void _out_char(char character, void* buffer, size_t idx, size_t ma
 }
 
 
+// console buffer, printf hands whole runs of characters to _putstring instead of
+// going through _putchar one at a time
+#ifndef PRINTF_CONSOLE_BUFFER_SIZE
+#define PRINTF_CONSOLE_BUFFER_SIZE  64U
+#endif
+
+typedef struct {
+  char   data[PRINTF_CONSOLE_BUFFER_SIZE];
+  size_t length;
+} out_console_type;
+
+
+// internal console output, buffer is the out_console_type
+static inline void _out_console(char character, void* buffer, size_t idx, size_t maxlen)
+{
+  (void)idx; (void)maxlen;
+  out_console_type* console = (out_console_type*)buffer;
+  if (character) {
+    console->data[console->length++] = character;
+    if (console->length == PRINTF_CONSOLE_BUFFER_SIZE) {
+      _putstring(console->data, console->length);
+      console->length = 0U;
+    }
+  }
+}
+
+
 // internal output function wrapper
 static inline void _out_fct(char character, void* buffer, size_t idx, size_t maxlen)
 {
@@ -861,12 +888,24 @@ static int _vsnprintf(out_fct_type out, char* buffer, const size_t maxlen, const
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// printf and vprintf into the console buffer, flushing what is left at the end
+static int _vprintf_console(const char* format, va_list va)
+{
+  out_console_type console;
+  console.length = 0U;
+  const int ret = _vsnprintf(_out_console, (char*)(uintptr_t)&console, (size_t)-1, format, va);
+  if (console.length) {
+    _putstring(console.data, console.length);
+  }
+  return ret;
+}
+
+
 int printf_(const char* format, ...)
 {
   va_list va;
   va_start(va, format);
-  char buffer[1];
-  const int ret = _vsnprintf(_out_char, buffer, (size_t)-1, format, va);
+  const int ret = _vprintf_console(format, va);
   va_end(va);
   return ret;
 }
@@ -894,8 +933,7 @@ int snprintf_(char* buffer, size_t count, const char* format, ...)
 
 int vprintf_(const char* format, va_list va)
 {
-  char buffer[1];
-  return _vsnprintf(_out_char, buffer, (size_t)-1, format, va);
+  return _vprintf_console(format, va);
 }
 
 
@@ -914,3 +952,45 @@ int fctprintf(void (*out)(char character, void* arg), void* arg, const char* for
   va_end(va);
   return ret;
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// constant format fast paths
+
+int format_uint(char* buffer, unsigned int value)
+{
+  char digits[PRINTF_UINT_BUFFER_SIZE];
+  int len = 0;
+  do {
+    digits[len++] = (char)('0' + (value % 10U));
+    value /= 10U;
+  } while (value);
+
+  for (int i = 0; i < len; i++) {
+    buffer[i] = digits[len - 1 - i];
+  }
+  buffer[len] = '\0';
+  return len;
+}
+
+
+int format_hex(char* buffer, unsigned int value, unsigned int width)
+{
+  static const char hex[] = "0123456789abcdef";
+  unsigned int len = 1U;
+  while (len < 8U && (value >> (len * 4U))) {
+    len++;
+  }
+  if (width > 8U) {
+    width = 8U;
+  }
+  if (len < width) {
+    len = width;
+  }
+
+  for (unsigned int i = 0U; i < len; i++) {
+    buffer[len - 1U - i] = hex[(value >> (i * 4U)) & 0xFU];
+  }
+  buffer[len] = '\0';
+  return (int)len;
+}
@@ -49,6 +49,15 @@ extern "C" {
 void _putchar(char character);
 
 
+/**
+ * Output of printf and vprintf in runs of characters, the run is not terminated
+ * and never longer than PRINTF_CONSOLE_BUFFER_SIZE
+ * \param str Characters to print
+ * \param length How many of them
+ */
+void _putstring(const char* str, size_t length);
+
+
 /**
  * Tiny printf implementation
  * You have to implement _putchar if you use printf()
@@ -109,6 +118,20 @@ int vprintf_(const char* format, va_list va);
 int fctprintf(void (*out)(char character, void* arg), void* arg, const char* format, ...);
 
 
+/**
+ * Fast paths for the constant formats "%u" and "%0<width>x", they skip the format parser
+ * \param buffer Receives the digits and a terminating 0, PRINTF_UINT_BUFFER_SIZE or
+ *        PRINTF_HEX_BUFFER_SIZE bytes are always enough
+ * \param value The value to format
+ * \param width Minimum number of hex digits, zero padded, at most 8
+ * \return The number of digits written, not counting the terminating 0
+ */
+#define PRINTF_UINT_BUFFER_SIZE 11U
+#define PRINTF_HEX_BUFFER_SIZE  9U
+int format_uint(char* buffer, unsigned int value);
+int format_hex(char* buffer, unsigned int value, unsigned int width);
+
+
 #ifdef __cplusplus
 }
 #endif
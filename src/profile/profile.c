@@ -0,0 +1,112 @@
+#include "profile.h"
+#include "idt/idt.h"
+#include "task/cpu.h"
+#include "task/task.h"
+#include "task/process.h"
+#include "timer/timer.h"
+#include "memory/memory.h"
+#include "status.h"
+
+static struct profile_buffer profile_buffers[PEACHOS_MAX_CPUS];
+static bool profile_running;
+static uint32_t profile_interval;
+static uint32_t profile_last_sample[PEACHOS_MAX_CPUS];
+
+// Keeps the timer firing at least once an interval while the profiler runs, the kernel is
+// tickless otherwise
+static struct timer_event profile_timer;
+
+static void profile_timer_expired(void* data)
+{
+    if (profile_running)
+    {
+        timer_add(&profile_timer, profile_interval, profile_timer_expired, 0);
+    }
+}
+
+/**
+ * Throws away the samples of the last run and samples every interval_ms from now on
+ */
+int profile_start(uint32_t interval_ms)
+{
+    if (interval_ms == 0)
+    {
+        return -EINVARG;
+    }
+
+    for (int i = 0; i < PEACHOS_MAX_CPUS; i++)
+    {
+        profile_buffers[i].total = 0;
+        profile_buffers[i].read = 0;
+        profile_last_sample[i] = timer_ticks();
+    }
+
+    profile_interval = timer_ms_to_ticks(interval_ms);
+    profile_running = true;
+    timer_add(&profile_timer, profile_interval, profile_timer_expired, 0);
+    return 0;
+}
+
+/**
+ * Stops sampling, the samples taken stay until they are read or the next start
+ */
+void profile_stop()
+{
+    profile_running = false;
+    timer_cancel(&profile_timer);
+}
+
+/**
+ * Called on every timer interrupt with what was interrupted
+ */
+void profile_sample(struct interrupt_frame* frame)
+{
+    if (!profile_running)
+    {
+        return;
+    }
+
+    struct cpu* cpu = cpu_current();
+    uint32_t now = timer_ticks();
+    if (now - profile_last_sample[cpu->id] < profile_interval)
+    {
+        return;
+    }
+    profile_last_sample[cpu->id] = now;
+
+    struct profile_buffer* buffer = &profile_buffers[cpu->id];
+    if (buffer->total == PEACHOS_PROFILE_SAMPLES)
+    {
+        return;
+    }
+
+    struct profile_sample* sample = &buffer->samples[buffer->total++];
+    struct task* task = cpu->current_task;
+    sample->pid = task && task->process ? task->process->id : 0;
+    sample->eip = frame->ip;
+    sample->flags = (frame->cs & 0x03) ? 0 : PROFILE_SAMPLE_KERNEL;
+}
+
+/**
+ * Hands out up to max samples that were not read yet, the processors one after the other.
+ * Returns how many, zero once all have been read
+ */
+int profile_read(struct profile_sample* out, int max)
+{
+    int total = 0;
+    for (int i = 0; i < PEACHOS_MAX_CPUS && total < max; i++)
+    {
+        struct profile_buffer* buffer = &profile_buffers[i];
+        int count = buffer->total - buffer->read;
+        if (count > max - total)
+        {
+            count = max - total;
+        }
+
+        memcpy(&out[total], &buffer->samples[buffer->read], count * sizeof(struct profile_sample));
+        buffer->read += count;
+        total += count;
+    }
+
+    return total;
+}
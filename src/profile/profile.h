@@ -0,0 +1,42 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Operations of the profile system call, must match the user library
+#define PROFILE_COMMAND_START 0
+#define PROFILE_COMMAND_STOP 1
+#define PROFILE_COMMAND_READ 2
+
+// Set when the sample was taken while the kernel ran
+#define PROFILE_SAMPLE_KERNEL 0x01
+
+/**
+ * Where a processor was when the profiler looked, must match the user library
+ */
+struct profile_sample
+{
+    // Process of the task that was running, zero when there was none
+    uint32_t pid;
+    uint32_t eip;
+    uint32_t flags;
+};
+
+struct profile_buffer
+{
+    uint32_t total;
+    // Samples handed out by profile_read
+    uint32_t read;
+    struct profile_sample samples[PEACHOS_PROFILE_SAMPLES];
+};
+
+struct interrupt_frame;
+
+int profile_start(uint32_t interval_ms);
+void profile_stop();
+void profile_sample(struct interrupt_frame* frame);
+int profile_read(struct profile_sample* out, int max);
+
+#endif
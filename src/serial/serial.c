@@ -0,0 +1,182 @@
+#include "serial.h"
+#include "config.h"
+#include "io/io.h"
+#include "idt/idt.h"
+#include <stdint.h>
+
+#define SERIAL_COM1 0x3F8
+#define SERIAL_COM1_IRQ 4
+
+#define SERIAL_DATA 0
+#define SERIAL_INTERRUPT_ENABLE 1
+#define SERIAL_INTERRUPT_ID 2
+#define SERIAL_FIFO_CONTROL 2
+#define SERIAL_LINE_CONTROL 3
+#define SERIAL_MODEM_CONTROL 4
+#define SERIAL_LINE_STATUS 5
+
+#define SERIAL_LINE_CONTROL_8N1 0x03
+#define SERIAL_LINE_CONTROL_DLAB 0x80
+// Enabled, both FIFOs cleared, receive interrupts at 14 bytes
+#define SERIAL_FIFO_ENABLE 0xC7
+// DTR, RTS and OUT2, the last one connects the UART interrupt to the IRQ line
+#define SERIAL_MODEM_CONTROL_READY 0x0B
+#define SERIAL_MODEM_CONTROL_LOOPBACK 0x1E
+#define SERIAL_LINE_STATUS_THR_EMPTY 0x20
+#define SERIAL_INTERRUPT_THR_EMPTY 0x02
+#define SERIAL_INTERRUPT_ID_MASK 0x0E
+#define SERIAL_INTERRUPT_ID_THR_EMPTY 0x02
+
+// Bytes the transmit FIFO of a 16550 takes at once
+#define SERIAL_FIFO_SIZE 16
+// 115200 baud
+#define SERIAL_DIVISOR 1
+
+static bool serial_found;
+
+// Filled in by writers and drained by the THR empty interrupt. The kernel runs with interrupts
+// disabled, so writers and the interrupt never interleave on a processor
+static char serial_tx_buffer[PEACHOS_SERIAL_TX_BUFFER_SIZE];
+static uint32_t serial_tx_head;
+static uint32_t serial_tx_tail;
+// Set while the THR empty interrupt is enabled and will pick up what writers queue
+static bool serial_tx_active;
+
+/**
+ * Moves as much of the ring as the transmit FIFO takes, the FIFO must be empty
+ */
+static void serial_fill_fifo()
+{
+    for (int i = 0; i < SERIAL_FIFO_SIZE && serial_tx_tail != serial_tx_head; i++)
+    {
+        outb(SERIAL_COM1 + SERIAL_DATA, serial_tx_buffer[serial_tx_tail++ & (PEACHOS_SERIAL_TX_BUFFER_SIZE - 1)]);
+    }
+}
+
+static void serial_interrupt(struct interrupt_frame* frame)
+{
+    uint8_t id = insb(SERIAL_COM1 + SERIAL_INTERRUPT_ID);
+    if ((id & SERIAL_INTERRUPT_ID_MASK) != SERIAL_INTERRUPT_ID_THR_EMPTY)
+    {
+        return;
+    }
+
+    serial_fill_fifo();
+    if (serial_tx_tail == serial_tx_head)
+    {
+        // Nothing left, the next write starts the transmitter again
+        outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, 0x00);
+        serial_tx_active = false;
+    }
+}
+
+/**
+ * Programs COM1 for 115200 8N1 when there is a working 16550 behind it
+ */
+void serial_init()
+{
+    outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, 0x00);
+    outb(SERIAL_COM1 + SERIAL_LINE_CONTROL, SERIAL_LINE_CONTROL_DLAB);
+    outb(SERIAL_COM1 + SERIAL_DATA, SERIAL_DIVISOR & 0xFF);
+    outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, SERIAL_DIVISOR >> 8);
+    outb(SERIAL_COM1 + SERIAL_LINE_CONTROL, SERIAL_LINE_CONTROL_8N1);
+    outb(SERIAL_COM1 + SERIAL_FIFO_CONTROL, SERIAL_FIFO_ENABLE);
+
+    // No UART, or a broken one, if a byte sent in loopback mode does not come back
+    outb(SERIAL_COM1 + SERIAL_MODEM_CONTROL, SERIAL_MODEM_CONTROL_LOOPBACK);
+    outb(SERIAL_COM1 + SERIAL_DATA, 0xAE);
+    if (insb(SERIAL_COM1 + SERIAL_DATA) != 0xAE)
+    {
+        return;
+    }
+
+    outb(SERIAL_COM1 + SERIAL_MODEM_CONTROL, SERIAL_MODEM_CONTROL_READY);
+    idt_register_interrupt_callback(PEACHOS_PIC_MASTER_VECTOR_START + SERIAL_COM1_IRQ, serial_interrupt);
+    // Through the PIC, the IO APIC takes the IRQ over along with the others should we move to it
+    outb(0x21, insb(0x21) & ~(1 << SERIAL_COM1_IRQ));
+    serial_found = true;
+}
+
+bool serial_present()
+{
+    return serial_found;
+}
+
+/**
+ * Queues len bytes for sending and returns right away. Bytes that do not fit in the ring are
+ * dropped rather than waiting for the port
+ */
+void serial_write(const char* buf, size_t len)
+{
+    if (!serial_found)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (serial_tx_head - serial_tx_tail == PEACHOS_SERIAL_TX_BUFFER_SIZE)
+        {
+            break;
+        }
+        serial_tx_buffer[serial_tx_head++ & (PEACHOS_SERIAL_TX_BUFFER_SIZE - 1)] = buf[i];
+    }
+
+    if (!serial_tx_active)
+    {
+        // Raises the first interrupt once the FIFO drained, from then on the interrupt keeps it fed
+        serial_tx_active = true;
+        if (insb(SERIAL_COM1 + SERIAL_LINE_STATUS) & SERIAL_LINE_STATUS_THR_EMPTY)
+        {
+            serial_fill_fifo();
+        }
+        outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, SERIAL_INTERRUPT_THR_EMPTY);
+    }
+}
+
+/**
+ * Terminals on the other end want a carriage return before every new line
+ */
+void serial_putchar(char c)
+{
+    if (c == '\n')
+    {
+        serial_write("\r\n", 2);
+        return;
+    }
+
+    if (c == 0x08)
+    {
+        serial_write("\b \b", 3);
+        return;
+    }
+
+    serial_write(&c, 1);
+}
+
+/**
+ * serial_putchar for fctprintf
+ */
+void serial_fctputc(char c, void* arg)
+{
+    serial_putchar(c);
+}
+
+/**
+ * Sends everything queued by polling the port, for when interrupts will not come anymore
+ */
+void serial_flush()
+{
+    if (!serial_found)
+    {
+        return;
+    }
+
+    while (serial_tx_tail != serial_tx_head)
+    {
+        while (!(insb(SERIAL_COM1 + SERIAL_LINE_STATUS) & SERIAL_LINE_STATUS_THR_EMPTY))
+        {
+        }
+        serial_fill_fifo();
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+void serial_init();
+bool serial_present();
+void serial_write(const char* buf, size_t len);
+void serial_putchar(char c);
+void serial_fctputc(char c, void* arg);
+void serial_flush();
+
+#endif
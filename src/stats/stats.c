@@ -0,0 +1,71 @@
+#include "stats.h"
+#include "memory/heap/kheap.h"
+#include "memory/memory.h"
+#include "disk/disk.h"
+#include "disk/cache.h"
+#include "timer/timer.h"
+#include "status.h"
+
+struct stats_cpu stats_cpus[PEACHOS_MAX_CPUS];
+
+void stats_syscall(int command)
+{
+    struct stats_cpu* stats = &stats_cpus[cpu_current()->id];
+    stats->syscalls_total++;
+    if (command < PEACHOS_STATS_COMMANDS)
+    {
+        stats->syscalls[command]++;
+    }
+}
+
+static void stats_add_cpu(struct stats_cpu* out, struct stats_cpu* cpu)
+{
+    out->context_switches += cpu->context_switches;
+    out->idle_ticks += cpu->idle_ticks;
+    out->sectors_read += cpu->sectors_read;
+    out->sectors_written += cpu->sectors_written;
+    out->fat_chain_hops += cpu->fat_chain_hops;
+    out->syscalls_total += cpu->syscalls_total;
+    for (int i = 0; i < PEACHOS_STATS_COMMANDS; i++)
+    {
+        out->syscalls[i] += cpu->syscalls[i];
+    }
+}
+
+/**
+ * Fills out with the system wide numbers and the counters of one processor, or of all
+ * processors added up when cpu is -1
+ */
+int stats_get(int cpu, struct stats_snapshot* out)
+{
+    if (cpu < -1 || cpu >= PEACHOS_MAX_CPUS)
+    {
+        return -EINVARG;
+    }
+
+    memset(out, 0, sizeof(struct stats_snapshot));
+    out->uptime_ticks = timer_ticks();
+    kheap_get_usage(&out->heap_total_blocks, &out->heap_used_blocks, &out->heap_peak_blocks);
+    for (int i = 0; i < PEACHOS_MAX_DISKS; i++)
+    {
+        struct disk* disk = disk_get(i);
+        struct disk_cache_stats* cache = disk ? diskcache_get_stats(disk) : 0;
+        if (cache)
+        {
+            out->cache_hits += cache->hits;
+            out->cache_misses += cache->misses;
+        }
+    }
+
+    if (cpu != -1)
+    {
+        out->cpu = stats_cpus[cpu];
+        return 0;
+    }
+
+    for (int i = 0; i < PEACHOS_MAX_CPUS; i++)
+    {
+        stats_add_cpu(&out->cpu, &stats_cpus[i]);
+    }
+    return 0;
+}
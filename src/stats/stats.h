@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "config.h"
+#include "task/cpu.h"
+
+/**
+ * Counters of one processor, each is only ever bumped by its own processor so no locks are
+ * needed. Must match the user library
+ */
+struct stats_cpu
+{
+    // Switches from one task to another in task_run
+    uint32_t context_switches;
+    // Timer ticks spent waiting for any task to become runnable
+    uint32_t idle_ticks;
+    // Sectors that went to or came from the disk hardware, cache hits are not counted
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    // FAT entries followed to find the cluster of a file offset
+    uint32_t fat_chain_hops;
+    uint32_t syscalls_total;
+    uint32_t syscalls[PEACHOS_STATS_COMMANDS];
+};
+
+/**
+ * What the stats system call hands out, must match the user library
+ */
+struct stats_snapshot
+{
+    uint32_t uptime_ticks;
+    uint32_t heap_total_blocks;
+    uint32_t heap_used_blocks;
+    uint32_t heap_peak_blocks;
+    // Summed over the block caches of every disk
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    struct stats_cpu cpu;
+};
+
+/**
+ * One process as listed by the process stats system call, must match the user library
+ */
+struct stats_process
+{
+    uint32_t id;
+    // Timer ticks all tasks of the process have run for
+    uint32_t ticks;
+    char name[PEACHOS_STATS_NAME_SIZE];
+};
+
+extern struct stats_cpu stats_cpus[PEACHOS_MAX_CPUS];
+
+#define STATS_ADD(field, value) (stats_cpus[cpu_current()->id].field += (value))
+#define STATS_INC(field) STATS_ADD(field, 1)
+
+void stats_syscall(int command);
+int stats_get(int cpu, struct stats_snapshot* out);
+
+#endif
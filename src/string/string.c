@@ -10,6 +10,16 @@ char tolower(char s1)
     return s1;
 }
 
+char toupper(char s1)
+{
+    if (s1 >= 97 && s1 <= 122)
+    {
+        s1 -= 32;
+    }
+
+    return s1;
+}
+
 int strlen(const char* ptr)
 {
     int i = 0;
@@ -11,4 +11,5 @@ int strncmp(const char* str1, const char* str2, int n);
 int istrncmp(const char* s1, const char* s2, int n);
 int strnlen_terminator(const char* str, int max, char terminator);
 char tolower(char s1);
+char toupper(char s1);
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+section .asm
+
+global cpu_features
+global cpu_write_msr
+
+; uint32_t cpu_features();
+; The feature flags CPUID leaf 1 returns in edx
+cpu_features:
+    push ebx
+    mov eax, 1
+    cpuid
+    mov eax, edx
+    pop ebx
+    ret
+
+; void cpu_write_msr(uint32_t msr, uint32_t low, uint32_t high);
+cpu_write_msr:
+    push ebp
+    mov ebp, esp
+    mov ecx, [ebp+8]
+    mov eax, [ebp+12]
+    mov edx, [ebp+16]
+    wrmsr
+    pop ebp
+    ret
@@ -0,0 +1,25 @@
+#include "cpu.h"
+#include "config.h"
+
+struct cpu cpus[PEACHOS_MAX_CPUS];
+
+void cpu_init()
+{
+    for (int i = 0; i < PEACHOS_MAX_CPUS; i++)
+    {
+        cpus[i].id = i;
+    }
+}
+
+/**
+ * Returns the processor we run on. Only the boot processor runs the kernel so far
+ */
+struct cpu* cpu_current()
+{
+    return &cpus[0];
+}
+
+int cpu_tss_selector(struct cpu* cpu)
+{
+    return (PEACHOS_GDT_TSS_INDEX + cpu->id) * 8;
+}
@@ -0,0 +1,63 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+#include "task/tss.h"
+#include "task/spinlock.h"
+
+// Feature flags from cpu_features
+#define CPU_FEATURE_APIC (1 << 9)
+#define CPU_FEATURE_SYSENTER (1 << 11)
+#define CPU_FEATURE_FXSR (1 << 24)
+
+#define CPU_MSR_SYSENTER_CS 0x174
+#define CPU_MSR_SYSENTER_ESP 0x175
+#define CPU_MSR_SYSENTER_EIP 0x176
+
+struct task;
+
+// Runnable tasks of one priority level
+struct cpu_runqueue
+{
+    struct task* head;
+    struct task* tail;
+};
+
+struct cpu
+{
+    int id;
+
+    // The local APIC of the processor, interrupts are sent here
+    uint8_t apic_id;
+
+    // The task running on this processor
+    struct task* current_task;
+
+    // Holds this processor's kernel stack for interrupts from user land
+    struct tss tss;
+
+    // Runnable tasks queued by priority, bit n of the map is set while level n has tasks
+    struct cpu_runqueue runqueues[PEACHOS_TASK_PRIORITY_LEVELS];
+    uint32_t runqueue_map;
+    struct spinlock lock;
+
+    // Tick count up to which running time has been charged to tasks
+    uint32_t accounted_ticks;
+
+    // The task whose state the FPU registers hold, fpu_trap mirrors CR0.TS
+    struct task* fpu_owner;
+    bool fpu_trap;
+};
+
+extern struct cpu cpus[PEACHOS_MAX_CPUS];
+
+void cpu_init();
+struct cpu* cpu_current();
+int cpu_tss_selector(struct cpu* cpu);
+
+uint32_t cpu_features();
+void cpu_write_msr(uint32_t msr, uint32_t low, uint32_t high);
+
+#endif
@@ -0,0 +1,129 @@
+#include "fdtable.h"
+#include "process.h"
+#include "status.h"
+#include "fs/file.h"
+#include "memory/heap/kheap.h"
+
+#define FDTABLE_MAP_WORDS (PEACHOS_MAX_PROCESS_FILES / 32)
+
+// Descriptors below this are the console of the process
+#define FDTABLE_FIRST_FILE 3
+
+static struct fd_table* fdtable_new()
+{
+    struct fd_table* table = kzalloc(sizeof(struct fd_table));
+    if (table)
+    {
+        table->map[0] = (1 << FDTABLE_FIRST_FILE) - 1;
+    }
+    return table;
+}
+
+/**
+ * Gives the kernel descriptor the lowest free descriptor of the process, which takes over the
+ * reference the caller holds on it. The table is created with the first file
+ */
+int fdtable_install(struct process* process, int kernel_fd, uint32_t pos)
+{
+    if (!process->files)
+    {
+        process->files = fdtable_new();
+        if (!process->files)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    struct fd_table* table = process->files;
+    for (int word = 0; word < FDTABLE_MAP_WORDS; word++)
+    {
+        if (table->map[word] == 0xffffffff)
+        {
+            continue;
+        }
+
+        int fd = word * 32 + __builtin_ctz(~table->map[word]);
+        table->map[word] |= 1U << (fd % 32);
+        table->files[fd].fd = kernel_fd;
+        table->files[fd].pos = pos;
+        return fd;
+    }
+
+    return -EISTKN;
+}
+
+struct process_file* fdtable_get(struct process* process, int fd)
+{
+    struct fd_table* table = process->files;
+    if (!table || fd < FDTABLE_FIRST_FILE || fd >= PEACHOS_MAX_PROCESS_FILES ||
+        !(table->map[fd / 32] & (1U << (fd % 32))))
+    {
+        return 0;
+    }
+
+    return &table->files[fd];
+}
+
+int fdtable_close(struct process* process, int fd)
+{
+    struct process_file* file = fdtable_get(process, fd);
+    if (!file)
+    {
+        return -EINVARG;
+    }
+
+    process->files->map[fd / 32] &= ~(1U << (fd % 32));
+    return fclose(file->fd);
+}
+
+/**
+ * The child gets the same files, each with its own position
+ */
+int fdtable_fork(struct process* parent, struct process* child)
+{
+    if (!parent->files)
+    {
+        return 0;
+    }
+
+    child->files = fdtable_new();
+    if (!child->files)
+    {
+        return -ENOMEM;
+    }
+
+    for (int fd = FDTABLE_FIRST_FILE; fd < PEACHOS_MAX_PROCESS_FILES; fd++)
+    {
+        if (!fdtable_get(parent, fd) || fdup(parent->files->files[fd].fd) < 0)
+        {
+            continue;
+        }
+
+        child->files->files[fd] = parent->files->files[fd];
+        child->files->map[fd / 32] |= 1U << (fd % 32);
+    }
+
+    return 0;
+}
+
+/**
+ * Closes every file of a terminating process
+ */
+void fdtable_free(struct process* process)
+{
+    if (!process->files)
+    {
+        return;
+    }
+
+    for (int fd = FDTABLE_FIRST_FILE; fd < PEACHOS_MAX_PROCESS_FILES; fd++)
+    {
+        if (fdtable_get(process, fd))
+        {
+            fdtable_close(process, fd);
+        }
+    }
+
+    kfree(process->files);
+    process->files = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct process;
+
+// A file the process has open, it refers to a descriptor of the kernel file table
+struct process_file
+{
+    int fd;
+    // Where the next read or write happens, pipes ignore it
+    uint32_t pos;
+};
+
+// The files of a process by descriptor, 0 to 2 are the console and never used here
+struct fd_table
+{
+    struct process_file files[PEACHOS_MAX_PROCESS_FILES];
+    // Bit n is set while descriptor n is taken
+    uint32_t map[PEACHOS_MAX_PROCESS_FILES / 32];
+};
+
+int fdtable_install(struct process* process, int kernel_fd, uint32_t pos);
+struct process_file* fdtable_get(struct process* process, int fd);
+int fdtable_close(struct process* process, int fd);
+int fdtable_fork(struct process* parent, struct process* child);
+void fdtable_free(struct process* process);
+
+#endif
@@ -0,0 +1,69 @@
+section .asm
+
+global fpu_enable
+global fpu_disable
+global fpu_set_task_switched
+global fpu_clear_task_switched
+global fpu_save
+global fpu_restore
+global fpu_reset
+
+CR0_MP equ 1 << 1
+CR0_EM equ 1 << 2
+CR0_TS equ 1 << 3
+CR0_NE equ 1 << 5
+CR4_OSFXSR equ 1 << 9
+CR4_OSXMMEXCPT equ 1 << 10
+
+; void fpu_enable();
+; Turns the FPU and SSE on with TS set, so the first instruction that uses them traps
+fpu_enable:
+    mov eax, cr0
+    and eax, ~CR0_EM
+    or eax, CR0_MP | CR0_NE | CR0_TS
+    mov cr0, eax
+    mov eax, cr4
+    or eax, CR4_OSFXSR | CR4_OSXMMEXCPT
+    mov cr4, eax
+    ret
+
+; void fpu_disable();
+; Every FPU instruction raises #NM from now on
+fpu_disable:
+    mov eax, cr0
+    or eax, CR0_EM
+    mov cr0, eax
+    ret
+
+; void fpu_set_task_switched();
+fpu_set_task_switched:
+    mov eax, cr0
+    or eax, CR0_TS
+    mov cr0, eax
+    ret
+
+; void fpu_clear_task_switched();
+fpu_clear_task_switched:
+    clts
+    ret
+
+; void fpu_save(void* state);
+fpu_save:
+    mov eax, [esp+4]
+    fxsave [eax]
+    ret
+
+; void fpu_restore(void* state);
+fpu_restore:
+    mov eax, [esp+4]
+    fxrstor [eax]
+    ret
+
+; void fpu_reset();
+; The state a task starts with, every exception masked and round to nearest
+fpu_reset:
+    fninit
+    push dword 0x1f80
+    ldmxcsr [esp]
+    add esp, 4
+    ret
@@ -0,0 +1,110 @@
+#include "fpu.h"
+#include "task.h"
+#include "cpu.h"
+#include "idt/idt.h"
+#include "memory/memory.h"
+#include "kernel.h"
+
+/**
+ * #NM, the running task touched the FPU while the registers still hold another task's state.
+ * The other state is saved only now, so tasks that never use the FPU never pay for it
+ */
+static void fpu_device_not_available(struct interrupt_frame* frame)
+{
+    struct cpu* cpu = cpu_current();
+    struct task* task = cpu->current_task;
+    fpu_clear_task_switched();
+    cpu->fpu_trap = false;
+    if (cpu->fpu_owner == task)
+    {
+        return;
+    }
+
+    if (cpu->fpu_owner)
+    {
+        fpu_save(cpu->fpu_owner->fpu_state);
+    }
+
+    if (task->fpu_used)
+    {
+        fpu_restore(task->fpu_state);
+    }
+    else
+    {
+        fpu_reset();
+        task->fpu_used = true;
+    }
+    cpu->fpu_owner = task;
+}
+
+void fpu_init()
+{
+    // Without FXSAVE there is nowhere to keep the SSE registers, any FPU use ends the process
+    if (!(cpu_features() & CPU_FEATURE_FXSR))
+    {
+        fpu_disable();
+        return;
+    }
+
+    fpu_enable();
+    cpu_current()->fpu_trap = true;
+    idt_register_interrupt_callback(0x07, fpu_device_not_available);
+}
+
+/**
+ * Called whenever the processor is about to run task, only the owner of the loaded state
+ * may use the FPU without trapping. CR0 is only written when that changes
+ */
+void fpu_switch(struct cpu* cpu, struct task* task)
+{
+    bool trap = task != cpu->fpu_owner;
+    if (trap == cpu->fpu_trap)
+    {
+        return;
+    }
+
+    cpu->fpu_trap = trap;
+    if (trap)
+    {
+        fpu_set_task_switched();
+    }
+    else
+    {
+        fpu_clear_task_switched();
+    }
+}
+
+/**
+ * A forked task carries on with the FPU state of its parent
+ */
+void fpu_copy(struct task* dst, struct task* src)
+{
+    struct cpu* cpu = cpu_current();
+    if (!src->fpu_used)
+    {
+        return;
+    }
+
+    if (cpu->fpu_owner == src)
+    {
+        // The registers are newer than the saved copy, fxsave needs TS clear
+        fpu_clear_task_switched();
+        fpu_save(src->fpu_state);
+        if (cpu->fpu_trap)
+        {
+            fpu_set_task_switched();
+        }
+    }
+
+    memcpy(dst->fpu_state, src->fpu_state, FPU_STATE_SIZE);
+    dst->fpu_used = true;
+}
+
+void fpu_release(struct task* task)
+{
+    struct cpu* cpu = cpu_current();
+    if (cpu->fpu_owner == task)
+    {
+        cpu->fpu_owner = 0;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// FXSAVE stores the x87, MMX and SSE registers in 512 bytes aligned to 16
+#define FPU_STATE_SIZE 512
+
+struct task;
+struct cpu;
+
+void fpu_init();
+void fpu_switch(struct cpu* cpu, struct task* task);
+void fpu_copy(struct task* dst, struct task* src);
+void fpu_release(struct task* task);
+
+void fpu_enable();
+void fpu_disable();
+void fpu_set_task_switched();
+void fpu_clear_task_switched();
+void fpu_save(void* state);
+void fpu_restore(void* state);
+void fpu_reset();
+
+#endif
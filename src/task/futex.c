@@ -0,0 +1,132 @@
+#include "futex.h"
+#include "task.h"
+#include "process.h"
+#include "config.h"
+#include "status.h"
+#include "memory/heap/kheap.h"
+
+static struct futex* futex_buckets[PEACHOS_FUTEX_HASH_BUCKETS];
+
+static struct futex** futex_bucket(struct process* process, uint32_t address)
+{
+    uint32_t hash = ((address >> 2) ^ ((uint32_t) process * 0x9E3779B1)) & (PEACHOS_FUTEX_HASH_BUCKETS - 1);
+    return &futex_buckets[hash];
+}
+
+static struct futex* futex_find(struct process* process, uint32_t address)
+{
+    for (struct futex* futex = *futex_bucket(process, address); futex; futex = futex->next)
+    {
+        if (futex->process == process && futex->address == address)
+        {
+            return futex;
+        }
+    }
+
+    return 0;
+}
+
+static void futex_unlink(struct futex* futex)
+{
+    struct futex** link = futex_bucket(futex->process, futex->address);
+    while (*link)
+    {
+        if (*link == futex)
+        {
+            *link = futex->next;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/**
+ * Puts the current task to sleep on the address as long as it still holds expected, it returns
+ * at once otherwise. Callers check the value again either way. Must be called with interrupts
+ * disabled from a task that can block
+ */
+int futex_wait(struct process* process, void* address, int expected)
+{
+    if ((uint32_t) address % sizeof(int))
+    {
+        return -EINVARG;
+    }
+
+    int value = 0;
+    int res = copy_from_task(task_current(), &value, address, sizeof(value));
+    if (res < 0 || value != expected)
+    {
+        return res;
+    }
+
+    if (!task_can_block())
+    {
+        return -EIO;
+    }
+
+    struct futex* futex = futex_find(process, (uint32_t) address);
+    if (!futex)
+    {
+        futex = kzalloc(sizeof(struct futex));
+        if (!futex)
+        {
+            return -ENOMEM;
+        }
+
+        struct futex** bucket = futex_bucket(process, (uint32_t) address);
+        futex->process = process;
+        futex->address = (uint32_t) address;
+        futex->next = *bucket;
+        *bucket = futex;
+    }
+
+    futex->sleepers++;
+    wait_queue_sleep(&futex->waiters);
+    futex->sleepers--;
+
+    if (futex->sleepers == 0)
+    {
+        futex_unlink(futex);
+        kfree(futex);
+    }
+    return 0;
+}
+
+/**
+ * Wakes up to count tasks waiting on the address, returns how many were woken
+ */
+int futex_wake(struct process* process, void* address, int count)
+{
+    struct futex* futex = futex_find(process, (uint32_t) address);
+    int woken = 0;
+    while (futex && futex->waiters.head && woken < count)
+    {
+        wait_queue_wake_one(&futex->waiters);
+        woken++;
+    }
+
+    return woken;
+}
+
+/**
+ * Forgets every futex of a terminating process, the tasks sleeping on them go with it
+ */
+void futex_release_process(struct process* process)
+{
+    for (int i = 0; i < PEACHOS_FUTEX_HASH_BUCKETS; i++)
+    {
+        struct futex** link = &futex_buckets[i];
+        while (*link)
+        {
+            struct futex* futex = *link;
+            if (futex->process != process)
+            {
+                link = &futex->next;
+                continue;
+            }
+
+            *link = futex->next;
+            kfree(futex);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+#include "waitqueue.h"
+
+struct process;
+
+// The tasks of a process waiting on one user address, it exists while anyone waits
+struct futex
+{
+    struct process* process;
+    uint32_t address;
+
+    struct wait_queue waiters;
+    // Tasks between going to sleep and getting back out of futex_wait
+    int sleepers;
+
+    struct futex* next;
+};
+
+int futex_wait(struct process* process, void* address, int expected);
+int futex_wake(struct process* process, void* address, int count);
+void futex_release_process(struct process* process);
+
+#endif
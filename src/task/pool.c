@@ -0,0 +1,137 @@
+#include "pool.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+#include "task/spinlock.h"
+
+/**
+ * Page directories ready for a new process, they share the kernel mappings and have nothing
+ * mapped in the user stack range yet. Directories of processes that exit go back in here
+ */
+static struct paging_4gb_chunk* pool[PEACHOS_PROCESS_POOL_SIZE];
+static int pool_count = 0;
+static struct spinlock pool_lock;
+
+/**
+ * Unmaps every page the stack grew into, pages still shared with a forked process stay with it
+ */
+static void pool_release_stack(uint32_t* directory)
+{
+    for (uint32_t virt = PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END; virt < PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START; virt += PAGING_PAGE_SIZE)
+    {
+        uint32_t entry = paging_get(directory, (void*) virt);
+        if (!(entry & PAGING_IS_PRESENT))
+        {
+            continue;
+        }
+
+        paging_set(directory, (void*) virt, 0x00);
+        cow_page_put((void*)(entry & 0xfffff000));
+    }
+}
+
+/**
+ * Takes the stack range and the guard page below it out of the identity map the directory came
+ * with, so the stack faults in a page at a time as it grows and an overflow faults for good
+ */
+static int pool_clear_stack(uint32_t* directory)
+{
+    int res = 0;
+    for (uint32_t virt = PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END - PAGING_PAGE_SIZE; virt < PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START; virt += PAGING_PAGE_SIZE)
+    {
+        res = paging_set(directory, (void*) virt, 0x00);
+        if (res < 0)
+        {
+            break;
+        }
+    }
+
+    return res;
+}
+
+static void pool_free(struct paging_4gb_chunk* directory)
+{
+    pool_release_stack(paging_4gb_chunk_get_directory(directory));
+    paging_free_4gb(directory);
+}
+
+static struct paging_4gb_chunk* pool_new()
+{
+    struct paging_4gb_chunk* directory = paging_new_4gb(PAGING_IS_PRESENT | PAGING_IS_WRITEABLE);
+    if (!directory)
+    {
+        return 0;
+    }
+
+    if (pool_clear_stack(paging_4gb_chunk_get_directory(directory)) < 0)
+    {
+        paging_free_4gb(directory);
+        return 0;
+    }
+
+    return directory;
+}
+
+/**
+ * Builds directories until the pool is full. Nothing waits for it at boot, the scheduler
+ * calls this when it would otherwise sit idle
+ */
+int pool_fill()
+{
+    while (pool_count < PEACHOS_PROCESS_POOL_SIZE)
+    {
+        struct paging_4gb_chunk* directory = pool_new();
+        if (!directory)
+        {
+            return -ENOMEM;
+        }
+        pool[pool_count++] = directory;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns a page directory ready for a new process, a new one is built when the pool is empty
+ */
+struct paging_4gb_chunk* pool_get()
+{
+    struct paging_4gb_chunk* directory = 0;
+    spinlock_acquire(&pool_lock);
+    if (pool_count > 0)
+    {
+        directory = pool[--pool_count];
+    }
+    spinlock_release(&pool_lock);
+
+    if (!directory)
+    {
+        directory = pool_new();
+    }
+
+    return directory;
+}
+
+/**
+ * Takes back the directory of a process whose memory is released except for its stack. It must
+ * not be loaded on any processor
+ */
+void pool_put(struct paging_4gb_chunk* directory)
+{
+    pool_release_stack(paging_4gb_chunk_get_directory(directory));
+
+    spinlock_acquire(&pool_lock);
+    if (pool_count < PEACHOS_PROCESS_POOL_SIZE)
+    {
+        pool[pool_count++] = directory;
+        directory = 0;
+    }
+    spinlock_release(&pool_lock);
+
+    if (directory)
+    {
+        pool_free(directory);
+    }
+}
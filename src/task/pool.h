@@ -0,0 +1,10 @@
+#ifndef POOL_H
+#define POOL_H
+
+struct paging_4gb_chunk;
+
+int pool_fill();
+struct paging_4gb_chunk* pool_get();
+void pool_put(struct paging_4gb_chunk* directory);
+
+#endif
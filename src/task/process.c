@@ -6,21 +6,141 @@
 #include "string/string.h"
 #include "fs/file.h"
 #include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
 #include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+#include "task/spinlock.h"
 #include "loader/formats/elfloader.h"
+#include "loader/exectable.h"
+#include "task/thread.h"
+#include "task/futex.h"
+#include "memory/shm/shm.h"
+#include "task/fdtable.h"
+#include "task/fpu.h"
+#include "keyboard/keyboard.h"
 #include "kernel.h"
+#include "stats/stats.h"
 
 // The current process that is running
 struct process* current_process = 0;
 
-static struct process* processes[PEACHOS_MAX_PROCESSES] = {};
+// Every process by id, the table doubles whenever an id past its end is handed out
+static struct process** processes = 0;
+static int process_table_size = 0;
+static struct spinlock process_table_lock;
+
+#define PROCESS_ID_MAP_WORDS (PEACHOS_MAX_PROCESSES / 32)
+
+// Bit n is set while process id n is in use, no word below the hint has a free id
+static uint32_t process_id_map[PROCESS_ID_MAP_WORDS];
+static int process_id_hint = 0;
+
+// Processes that exited and still hold their memory, oldest first
+static struct process* process_reap_head = 0;
+static struct process* process_reap_tail = 0;
+static int process_reap_count = 0;
 
 int process_free_process(struct process* process);
+static int process_load_for_id(const char* filename, struct process** process, int process_id);
+
+/**
+ * Makes the process table big enough for the id, must be called with the table lock held
+ */
+static int process_table_grow(int id)
+{
+    int size = process_table_size ? process_table_size : PEACHOS_PROCESS_TABLE_INITIAL_SIZE;
+    while (size <= id)
+    {
+        size *= 2;
+    }
+
+    if (size == process_table_size)
+    {
+        return 0;
+    }
 
+    struct process** table = kzalloc(sizeof(struct process*) * size);
+    if (!table)
+    {
+        return -ENOMEM;
+    }
+
+    if (processes)
+    {
+        memcpy(table, processes, sizeof(struct process*) * process_table_size);
+        kfree(processes);
+    }
+    processes = table;
+    process_table_size = size;
+    return 0;
+}
+
+/**
+ * Reserves the lowest free process id that is at least lowest, which is zero or one
+ */
+static int process_id_alloc(int lowest)
+{
+    int res = -EISTKN;
+    spinlock_acquire(&process_table_lock);
+    for (int word = process_id_hint; word < PROCESS_ID_MAP_WORDS; word++)
+    {
+        uint32_t free = ~process_id_map[word];
+        if (word == 0)
+        {
+            free &= ~((1 << lowest) - 1);
+        }
+
+        if (!free)
+        {
+            continue;
+        }
+
+        int id = word * 32 + __builtin_ctz(free);
+        res = process_table_grow(id);
+        if (res < 0)
+        {
+            break;
+        }
+
+        process_id_map[word] |= 1 << (id % 32);
+        res = id;
+        break;
+    }
+
+    while (process_id_hint < PROCESS_ID_MAP_WORDS && process_id_map[process_id_hint] == 0xffffffff)
+    {
+        process_id_hint++;
+    }
+    spinlock_release(&process_table_lock);
+    return res;
+}
+
+static void process_id_free(int id)
+{
+    spinlock_acquire(&process_table_lock);
+    processes[id] = 0x00;
+    process_id_map[id / 32] &= ~(1 << (id % 32));
+    if (id / 32 < process_id_hint)
+    {
+        process_id_hint = id / 32;
+    }
+    spinlock_release(&process_table_lock);
+}
+
+/**
+ * Makes a fully loaded process visible under the id it reserved
+ */
+static void process_publish(struct process* process)
+{
+    spinlock_acquire(&process_table_lock);
+    processes[process->id] = process;
+    spinlock_release(&process_table_lock);
+}
 
 static void process_init(struct process* process)
 {
     memset(process, 0, sizeof(struct process));
+    process->brk = PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_START;
 }
 
 struct process* process_current()
@@ -30,12 +150,38 @@ struct process* process_current()
 
 struct process* process_get(int process_id)
 {
-    if (process_id < 0 || process_id >= PEACHOS_MAX_PROCESSES)
+    struct process* process = NULL;
+    spinlock_acquire(&process_table_lock);
+    if (process_id >= 0 && process_id < process_table_size)
     {
-        return NULL;
+        process = processes[process_id];
     }
+    spinlock_release(&process_table_lock);
+    return process;
+}
+
+/**
+ * Fills out with up to max of the running processes in id order, returns how many
+ */
+int process_get_stats(struct stats_process* out, int max)
+{
+    int total = 0;
+    spinlock_acquire(&process_table_lock);
+    for (int i = 0; i < process_table_size && total < max; i++)
+    {
+        struct process* process = processes[i];
+        if (!process)
+        {
+            continue;
+        }
 
-    return processes[process_id];
+        out[total].id = process->id;
+        out[total].ticks = process->ticks;
+        strncpy(out[total].name, process->filename, sizeof(out[total].name));
+        total++;
+    }
+    spinlock_release(&process_table_lock);
+    return total;
 }
 
 int process_switch(struct process* process)
@@ -44,104 +190,600 @@ int process_switch(struct process* process)
     return 0;
 }
 
-static int process_find_free_allocation_index(struct process* process)
+
+/**
+ * Unmaps every page of the range and drops the reference the process held on it, pages
+ * shared with a forked process stay with the other one
+ */
+static void process_release_range(struct process* process, void* virt, uint32_t size)
 {
-    int res = -ENOMEM;
-    for (int i = 0; i < PEACHOS_MAX_PROGRAM_ALLOCATIONS; i++)
+    uint32_t* directory = paging_4gb_chunk_get_directory(process->task->page_directory);
+    for (uint32_t offset = 0; offset < size; offset += PAGING_PAGE_SIZE)
     {
-        if (process->allocations[i].ptr == 0)
+        uint32_t entry = paging_get(directory, virt + offset);
+        if (!(entry & PAGING_IS_PRESENT))
         {
-            res = i;
-            break;
+            continue;
         }
-    }
 
-    return res;
+        paging_set(directory, virt + offset, 0x00);
+        cow_page_put((void*)(entry & 0xfffff000));
+    }
 }
 
+/**
+ * Allocates zeroed memory for the process. Every page is a frame mapped on its own, the memory
+ * does not have to be contiguous anywhere but in the process
+ */
 void* process_malloc(struct process* process, size_t size)
 {
-    void* ptr = kzalloc(size);
-    if (!ptr)
+    uint32_t total = (uint32_t) paging_align_address((void*) size);
+    if (!size || total < size)
     {
-        goto out_err;
+        return 0;
     }
 
-    int index = process_find_free_allocation_index(process);
-    if (index < 0)
+    struct vma* vma = kzalloc(sizeof(struct vma));
+    if (!vma)
     {
-        goto out_err;
+        return 0;
     }
 
-    int res = paging_map_to(process->task->page_directory, ptr, ptr, paging_align_address(ptr+size), PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
-    if (res < 0)
+    uint32_t virt = vma_find_free(&process->vmas, PEACHOS_PROCESS_HEAP_VIRTUAL_ADDRESS_START, PEACHOS_PROCESS_HEAP_VIRTUAL_ADDRESS_END, total);
+    if (!virt)
     {
-        goto out_err;
+        kfree(vma);
+        return 0;
     }
 
-    process->allocations[index].ptr = ptr;
-    process->allocations[index].size = size;
-    return ptr;
+    vma->start = virt;
+    vma->end = virt + total;
+    vma->type = VMA_TYPE_ALLOCATION;
+    vma_insert(&process->vmas, vma);
+    for (uint32_t offset = 0; offset < total; offset += PAGING_PAGE_SIZE)
+    {
+        void* page = frame_zalloc();
+        if (!page)
+        {
+            goto out_err;
+        }
+
+        if (paging_map(process->task->page_directory, (void*)(virt + offset), page, PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL) < 0)
+        {
+            frame_free(page);
+            goto out_err;
+        }
+    }
+
+    return (void*) virt;
 
 out_err:
-    if(ptr)
+    // Gives back the frames mapped so far along with the range
+    process_release_vma(process, vma);
+    return 0;
+}
+
+/**
+ * Moves the end of the sbrk region by increment bytes and returns where it was. Growing only
+ * reserves the range, the pages are allocated as the process touches them
+ */
+void* process_sbrk(struct process* process, int increment)
+{
+    uint32_t old_brk = process->brk;
+    uint32_t new_brk = old_brk + increment;
+    if ((increment > 0 && new_brk < old_brk) || (increment < 0 && new_brk > old_brk) ||
+        new_brk < PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_START || new_brk > PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_END)
     {
-        kfree(ptr);
+        return ERROR(-ENOMEM);
     }
-    return 0;
+
+    if (increment < 0)
+    {
+        // Give back the pages that are no longer part of the region
+        uint32_t start = (uint32_t) paging_align_address((void*) new_brk);
+        uint32_t end = (uint32_t) paging_align_address((void*) old_brk);
+        process_release_range(process, (void*) start, end - start);
+    }
+
+    process->brk = new_brk;
+    return (void*) old_brk;
 }
 
-static bool process_is_process_pointer(struct process* process, void* ptr)
+/**
+ * Returns true when the page at virt holds plain anonymous memory of the process, only those
+ * pages can be handed to or taken from a pipe without copying
+ */
+static bool process_page_is_anonymous(struct process* process, void* virt)
 {
-    for (int i = 0; i < PEACHOS_MAX_PROGRAM_ALLOCATIONS; i++)
+    struct vma* vma = vma_find(&process->vmas, (uint32_t) virt);
+    if (!vma)
+    {
+        return false;
+    }
+
+    switch (vma->type)
     {
-        if (process->allocations[i].ptr == ptr)
+        case VMA_TYPE_BRK:
+            return (uint32_t) virt + PAGING_PAGE_SIZE <= (uint32_t) paging_align_address((void*) process->brk);
+
+        case VMA_TYPE_STACK:
+        case VMA_TYPE_THREAD_STACK:
             return true;
     }
 
     return false;
 }
 
-static void process_allocation_unjoin(struct process* process, void* ptr)
+/**
+ * Takes a reference on the anonymous page at virt and turns it copy on write in the process, so
+ * the page keeps what it holds now. Returns the page or NULL if it cannot be lent
+ */
+void* process_lend_page(struct process* process, void* virt)
+{
+    if (!paging_is_aligned(virt) || !process_page_is_anonymous(process, virt) ||
+        task_check_user_range(process->task, virt, PAGING_PAGE_SIZE, false) < 0)
+    {
+        return 0;
+    }
+
+    uint32_t* directory = paging_4gb_chunk_get_directory(process->task->page_directory);
+    uint32_t entry = paging_get(directory, virt);
+    if (entry & PAGING_IS_WRITEABLE)
+    {
+        entry = (entry & ~PAGING_IS_WRITEABLE) | PAGING_IS_COPY_ON_WRITE;
+        if (paging_set(directory, virt, entry) < 0)
+        {
+            return 0;
+        }
+    }
+
+    void* page = (void*)(entry & 0xfffff000);
+    cow_page_get(page);
+    return page;
+}
+
+/**
+ * Maps a lent page over the anonymous page at virt, the reference on it passes to the process.
+ * It is mapped copy on write since the lender may still see it
+ */
+int process_adopt_page(struct process* process, void* virt, void* page)
+{
+    if (!paging_is_aligned(virt) || !process_page_is_anonymous(process, virt))
+    {
+        return -EINVARG;
+    }
+
+    uint32_t* directory = paging_4gb_chunk_get_directory(process->task->page_directory);
+    uint32_t old_entry = paging_get(directory, virt);
+    int res = paging_set(directory, virt, (uint32_t) page | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_COPY_ON_WRITE);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    if (old_entry & PAGING_IS_PRESENT)
+    {
+        cow_page_put((void*)(old_entry & 0xfffff000));
+    }
+    return 0;
+}
+
+static struct vma* process_get_allocation(struct process* process, void* addr)
+{
+    struct vma* vma = vma_find(&process->vmas, (uint32_t) addr);
+    if (!vma || vma->type != VMA_TYPE_ALLOCATION || vma->start != (uint32_t) addr)
+    {
+        return 0;
+    }
+
+    return vma;
+}
+
+static struct process_mapping* process_get_mapping(struct process* process, void* address)
+{
+    struct vma* vma = vma_find(&process->vmas, (uint32_t) address);
+    if (!vma || vma->type != VMA_TYPE_MAPPING)
+    {
+        return 0;
+    }
+
+    return (struct process_mapping*) vma;
+}
+
+/**
+ * Finds room for size bytes in the mmap range of the process, first fit
+ */
+static void* process_find_mapping_address(struct process* process, uint32_t size)
+{
+    return (void*) vma_find_free(&process->vmas, PEACHOS_MMAP_VIRTUAL_ADDRESS_START, PEACHOS_MMAP_VIRTUAL_ADDRESS_END, size);
+}
+
+static struct process_mapping* process_new_mapping(void* virt, uint32_t size)
+{
+    struct process_mapping* mapping = kzalloc(sizeof(struct process_mapping));
+    if (mapping)
+    {
+        mapping->vma.start = (uint32_t) virt;
+        mapping->vma.end = (uint32_t) virt + size;
+        mapping->vma.type = VMA_TYPE_MAPPING;
+    }
+    return mapping;
+}
+
+/**
+ * Maps size bytes of the file starting at offset into the process, zero maps the rest of the
+ * file. Nothing is read yet, the page fault handler reads each page on first touch. Pages past
+ * the end of the file read as zero and writes to the mapping are never written to the file
+ */
+void* process_mmap(struct process* process, const char* filename, uint32_t offset, uint32_t size)
+{
+    int res = 0;
+    struct process_mapping* mapping = 0;
+    if (offset % PAGING_PAGE_SIZE)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    int fd = fopen(filename, "r");
+    if (fd <= 0)
+    {
+        res = -EIO;
+        goto out;
+    }
+
+    struct file_stat stat;
+    res = fstat(fd, &stat);
+    if (res < 0)
+    {
+        fclose(fd);
+        goto out;
+    }
+
+    if (size == 0)
+    {
+        size = offset < stat.filesize ? stat.filesize - offset : 0;
+    }
+
+    size = (uint32_t) paging_align_address((void*) size);
+    void* virt = size ? process_find_mapping_address(process, size) : 0;
+    mapping = virt ? process_new_mapping(virt, size) : 0;
+    if (!mapping)
+    {
+        fclose(fd);
+        res = -ENOMEM;
+        goto out;
+    }
+
+    mapping->fd = fd;
+    mapping->offset = offset;
+    mapping->file_end = stat.filesize;
+    mapping->flags = PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+    mapping->owns_file = true;
+    vma_insert(&process->vmas, &mapping->vma);
+out:
+    if (res < 0)
+    {
+        return 0;
+    }
+    return virt;
+}
+
+static void process_unmap(struct process* process, struct process_mapping* mapping)
 {
-    for (int i = 0; i < PEACHOS_MAX_PROGRAM_ALLOCATIONS; i++)
+    uint32_t* directory = paging_4gb_chunk_get_directory(process->task->page_directory);
+    for (uint32_t virt = mapping->vma.start; virt < mapping->vma.end; virt += PAGING_PAGE_SIZE)
     {
-        if (process->allocations[i].ptr == ptr)
+        uint32_t entry = paging_get(directory, (void*) virt);
+        if (!(entry & PAGING_IS_PRESENT))
         {
-            process->allocations[i].ptr = 0x00;
-            process->allocations[i].size = 0;
+            // Never touched
+            continue;
         }
+
+        paging_set(directory, (void*) virt, 0x00);
+        // Pages of the page cache go back to it, the cache holds its own reference
+        cow_page_put((void*)(entry & 0xfffff000));
     }
+
+    if (mapping->owns_file)
+    {
+        fclose(mapping->fd);
+    }
+    vma_remove(&process->vmas, &mapping->vma);
+    kfree(mapping);
 }
 
-static struct process_allocation* process_get_allocation_by_addr(struct process* process, void* addr)
+int process_munmap(struct process* process, void* virt)
 {
-    for (int i = 0; i < PEACHOS_MAX_PROGRAM_ALLOCATIONS; i++)
+    struct process_mapping* mapping = process_get_mapping(process, virt);
+    if (!mapping || mapping->vma.start != (uint32_t) virt)
     {
-        if (process->allocations[i].ptr == addr)
-            return &process->allocations[i];
+        return -EINVARG;
     }
 
+    process_unmap(process, mapping);
     return 0;
 }
 
+/**
+ * Maps every frame of the shared memory object at the mapping, each mapping holds a reference
+ * on the frames so they outlive the object as long as anyone maps them
+ */
+static int process_shm_map_pages(struct process* process, struct process_shm_mapping* mapping)
+{
+    int res = 0;
+    for (uint32_t offset = 0; offset < mapping->shm->size; offset += PAGING_PAGE_SIZE)
+    {
+        void* page = mapping->shm->pages[offset / PAGING_PAGE_SIZE];
+        res = paging_map(process->task->page_directory, (void*) mapping->vma.start + offset, page, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL);
+        if (res < 0)
+        {
+            break;
+        }
+        cow_page_get(page);
+    }
+
+    return res;
+}
+
+static struct process_shm_mapping* process_new_shm_mapping(struct process* process, void* virt, struct shm* shm)
+{
+    struct process_shm_mapping* mapping = kzalloc(sizeof(struct process_shm_mapping));
+    if (!mapping)
+    {
+        return 0;
+    }
+
+    mapping->vma.start = (uint32_t) virt;
+    mapping->vma.end = (uint32_t) virt + shm->size;
+    mapping->vma.type = VMA_TYPE_SHARED;
+    mapping->shm = shm;
+    vma_insert(&process->vmas, &mapping->vma);
+    return mapping;
+}
+
+/**
+ * Maps the shared memory object into the mmap range of the process. The mapping takes over the
+ * reference the caller holds on the object, it is dropped on failure. Returns NULL on failure
+ */
+void* process_shm_map(struct process* process, struct shm* shm)
+{
+    void* virt = process_find_mapping_address(process, shm->size);
+    struct process_shm_mapping* mapping = virt ? process_new_shm_mapping(process, virt, shm) : 0;
+    if (!mapping)
+    {
+        shm_put(shm);
+        return 0;
+    }
+
+    if (process_shm_map_pages(process, mapping) < 0)
+    {
+        process_release_vma(process, &mapping->vma);
+        return 0;
+    }
+
+    return virt;
+}
+
+int process_shm_unmap(struct process* process, void* virt)
+{
+    struct vma* vma = vma_find(&process->vmas, (uint32_t) virt);
+    if (!vma || vma->type != VMA_TYPE_SHARED || vma->start != (uint32_t) virt)
+    {
+        return -EINVARG;
+    }
+
+    process_release_vma(process, vma);
+    return 0;
+}
+
+/**
+ * Takes the region out of the process and frees whatever backs it
+ */
+void process_release_vma(struct process* process, struct vma* vma)
+{
+    switch (vma->type)
+    {
+        case VMA_TYPE_MAPPING:
+            process_unmap(process, (struct process_mapping*) vma);
+            return;
+
+        case VMA_TYPE_ALLOCATION:
+            process_release_range(process, (void*) vma->start, vma->end - vma->start);
+            vma_remove(&process->vmas, vma);
+            kfree(vma);
+            return;
+
+        case VMA_TYPE_SHARED:
+            process_release_range(process, (void*) vma->start, vma->end - vma->start);
+            vma_remove(&process->vmas, vma);
+            shm_put(((struct process_shm_mapping*) vma)->shm);
+            kfree(vma);
+            return;
+
+        case VMA_TYPE_BRK:
+            process_release_range(process, (void*) vma->start, (uint32_t) paging_align_address((void*) process->brk) - vma->start);
+            break;
+
+        case VMA_TYPE_STACK:
+            // The stack goes back to the process pool with the page directory
+            break;
+
+        case VMA_TYPE_THREAD_STACK:
+            process_release_range(process, (void*) vma->start, vma->end - vma->start);
+            break;
+
+        default:
+            // The program is only reached through the page tables once mapped
+            if (process->mapped)
+            {
+                process_release_range(process, (void*) vma->start, vma->end - vma->start);
+            }
+            break;
+    }
+
+    vma_remove(&process->vmas, vma);
+}
+
+static void process_terminate_vmas(struct process* process)
+{
+    while (process->vmas.root)
+    {
+        process_release_vma(process, process->vmas.root);
+    }
+}
 
-int process_terminate_allocations(struct process* process)
+/**
+ * Returns how many bytes of the file back the mapping page at virt, file_pos is set to where
+ * they start in the file
+ */
+static uint32_t process_mapping_file_range(struct process_mapping* mapping, void* virt, uint32_t* file_pos)
 {
-    for (int i = 0; i < PEACHOS_MAX_PROGRAM_ALLOCATIONS; i++)
+    uint32_t total = 0;
+    *file_pos = mapping->offset + ((uint32_t) virt - mapping->vma.start);
+    if (*file_pos < mapping->file_end)
     {
-        if (process->allocations[i].ptr)
+        total = mapping->file_end - *file_pos;
+        if (total > PAGING_PAGE_SIZE)
         {
-            process_free(process, process->allocations[i].ptr);
+            total = PAGING_PAGE_SIZE;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Reads in the page of a file mapping that address falls in, or takes a private copy of a page
+ * shared after a fork when it is written. Anonymous pages that are only read map the zero page.
+ * Returns zero once the page is mapped, a negative value if the fault is not one we can resolve
+ */
+int process_handle_page_fault(struct process* process, void* address, uint32_t error_code)
+{
+    int res = 0;
+    void* page = 0;
+    // Declared up here as the early exits jump past where it is filled in
+    void* cached = 0;
+    if (!process)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    if (error_code & PAGING_IS_PRESENT)
+    {
+        // Only a write to a copy on write page can be resolved on a present page
+        res = -EINVARG;
+        if (error_code & PAGING_IS_WRITEABLE)
+        {
+            res = cow_break(paging_4gb_chunk_get_directory(process->task->page_directory), address);
+        }
+        goto out;
+    }
+
+    struct vma* vma = vma_find(&process->vmas, (uint32_t) address);
+    bool write = error_code & PAGING_IS_WRITEABLE;
+    if (vma && ((vma->type == VMA_TYPE_BRK && (uint32_t) address < process->brk) || vma->type == VMA_TYPE_STACK))
+    {
+        // First touch of the sbrk region or the stack growing into another page, reading it
+        // only needs the zero page
+        if (!write)
+        {
+            res = cow_map_zero_page(paging_4gb_chunk_get_directory(process->task->page_directory), paging_align_to_lower_page(address));
+            goto out;
+        }
+
+        page = frame_zalloc();
+        if (!page)
+        {
+            res = -ENOMEM;
+            goto out;
         }
+
+        res = paging_map(process->task->page_directory, paging_align_to_lower_page(address), page, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE | PAGING_ACCESS_FROM_ALL);
+        goto out;
+    }
+
+    if (!vma || vma->type != VMA_TYPE_MAPPING)
+    {
+        res = -EINVARG;
+        goto out;
+    }
+
+    struct process_mapping* mapping = (struct process_mapping*) vma;
+
+    void* virt = paging_align_to_lower_page(address);
+    uint32_t file_pos = 0;
+    uint32_t total = process_mapping_file_range(mapping, virt, &file_pos);
+
+    uint32_t length = 0;
+    if (total)
+    {
+        cached = file_get_page(mapping->fd, file_pos, &length);
+        if (ISERR(cached))
+        {
+            res = ERROR_I(cached);
+            cached = 0;
+            goto out;
+        }
+    }
+
+    if (cached && total >= length)
+    {
+        // The page shows exactly what the cache holds, map the cached page itself. A writable
+        // mapping gets its own copy the first time it is written to
+        int flags = mapping->flags;
+        if (flags & PAGING_IS_WRITEABLE)
+        {
+            flags = (flags & ~PAGING_IS_WRITEABLE) | PAGING_IS_COPY_ON_WRITE;
+        }
+
+        res = paging_map(process->task->page_directory, virt, cached, flags);
+        if (res == 0)
+        {
+            cached = 0;
+        }
+        goto out;
+    }
+
+    if (!total && !write && (mapping->flags & PAGING_IS_WRITEABLE))
+    {
+        // A page of BSS that is only read so far
+        res = cow_map_zero_page(paging_4gb_chunk_get_directory(process->task->page_directory), virt);
+        goto out;
+    }
+
+    page = frame_zalloc();
+    if (!page)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    // The mapping ends inside the page, the BSS after it starts out zeroed
+    if (cached)
+    {
+        memcpy(page, cached, total);
     }
 
-    return 0;
+    res = paging_map(process->task->page_directory, virt, page, mapping->flags);
+out:
+    if (cached)
+    {
+        cow_page_put(cached);
+    }
+    if (res < 0 && page)
+    {
+        frame_free(page);
+    }
+    return res;
 }
 
 int process_free_binary_data(struct process* process)
 {
-    if (process->ptr)
+    // Once mapped the program may be shared with a forked process, it goes with its region
+    if (!process->mapped && process->ptr)
     {
         kfree(process->ptr);
     }
@@ -178,7 +820,7 @@ int process_free_program_data(struct process* process)
 
 void process_switch_to_any()
 {
-    for (int i = 0; i < PEACHOS_MAX_PROCESSES; i++)
+    for (int i = 0; i < process_table_size; i++)
     {
         if (processes[i])
         {
@@ -193,7 +835,7 @@ void process_switch_to_any()
 
 static void process_unlink(struct process* process)
 {
-    processes[process->id] = 0x00;
+    process_id_free(process->id);
 
     if (current_process == process)
     {
@@ -204,15 +846,16 @@ static void process_unlink(struct process* process)
 int process_free_process(struct process* process)
 {
     int res = 0;
-    process_terminate_allocations(process);
-    process_free_program_data(process);
-
-    // Free the process stack memory.
-    if (process->stack)
-    {    
-        kfree(process->stack);
-        process->stack = NULL;
+    if (process->task)
+    {
+        // Allocations, mappings, the stacks, the sbrk memory and once mapped the program
+        process_terminate_vmas(process);
     }
+    // The threads go before the main task, it owns the page directory they run in
+    futex_release_process(process);
+    thread_free_all(process);
+    fdtable_free(process);
+    process_free_program_data(process);
     // Free the task
     if (process->task)
     {
@@ -220,26 +863,101 @@ int process_free_process(struct process* process)
         process->task = NULL;
     }
 
+    keyboard_free(process);
     kfree(process);
 
 out:
     return res;
 }
 
+/**
+ * Releases up to PEACHOS_PROCESS_REAP_BATCH regions of the oldest exited process, the rest of it
+ * goes with its last region. Returns true while exited processes are left
+ */
+bool process_reap()
+{
+    struct process* process = process_reap_head;
+    if (!process)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < PEACHOS_PROCESS_REAP_BATCH && process->task && process->vmas.root; i++)
+    {
+        process_release_vma(process, process->vmas.root);
+    }
+
+    if (!process->task || !process->vmas.root)
+    {
+        process_reap_head = process->reap_next;
+        if (!process_reap_head)
+        {
+            process_reap_tail = 0;
+        }
+        process_reap_count--;
+        process_free_process(process);
+    }
+
+    return process_reap_head != 0;
+}
+
+/**
+ * Ends the process, none of its tasks runs again and its files are closed straight away. The
+ * memory is left to process_reap so neither the exit nor the start of the next task waits on it
+ */
 int process_terminate(struct process* process)
 {
     // Unlink the process from the process array.
     process_unlink(process);
 
-    int res = process_free_process(process);
-    if (res < 0)
+    // The task running this stops last, closing a file may flush it to the disk and block
+    // the current task until the transfer is done
+    struct task* current = task_current();
+    for (struct process_thread* thread = process->threads; thread; thread = thread->next)
     {
-        goto out;
+        if (thread->task && thread->task != current)
+        {
+            task_stop(thread->task);
+        }
+    }
+
+    if (process->task && process->task != current)
+    {
+        task_stop(process->task);
     }
 
+    // Readers of its pipes see the end of them now and the keyboard goes to whoever reads next
+    fdtable_free(process);
+    keyboard_free(process);
 
-out:
-    return res;
+    if (current && current->process == process)
+    {
+        task_stop(current);
+    }
+
+    process->reap_next = 0;
+    if (process_reap_tail)
+    {
+        process_reap_tail->reap_next = process;
+    }
+    else
+    {
+        process_reap_head = process;
+    }
+    process_reap_tail = process;
+    process_reap_count++;
+
+    // Nothing went idle for a while, release the oldest now before memory runs out
+    while (process_reap_count > PEACHOS_PROCESS_MAX_EXITED)
+    {
+        struct process* oldest = process_reap_head;
+        while (process_reap_head == oldest)
+        {
+            process_reap();
+        }
+    }
+
+    return 0;
 }
 
 void process_get_arguments(struct process* process, int* argc, char*** argv)
@@ -248,81 +966,67 @@ void process_get_arguments(struct process* process, int* argc, char*** argv)
     *argv = process->arguments.argv;
 }
 
-int process_count_command_arguments(struct command_argument* root_argument)
+/**
+ * Places the arguments at the top of the stack of a process that has not run yet. strings holds
+ * them packed back to back with their terminators, they are copied over in one go and argv
+ * points into that copy
+ */
+int process_inject_arguments(struct process* process, const char* strings, size_t size)
 {
-    struct command_argument* current = root_argument;
-    int i = 0;
-    while(current)
+    int res = 0;
+    char* argv[PEACHOS_MAX_PROGRAM_ARGUMENTS + 1];
+    int argc = 0;
+    if (!size || size > PEACHOS_MAX_ARGUMENTS_SIZE || strings[size - 1] != 0x00)
     {
-        i++;
-        current = current->next;
+        res = -EINVARG;
+        goto out;
     }
 
-    return i;
-}
-
-
-int process_inject_arguments(struct process* process, struct command_argument* root_argument)
-{
-    int res = 0;
-    struct command_argument* current = root_argument;
-    int i = 0;
-    int argc = process_count_command_arguments(root_argument);
-    if (argc == 0)
+    uint32_t strings_address = PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START - size;
+    for (size_t offset = 0; offset < size; offset += strlen(strings + offset) + 1)
     {
-        res = -EIO;
-        goto out;
+        if (argc == PEACHOS_MAX_PROGRAM_ARGUMENTS)
+        {
+            res = -EINVARG;
+            goto out;
+        }
+        argv[argc++] = (char*) strings_address + offset;
     }
+    argv[argc] = 0;
 
-    char **argv = process_malloc(process, sizeof(const char*) * argc);
-    if (!argv)
+    // The program's own stack starts right below argv
+    uint32_t argv_address = (strings_address - (argc + 1) * sizeof(char*)) & ~0x0f;
+    res = copy_to_task(process->task, (void*) strings_address, (void*) strings, size);
+    if (res < 0)
     {
-        res = -ENOMEM;
         goto out;
     }
 
-
-    while(current)
+    res = copy_to_task(process->task, (void*) argv_address, argv, (argc + 1) * sizeof(char*));
+    if (res < 0)
     {
-        char* argument_str = process_malloc(process, sizeof(current->argument));
-        if (!argument_str)
-        {
-            res = -ENOMEM;
-            goto out;
-        }
-
-        strncpy(argument_str, current->argument, sizeof(current->argument));
-        argv[i] = argument_str;
-        current = current->next;
-        i++;
+        goto out;
     }
 
+    process->task->registers.esp = argv_address;
     process->arguments.argc = argc;
-    process->arguments.argv = argv;
+    process->arguments.argv = (char**) argv_address;
 out:
     return res;
 }
+
 void process_free(struct process* process, void* ptr)
 {
     // Unlink the pages from the process for the given address
-    struct process_allocation* allocation = process_get_allocation_by_addr(process, ptr);
+    struct vma* allocation = process_get_allocation(process, ptr);
     if (!allocation)
     {
         // Oops its not our pointer.
         return;
     }
 
-    int res = paging_map_to(process->task->page_directory, allocation->ptr, allocation->ptr, paging_align_address(allocation->ptr+allocation->size), 0x00);
-    if (res < 0)
-    {
-        return;
-    }
-
-    // Unjoin the allocation
-    process_allocation_unjoin(process, ptr);
-
-    // We can now free the memory.
-    kfree(ptr);
+    // The pages go back to the heap once no forked process shares them
+    process_release_vma(process, allocation);
 }
 
 static int process_load_binary(const char* filename, struct process* process)
@@ -343,7 +1047,7 @@ static int process_load_binary(const char* filename, struct process* process)
         goto out;
     }
 
-    program_data_ptr = kzalloc(stat.filesize);
+    program_data_ptr = kzalloc_block(stat.filesize);
     if (!program_data_ptr)
     {
         res = -ENOMEM;
@@ -376,7 +1080,7 @@ static int process_load_elf(const char* filename, struct process* process)
 {
     int res = 0;
     struct elf_file* elf_file = 0;
-    res = elf_load(filename, &elf_file);
+    res = exectable_load(filename, &elf_file);
     if (ISERR(res))
     {
         goto out;
@@ -407,6 +1111,54 @@ int process_map_binary(struct process* process)
     return res;
 }
 
+/**
+ * Reads the file part of a segment whose offset does not line up with its address into pages of
+ * its own, such a segment can not be mapped from the page cache. The BSS after it still faults in
+ */
+static int process_copy_elf_segment(struct process* process, struct process_mapping* mapping, struct elf32_phdr* phdr)
+{
+    int res = 0;
+    int fd = elf_fd(process->elf_file);
+    uint32_t file_end = phdr->p_vaddr + phdr->p_filesz;
+    for (uint32_t virt = mapping->vma.start; virt < file_end; virt += PAGING_PAGE_SIZE)
+    {
+        uint32_t from = virt < phdr->p_vaddr ? phdr->p_vaddr : virt;
+        uint32_t to = virt + PAGING_PAGE_SIZE < file_end ? virt + PAGING_PAGE_SIZE : file_end;
+        void* page = frame_zalloc();
+        if (!page)
+        {
+            res = -ENOMEM;
+            break;
+        }
+
+        res = fseek(fd, phdr->p_offset + (from - phdr->p_vaddr), SEEK_SET);
+        if (res == 0 && fread(page + (from - virt), to - from, 1, fd) != 1)
+        {
+            res = -EIO;
+        }
+
+        if (res == 0)
+        {
+            res = paging_map(process->task->page_directory, (void*) virt, page, mapping->flags);
+        }
+
+        if (res < 0)
+        {
+            frame_free(page);
+            break;
+        }
+    }
+
+    // Nothing is left to read from the file, pages past it are BSS
+    mapping->offset = 0;
+    mapping->file_end = 0;
+    return res;
+}
+
+/**
+ * Every loadable segment becomes a mapping of the ELF file, nothing is read until the program
+ * touches it. Pages past p_filesz are the BSS, they map the zero page until they are written
+ */
 static int process_map_elf(struct process* process)
 {
     int res = 0;
@@ -414,23 +1166,88 @@ static int process_map_elf(struct process* process)
     struct elf_file* elf_file = process->elf_file;
     struct elf_header* header = elf_header(elf_file);
     struct elf32_phdr* phdrs = elf_pheader(header);
+
     for (int i = 0; i < header->e_phnum; i++)
     {
         struct elf32_phdr* phdr = &phdrs[i];
-        void* phdr_phys_address = elf_phdr_phys_address(elf_file, phdr);
-        int flags = PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
-        if (phdr->p_flags & PF_W)
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
         {
-            flags |= PAGING_IS_WRITEABLE;
+            continue;
         }
-        res = paging_map_to(process->task->page_directory, paging_align_to_lower_page((void*)phdr->p_vaddr), paging_align_to_lower_page(phdr_phys_address), paging_align_address(phdr_phys_address+phdr->p_memsz), flags);
-        if (ISERR(res))
+
+        void* virt = paging_align_to_lower_page((void*) phdr->p_vaddr);
+        struct process_mapping* mapping = process_new_mapping(virt, (uint32_t) paging_align_address((void*)(phdr->p_vaddr + phdr->p_memsz)) - (uint32_t) virt);
+        if (!mapping)
+        {
+            res = -ENOMEM;
+            break;
+        }
+
+        res = vma_insert(&process->vmas, &mapping->vma);
+        if (res < 0)
         {
+            // Segments may not overlap each other
+            kfree(mapping);
+            res = -EINFORMAT;
             break;
         }
+
+        mapping->fd = elf_fd(elf_file);
+        mapping->offset = phdr->p_offset - (phdr->p_vaddr - (uint32_t) virt);
+        mapping->file_end = phdr->p_offset + phdr->p_filesz;
+        mapping->flags = PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL;
+        mapping->owns_file = false;
+        if (phdr->p_flags & PF_W)
+        {
+            mapping->flags |= PAGING_IS_WRITEABLE;
+        }
+
+        // The PeachOS layout, tools/elfcheck.c, has the file offset and the address at the same
+        // place in a page so the pages are mapped from the page cache as they are touched
+        if ((phdr->p_offset % PAGING_PAGE_SIZE) != (phdr->p_vaddr % PAGING_PAGE_SIZE))
+        {
+            res = process_copy_elf_segment(process, mapping, phdr);
+            if (res < 0)
+            {
+                break;
+            }
+        }
+    }
+    return res;
+}
+static int process_insert_vma(struct process* process, struct vma* vma, uint32_t start, uint32_t end, int type)
+{
+    vma->start = start;
+    vma->end = end;
+    vma->type = type;
+    return vma_insert(&process->vmas, vma);
+}
+
+/**
+ * Adds the regions every process has, the stack, the sbrk region and the program of a binary
+ */
+static int process_insert_fixed_vmas(struct process* process)
+{
+    int res = process_insert_vma(process, &process->stack_vma, PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END, PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_START, VMA_TYPE_STACK);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = process_insert_vma(process, &process->brk_vma, PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_START, PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_END, VMA_TYPE_BRK);
+    if (res < 0)
+    {
+        goto out;
     }
+
+    if (process->filetype == PROCESS_FILETYPE_BINARY)
+    {
+        res = process_insert_vma(process, &process->program_vma, PEACHOS_PROGRAM_VIRTUAL_ADDRESS, (uint32_t) paging_align_address((void*)(PEACHOS_PROGRAM_VIRTUAL_ADDRESS + process->size)), VMA_TYPE_PROGRAM);
+    }
+out:
     return res;
 }
+
 int process_map_memory(struct process* process)
 {
     int res = 0;
@@ -454,35 +1271,36 @@ int process_map_memory(struct process* process)
         goto out;
     }
 
-    // Finally map the stack
-    paging_map_to(process->task->page_directory, (void*)PEACHOS_PROGRAM_VIRTUAL_STACK_ADDRESS_END, process->stack, paging_align_address(process->stack+PEACHOS_USER_PROGRAM_STACK_SIZE), PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITEABLE);
-out:
-    return res;
-}
-
-int process_get_free_slot()
-{
-    for (int i = 0; i < PEACHOS_MAX_PROCESSES; i++)
+    // An ELF segment may not cover the stack or the sbrk region
+    res = process_insert_fixed_vmas(process);
+    if (res < 0)
     {
-        if (processes[i] == 0)
-            return i;
+        goto out;
     }
 
-    return -EISTKN;
+    // The stack came mapped with the page directory, from here on the program is freed through
+    // the page tables
+    process->mapped = true;
+out:
+    return res;
 }
 
 int process_load(const char* filename, struct process** process)
 {
     int res = 0;
-    int process_slot = process_get_free_slot();
-    if (process_slot < 0)
+    int process_id = process_id_alloc(0);
+    if (process_id < 0)
     {
-        res = -EISTKN;
-        print("No free process slots\n");
+        res = process_id;
+        print("No free process ids\n");
         goto out;
     }
 
-    res = process_load_for_slot(filename, process, process_slot);
+    res = process_load_for_id(filename, process, process_id);
+    if (res < 0)
+    {
+        process_id_free(process_id);
+    }
 out:
     return res;
 }
@@ -498,18 +1316,14 @@ int process_load_switch(const char* filename, struct process** process)
     return res;
 }
 
-int process_load_for_slot(const char* filename, struct process** process, int process_slot)
+/**
+ * Loads the program as a new process under an id the caller reserved
+ */
+static int process_load_for_id(const char* filename, struct process** process, int process_id)
 {
     int res = 0;
     struct process* _process;
 
-    if (process_get(process_slot) != 0)
-    {
-        res = -EISTKN;
-        print("Process slot is already taken\n");
-        goto out;
-    }
-
     _process = kzalloc(sizeof(struct process));
     if (!_process)
     {
@@ -526,16 +1340,8 @@ int process_load_for_slot(const char* filename, struct process** process, int pr
         goto out;
     }
 
-    _process->stack = kzalloc(PEACHOS_USER_PROGRAM_STACK_SIZE);
-    if (!_process->stack)
-    {
-        res = -ENOMEM;
-        print("Failed to allocate process stack\n");
-        goto out;
-    }
-
     strncpy(_process->filename, filename, sizeof(_process->filename));
-    _process->id = process_slot;
+    _process->id = process_id;
 
     // Create a task
     _process->task = task_new(_process);
@@ -557,11 +1363,10 @@ int process_load_for_slot(const char* filename, struct process** process, int pr
         goto out;
     }
 
+    // Add the process to the table
+    process_publish(_process);
     *process = _process;
 
-    // Add the process to the array
-    processes[process_slot] = _process;
-
 out:
     if (ISERR(res))
     {
@@ -575,4 +1380,195 @@ out:
        // Free the process data
     }
     return res;
-}
\ No newline at end of file
+}
+/**
+ * Shares every present page of the range with the child, the first write from either
+ * process takes a private copy
+ */
+static int process_share_range(struct process* parent, struct process* child, void* virt, uint32_t size)
+{
+    int res = 0;
+    uint32_t* from = paging_4gb_chunk_get_directory(parent->task->page_directory);
+    uint32_t* to = paging_4gb_chunk_get_directory(child->task->page_directory);
+    for (uint32_t offset = 0; offset < size; offset += PAGING_PAGE_SIZE)
+    {
+        res = cow_share_page(from, to, virt + offset);
+        if (res < 0)
+        {
+            break;
+        }
+    }
+
+    return res;
+}
+
+static int process_fork_allocation(struct process* parent, struct process* child, struct vma* allocation)
+{
+    struct vma* vma = kzalloc(sizeof(struct vma));
+    if (!vma)
+    {
+        return -ENOMEM;
+    }
+
+    int res = process_insert_vma(child, vma, allocation->start, allocation->end, VMA_TYPE_ALLOCATION);
+    if (res < 0)
+    {
+        kfree(vma);
+        return res;
+    }
+
+    return process_share_range(parent, child, (void*) allocation->start, allocation->end - allocation->start);
+}
+
+/**
+ * The child maps the same frames writable, a shared mapping is never copied on write
+ */
+static int process_fork_shm_mapping(struct process* parent, struct process* child, struct process_shm_mapping* mapping)
+{
+    struct process_shm_mapping* copy = process_new_shm_mapping(child, (void*) mapping->vma.start, shm_dup(mapping->shm));
+    if (!copy)
+    {
+        shm_put(mapping->shm);
+        return -ENOMEM;
+    }
+
+    return process_shm_map_pages(child, copy);
+}
+
+static int process_fork_mapping(struct process* parent, struct process* child, struct process_mapping* mapping)
+{
+    struct process_mapping* copy = kzalloc(sizeof(struct process_mapping));
+    if (!copy)
+    {
+        return -ENOMEM;
+    }
+
+    // The child mapping holds its own references before any page is handed over
+    if (mapping->owns_file && fdup(mapping->fd) < 0)
+    {
+        kfree(copy);
+        return -EIO;
+    }
+
+    *copy = *mapping;
+    vma_insert(&child->vmas, &copy->vma);
+    return process_share_range(parent, child, (void*) mapping->vma.start, mapping->vma.end - mapping->vma.start);
+}
+
+static int process_fork_memory(struct process* parent, struct process* child)
+{
+    int res = process_insert_fixed_vmas(child);
+    for (struct vma* vma = vma_first(&parent->vmas); vma && res == 0; vma = vma_next(&parent->vmas, vma))
+    {
+        switch (vma->type)
+        {
+            case VMA_TYPE_ALLOCATION:
+                res = process_fork_allocation(parent, child, vma);
+            break;
+
+            case VMA_TYPE_MAPPING:
+                res = process_fork_mapping(parent, child, (struct process_mapping*) vma);
+            break;
+
+            case VMA_TYPE_BRK:
+                res = process_share_range(parent, child, (void*) vma->start, (uint32_t) paging_align_address((void*) parent->brk) - vma->start);
+            break;
+
+            case VMA_TYPE_THREAD_STACK:
+                // Only the main task is carried over to the child
+            break;
+
+            case VMA_TYPE_SHARED:
+                res = process_fork_shm_mapping(parent, child, (struct process_shm_mapping*) vma);
+            break;
+
+            case VMA_TYPE_STACK:
+                // The child shares the parent stack instead of the fresh one its directory came with
+                process_release_range(child, (void*) vma->start, vma->end - vma->start);
+                res = process_share_range(parent, child, (void*) vma->start, vma->end - vma->start);
+            break;
+
+            default:
+                res = process_share_range(parent, child, (void*) vma->start, vma->end - vma->start);
+            break;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Creates a copy of the parent process that shares all of its memory copy on write. The child
+ * resumes from the same registers as the parent except that it sees zero returned
+ */
+int process_fork(struct process* parent, struct process** child_out)
+{
+    int res = 0;
+    struct process* child = 0;
+
+    // Id zero is never handed to a child so that zero can tell the child apart
+    int id = process_id_alloc(1);
+    if (id < 0)
+    {
+        res = id;
+        goto out;
+    }
+
+    child = kzalloc(sizeof(struct process));
+    if (!child)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    process_init(child);
+    strncpy(child->filename, parent->filename, sizeof(child->filename));
+    child->id = id;
+    child->filetype = parent->filetype;
+    child->size = parent->size;
+    child->ptr = parent->ptr;
+    if (child->filetype == PROCESS_FILETYPE_ELF)
+    {
+        elf_dup(child->elf_file);
+    }
+    child->arguments = parent->arguments;
+    child->mapped = true;
+
+    child->task = task_new(child);
+    if (ISERR(child->task))
+    {
+        res = ERROR_I(child->task);
+        child->task = NULL;
+        goto out;
+    }
+
+    child->task->registers = parent->task->registers;
+    child->task->registers.eax = 0;
+    fpu_copy(child->task, parent->task);
+
+    res = process_fork_memory(parent, child);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    res = fdtable_fork(parent, child);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    process_publish(child);
+    *child_out = child;
+
+out:
+    if (res < 0 && child)
+    {
+        process_free_process(child);
+    }
+    if (res < 0 && id >= 0)
+    {
+        process_id_free(id);
+    }
+    return res;
+}
@@ -4,23 +4,72 @@
 #include <stdbool.h>
 
 #include "task.h"
+#include "waitqueue.h"
 #include "config.h"
+#include "memory/vma/vma.h"
 
 #define PROCESS_FILETYPE_ELF 0
 #define PROCESS_FILETYPE_BINARY 1
 
 typedef unsigned char PROCESS_FILETYPE;
 
-struct process_allocation
+struct fd_table;
+
+// A file range mapped into the process, pages are read in the first time they are touched
+struct process_mapping
 {
-    void* ptr;
-    size_t size;
+    // Where the mapping sits in the process, must stay first
+    struct vma vma;
+
+    // The file backing the mapping, the mapping starts at offset in it
+    int fd;
+    uint32_t offset;
+    // Bytes at or past this file position read as zero
+    uint32_t file_end;
+
+    // Paging flags the pages are mapped with once read in
+    int flags;
+    // Set when the mapping opened the file itself and closes it when it goes away
+    bool owns_file;
+};
+
+// Keys on their way from the keyboard interrupt to the process. Only the interrupt moves tail and
+// only the reading system call moves head, both count up freely and are masked to index buffer
+struct keyboard_buffer
+{
+    char buffer[PEACHOS_KEYBOARD_BUFFER_SIZE];
+    uint32_t tail;
+    uint32_t head;
+
+    // Tasks waiting for a key to be pushed
+    struct wait_queue readers;
 };
 
-struct command_argument
+// A thread the process started besides its main task
+struct process_thread
 {
-    char argument[512];
-    struct command_argument* next;
+    int id;
+    // NULL once the thread has exited, the exit code stays until it is joined
+    struct task* task;
+    int exit_code;
+
+    // The stack of the thread, the page below it is left unmapped
+    struct vma stack_vma;
+
+    // Tasks waiting in thread_join for the thread to exit
+    struct wait_queue joiners;
+
+    struct process_thread* next;
+};
+
+struct shm;
+
+// A shared memory object mapped into the process, its pages are the object's own frames
+struct process_shm_mapping
+{
+    // Where the mapping sits in the process, must stay first
+    struct vma vma;
+    struct shm* shm;
 };
 
 struct process_arguments
@@ -39,8 +88,19 @@ struct process
     // The main process task
     struct task* task;
 
-    // The memory (malloc) allocations of the process
-    struct process_allocation allocations[PEACHOS_MAX_PROGRAM_ALLOCATIONS];
+    // Threads started with thread_create, the main task is thread zero
+    struct process_thread* threads;
+    int next_thread_id;
+
+    // Every region of the process address space: allocations, mappings, the stack, the sbrk
+    // region and the program of a binary
+    struct vma_tree vmas;
+    struct vma program_vma;
+    struct vma stack_vma;
+    struct vma brk_vma;
+
+    // The end of the sbrk region, it starts at PEACHOS_PROCESS_BRK_VIRTUAL_ADDRESS_START
+    uint32_t brk;
 
     PROCESS_FILETYPE filetype;
 
@@ -52,34 +112,52 @@ struct process
     };
     
 
-    // The physical pointer to the stack memory
-    void* stack;
+    // Set once the program is mapped, it is then freed through the page tables as a fork may
+    // share it
+    bool mapped;
 
     // The size of the data pointed to by "ptr"
     uint32_t size;
 
-    struct keyboard_buffer
-    {
-        char buffer[PEACHOS_KEYBOARD_BUFFER_SIZE];
-        int tail;
-        int head;
-    } keyboard;
+    // Allocated the first time the process reads the keyboard
+    struct keyboard_buffer* keyboard;
+
+    // Allocated when the process opens its first file
+    struct fd_table* files;
 
     // The arguments of the process.
     struct process_arguments arguments;
+
+    // Timer ticks every task of the process has run for, exited threads included
+    uint32_t ticks;
+
+    // Next exited process waiting for its memory to be released
+    struct process* reap_next;
 };
 
 int process_switch(struct process* process);
 int process_load_switch(const char* filename, struct process** process);
 int process_load(const char* filename, struct process** process);
-int process_load_for_slot(const char* filename, struct process** process, int process_slot);
 struct process* process_current();
 struct process* process_get(int process_id);
+struct stats_process;
+int process_get_stats(struct stats_process* out, int max);
 void* process_malloc(struct process* process, size_t size);
 void process_free(struct process* process, void* ptr);
+void* process_mmap(struct process* process, const char* filename, uint32_t offset, uint32_t size);
+void* process_sbrk(struct process* process, int increment);
+void* process_lend_page(struct process* process, void* virt);
+int process_adopt_page(struct process* process, void* virt, void* page);
+int process_munmap(struct process* process, void* virt);
+void* process_shm_map(struct process* process, struct shm* shm);
+int process_shm_unmap(struct process* process, void* virt);
+int process_handle_page_fault(struct process* process, void* address, uint32_t error_code);
+int process_fork(struct process* parent, struct process** child_out);
 
 void process_get_arguments(struct process* process, int* argc, char*** argv);
-int process_inject_arguments(struct process* process, struct command_argument* root_argument);
+int process_inject_arguments(struct process* process, const char* strings, size_t size);
 int process_terminate(struct process* process);
+bool process_reap();
+void process_release_vma(struct process* process, struct vma* vma);
 
 #endif
\ No newline at end of file
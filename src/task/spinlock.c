@@ -0,0 +1,18 @@
+#include "spinlock.h"
+
+void spinlock_acquire(struct spinlock* lock)
+{
+    while (__sync_lock_test_and_set(&lock->locked, 1))
+    {
+        // Wait on the cached value, only retry the locked exchange once it looks free
+        while (lock->locked)
+        {
+            __builtin_ia32_pause();
+        }
+    }
+}
+
+void spinlock_release(struct spinlock* lock)
+{
+    __sync_lock_release(&lock->locked);
+}
@@ -0,0 +1,13 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+// A lock for state that processors share, holders must not block while they keep it
+struct spinlock
+{
+    volatile int locked;
+};
+
+void spinlock_acquire(struct spinlock* lock);
+void spinlock_release(struct spinlock* lock);
+
+#endif
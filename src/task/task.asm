@@ -4,6 +4,10 @@ section .asm
 global restore_general_purpose_registers
 global task_return
 global user_registers
+global task_kernel_save
+global task_kernel_resume
+global task_idle_wait
+global task_idle_poll
 
 ; void task_return(struct registers* regs);
 task_return:
@@ -68,4 +72,48 @@ user_registers:
     mov es, ax
     mov fs, ax
     mov gs, ax
-    ret
\ No newline at end of file
+    ret
+
+; int task_kernel_save(struct task_kernel_context* context);
+; Returns zero when the context is saved and one when it is later resumed
+task_kernel_save:
+    mov eax, [esp+4]
+    mov [eax], ebx
+    mov [eax+4], esi
+    mov [eax+8], edi
+    mov [eax+12], ebp
+    ; The stack pointer as it will be after we return
+    lea ecx, [esp+4]
+    mov [eax+16], ecx
+    mov ecx, [esp]
+    mov [eax+20], ecx
+    xor eax, eax
+    ret
+
+; void task_kernel_resume(struct task_kernel_context* context);
+task_kernel_resume:
+    mov eax, [esp+4]
+    mov ebx, [eax]
+    mov esi, [eax+4]
+    mov edi, [eax+8]
+    mov ebp, [eax+12]
+    mov esp, [eax+16]
+    mov ecx, [eax+20]
+    mov eax, 1
+    jmp ecx
+
+; void task_idle_wait();
+; Sleeps until the next interrupt, sti only takes effect after hlt so no interrupt is missed
+task_idle_wait:
+    sti
+    hlt
+    cli
+    ret
+
+; void task_idle_poll();
+; Takes the interrupts that are already waiting, they come in after the instruction following sti
+task_idle_poll:
+    sti
+    nop
+    cli
+    ret
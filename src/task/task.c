@@ -8,22 +8,95 @@
 #include "memory/paging/paging.h"
 #include "loader/formats/elfloader.h"
 #include "idt/idt.h"
-
-// The current task that is running
-struct task *current_task = 0;
+#include "task/tss.h"
+#include "task/cpu.h"
+#include "task/pool.h"
+#include "task/fpu.h"
+#include "trace/trace.h"
+#include "stats/stats.h"
 
 // Task linked list
 struct task *task_tail = 0;
 struct task *task_head = 0;
+static struct spinlock task_list_lock;
+
+// Set once the first task runs, before that there is nothing to switch to while blocking
+static bool task_scheduler_running = false;
 
-int task_init(struct task *task, struct process *process);
+// The kernel stack of a task that was freed while we were still running on it
+static void *task_dead_kernel_stack = 0;
+
+int task_init(struct task *task, struct process *process, struct process_thread *thread);
 
 struct task *task_current()
 {
-    return current_task;
+    return cpu_current()->current_task;
 }
 
-struct task *task_new(struct process *process)
+static void task_runqueue_add(struct task *task)
+{
+    struct cpu *cpu = task->cpu;
+    spinlock_acquire(&cpu->lock);
+    struct cpu_runqueue *queue = &cpu->runqueues[task->priority];
+    task->run_next = 0;
+    task->run_prev = queue->tail;
+    if (queue->tail)
+    {
+        queue->tail->run_next = task;
+    }
+    else
+    {
+        queue->head = task;
+    }
+    queue->tail = task;
+    cpu->runqueue_map |= 1 << task->priority;
+    spinlock_release(&cpu->lock);
+}
+
+static void task_runqueue_remove(struct task *task)
+{
+    struct cpu *cpu = task->cpu;
+    if (!cpu)
+    {
+        return;
+    }
+
+    spinlock_acquire(&cpu->lock);
+    struct cpu_runqueue *queue = &cpu->runqueues[task->priority];
+    if (task->run_prev)
+    {
+        task->run_prev->run_next = task->run_next;
+    }
+    else if (queue->head == task)
+    {
+        queue->head = task->run_next;
+    }
+    else
+    {
+        // Not queued
+        goto out;
+    }
+
+    if (task->run_next)
+    {
+        task->run_next->run_prev = task->run_prev;
+    }
+    else
+    {
+        queue->tail = task->run_prev;
+    }
+
+    task->run_next = 0;
+    task->run_prev = 0;
+    if (!queue->head)
+    {
+        cpu->runqueue_map &= ~(1 << task->priority);
+    }
+out:
+    spinlock_release(&cpu->lock);
+}
+
+static struct task *task_create(struct process *process, struct process_thread *thread)
 {
     int res = 0;
     struct task *task = kzalloc(sizeof(struct task));
@@ -33,23 +106,29 @@ struct task *task_new(struct process *process)
         goto out;
     }
 
-    res = task_init(task, process);
+    res = task_init(task, process, thread);
     if (res != PEACHOS_ALL_OK)
     {
         goto out;
     }
 
+    task->cpu = cpu_current();
+    task_runqueue_add(task);
+
+    spinlock_acquire(&task_list_lock);
     if (task_head == 0)
     {
         task_head = task;
         task_tail = task;
-        current_task = task;
-        goto out;
+        cpu_current()->current_task = task;
     }
-
-    task_tail->next = task;
-    task->prev = task_tail;
-    task_tail = task;
+    else
+    {
+        task_tail->next = task;
+        task->prev = task_tail;
+        task_tail = task;
+    }
+    spinlock_release(&task_list_lock);
 
 out:
     if (ISERR(res))
@@ -61,23 +140,76 @@ out:
     return task;
 }
 
+struct task *task_new(struct process *process)
+{
+    return task_create(process, 0);
+}
+
+/**
+ * Creates another task in the address space of the process, switching between it and the other
+ * tasks of the process leaves CR3 alone
+ */
+struct task *task_new_thread(struct process *process, struct process_thread *thread)
+{
+    return task_create(process, thread);
+}
+
+/**
+ * Creates a task that runs entry in ring 0 on the kernel page directory. It starts out as if it
+ * had blocked inside the kernel and, as the kernel is not preemptible, runs until it blocks
+ */
+struct task *task_new_kernel(void (*entry)())
+{
+    struct task *task = task_create(0, 0);
+    if (!ISERR(task))
+    {
+        task->kernel_context.eip = (uint32_t) entry;
+    }
+
+    return task;
+}
+
+/**
+ * Returns the first task of the highest priority runqueue of this processor. The current task
+ * moves behind the others of its priority so that they take turns. Returns NULL when every task
+ * is blocked
+ */
 struct task *task_get_next()
 {
-    if (!current_task->next)
+    struct cpu *cpu = cpu_current();
+    struct task *current = cpu->current_task;
+    if (!current)
+    {
+        return 0;
+    }
+
+    if (current->state == TASK_STATE_RUNNABLE && current->cpu == cpu)
     {
-        return task_head;
+        task_runqueue_remove(current);
+        task_runqueue_add(current);
     }
 
-    return current_task->next;
+    if (!cpu->runqueue_map)
+    {
+        return 0;
+    }
+
+    return cpu->runqueues[__builtin_ctz(cpu->runqueue_map)].head;
 }
 
 static void task_list_remove(struct task *task)
 {
+    spinlock_acquire(&task_list_lock);
     if (task->prev)
     {
         task->prev->next = task->next;
     }
 
+    if (task->next)
+    {
+        task->next->prev = task->prev;
+    }
+
     if (task == task_head)
     {
         task_head = task->next;
@@ -88,91 +220,274 @@ static void task_list_remove(struct task *task)
         task_tail = task->prev;
     }
 
-    if (task == current_task)
+    if (task == cpu_current()->current_task)
     {
-        current_task = task_get_next();
+        cpu_current()->current_task = task->next ? task->next : task_head;
     }
+    spinlock_release(&task_list_lock);
 }
 
-int task_free(struct task *task)
+static bool task_running_on_stack(void *stack)
 {
-    paging_free_4gb(task->page_directory);
+    char marker;
+    return (char *)&marker >= (char *)stack && (char *)&marker < (char *)stack + PEACHOS_TASK_KERNEL_STACK_SIZE;
+}
+
+static void task_free_kernel_stack(void *stack)
+{
+    if (task_dead_kernel_stack && !task_running_on_stack(task_dead_kernel_stack))
+    {
+        kfree(task_dead_kernel_stack);
+        task_dead_kernel_stack = 0;
+    }
+
+    if (!stack)
+    {
+        return;
+    }
+
+    if (task_running_on_stack(stack))
+    {
+        // A task that exits frees itself on its own kernel stack, release it after the next switch
+        if (task_dead_kernel_stack)
+        {
+            kfree(task_dead_kernel_stack);
+        }
+        task_dead_kernel_stack = stack;
+        return;
+    }
+
+    kfree(stack);
+}
+
+/**
+ * Takes the task off the processor for good, wakeups no longer reach it. The page directory and
+ * the task itself stay until task_free
+ */
+void task_stop(struct task *task)
+{
+    if (task->state == TASK_STATE_DEAD)
+    {
+        return;
+    }
+
+    task->state = TASK_STATE_DEAD;
+    task_runqueue_remove(task);
+    timer_cancel(&task->sleep_timer);
+    fpu_release(task);
     task_list_remove(task);
+    task_free_kernel_stack(task->kernel_stack);
+    task->kernel_stack = 0;
+}
+
+int task_free(struct task *task)
+{
+    task_stop(task);
+
+    // Threads leave the page directory to the main task of their process, kernel tasks
+    // borrow the kernel's
+    if (task->page_directory && !task->thread && task->process)
+    {
+        // We cant keep running on page tables that are about to be freed
+        if (paging_current_directory() == task->page_directory->directory_entry)
+        {
+            kernel_page();
+        }
+
+        // The stack stays mapped so the directory can be handed to the next process
+        pool_put(task->page_directory);
+    }
 
     // Finally free the task data
     kfree(task);
     return 0;
 }
 
+/**
+ * Charges the ticks since the last call to task, or to the idle time of the processor when
+ * task is NULL
+ */
+static void task_account(struct cpu *cpu, struct task *task)
+{
+    uint32_t now = timer_ticks();
+    uint32_t elapsed = now - cpu->accounted_ticks;
+    cpu->accounted_ticks = now;
+    if (!task)
+    {
+        stats_cpus[cpu->id].idle_ticks += elapsed;
+        return;
+    }
+
+    task->ticks += elapsed;
+    if (task->process)
+    {
+        task->process->ticks += elapsed;
+    }
+}
+
+static void task_run(struct task *task)
+{
+    struct cpu *cpu = cpu_current();
+    task_free_kernel_stack(0);
+    if (task != cpu->current_task)
+    {
+        // A fresh timeslice for the task we switch to
+        timer_schedule(PEACHOS_TASK_TIMESLICE_TICKS);
+        task_account(cpu, cpu->current_task);
+        TRACE(TRACE_EVENT_CONTEXT_SWITCH, cpu->current_task, task, task->process ? task->process->id : 0);
+        STATS_INC(context_switches);
+    }
+    task_switch(task);
+    if (task->in_kernel)
+    {
+        // Carry on inside the kernel where the task blocked
+        task->in_kernel = 0;
+        kernel_registers();
+        task_kernel_resume(&task->kernel_context);
+    }
+
+    task_return(&task->registers);
+}
+
 void task_next()
 {
     struct task* next_task = task_get_next();
-    if (!next_task)
+    while (!next_task)
     {
-        panic("No more tasks!\n");
+        if (!task_head)
+        {
+            panic("No more tasks!\n");
+        }
+
+        // Every task is blocked, sleep until an interrupt wakes one of them up. The time is
+        // used to release the memory of exited processes and to get page directories ready
+        // for the next programs first
+        task_account(cpu_current(), cpu_current()->current_task);
+        if (process_reap())
+        {
+            // More to release, let waiting interrupts in between the steps
+            task_idle_poll();
+        }
+        else
+        {
+            pool_fill();
+            timer_idle();
+            task_idle_wait();
+        }
+        task_account(cpu_current(), 0);
+        next_task = task_get_next();
     }
 
-    task_switch(next_task);
-    task_return(&next_task->registers);
+    task_run(next_task);
 }
 
 int task_switch(struct task *task)
 {
-    current_task = task;
+    struct cpu *cpu = cpu_current();
+    cpu->current_task = task;
+    fpu_switch(cpu, task);
+    cpu->tss.esp0 = (uint32_t) task->kernel_stack + PEACHOS_TASK_KERNEL_STACK_SIZE;
     paging_switch(task->page_directory);
     return 0;
 }
 
-void task_save_state(struct task *task, struct interrupt_frame *frame)
+bool task_can_block()
 {
-    task->registers.ip = frame->ip;
-    task->registers.cs = frame->cs;
-    task->registers.flags = frame->flags;
-    task->registers.esp = frame->esp;
-    task->registers.ss = frame->ss;
-    task->registers.eax = frame->eax;
-    task->registers.ebp = frame->ebp;
-    task->registers.ebx = frame->ebx;
-    task->registers.ecx = frame->ecx;
-    task->registers.edi = frame->edi;
-    task->registers.edx = frame->edx;
-    task->registers.esi = frame->esi;
+    return task_scheduler_running && cpu_current()->current_task;
 }
-int copy_string_from_task(struct task* task, void* virtual, void* phys, int max)
+
+static void task_block_as(TASK_STATE state)
 {
-    if (max >= PAGING_PAGE_SIZE)
+    struct task *task = cpu_current()->current_task;
+    task->state = state;
+    task_runqueue_remove(task);
+    if (task_kernel_save(&task->kernel_context) == 0)
     {
-        return -EINVARG;
+        task->in_kernel = 1;
+        task_next();
     }
 
-    int res = 0;
-    char* tmp = kzalloc(max);
-    if (!tmp)
+    // We have been woken up and switched back to
+}
+
+/**
+ * Blocks the current task until task_wake is called on it, other tasks run in the meantime.
+ * Must be called from inside the kernel with interrupts disabled
+ */
+void task_block()
+{
+    task_block_as(TASK_STATE_BLOCKED);
+}
+
+static void task_sleep_expired(void *data)
+{
+    task_wake((struct task *) data);
+}
+
+/**
+ * Puts the current task to sleep for at least the given number of timer ticks
+ */
+void task_sleep(uint32_t ticks)
+{
+    struct task *task = cpu_current()->current_task;
+    timer_add(&task->sleep_timer, ticks, task_sleep_expired, task);
+    task_block_as(TASK_STATE_SLEEPING);
+}
+
+void task_wake(struct task *task)
+{
+    if (task->state == TASK_STATE_RUNNABLE || task->state == TASK_STATE_DEAD)
     {
-        res = -ENOMEM;
-        goto out;
+        return;
     }
 
-    uint32_t* task_directory = task->page_directory->directory_entry;
-    uint32_t old_entry = paging_get(task_directory, tmp);
-    paging_map(task->page_directory, tmp, tmp, PAGING_IS_WRITEABLE | PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
-    paging_switch(task->page_directory);
-    strncpy(tmp, virtual, max);
-    kernel_page();
+    task->state = TASK_STATE_RUNNABLE;
+    task_runqueue_add(task);
+}
 
-    res = paging_set(task_directory, tmp, old_entry);
-    if (res < 0)
+/**
+ * Moves the task nice levels away from the default priority, negative values run it sooner
+ */
+void task_set_nice(struct task *task, int nice)
+{
+    int priority = PEACHOS_TASK_DEFAULT_PRIORITY + nice;
+    if (priority < 0)
     {
-        res = -EIO;
-        goto out_free;
+        priority = 0;
+    }
+    else if (priority >= PEACHOS_TASK_PRIORITY_LEVELS)
+    {
+        priority = PEACHOS_TASK_PRIORITY_LEVELS - 1;
     }
 
-    strncpy(phys, tmp, max);
+    bool queued = task->state == TASK_STATE_RUNNABLE;
+    if (queued)
+    {
+        task_runqueue_remove(task);
+    }
 
-out_free:
-    kfree(tmp);
-out:
-    return res;
+    task->nice = nice;
+    task->priority = priority;
+    if (queued)
+    {
+        task_runqueue_add(task);
+    }
+}
+
+void task_save_state(struct task *task, struct interrupt_frame *frame)
+{
+    task->registers.ip = frame->ip;
+    task->registers.cs = frame->cs;
+    task->registers.flags = frame->flags;
+    task->registers.esp = frame->esp;
+    task->registers.ss = frame->ss;
+    task->registers.eax = frame->eax;
+    task->registers.ebp = frame->ebp;
+    task->registers.ebx = frame->ebx;
+    task->registers.ecx = frame->ecx;
+    task->registers.edi = frame->edi;
+    task->registers.edx = frame->edx;
+    task->registers.esi = frame->esi;
 }
 void task_current_save_state(struct interrupt_frame *frame)
 {
@@ -188,7 +503,7 @@ void task_current_save_state(struct interrupt_frame *frame)
 int task_page()
 {
     user_registers();
-    task_switch(current_task);
+    task_switch(cpu_current()->current_task);
     return 0;
 }
 
@@ -201,25 +516,45 @@ int task_page_task(struct task* task)
 
 void task_run_first_ever_task()
 {
-    if (!current_task)
+    if (!cpu_current()->current_task)
     {
         panic("task_run_first_ever_task(): No current task exists!\n");
     }
 
+    task_scheduler_running = true;
+    cpu_current()->accounted_ticks = timer_ticks();
     task_switch(task_head);
     task_return(&task_head->registers);
 }
 
-int task_init(struct task *task, struct process *process)
+int task_init(struct task *task, struct process *process, struct process_thread *thread)
 {
     memset(task, 0, sizeof(struct task));
-    // Map the entire 4GB address space to its self
-    task->page_directory = paging_new_4gb(PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL);
+    // Shares the kernel mappings and comes with the user stack, the rest is mapped in afterwards
+    task->page_directory = !process ? kernel_directory() : thread ? process->task->page_directory : pool_get();
+    task->thread = thread;
     if (!task->page_directory)
     {
         return -EIO;
     }
 
+    task->kernel_stack = kzalloc_block(PEACHOS_TASK_KERNEL_STACK_SIZE);
+    if (!task->kernel_stack)
+    {
+        return -ENOMEM;
+    }
+    task->state = TASK_STATE_RUNNABLE;
+    task->priority = PEACHOS_TASK_DEFAULT_PRIORITY;
+
+    if (!process)
+    {
+        // Resumed like a task blocked in the kernel, with a zero return address on its stack
+        task->priority = PEACHOS_TASK_KERNEL_PRIORITY;
+        task->in_kernel = 1;
+        task->kernel_context.esp = (uint32_t) task->kernel_stack + PEACHOS_TASK_KERNEL_STACK_SIZE - sizeof(uint32_t);
+        return 0;
+    }
+
     task->registers.ip = PEACHOS_PROGRAM_VIRTUAL_ADDRESS;
     if (process->filetype == PROCESS_FILETYPE_ELF)
     {
@@ -235,24 +570,204 @@ int task_init(struct task *task, struct process *process)
     return 0;
 }
 
-void* task_get_stack_item(struct task* task, int index)
+void* task_get_syscall_argument(struct task* task, int index)
+{
+    // Arguments arrive in ebx, esi and edi, ecx and edx are lost to sysenter
+    switch (index)
+    {
+        case 0:
+            return (void*) task->registers.ebx;
+        case 1:
+            return (void*) task->registers.esi;
+        case 2:
+            return (void*) task->registers.edi;
+    }
+
+    return 0;
+}
+
+static int task_check_user_page(struct task* task, void* virtual_address, bool write)
+{
+    uint32_t* directory = task->page_directory->directory_entry;
+    uint32_t entry = paging_get(directory, paging_align_to_lower_page(virtual_address));
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        // Not touched yet, a file or heap mapping may still fault it in
+        process_handle_page_fault(task->process, virtual_address, 0);
+        entry = paging_get(directory, paging_align_to_lower_page(virtual_address));
+    }
+
+    if (write && (entry & PAGING_IS_COPY_ON_WRITE))
+    {
+        process_handle_page_fault(task->process, virtual_address, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE);
+        entry = paging_get(directory, paging_align_to_lower_page(virtual_address));
+    }
+
+    if (!(entry & PAGING_IS_PRESENT) || !(entry & PAGING_ACCESS_FROM_ALL))
+    {
+        return -EINVARG;
+    }
+
+    if (write && !(entry & PAGING_IS_WRITEABLE))
+    {
+        return -ERDONLY;
+    }
+
+    return 0;
+}
+
+int task_check_user_range(struct task* task, void* virtual_address, size_t size, bool write)
+{
+    uint32_t start = (uint32_t) virtual_address;
+    if (start + size < start)
+    {
+        return -EINVARG;
+    }
+
+    for (uint32_t page = start & ~(PAGING_PAGE_SIZE - 1); page < start + size; page += PAGING_PAGE_SIZE)
+    {
+        int res = task_check_user_page(task, (void*) page, write);
+        if (res < 0)
+        {
+            return res;
+        }
+    }
+
+    return 0;
+}
+
+static void task_copy_user_range(struct task* task, void* user_address, void* kernel_address, size_t size, bool to_user)
+{
+    if (paging_current_directory() == task->page_directory->directory_entry)
+    {
+        // The usual case, a system call copying from the process that made it
+        if (to_user)
+        {
+            memcpy(user_address, kernel_address, size);
+        }
+        else
+        {
+            memcpy(kernel_address, user_address, size);
+        }
+        return;
+    }
+
+    // Some other directory is loaded, copy through the physical pages the kernel can see
+    while (size)
+    {
+        uint32_t offset = (uint32_t) user_address % PAGING_PAGE_SIZE;
+        size_t chunk = PAGING_PAGE_SIZE - offset;
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+
+        void* phys = paging_get_physical_address(task->page_directory->directory_entry, user_address);
+        if (to_user)
+        {
+            memcpy(phys, kernel_address, chunk);
+        }
+        else
+        {
+            memcpy(kernel_address, phys, chunk);
+        }
+
+        user_address += chunk;
+        kernel_address += chunk;
+        size -= chunk;
+    }
+}
+
+int copy_from_task(struct task* task, void* kernel_dst, void* user_src, size_t size)
+{
+    int res = task_check_user_range(task, user_src, size, false);
+    if (res < 0)
+    {
+        goto out;
+    }
+
+    task_copy_user_range(task, user_src, kernel_dst, size, false);
+
+out:
+    return res;
+}
+
+int copy_to_task(struct task* task, void* user_dst, void* kernel_src, size_t size)
 {
-    void* result = 0;
+    int res = task_check_user_range(task, user_dst, size, true);
+    if (res < 0)
+    {
+        goto out;
+    }
 
-    uint32_t* sp_ptr = (uint32_t*) task->registers.esp;
+    task_copy_user_range(task, user_dst, kernel_src, size, true);
 
-    // Switch to the given tasks page
-    task_page_task(task);
+out:
+    return res;
+}
 
-    result = (void*) sp_ptr[index];
+/**
+ * Copies a string of at most max bytes out of the task, what is left of phys after the terminator
+ * is zeroed like strncpy does. Each page is checked before anything is read from it and the copy
+ * stops at the page holding the terminator
+ */
+int copy_string_from_task(struct task* task, void* virtual, void* phys, int max)
+{
+    if (max >= PAGING_PAGE_SIZE)
+    {
+        return -EINVARG;
+    }
 
-    // Switch back to the kernel page
-    kernel_page();
+    int res = 0;
+    char* user = virtual;
+    char* out = phys;
+    while (max > 0)
+    {
+        int chunk = PAGING_PAGE_SIZE - ((uint32_t) user % PAGING_PAGE_SIZE);
+        if (chunk > max)
+        {
+            chunk = max;
+        }
+
+        res = task_check_user_page(task, user, false);
+        if (res < 0)
+        {
+            goto out;
+        }
+
+        task_copy_user_range(task, user, out, chunk, false);
+        int len = strnlen(out, chunk);
+        if (len < chunk)
+        {
+            memset(out + len, 0, max - len);
+            break;
+        }
+
+        user += chunk;
+        out += chunk;
+        max -= chunk;
+    }
 
-    return result;
+out:
+    return res;
 }
 
 void* task_virtual_address_to_physical(struct task* task, void* virtual_address)
 {
+    uint32_t entry = paging_get(task->page_directory->directory_entry, paging_align_to_lower_page(virtual_address));
+    if (!(entry & PAGING_IS_PRESENT))
+    {
+        // The page may belong to a file mapping that has not been touched yet, faulting it in
+        // as a write keeps the zero page out of it
+        process_handle_page_fault(task->process, virtual_address, PAGING_IS_WRITEABLE);
+        entry = paging_get(task->page_directory->directory_entry, paging_align_to_lower_page(virtual_address));
+    }
+
+    if (entry & PAGING_IS_COPY_ON_WRITE)
+    {
+        // The kernel may write through the address, the process needs a page of its own
+        process_handle_page_fault(task->process, virtual_address, PAGING_IS_PRESENT | PAGING_IS_WRITEABLE);
+    }
+
     return paging_get_physical_address(task->page_directory->directory_entry, virtual_address);
 }
\ No newline at end of file
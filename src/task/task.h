@@ -3,6 +3,9 @@
 
 #include "config.h"
 #include "memory/paging/paging.h"
+#include "timer/timer.h"
+#include "task/fpu.h"
+#include <stdbool.h>
 
 struct interrupt_frame;
 struct registers
@@ -23,7 +26,29 @@ struct registers
 };
 
 
+// Callee saved registers of a task that is blocked inside the kernel
+struct task_kernel_context
+{
+    uint32_t ebx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t esp;
+    uint32_t eip;
+};
+
+typedef unsigned int TASK_STATE;
+#define TASK_STATE_RUNNABLE 0
+// Waiting inside the kernel for an event, e.g. a disk request to complete
+#define TASK_STATE_BLOCKED 1
+// Waiting for time to pass
+#define TASK_STATE_SLEEPING 2
+// Stopped for good, the task is freed once its process is reaped
+#define TASK_STATE_DEAD 3
+
 struct process;
+struct process_thread;
+struct cpu;
 struct task
 {
     /**
@@ -34,9 +59,45 @@ struct task
     // The registers of the task when the task is not running
     struct registers registers;
 
-    // The process of the task
+    // FPU and SSE registers, only saved here once another task wants the FPU.
+    // fpu_used is set the first time the task uses it
+    uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+    bool fpu_used;
+
+    TASK_STATE state;
+
+    // The runqueue level the task is scheduled from, the default priority moved by nice
+    int priority;
+    int nice;
+
+    // Interrupts and system calls from this task run on this stack
+    void* kernel_stack;
+
+    // Set while the task is blocked inside the kernel, it resumes from kernel_context
+    // instead of returning to user land with its saved registers
+    int in_kernel;
+    struct task_kernel_context kernel_context;
+
+    // Next task in the wait queue this task is sleeping on
+    struct task* wait_next;
+
+    // Wakes the task up once a sleep is over
+    struct timer_event sleep_timer;
+
+    // The process of the task, NULL for a kernel task
     struct process* process;
 
+    // Timer ticks the task has run for
+    uint32_t ticks;
+
+    // Set for the tasks thread_create starts, they share the page directory of the main task
+    struct process_thread* thread;
+
+    // The processor whose runqueues the task is on, and its neighbours there while runnable
+    struct cpu* cpu;
+    struct task* run_next;
+    struct task* run_prev;
+
     // The next task in the linked list
     struct task* next;
 
@@ -45,8 +106,11 @@ struct task
 };
 
 struct task* task_new(struct process* process);
+struct task* task_new_thread(struct process* process, struct process_thread* thread);
+struct task* task_new_kernel(void (*entry)());
 struct task* task_current();
 struct task* task_get_next();
+void task_stop(struct task* task);
 int task_free(struct task* task);
 
 int task_switch(struct task* task);
@@ -61,8 +125,22 @@ void user_registers();
 
 void task_current_save_state(struct interrupt_frame *frame);
 int copy_string_from_task(struct task* task, void* virtual, void* phys, int max);
-void* task_get_stack_item(struct task* task, int index);
+void* task_get_syscall_argument(struct task* task, int index);
+int task_check_user_range(struct task* task, void* virtual_address, size_t size, bool write);
+int copy_from_task(struct task* task, void* kernel_dst, void* user_src, size_t size);
+int copy_to_task(struct task* task, void* user_dst, void* kernel_src, size_t size);
 void* task_virtual_address_to_physical(struct task* task, void* virtual_address);
 void task_next();
 
+bool task_can_block();
+void task_block();
+void task_wake(struct task* task);
+void task_sleep(uint32_t ticks);
+void task_set_nice(struct task* task, int nice);
+
+int task_kernel_save(struct task_kernel_context* context) __attribute__((returns_twice));
+void task_kernel_resume(struct task_kernel_context* context);
+void task_idle_wait();
+void task_idle_poll();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "thread.h"
+#include "process.h"
+#include "task.h"
+#include "config.h"
+#include "status.h"
+#include "kernel.h"
+#include "memory/heap/kheap.h"
+#include "memory/frame/frame.h"
+#include "memory/paging/paging.h"
+#include "memory/paging/cow.h"
+
+static struct process_thread* thread_find(struct process* process, int id)
+{
+    for (struct process_thread* thread = process->threads; thread; thread = thread->next)
+    {
+        if (thread->id == id)
+        {
+            return thread;
+        }
+    }
+
+    return 0;
+}
+
+static void thread_unlink(struct process* process, struct process_thread* thread)
+{
+    struct process_thread** link = &process->threads;
+    while (*link)
+    {
+        if (*link == thread)
+        {
+            *link = thread->next;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/**
+ * Backs the top page of the thread stack with a zeroed frame and the rest with the zero page,
+ * the cdecl arguments arg0 and arg1 are put on top of it behind a null return address
+ */
+static int thread_map_stack(struct process* process, struct process_thread* thread, uint32_t arg0, uint32_t arg1)
+{
+    int res = 0;
+    uint32_t* top = 0;
+    for (uint32_t virt = thread->stack_vma.start; virt < thread->stack_vma.end - PAGING_PAGE_SIZE; virt += PAGING_PAGE_SIZE)
+    {
+        res = cow_map_zero_page(paging_4gb_chunk_get_directory(process->task->page_directory), (void*) virt);
+        if (res < 0)
+        {
+            goto out;
+        }
+    }
+
+    void* frame = frame_zalloc();
+    if (!frame)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    res = paging_map(process->task->page_directory, (void*)(thread->stack_vma.end - PAGING_PAGE_SIZE), frame, PAGING_IS_PRESENT | PAGING_ACCESS_FROM_ALL | PAGING_IS_WRITEABLE);
+    if (res < 0)
+    {
+        frame_free(frame);
+        goto out;
+    }
+    top = (uint32_t*)(frame + PAGING_PAGE_SIZE);
+
+    // Frames are identity mapped in the kernel, the top page is written through its address
+    top[-3] = 0;
+    top[-2] = arg0;
+    top[-1] = arg1;
+out:
+    return res;
+}
+
+/**
+ * Starts a thread of the process at entry on a stack of its own, entry is called with arg0 and
+ * arg1 and must not return. Returns the id of the thread
+ */
+int thread_create(struct process* process, void* entry, uint32_t arg0, uint32_t arg1)
+{
+    int res = 0;
+    struct process_thread* thread = kzalloc(sizeof(struct process_thread));
+    if (!thread)
+    {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    uint32_t virt = vma_find_free(&process->vmas, PEACHOS_THREAD_STACK_VIRTUAL_ADDRESS_START, PEACHOS_THREAD_STACK_VIRTUAL_ADDRESS_END, PEACHOS_THREAD_STACK_SIZE + PAGING_PAGE_SIZE);
+    if (!virt)
+    {
+        res = -ENOMEM;
+        goto out_free;
+    }
+
+    // The lowest page of the slot stays unmapped so an overflow faults instead of running into
+    // the stack below
+    thread->stack_vma.start = virt + PAGING_PAGE_SIZE;
+    thread->stack_vma.end = virt + PAGING_PAGE_SIZE + PEACHOS_THREAD_STACK_SIZE;
+    thread->stack_vma.type = VMA_TYPE_THREAD_STACK;
+    res = vma_insert(&process->vmas, &thread->stack_vma);
+    if (res < 0)
+    {
+        goto out_free;
+    }
+
+    res = thread_map_stack(process, thread, arg0, arg1);
+    if (res < 0)
+    {
+        goto out_release;
+    }
+
+    struct task* task = task_new_thread(process, thread);
+    if (ISERR(task))
+    {
+        res = ERROR_I(task);
+        goto out_release;
+    }
+
+    task->registers.ip = (uint32_t) entry;
+    task->registers.esp = thread->stack_vma.end - sizeof(uint32_t) * 3;
+    task_set_nice(task, process->task->nice);
+
+    thread->task = task;
+    thread->id = ++process->next_thread_id;
+    thread->next = process->threads;
+    process->threads = thread;
+    res = thread->id;
+    goto out;
+
+out_release:
+    process_release_vma(process, &thread->stack_vma);
+out_free:
+    kfree(thread);
+out:
+    return res;
+}
+
+/**
+ * Ends a thread. Its stack is released right away, the exit code is kept for thread_join. The
+ * caller switches to another task when the thread was the current one
+ */
+void thread_exit(struct task* task, int exit_code)
+{
+    struct process* process = task->process;
+    struct process_thread* thread = task->thread;
+    thread->exit_code = exit_code;
+    thread->task = 0;
+    process_release_vma(process, &thread->stack_vma);
+    wait_queue_wake_all(&thread->joiners);
+    task_free(task);
+}
+
+/**
+ * Waits for the thread to exit and stores its exit code, the thread is forgotten afterwards
+ */
+int thread_join(struct process* process, int id, int* exit_code)
+{
+    struct process_thread* thread = 0;
+    while (true)
+    {
+        // Another task may have joined the thread while we slept
+        thread = thread_find(process, id);
+        if (!thread || thread->task == task_current())
+        {
+            return -EINVARG;
+        }
+
+        if (!thread->task)
+        {
+            break;
+        }
+
+        if (!task_can_block())
+        {
+            return -EIO;
+        }
+        wait_queue_sleep(&thread->joiners);
+    }
+
+    *exit_code = thread->exit_code;
+    thread_unlink(process, thread);
+    kfree(thread);
+    return 0;
+}
+
+/**
+ * Frees every thread of a terminating process, their stacks are released with the rest of the
+ * process memory
+ */
+void thread_free_all(struct process* process)
+{
+    while (process->threads)
+    {
+        struct process_thread* thread = process->threads;
+        process->threads = thread->next;
+        if (thread->task)
+        {
+            task_free(thread->task);
+        }
+        kfree(thread);
+    }
+}
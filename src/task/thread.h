@@ -0,0 +1,14 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+
+struct process;
+struct task;
+
+int thread_create(struct process* process, void* entry, uint32_t arg0, uint32_t arg1);
+void thread_exit(struct task* task, int exit_code);
+int thread_join(struct process* process, int id, int* exit_code);
+void thread_free_all(struct process* process);
+
+#endif
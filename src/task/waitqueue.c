@@ -0,0 +1,70 @@
+#include "waitqueue.h"
+#include "task.h"
+#include "kernel.h"
+
+/**
+ * Blocks the current task until the queue is woken, must be called with interrupts disabled
+ */
+void wait_queue_sleep(struct wait_queue* queue)
+{
+    struct task* task = task_current();
+    if (!task_can_block())
+    {
+        panic("wait_queue_sleep(): Nothing can run while we wait\n");
+    }
+
+    task->wait_next = 0;
+    if (queue->tail)
+    {
+        queue->tail->wait_next = task;
+    }
+    else
+    {
+        queue->head = task;
+    }
+    queue->tail = task;
+
+    task_block();
+}
+
+void wait_queue_wake_one(struct wait_queue* queue)
+{
+    struct task* task = queue->head;
+    if (!task)
+    {
+        return;
+    }
+
+    queue->head = task->wait_next;
+    if (!queue->head)
+    {
+        queue->tail = 0;
+    }
+
+    task->wait_next = 0;
+    task_wake(task);
+}
+
+void wait_queue_wake_all(struct wait_queue* queue)
+{
+    while (queue->head)
+    {
+        wait_queue_wake_one(queue);
+    }
+}
+
+void sleep_lock_acquire(struct sleep_lock* lock)
+{
+    while (lock->locked)
+    {
+        wait_queue_sleep(&lock->waiters);
+    }
+
+    lock->locked = 1;
+}
+
+void sleep_lock_release(struct sleep_lock* lock)
+{
+    lock->locked = 0;
+    wait_queue_wake_one(&lock->waiters);
+}
@@ -0,0 +1,27 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+struct task;
+
+// Tasks blocked in the kernel waiting for the same event, woken in the order they went to sleep
+struct wait_queue
+{
+    struct task* head;
+    struct task* tail;
+};
+
+// A lock that puts contending tasks to sleep instead of spinning
+struct sleep_lock
+{
+    int locked;
+    struct wait_queue waiters;
+};
+
+void wait_queue_sleep(struct wait_queue* queue);
+void wait_queue_wake_one(struct wait_queue* queue);
+void wait_queue_wake_all(struct wait_queue* queue);
+
+void sleep_lock_acquire(struct sleep_lock* lock);
+void sleep_lock_release(struct sleep_lock* lock);
+
+#endif
@@ -0,0 +1,87 @@
+#include "workqueue.h"
+#include "task.h"
+#include "kernel.h"
+#include "status.h"
+
+// Work waiting to run, oldest first
+static struct work* workqueue_head = 0;
+static struct work* workqueue_tail = 0;
+
+// The kernel task that runs the work, NULL until workqueue_init
+static struct task* workqueue_task = 0;
+
+/**
+ * Queues work for the worker task, interrupt handlers call this and return straight away.
+ * Work that is already waiting is not queued twice, it runs once with the latest data
+ */
+void work_queue(struct work* work, WORK_FUNCTION function, void* data)
+{
+    work->function = function;
+    work->data = data;
+    if (work->queued)
+    {
+        return;
+    }
+
+    work->queued = true;
+    work->next = 0;
+    if (workqueue_tail)
+    {
+        workqueue_tail->next = work;
+    }
+    else
+    {
+        workqueue_head = work;
+    }
+    workqueue_tail = work;
+
+    if (workqueue_task)
+    {
+        task_wake(workqueue_task);
+    }
+}
+
+/**
+ * True when the worker has something to run, interrupts from user land switch to it first
+ */
+bool work_pending()
+{
+    return workqueue_task && workqueue_head;
+}
+
+/**
+ * Interrupts stay disabled in the kernel, so nothing is queued while we look at the queue
+ */
+static void workqueue_worker()
+{
+    while (1)
+    {
+        while (workqueue_head)
+        {
+            struct work* work = workqueue_head;
+            workqueue_head = work->next;
+            if (!workqueue_head)
+            {
+                workqueue_tail = 0;
+            }
+
+            // Cleared first so the work can queue itself again
+            work->queued = false;
+            work->function(work->data);
+        }
+
+        task_block();
+    }
+}
+
+int workqueue_init()
+{
+    struct task* task = task_new_kernel(workqueue_worker);
+    if (ISERR(task))
+    {
+        return ERROR_I(task);
+    }
+
+    workqueue_task = task;
+    return 0;
+}
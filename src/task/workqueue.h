@@ -0,0 +1,21 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdbool.h>
+
+typedef void (*WORK_FUNCTION)(void* data);
+
+// Work an interrupt hands to the kernel worker task, the caller owns the memory
+struct work
+{
+    WORK_FUNCTION function;
+    void* data;
+    bool queued;
+    struct work* next;
+};
+
+int workqueue_init();
+void work_queue(struct work* work, WORK_FUNCTION function, void* data);
+bool work_pending();
+
+#endif
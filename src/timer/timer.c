@@ -0,0 +1,328 @@
+#include "timer.h"
+#include "config.h"
+#include "io/io.h"
+#include "idt/apic.h"
+
+#define TIMER_PIT_FREQUENCY 1193182
+#define TIMER_PIT_COUNTS_PER_TICK (TIMER_PIT_FREQUENCY / PEACHOS_TIMER_FREQUENCY)
+#define TIMER_PIT_MAX_COUNT 0xFFFF
+#define TIMER_APIC_MAX_COUNT 0x7FFFFFFF
+#define TIMER_MS_PER_TICK (1000 / PEACHOS_TIMER_FREQUENCY)
+
+#define TIMER_PIT_CHANNEL0_PORT 0x40
+#define TIMER_PIT_COMMAND_PORT 0x43
+// Channel 0, low then high byte, mode 0 interrupt on terminal count
+#define TIMER_PIT_COMMAND_ONE_SHOT 0x30
+// Latch the count and status of channel 0
+#define TIMER_PIT_COMMAND_READ_BACK 0xC2
+#define TIMER_PIT_STATUS_OUTPUT 0x80
+#define TIMER_PIT_STATUS_NULL_COUNT 0x40
+
+// Ticks since boot, counts that do not make up a whole tick yet are carried in the remainder
+static uint32_t timer_tick_count = 0;
+static uint32_t timer_remainder = 0;
+
+// The count the timer was last started with
+static uint32_t timer_programmed = 0;
+
+// The local APIC timer replaces the PIT when there is one, counts are in its own clock then
+static bool timer_apic = false;
+static uint32_t timer_counts_per_tick = TIMER_PIT_COUNTS_PER_TICK;
+static uint32_t timer_max_count = TIMER_PIT_MAX_COUNT;
+
+// Hierarchical timer wheel, a slot of level n covers 64^n ticks. Events are kept in the lowest
+// level their deadline fits in and cascade down a level as the wheel's time gets closer
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_RANGE (1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+static struct timer_event* timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint32_t timer_wheel_pending[TIMER_WHEEL_LEVELS];
+
+// The last tick the wheel has run the events of
+static uint32_t timer_wheel_tick = 0;
+
+uint32_t timer_ticks()
+{
+    return timer_tick_count;
+}
+
+static void timer_account(uint32_t counts)
+{
+    timer_remainder += counts;
+    timer_tick_count += timer_remainder / timer_counts_per_tick;
+    timer_remainder %= timer_counts_per_tick;
+}
+
+static void timer_wheel_insert(struct timer_event* event)
+{
+    int32_t delta = event->expires - timer_wheel_tick;
+    uint32_t expires = event->expires;
+    if (delta < 0)
+    {
+        // Cascaded while due, it runs along with the events of the current tick
+        expires = timer_wheel_tick;
+        delta = 0;
+    }
+    else if (delta >= TIMER_WHEEL_RANGE)
+    {
+        // Parked in the last slot in range, it is placed again when that slot cascades
+        expires = timer_wheel_tick + TIMER_WHEEL_RANGE - 1;
+        delta = TIMER_WHEEL_RANGE - 1;
+    }
+
+    int level = 0;
+    while (delta >= (1 << (TIMER_WHEEL_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    struct timer_event** slot = &timer_wheel[level][(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+    event->level = level;
+    event->slot = slot;
+    event->prev = 0;
+    event->next = *slot;
+    if (*slot)
+    {
+        (*slot)->prev = event;
+    }
+    *slot = event;
+    timer_wheel_pending[level]++;
+}
+
+void timer_cancel(struct timer_event* event)
+{
+    if (!event->slot)
+    {
+        return;
+    }
+
+    if (event->prev)
+    {
+        event->prev->next = event->next;
+    }
+    else
+    {
+        *event->slot = event->next;
+    }
+
+    if (event->next)
+    {
+        event->next->prev = event->prev;
+    }
+
+    timer_wheel_pending[event->level]--;
+    event->slot = 0;
+    event->next = 0;
+    event->prev = 0;
+}
+
+/**
+ * Calls callback with data once ticks have passed, the callback runs in the timer interrupt
+ */
+void timer_add(struct timer_event* event, uint32_t ticks, TIMER_CALLBACK callback, void* data)
+{
+    timer_cancel(event);
+    // The tick the wheel is on has run already, the earliest we can do is the next one
+    event->expires = timer_tick_count + (ticks ? ticks : 1);
+    event->callback = callback;
+    event->data = data;
+    timer_wheel_insert(event);
+}
+
+/**
+ * Moves the events of a higher level slot down now that their time is close
+ */
+static void timer_wheel_cascade(int level)
+{
+    struct timer_event** slot = &timer_wheel[level][(timer_wheel_tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+    struct timer_event* event = *slot;
+    *slot = 0;
+    while (event)
+    {
+        struct timer_event* next = event->next;
+        timer_wheel_pending[level]--;
+        timer_wheel_insert(event);
+        event = next;
+    }
+}
+
+/**
+ * Runs the wheel up to the current tick, each tick costs the same however many events wait
+ */
+static void timer_wheel_run()
+{
+    while (timer_wheel_tick != timer_tick_count)
+    {
+        timer_wheel_tick++;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            if (timer_wheel_tick & ((1 << (TIMER_WHEEL_BITS * level)) - 1))
+            {
+                break;
+            }
+            timer_wheel_cascade(level);
+        }
+
+        struct timer_event** slot = &timer_wheel[0][timer_wheel_tick & TIMER_WHEEL_MASK];
+        while (*slot)
+        {
+            struct timer_event* event = *slot;
+            timer_cancel(event);
+            event->callback(event->data);
+        }
+    }
+}
+
+/**
+ * Returns how many ticks from now the wheel next has something to do, at most max
+ */
+static uint32_t timer_wheel_next(uint32_t max)
+{
+    uint32_t lag = timer_tick_count - timer_wheel_tick;
+    uint32_t next = max + lag;
+    if (timer_wheel_pending[1] || timer_wheel_pending[2] || timer_wheel_pending[3])
+    {
+        uint32_t cascade = TIMER_WHEEL_SLOTS - (timer_wheel_tick & TIMER_WHEEL_MASK);
+        if (cascade < next)
+        {
+            next = cascade;
+        }
+    }
+
+    if (timer_wheel_pending[0])
+    {
+        for (uint32_t ticks = 1; ticks < next && ticks < TIMER_WHEEL_SLOTS; ticks++)
+        {
+            if (timer_wheel[0][(timer_wheel_tick + ticks) & TIMER_WHEEL_MASK])
+            {
+                next = ticks;
+                break;
+            }
+        }
+    }
+
+    return next > lag ? next - lag : 1;
+}
+
+static void timer_pit_start(uint32_t counts)
+{
+    outb(TIMER_PIT_COMMAND_PORT, TIMER_PIT_COMMAND_ONE_SHOT);
+    outb(TIMER_PIT_CHANNEL0_PORT, counts & 0xff);
+    outb(TIMER_PIT_CHANNEL0_PORT, counts >> 8);
+}
+
+/**
+ * Returns the counts left on the PIT, zero once it has expired
+ */
+static uint32_t timer_pit_remaining()
+{
+    outb(TIMER_PIT_COMMAND_PORT, TIMER_PIT_COMMAND_READ_BACK);
+    uint8_t status = insb(TIMER_PIT_CHANNEL0_PORT);
+    uint32_t count = insb(TIMER_PIT_CHANNEL0_PORT);
+    count |= insb(TIMER_PIT_CHANNEL0_PORT) << 8;
+    if (status & TIMER_PIT_STATUS_OUTPUT)
+    {
+        return 0;
+    }
+
+    if (status & TIMER_PIT_STATUS_NULL_COUNT)
+    {
+        // Not loaded into the counter yet
+        return timer_programmed;
+    }
+    return count;
+}
+
+static void timer_program(uint32_t ticks)
+{
+    ticks = timer_wheel_next(ticks);
+    uint32_t counts = ticks * timer_counts_per_tick;
+    if (ticks > timer_max_count / timer_counts_per_tick)
+    {
+        // Longer waits take several interrupts
+        counts = timer_max_count;
+    }
+
+    if (timer_apic)
+    {
+        apic_timer_start(counts);
+    }
+    else
+    {
+        timer_pit_start(counts);
+    }
+    timer_programmed = counts;
+}
+
+/**
+ * Replaces the pending timer interrupt with one ticks from now. Must be called with
+ * interrupts disabled
+ */
+void timer_schedule(uint32_t ticks)
+{
+    uint32_t remaining = timer_apic ? apic_timer_remaining() : timer_pit_remaining();
+    if (remaining == 0)
+    {
+        // Already expired, the interrupt on its way programs the next one
+        return;
+    }
+
+    if (remaining <= timer_programmed)
+    {
+        timer_account(timer_programmed - remaining);
+    }
+    timer_program(ticks);
+}
+
+/**
+ * Called on every timer interrupt, runs the events that are due and gives the running task a
+ * new timeslice
+ */
+void timer_interrupt()
+{
+    timer_account(timer_programmed);
+    timer_wheel_run();
+    timer_program(PEACHOS_TASK_TIMESLICE_TICKS);
+}
+
+uint32_t timer_ms_to_ticks(uint32_t ms)
+{
+    return (ms + TIMER_MS_PER_TICK - 1) / TIMER_MS_PER_TICK;
+}
+
+uint32_t timer_ms()
+{
+    return timer_tick_count * TIMER_MS_PER_TICK;
+}
+
+/**
+ * Nothing can run, only wake up for the next event
+ */
+void timer_idle()
+{
+    timer_schedule(timer_max_count / timer_counts_per_tick);
+}
+
+void timer_init()
+{
+    if (apic_enabled())
+    {
+        // Count how fast the local APIC timer runs against 10ms of the PIT
+        timer_programmed = TIMER_PIT_FREQUENCY / 100;
+        timer_pit_start(timer_programmed);
+        apic_timer_start(0xFFFFFFFF);
+        while (timer_pit_remaining())
+        {
+        }
+
+        uint32_t elapsed = 0xFFFFFFFF - apic_timer_remaining();
+        timer_counts_per_tick = elapsed * 100 / PEACHOS_TIMER_FREQUENCY;
+        timer_max_count = TIMER_APIC_MAX_COUNT;
+        timer_apic = true;
+    }
+
+    timer_program(PEACHOS_TASK_TIMESLICE_TICKS);
+}
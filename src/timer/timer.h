@@ -0,0 +1,32 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+typedef void (*TIMER_CALLBACK)(void* data);
+
+// A callback due at a tick, owned by the caller and linked into the timer wheel while pending
+struct timer_event
+{
+    uint32_t expires;
+    TIMER_CALLBACK callback;
+    void* data;
+
+    int level;
+    struct timer_event** slot;
+    struct timer_event* next;
+    struct timer_event* prev;
+};
+
+void timer_init();
+uint32_t timer_ticks();
+uint32_t timer_ms();
+uint32_t timer_ms_to_ticks(uint32_t ms);
+void timer_schedule(uint32_t ticks);
+void timer_interrupt();
+void timer_idle();
+
+void timer_add(struct timer_event* event, uint32_t ticks, TIMER_CALLBACK callback, void* data);
+void timer_cancel(struct timer_event* event);
+
+#endif
@@ -0,0 +1,11 @@
+[BITS 32]
+
+section .asm
+
+global trace_read_tsc
+
+; uint64_t trace_read_tsc()
+; The whole time stamp counter, edx:eax is already where a 64 bit result is returned
+trace_read_tsc:
+    rdtsc
+    ret
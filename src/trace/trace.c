@@ -0,0 +1,135 @@
+#include "trace.h"
+#include "task/cpu.h"
+#include "printf/printf.h"
+#include "serial/serial.h"
+#include "kernel.h"
+#include "status.h"
+
+// Events of the current processor that trace_dump prints
+#define TRACE_DUMP_EVENTS 16
+// Two halves of the timestamp, the type and three arguments with their separators and a new line
+#define TRACE_LINE_SIZE (2 * 8 + PRINTF_UINT_BUFFER_SIZE + 3 * (PRINTF_HEX_BUFFER_SIZE + 1) + 2)
+
+// Each processor only ever records into its own ring, nothing here takes a lock
+static struct trace_ring trace_rings[PEACHOS_MAX_CPUS];
+
+/**
+ * Records one event on the current processor. Interrupt handlers may record in the middle of
+ * another event, each claims its own slot first so neither is lost
+ */
+void trace_record(uint32_t type, uint32_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    struct trace_ring* ring = &trace_rings[cpu_current()->id];
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    uint32_t index = slot & (PEACHOS_TRACE_RING_ENTRIES - 1);
+    struct trace_event* event = &ring->events[index];
+    event->timestamp = trace_read_tsc();
+    event->type = type;
+    event->arg0 = arg0;
+    event->arg1 = arg1;
+    event->arg2 = arg2;
+    __atomic_store_n(&ring->sequence[index], slot + 1, __ATOMIC_RELEASE);
+}
+
+static int trace_copy_event(struct trace_ring* ring, uint32_t slot, struct trace_event* out)
+{
+    uint32_t index = slot & (PEACHOS_TRACE_RING_ENTRIES - 1);
+    if (__atomic_load_n(&ring->sequence[index], __ATOMIC_ACQUIRE) != slot + 1)
+    {
+        return -EIO;
+    }
+
+    *out = ring->events[index];
+
+    // Overwritten while we copied it
+    if (__atomic_load_n(&ring->sequence[index], __ATOMIC_ACQUIRE) != slot + 1)
+    {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/**
+ * Hands out up to max events of a processor's ring that have not been read yet, oldest first.
+ * Events that were overwritten before anyone read them are skipped
+ */
+int trace_read(int cpu, struct trace_event* out, int max)
+{
+    if (cpu < 0 || cpu >= PEACHOS_MAX_CPUS || max < 0)
+    {
+        return -EINVARG;
+    }
+
+    struct trace_ring* ring = &trace_rings[cpu];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head - ring->tail > PEACHOS_TRACE_RING_ENTRIES)
+    {
+        ring->tail = head - PEACHOS_TRACE_RING_ENTRIES;
+    }
+
+    int total = 0;
+    while (total < max && ring->tail != head)
+    {
+        if (trace_copy_event(ring, ring->tail, &out[total]) == 0)
+        {
+            total++;
+        }
+        ring->tail++;
+    }
+
+    return total;
+}
+
+/**
+ * Formats an event as "%x%08x %u %x %x %x" without going through the printf parser, the
+ * kernel printf has no 64 bit conversions so the timestamp is printed in two halves
+ */
+static int trace_format_event(struct trace_event* event, char* line)
+{
+    int len = format_hex(line, event->timestamp >> 32, 0);
+    len += format_hex(line + len, (uint32_t) event->timestamp, 8);
+    line[len++] = ' ';
+    len += format_uint(line + len, event->type);
+    line[len++] = ' ';
+    len += format_hex(line + len, event->arg0, 0);
+    line[len++] = ' ';
+    len += format_hex(line + len, event->arg1, 0);
+    line[len++] = ' ';
+    len += format_hex(line + len, event->arg2, 0);
+    return len;
+}
+
+/**
+ * Writes the events of the current processor out without consuming them, for when nothing
+ * else is left to read the ring. The whole ring goes to the serial port when there is one,
+ * the screen only gets the latest events
+ */
+void trace_dump()
+{
+    struct trace_ring* ring = &trace_rings[cpu_current()->id];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t total = serial_present() ? PEACHOS_TRACE_RING_ENTRIES : TRACE_DUMP_EVENTS;
+    uint32_t slot = head > total ? head - total : 0;
+    for (; slot != head; slot++)
+    {
+        struct trace_event event;
+        if (trace_copy_event(ring, slot, &event) < 0)
+        {
+            continue;
+        }
+
+        char line[TRACE_LINE_SIZE];
+        int len = trace_format_event(&event, line);
+        if (serial_present())
+        {
+            serial_write(line, len);
+            serial_putchar('\n');
+            // Far more than the transmit ring holds, wait for the port instead of dropping events
+            serial_flush();
+            continue;
+        }
+        line[len++] = '\n';
+        terminal_write(line, len);
+    }
+}
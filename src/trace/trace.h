@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum
+{
+    TRACE_EVENT_SYSCALL_ENTER = 1,
+    TRACE_EVENT_SYSCALL_EXIT,
+    TRACE_EVENT_CONTEXT_SWITCH,
+    TRACE_EVENT_DISK_READ,
+    TRACE_EVENT_DISK_WRITE,
+    TRACE_EVENT_KMALLOC,
+    TRACE_EVENT_KFREE,
+    TRACE_EVENT_PAGE_FAULT,
+    TRACE_EVENT_FS_MOUNT,
+    TRACE_EVENT_FS_CLOSE
+};
+
+/**
+ * One entry of a trace ring, must match the user library. What the arguments mean depends
+ * on the type, see the tracepoints
+ */
+struct trace_event
+{
+    uint64_t timestamp;
+    uint32_t type;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+};
+
+struct trace_ring
+{
+    // Events ever recorded, the slot of the next one is head modulo the ring size
+    uint32_t head;
+    // Events ever handed to trace_read
+    uint32_t tail;
+    // Written last, an event whose sequence is not its slot number plus one is still being filled in
+    uint32_t sequence[PEACHOS_TRACE_RING_ENTRIES];
+    struct trace_event events[PEACHOS_TRACE_RING_ENTRIES];
+};
+
+uint64_t trace_read_tsc();
+void trace_record(uint32_t type, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+int trace_read(int cpu, struct trace_event* out, int max);
+void trace_dump();
+
+#if PEACHOS_TRACE
+#define TRACE(type, arg0, arg1, arg2) trace_record((type), (uint32_t)(arg0), (uint32_t)(arg1), (uint32_t)(arg2))
+#else
+#define TRACE(type, arg0, arg1, arg2) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Checks that programs follow the PeachOS executable layout: every PT_LOAD segment sits at the
+ * same offset into a page in the file as in memory, so the kernel maps page cache pages straight
+ * into the process. Built and run on the host: elfcheck <file>...
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ELFCHECK_PAGE_SIZE 4096
+#define ELFCHECK_PT_LOAD 1
+
+// Just the parts of the ELF structures the check needs
+struct elfcheck_header
+{
+    unsigned char ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elfcheck_phdr
+{
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed));
+
+static int check_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "elfcheck: can not read %s\n", path);
+        return 1;
+    }
+
+    int res = 0;
+    struct elfcheck_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.ident, "\x7f" "ELF", 4) != 0 || header.ident[4] != 1 ||
+        header.phentsize != sizeof(struct elfcheck_phdr))
+    {
+        fprintf(stderr, "elfcheck: %s is not a 32 bit ELF\n", path);
+        res = 1;
+        goto out;
+    }
+
+    for (int i = 0; i < header.phnum; i++)
+    {
+        struct elfcheck_phdr phdr;
+        if (fseek(f, header.phoff + i * sizeof(phdr), SEEK_SET) != 0 || fread(&phdr, sizeof(phdr), 1, f) != 1)
+        {
+            fprintf(stderr, "elfcheck: %s: truncated program headers\n", path);
+            res = 1;
+            goto out;
+        }
+
+        if (phdr.type == ELFCHECK_PT_LOAD && phdr.memsz && phdr.offset % ELFCHECK_PAGE_SIZE != phdr.vaddr % ELFCHECK_PAGE_SIZE)
+        {
+            fprintf(stderr, "elfcheck: %s: segment %d at offset 0x%x does not line up with address 0x%x\n",
+                    path, i, phdr.offset, phdr.vaddr);
+            res = 1;
+        }
+    }
+
+out:
+    fclose(f);
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <file>...\n", argv[0]);
+        return 1;
+    }
+
+    int res = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        res |= check_file(argv[i]);
+    }
+
+    return res;
+}
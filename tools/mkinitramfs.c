@@ -0,0 +1,199 @@
+/*
+ * Packs files into a PeachOS initramfs image, see src/fs/initramfs/format.h.
+ * Built and run on the host: mkinitramfs <image> <file>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../src/fs/initramfs/format.h"
+
+struct input_file
+{
+    struct initramfs_entry entry;
+    unsigned char *data;
+};
+
+static unsigned char *read_file(const char *path, uint32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = malloc(length ? length : 1);
+    if (data && fread(data, 1, length, f) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(f);
+    *size = length;
+    return data;
+}
+
+/**
+ * Greedy LZSS, the longest match in the window wins. Returns the packed size, or more than
+ * size when packing does not pay off
+ */
+static uint32_t lz_pack(const unsigned char *in, uint32_t size, unsigned char *out)
+{
+    uint32_t in_pos = 0;
+    uint32_t out_pos = 0;
+    while (in_pos < size)
+    {
+        uint32_t flag_pos = out_pos++;
+        unsigned char flags = 0;
+        for (int bit = 0; bit < 8 && in_pos < size; bit++)
+        {
+            uint32_t best_length = 0;
+            uint32_t best_distance = 0;
+            uint32_t start = in_pos > INITRAMFS_LZ_WINDOW ? in_pos - INITRAMFS_LZ_WINDOW : 0;
+            for (uint32_t candidate = start; candidate < in_pos; candidate++)
+            {
+                uint32_t length = 0;
+                while (length < INITRAMFS_LZ_MAX_MATCH && in_pos + length < size && in[candidate + length] == in[in_pos + length])
+                {
+                    length++;
+                }
+
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = in_pos - candidate;
+                }
+            }
+
+            if (best_length >= INITRAMFS_LZ_MIN_MATCH)
+            {
+                uint32_t distance = best_distance - 1;
+                out[out_pos++] = distance & 0xff;
+                out[out_pos++] = ((distance >> 4) & 0xf0) | (best_length - INITRAMFS_LZ_MIN_MATCH);
+                in_pos += best_length;
+            }
+            else
+            {
+                flags |= 1 << bit;
+                out[out_pos++] = in[in_pos++];
+            }
+        }
+
+        out[flag_pos] = flags;
+        if (out_pos >= size)
+        {
+            return size + 1;
+        }
+    }
+
+    return out_pos;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct input_file *fa = a;
+    const struct input_file *fb = b;
+    return strcmp(fa->entry.name, fb->entry.name);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <image> <file>...\n", argv[0]);
+        return 1;
+    }
+
+    int total = argc - 2;
+    struct input_file *files = calloc(total ? total : 1, sizeof(struct input_file));
+    for (int i = 0; i < total; i++)
+    {
+        const char *path = argv[i + 2];
+        const char *name = strrchr(path, '/');
+        name = name ? name + 1 : path;
+        if (strlen(name) >= INITRAMFS_NAME_MAX)
+        {
+            fprintf(stderr, "mkinitramfs: name too long: %s\n", name);
+            return 1;
+        }
+
+        for (int j = 0; name[j]; j++)
+        {
+            files[i].entry.name[j] = tolower((unsigned char)name[j]);
+        }
+
+        uint32_t size = 0;
+        unsigned char *data = read_file(path, &size);
+        if (!data)
+        {
+            fprintf(stderr, "mkinitramfs: can not read %s\n", path);
+            return 1;
+        }
+
+        // A packed group can be a byte longer than its input before lz_pack gives up
+        unsigned char *packed = malloc(size + 2 + size / 8);
+        uint32_t packed_size = lz_pack(data, size, packed);
+        files[i].entry.size = size;
+        if (packed_size < size)
+        {
+            files[i].entry.stored_size = packed_size;
+            files[i].entry.flags = INITRAMFS_ENTRY_PACKED;
+            files[i].data = packed;
+            free(data);
+        }
+        else
+        {
+            files[i].entry.stored_size = size;
+            files[i].data = data;
+            free(packed);
+        }
+    }
+
+    qsort(files, total, sizeof(struct input_file), compare_entries);
+    for (int i = 1; i < total; i++)
+    {
+        if (strcmp(files[i - 1].entry.name, files[i].entry.name) == 0)
+        {
+            fprintf(stderr, "mkinitramfs: duplicate name %s\n", files[i].entry.name);
+            return 1;
+        }
+    }
+
+    uint32_t offset = sizeof(struct initramfs_header) + total * sizeof(struct initramfs_entry);
+    for (int i = 0; i < total; i++)
+    {
+        files[i].entry.offset = offset;
+        offset += files[i].entry.stored_size;
+    }
+
+    struct initramfs_header header = {
+        .magic = INITRAMFS_MAGIC,
+        .version = INITRAMFS_VERSION,
+        .total_entries = total,
+        .image_size = offset};
+
+    FILE *out = fopen(argv[1], "wb");
+    if (!out)
+    {
+        fprintf(stderr, "mkinitramfs: can not create %s\n", argv[1]);
+        return 1;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    for (int i = 0; i < total; i++)
+    {
+        fwrite(&files[i].entry, sizeof(struct initramfs_entry), 1, out);
+    }
+    for (int i = 0; i < total; i++)
+    {
+        fwrite(files[i].data, 1, files[i].entry.stored_size, out);
+        printf("%-32s %8u -> %8u\n", files[i].entry.name, files[i].entry.size, files[i].entry.stored_size);
+    }
+
+    fclose(out);
+    return 0;
+}